@@ -0,0 +1,109 @@
+// FakeSystem.h: The in-memory system behind the headless Win32 shim, and its call log.
+
+#pragma once
+
+#include <windows.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Each shim call is counted against the part of Windows it stands in for
+enum FakeApiClass
+{
+    API_POWRPROF, // Power schemes, setting notifications and power information
+    API_REGISTRY,
+    API_SHELL,    // Notification area
+    API_USER,     // Windows, menus, timers, icons, strings and input
+    API_KERNEL,   // Handles, modules, memory, processes and performance counters
+    API_FILE,
+    API_CLOCK,    // Tick counts, performance counter and wall clock
+    API_MESSAGE,  // The message loop itself
+    API_CLASS_COUNT
+};
+
+struct FakeCall
+{
+    uint64_t tickMs;
+    FakeApiClass apiClass;
+    const char* api;
+    char detail[112];
+};
+
+// Supplies the session's events. The message loop asks for the next one
+// whenever the queue is empty, and runs whichever comes first: it or a timer.
+class FakeScript
+{
+public:
+    virtual ~FakeScript() {}
+    // Tick the next event is due at; false once the script is over
+    virtual bool NextEventMs(uint64_t& tickMs) = 0;
+    virtual void RunEvent() = 0;
+};
+
+// ----- Session -----
+void FakeSetScript(FakeScript* script);
+// Called for every shim call as it is made; nullptr to stop
+void FakeSetCallSink(void (*sink)(const FakeCall& call));
+// Unix time at the first tick; local time follows the TZ environment variable
+void FakeSetWallClock(int64_t unixMs);
+uint64_t FakeStartTickMs();
+uint64_t FakeTickMs();
+// What GetCommandLineW returns after the program name; empty to start the tray
+void FakeSetCommandLine(const wchar_t* args);
+// Strings served by LoadStringW, read from the app's own resource sources
+bool FakeLoadStrings(const char* resourceHeaderPath, const char* stringsRcPath);
+
+// ----- Power schemes -----
+bool FakeAddPlan(const GUID& guid, const wchar_t* name, const GUID& personality);
+bool FakeFindPlan(const wchar_t* name, GUID& out);
+const wchar_t* FakePlanName(const GUID& guid); // nullptr if unknown
+const GUID& FakeActivePlan();
+// Someone else switched the plan (powercfg, the Settings app)
+bool FakeSwitchPlan(const GUID& guid);
+// PowerSetActiveScheme refused with access denied, as under a policy that fixes the plan
+void FakeLockPlans(bool locked);
+// Delivers a power setting broadcast if the app registered for it
+bool FakePowerSetting(const GUID& setting, DWORD value);
+
+// ----- Registry (HKEY_CURRENT_USER) -----
+bool FakeRegSet(const wchar_t* key, const wchar_t* name, DWORD type, const void* data, DWORD bytes);
+
+// ----- Input, processes and CPU -----
+void FakeUserInput();
+bool FakeInputSink(); // Raw input registered for the app's window
+DWORD FakeStartProcess(const wchar_t* imagePath);
+bool FakeStopProcess(const wchar_t* imagePath);
+bool FakeSetForeground(const wchar_t* imagePath);
+void FakeSetCpuBusyPercent(uint32_t percent);
+
+// ----- Shell and window events -----
+// Right-click on the tray icon. TrackPopupMenu picks the item found by its
+// "Submenu/Item" label path; nullptr dismisses the menu.
+void FakeRightClick(const wchar_t* choice);
+bool FakeMenuChoiceFound(); // Whether the last menu had the chosen item
+void FakeTaskbarCreated();
+void FakeDpiChanged(UINT dpi);
+void FakeResume();
+void FakeTimeChange();
+void FakeClose();
+
+// ----- Another instance -----
+// Sends WM_COPYDATA to the app's window from another instance's window;
+// false if the app has none. Whatever the app sent back is the reply.
+bool FakeCopyData(ULONG_PTR tag, const void* data, DWORD bytes, DWORD_PTR& result);
+const void* FakeCopyDataReply(ULONG_PTR& tag, DWORD& bytes); // nullptr if none
+
+// ----- Observations -----
+bool FakeTrayIconShown();
+const wchar_t* FakeTrayTip();
+const wchar_t* FakeLastMessageBox();
+uint64_t FakeClassCount(FakeApiClass apiClass);
+const char* FakeClassName(FakeApiClass apiClass);
+size_t FakeApiCount(); // Distinct functions called so far
+void FakeApiAt(size_t index, const char*& api, FakeApiClass& apiClass, uint64_t& calls);
+// Forgets every call so far, e.g. those that set up state before the launch
+void FakeResetCounts();
+// Resources the app holds right now
+size_t FakeOpenHandles();
+size_t FakeLiveIcons();
+size_t FakeLiveMenus();
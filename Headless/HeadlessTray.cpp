@@ -0,0 +1,766 @@
+// HeadlessTray.cpp: Runs the tray app against the fake system from a text script and prints every API call.
+
+#include "FakeSystem.h"
+#include "AllocGuard.h"
+#include "CliCommand.h"
+#include "PlanCache.h"
+
+#include <powrprof.h>
+
+#include <chrono>
+#include <thread>
+
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+int wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLine, int nCmdShow);
+void EnumeratePlans(PlanList& out);
+bool GetActivePlanGuid(GUID& outGuid);
+
+// Script format, one directive per line, '#' starts a comment.
+//
+// Setup, before the app starts:
+//   addplan <name> [like <plan>]  add a plan, with the personality of another
+//   active <plan>                 make a plan active
+//   set <subkey\>name = <value>   a value under HKCU\Software\PowerPlanTray:
+//                                 a number (REG_DWORD), a plan name (its GUID)
+//                                 or "<seconds>:<plan>, ..." (AfkStages records)
+//   process <image>               a process already running
+//   foreground <image>            the foreground process
+//   cmdline <verb> ...            run with these arguments, as a second
+//                                 launch would with no tray to forward to
+//   cached                        start with the plan cache an earlier run
+//                                 left for these plans (a warm start)
+//   lockplans                     refuse every PowerSetActiveScheme, as a
+//                                 policy that fixes the plan does
+//   startup @<scenario>           measure the launch, up to the first
+//                                 tooltip that names the active plan
+//
+// Timed, <seconds after start> <event>:
+//   menu [Submenu/Item]           right-click the icon, choose the item (or dismiss)
+//   input                         the user touches the keyboard or mouse
+//   plan <name>                   someone else switches the plan
+//   ac | dc | battery <percent> | saver 0|1
+//   dpi <dpi> | taskbar | resume | timechange
+//   start <image> | stop <image> | foreground <image> | cpu <percent>
+//   cli <verb> ...                a second launch with these arguments,
+//                                 forwarding them to the app
+//   hold <ms>                     stop the fake clock for this long in real
+//                                 time, so outside clients reach the IPC endpoint
+//   measure                       nothing; starts or ends a measured stretch
+//   end                           close the app (otherwise after the last event)
+//
+// Budgets. A timed event tagged "@<scenario>" is measured: every call from it
+// up to the next event, timers included, so give it room before the next
+// poll tick. A menu pick is measured from its command on; a bare "menu"
+// measures the open. Setup lines give the caps, checked on every measurement:
+//   budget <scenario> <class> <max> ...
+// where <class> is powrprof, registry, shell, user, kernel, file, switch for
+// PowerSetActiveScheme alone, or alloc for operator new (counted in _DEBUG
+// builds only).
+
+static const size_t kMaxEvents = 256;
+static const size_t kMaxLine = 256;
+
+static const size_t kMaxBudgets = 32;
+static const size_t kCounters = API_CLASS_COUNT + 2; // Each API class, operator new, then plan switches
+static const size_t kAllocCounter = API_CLASS_COUNT;
+static const size_t kSwitchCounter = API_CLASS_COUNT + 1;
+#ifdef _DEBUG
+static const bool kAllocsCounted = true;
+#else
+static const bool kAllocsCounted = false;
+#endif
+
+struct Event
+{
+    uint64_t tickMs;
+    wchar_t verb[24];
+    wchar_t arg[kMaxLine];
+    wchar_t scenario[32]; // Empty if not measured
+    int line;
+};
+
+struct Budget
+{
+    wchar_t scenario[32];
+    bool capped[kCounters];
+    uint64_t cap[kCounters];
+    uint64_t worst[kCounters]; // Over every measurement
+    size_t measured;
+    int line;
+};
+
+static Event g_events[kMaxEvents];
+static size_t g_eventCount = 0;
+static Budget g_budgets[kMaxBudgets];
+static size_t g_budgetCount = 0;
+static Event g_startup; // The launch, when measured
+static bool g_seedCache = false;
+static bool g_showAll = false;
+static bool g_quiet = false;
+static int g_failures = 0;
+
+static void Fail(int line, const char* what, const wchar_t* text)
+{
+    fprintf(stderr, "script line %d: %s: %ls\n", line, what, text);
+    ++g_failures;
+}
+
+static const char* CounterName(size_t counter)
+{
+    if (counter == kSwitchCounter)
+        return "switch";
+    return counter == kAllocCounter ? "alloc" : FakeClassName((FakeApiClass)counter);
+}
+
+static uint64_t ApiCalls(const char* name)
+{
+    for (size_t i = 0; i < FakeApiCount(); ++i)
+    {
+        const char* api;
+        FakeApiClass cls;
+        uint64_t calls;
+        FakeApiAt(i, api, cls, calls);
+        if (strcmp(api, name) == 0)
+            return calls;
+    }
+    return 0;
+}
+
+static void Snapshot(uint64_t (&counts)[kCounters])
+{
+    for (size_t c = 0; c < API_CLASS_COUNT; ++c)
+        counts[c] = FakeClassCount((FakeApiClass)c);
+#ifdef _DEBUG
+    counts[kAllocCounter] = AllocCount();
+#else
+    counts[kAllocCounter] = 0;
+#endif
+    counts[kSwitchCounter] = ApiCalls("PowerSetActiveScheme");
+}
+
+static Budget* FindBudget(const wchar_t* scenario)
+{
+    for (size_t i = 0; i < g_budgetCount; ++i)
+    {
+        if (wcscmp(g_budgets[i].scenario, scenario) == 0)
+            return &g_budgets[i];
+    }
+    return nullptr;
+}
+
+// ===== Measurement =====
+// One stretch at a time, from a tagged event (or its menu command) to the next event
+enum MeasureState
+{
+    MEASURE_OFF,
+    MEASURE_AWAIT_COMMAND,
+    MEASURE_ON
+};
+
+static MeasureState g_measure = MEASURE_OFF;
+static const Event* g_measuredEvent = nullptr;
+static uint64_t g_measureStart[kCounters];
+
+static void BeginMeasure(const Event& e)
+{
+    g_measuredEvent = &e;
+    g_measure = wcscmp(e.verb, L"menu") == 0 && e.arg[0] ? MEASURE_AWAIT_COMMAND : MEASURE_ON;
+    Snapshot(g_measureStart);
+}
+
+static void EndMeasure()
+{
+    if (g_measure == MEASURE_OFF)
+        return;
+    const Event& e = *g_measuredEvent;
+    if (g_measure == MEASURE_AWAIT_COMMAND)
+    {
+        g_measure = MEASURE_OFF;
+        Fail(e.line, "no menu command to measure", e.scenario);
+        return;
+    }
+    g_measure = MEASURE_OFF;
+    uint64_t now[kCounters];
+    Snapshot(now);
+    Budget* budget = FindBudget(e.scenario);
+    printf("------ @%ls:", e.scenario);
+    bool over = false;
+    for (size_t c = 0; c < kCounters; ++c)
+    {
+        if (c == kAllocCounter && !kAllocsCounted)
+            continue;
+        const uint64_t used = now[c] - g_measureStart[c];
+        if (budget)
+        {
+            budget->worst[c] = budget->measured && budget->worst[c] > used ? budget->worst[c] : used;
+            if (budget->capped[c])
+            {
+                printf(" %s %llu/%llu%s", CounterName(c), (unsigned long long)used, (unsigned long long)budget->cap[c],
+                    used > budget->cap[c] ? " OVER" : "");
+                over |= used > budget->cap[c];
+            }
+        }
+        else if (used)
+        {
+            printf(" %s %llu", CounterName(c), (unsigned long long)used);
+        }
+    }
+    printf("\n");
+    if (over)
+        Fail(e.line, "over budget", e.scenario);
+    if (budget)
+        ++budget->measured;
+}
+
+static void OnCall(const FakeCall& call)
+{
+    // The menu has closed and its command is being handled
+    if (g_measure == MEASURE_AWAIT_COMMAND && strcmp(call.api, "DispatchMessageW") == 0 &&
+        strcmp(call.detail, "0x0111") == 0)
+    {
+        g_measure = MEASURE_ON;
+        Snapshot(g_measureStart);
+    }
+    if (!g_quiet && (g_showAll || (call.apiClass != API_CLOCK && call.apiClass != API_MESSAGE)))
+    {
+        const uint64_t ms = call.tickMs - FakeStartTickMs();
+        printf("%6llu.%03llu %-8s %s%s%s\n", (unsigned long long)(ms / 1000), (unsigned long long)(ms % 1000),
+            FakeClassName(call.apiClass), call.api, call.detail[0] ? " " : "", call.detail);
+    }
+    // The launch is over for the user once the tooltip says which plan is on
+    if (g_measure == MEASURE_ON && g_measuredEvent == &g_startup && strcmp(call.api, "Shell_NotifyIconW") == 0)
+    {
+        char tip[4 + 3 * 128] = "tip=";
+        const size_t len = strlen(call.detail);
+        const size_t n = wcstombs(tip + 4, FakePlanName(FakeActivePlan()), sizeof(tip) - 4);
+        if (n != (size_t)-1 && len >= n + 4 && strcmp(call.detail + len - n - 4, tip) == 0)
+            EndMeasure();
+    }
+}
+
+static bool PlanByName(const wchar_t* name, GUID& guid, int line)
+{
+    if (FakeFindPlan(name, guid))
+        return true;
+    Fail(line, "no such plan", name);
+    return false;
+}
+
+class TextScript : public FakeScript
+{
+public:
+    bool NextEventMs(uint64_t& tickMs) override
+    {
+        if (m_next > g_eventCount)
+            return false;
+        // After the last event the app is closed, as a user would
+        tickMs = m_next < g_eventCount ? g_events[m_next].tickMs : FakeTickMs();
+        return true;
+    }
+
+    void RunEvent() override
+    {
+        // The menu has shown by the time the next event comes round
+        if (m_menuLine && !FakeMenuChoiceFound())
+            Fail(m_menuLine, "no such enabled menu item", g_events[m_menuEvent].arg);
+        m_menuLine = 0;
+        EndMeasure();
+        if (m_next == g_eventCount)
+        {
+            ++m_next;
+            printf("------ close\n");
+            FakeClose();
+            return;
+        }
+        const Event& e = g_events[m_next];
+        printf("------ %ls%s%ls\n", e.verb, e.arg[0] ? " " : "", e.arg);
+        if (wcscmp(e.verb, L"menu") == 0 && e.arg[0])
+        {
+            m_menuLine = e.line;
+            m_menuEvent = m_next;
+        }
+        ++m_next;
+        if (e.scenario[0])
+            BeginMeasure(e);
+        Run(e);
+    }
+
+private:
+    static void Run(const Event& e)
+    {
+        GUID guid;
+        const DWORD value = (DWORD)wcstoul(e.arg, nullptr, 10);
+        if (wcscmp(e.verb, L"menu") == 0)
+        {
+            FakeRightClick(e.arg[0] ? e.arg : nullptr);
+        }
+        else if (wcscmp(e.verb, L"input") == 0)
+        {
+            FakeUserInput();
+        }
+        else if (wcscmp(e.verb, L"plan") == 0)
+        {
+            if (PlanByName(e.arg, guid, e.line))
+                FakeSwitchPlan(guid);
+        }
+        else if (wcscmp(e.verb, L"ac") == 0 || wcscmp(e.verb, L"dc") == 0)
+        {
+            FakePowerSetting(GUID_ACDC_POWER_SOURCE, e.verb[0] == L'd' ? 1 : 0);
+        }
+        else if (wcscmp(e.verb, L"battery") == 0)
+        {
+            FakePowerSetting(GUID_BATTERY_PERCENTAGE_REMAINING, value);
+        }
+        else if (wcscmp(e.verb, L"saver") == 0)
+        {
+            FakePowerSetting(GUID_ENERGY_SAVER_STATUS, value);
+        }
+        else if (wcscmp(e.verb, L"dpi") == 0)
+        {
+            FakeDpiChanged(value);
+        }
+        else if (wcscmp(e.verb, L"taskbar") == 0)
+        {
+            FakeTaskbarCreated();
+        }
+        else if (wcscmp(e.verb, L"resume") == 0)
+        {
+            FakeResume();
+        }
+        else if (wcscmp(e.verb, L"timechange") == 0)
+        {
+            FakeTimeChange();
+        }
+        else if (wcscmp(e.verb, L"start") == 0)
+        {
+            FakeStartProcess(e.arg);
+        }
+        else if (wcscmp(e.verb, L"stop") == 0)
+        {
+            if (!FakeStopProcess(e.arg))
+                Fail(e.line, "not running", e.arg);
+        }
+        else if (wcscmp(e.verb, L"foreground") == 0)
+        {
+            if (!FakeSetForeground(e.arg))
+                Fail(e.line, "not running", e.arg);
+        }
+        else if (wcscmp(e.verb, L"cpu") == 0)
+        {
+            FakeSetCpuBusyPercent(value);
+        }
+        else if (wcscmp(e.verb, L"cli") == 0)
+        {
+            Forward(e);
+        }
+        else if (wcscmp(e.verb, L"hold") == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(value));
+        }
+        else if (wcscmp(e.verb, L"end") == 0)
+        {
+            FakeClose();
+        }
+        else if (wcscmp(e.verb, L"measure") != 0)
+        {
+            Fail(e.line, "unknown event", e.verb);
+        }
+    }
+
+    // What a second launch does: parse, send, print what came back
+    static void Forward(const Event& e)
+    {
+        wchar_t words[kMaxLine];
+        wcscpy(words, e.arg);
+        const wchar_t* argv[kMaxLine / 2 + 2] = { L"PowerPlanTray.exe" };
+        int argc = 1;
+        wchar_t* state = nullptr;
+        for (wchar_t* word = wcstok(words, L" ", &state); word; word = wcstok(nullptr, L" ", &state))
+            argv[argc++] = word;
+        CliRequest request;
+        if (!CliParse(argc, argv, request) || request.verb <= CLI_HELP)
+        {
+            Fail(e.line, "not a verb the tray takes", e.arg);
+            return;
+        }
+        DWORD_PTR result = 0;
+        if (!FakeCopyData(kCliRequestTag, &request, sizeof(request), result))
+        {
+            Fail(e.line, "no tray window", e.arg);
+            return;
+        }
+        ULONG_PTR tag;
+        DWORD bytes;
+        const wchar_t* reply = (const wchar_t*)FakeCopyDataReply(tag, bytes);
+        if (!(result & kCliHandled) || !reply || tag != kCliReplyTag)
+        {
+            Fail(e.line, "the tray did not answer", e.arg);
+            return;
+        }
+        printf("cli status %u\n%ls", (unsigned)(result & 0xFF), reply);
+    }
+
+    size_t m_next = 0;
+    int m_menuLine = 0; // A menu choice still to be checked
+    size_t m_menuEvent = 0;
+};
+
+// ===== Script parsing =====
+static wchar_t* Trim(wchar_t* text)
+{
+    while (*text == L' ' || *text == L'\t')
+        ++text;
+    size_t len = wcslen(text);
+    while (len && wcschr(L" \t\r\n", text[len - 1]))
+        text[--len] = L'\0';
+    return text;
+}
+
+// "300:Power saver, 1200:Quiet" as the app stores AfkStages: { DWORD
+// seconds, GUID plan } per stage, as many as given
+static bool SetStages(const wchar_t* key, const wchar_t* name, wchar_t* value, int line)
+{
+    struct StageRecord
+    {
+        DWORD thresholdSeconds;
+        GUID plan;
+    };
+    StageRecord records[16];
+    DWORD count = 0;
+    wchar_t* state = nullptr;
+    for (wchar_t* item = wcstok(value, L",", &state); item; item = wcstok(nullptr, L",", &state))
+    {
+        wchar_t* colon = wcschr(item, L':');
+        if (!colon || count == ARRAYSIZE(records))
+        {
+            Fail(line, "expected <seconds>:<plan>, at most 16", item);
+            return false;
+        }
+        *colon = L'\0';
+        records[count].thresholdSeconds = (DWORD)wcstoul(Trim(item), nullptr, 10);
+        if (!PlanByName(Trim(colon + 1), records[count].plan, line))
+            return false;
+        ++count;
+    }
+    return FakeRegSet(key, name, REG_BINARY, records, count * (DWORD)sizeof(StageRecord));
+}
+
+// "<subkey\>name = value" under the app's key
+static bool SetValue(wchar_t* text, int line)
+{
+    wchar_t* eq = wcschr(text, L'=');
+    if (!eq)
+    {
+        Fail(line, "expected name = value", text);
+        return false;
+    }
+    *eq = L'\0';
+    wchar_t* name = Trim(text);
+    wchar_t* value = Trim(eq + 1);
+    wchar_t key[192] = L"Software\\PowerPlanTray";
+    wchar_t* slash = wcsrchr(name, L'\\');
+    if (slash)
+    {
+        *slash = L'\0';
+        wcscat(key, L"\\");
+        wcsncat(key, name, ARRAYSIZE(key) - wcslen(key) - 1);
+        name = slash + 1;
+    }
+    wchar_t* end;
+    const unsigned long number = wcstoul(value, &end, 10);
+    if (*value && !*end)
+    {
+        const DWORD dword = (DWORD)number;
+        return FakeRegSet(key, name, REG_DWORD, &dword, sizeof(dword));
+    }
+    if (wcschr(value, L':'))
+        return SetStages(key, name, value, line);
+    GUID guid;
+    return PlanByName(value, guid, line) && FakeRegSet(key, name, REG_BINARY, &guid, sizeof(guid));
+}
+
+static bool AddPlan(wchar_t* text, int line)
+{
+    GUID personality = GUID_TYPICAL_POWER_SAVINGS;
+    if (wchar_t* like = wcsstr(text, L" like "))
+    {
+        *like = L'\0';
+        GUID other;
+        if (!PlanByName(Trim(like + 6), other, line))
+            return false;
+        // The three built-in plans are their own personalities; a copy of a
+        // made-up plan is taken as Balanced-like
+        if (IsEqualGUID(other, GUID_MIN_POWER_SAVINGS) || IsEqualGUID(other, GUID_MAX_POWER_SAVINGS))
+            personality = other;
+    }
+    // Made-up plans get GUIDs that only have to be unique
+    static DWORD next = 0xdeadbe00;
+    const GUID guid = { ++next, 0x1234, 0x5678, { 0x9a, 0xbc, 0xde, 0xf0, 0x12, 0x34, 0x56, 0x78 } };
+    return FakeAddPlan(guid, Trim(text), personality);
+}
+
+// "@<scenario>"
+static bool AddStartup(const wchar_t* text, int line)
+{
+    if (text[0] != L'@' || !text[1] || g_startup.scenario[0] || wcslen(text + 1) >= ARRAYSIZE(g_startup.scenario))
+    {
+        Fail(line, "expected one startup @<scenario>", text);
+        return false;
+    }
+    wcscpy(g_startup.verb, L"startup");
+    wcscpy(g_startup.scenario, text + 1);
+    g_startup.line = line;
+    return true;
+}
+
+static size_t FindCounter(const wchar_t* name)
+{
+    char narrow[16];
+    if (wcstombs(narrow, name, sizeof(narrow)) >= sizeof(narrow))
+        return kCounters;
+    size_t c = 0;
+    while (c < kCounters && strcmp(CounterName(c), narrow) != 0)
+        ++c;
+    return c;
+}
+
+// "<scenario> <class> <max> ..."
+static bool AddBudget(wchar_t* text, int line)
+{
+    wchar_t* state;
+    const wchar_t* scenario = wcstok(text, L" \t", &state);
+    if (!scenario || g_budgetCount == kMaxBudgets || FindBudget(scenario) || wcslen(scenario) >= ARRAYSIZE(g_budgets[0].scenario))
+    {
+        Fail(line, "bad or repeated budget", text);
+        return false;
+    }
+    Budget& b = g_budgets[g_budgetCount++];
+    wcscpy(b.scenario, scenario);
+    b.line = line;
+    while (const wchar_t* name = wcstok(nullptr, L" \t", &state))
+    {
+        const wchar_t* max = wcstok(nullptr, L" \t", &state);
+        const size_t c = FindCounter(name);
+        wchar_t* end;
+        const unsigned long long cap = max ? wcstoull(max, &end, 10) : 0;
+        if (c == kCounters || !max || *end)
+        {
+            Fail(line, "expected <class> <max>", name);
+            return false;
+        }
+        b.capped[c] = true;
+        b.cap[c] = cap;
+    }
+    return true;
+}
+
+static bool Parse(FILE* f)
+{
+    char raw[kMaxLine];
+    int line = 0;
+    while (fgets(raw, sizeof(raw), f))
+    {
+        ++line;
+        wchar_t wide[kMaxLine];
+        if (mbstowcs(wide, raw, ARRAYSIZE(wide)) == (size_t)-1)
+        {
+            fprintf(stderr, "script line %d: not valid text\n", line);
+            return false;
+        }
+        wide[ARRAYSIZE(wide) - 1] = L'\0';
+        if (wchar_t* hash = wcschr(wide, L'#'))
+            *hash = L'\0';
+        wchar_t* text = Trim(wide);
+        if (!*text)
+            continue;
+
+        wchar_t* end;
+        const double seconds = wcstod(text, &end);
+        if (end == text)
+        {
+            // A setup directive
+            wchar_t* rest = wcschr(text, L' ');
+            if (rest) *rest++ = L'\0';
+            rest = rest ? Trim(rest) : text + wcslen(text);
+            GUID guid;
+            bool ok = true;
+            if (wcscmp(text, L"addplan") == 0) ok = AddPlan(rest, line);
+            else if (wcscmp(text, L"active") == 0) ok = PlanByName(rest, guid, line) && FakeSwitchPlan(guid);
+            else if (wcscmp(text, L"set") == 0) ok = SetValue(rest, line);
+            else if (wcscmp(text, L"process") == 0) ok = FakeStartProcess(rest) != 0;
+            else if (wcscmp(text, L"foreground") == 0) ok = FakeSetForeground(rest);
+            else if (wcscmp(text, L"budget") == 0) ok = AddBudget(rest, line);
+            else if (wcscmp(text, L"cmdline") == 0) FakeSetCommandLine(rest);
+            else if (wcscmp(text, L"cached") == 0) g_seedCache = true;
+            else if (wcscmp(text, L"lockplans") == 0) FakeLockPlans(true);
+            else if (wcscmp(text, L"startup") == 0) ok = AddStartup(rest, line);
+            else { Fail(line, "unknown directive", text); ok = false; }
+            if (!ok)
+                return false;
+            continue;
+        }
+
+        if (g_eventCount == kMaxEvents || seconds < 0)
+        {
+            Fail(line, "too many events or a negative time", text);
+            return false;
+        }
+        Event& e = g_events[g_eventCount];
+        e.tickMs = FakeStartTickMs() + (uint64_t)(seconds * 1000.0 + 0.5);
+        e.line = line;
+        if (g_eventCount && e.tickMs < g_events[g_eventCount - 1].tickMs)
+        {
+            Fail(line, "events must be in time order", text);
+            return false;
+        }
+        wchar_t* verb = Trim(end);
+        e.scenario[0] = L'\0';
+        if (wchar_t* at = wcsstr(verb, L" @"))
+        {
+            *at = L'\0';
+            wcsncpy(e.scenario, Trim(at + 2), ARRAYSIZE(e.scenario) - 1);
+            e.scenario[ARRAYSIZE(e.scenario) - 1] = L'\0';
+            verb = Trim(verb);
+        }
+        wchar_t* arg = wcschr(verb, L' ');
+        if (arg) *arg++ = L'\0';
+        wcsncpy(e.verb, verb, ARRAYSIZE(e.verb) - 1);
+        e.verb[ARRAYSIZE(e.verb) - 1] = L'\0';
+        wcsncpy(e.arg, arg ? Trim(arg) : L"", ARRAYSIZE(e.arg) - 1);
+        e.arg[ARRAYSIZE(e.arg) - 1] = L'\0';
+        ++g_eventCount;
+    }
+    return true;
+}
+
+// What an earlier run of the tray leaves behind, written by the app's own code
+static bool SeedPlanCache()
+{
+    static PlanCacheData data;
+    data.lang = GetUserDefaultUILanguage();
+    EnumeratePlans(data.plans);
+    GetActivePlanGuid(data.active);
+    return PlanCacheSave(data);
+}
+
+// ===== Report =====
+static void PrintSummary(int exitCode)
+{
+    printf("\n====== exit %d after %.1f s\n", exitCode, (FakeTickMs() - FakeStartTickMs()) / 1000.0);
+    for (int c = 0; c < API_CLASS_COUNT; ++c)
+    {
+        const FakeApiClass apiClass = (FakeApiClass)c;
+        printf("%-8s %8llu calls\n", FakeClassName(apiClass), (unsigned long long)FakeClassCount(apiClass));
+        for (size_t i = 0; i < FakeApiCount(); ++i)
+        {
+            const char* api;
+            FakeApiClass cls;
+            uint64_t calls;
+            FakeApiAt(i, api, cls, calls);
+            if (cls == apiClass)
+                printf("    %-34s %8llu\n", api, (unsigned long long)calls);
+        }
+    }
+    printf("left open: %zu handles, %zu icons, %zu menus; tray icon %s\n",
+        FakeOpenHandles(), FakeLiveIcons(), FakeLiveMenus(), FakeTrayIconShown() ? "still shown" : "removed");
+
+    // The worst case per scenario, as budget lines to record new goldens from
+    for (size_t i = 0; i < g_budgetCount; ++i)
+    {
+        const Budget& b = g_budgets[i];
+        if (!b.measured)
+        {
+            Fail(b.line, "budget never measured", b.scenario);
+            continue;
+        }
+        printf("budget %-12ls", b.scenario);
+        for (size_t c = 0; c < kCounters; ++c)
+        {
+            if (!b.capped[c] || (c == kAllocCounter && !kAllocsCounted))
+                continue;
+            printf(" %s %llu", CounterName(c), (unsigned long long)b.worst[c]);
+        }
+        printf("\n");
+    }
+    if (g_budgetCount && !kAllocsCounted)
+        printf("alloc budgets are checked in _DEBUG builds only\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* scriptPath = nullptr;
+    const char* sourceDir = "PowerPlanTray";
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--all") == 0)
+            g_showAll = true;
+        else if (strcmp(argv[i], "--quiet") == 0)
+            g_quiet = true;
+        else if (strcmp(argv[i], "--source") == 0 && i + 1 < argc)
+            sourceDir = argv[++i];
+        else if (!scriptPath)
+            scriptPath = argv[i];
+        else
+            scriptPath = nullptr, i = argc;
+    }
+    if (!scriptPath)
+    {
+        fprintf(stderr, "usage: headlesstray [--all | --quiet] [--source <PowerPlanTray dir>] <script | ->\n");
+        return 2;
+    }
+
+    setlocale(LC_CTYPE, "");
+    setvbuf(stdout, nullptr, _IOFBF, 1 << 16);
+    setenv("TZ", getenv("TZ") ? getenv("TZ") : "UTC", 1);
+    char resourceH[512], stringsRc[512];
+    snprintf(resourceH, sizeof(resourceH), "%s/Resource.h", sourceDir);
+    snprintf(stringsRc, sizeof(stringsRc), "%s/Strings.rc", sourceDir);
+    if (!FakeLoadStrings(resourceH, stringsRc))
+    {
+        fprintf(stderr, "cannot read strings from %s and %s\n", resourceH, stringsRc);
+        return 2;
+    }
+
+    FakeAddPlan(GUID_TYPICAL_POWER_SAVINGS, L"Balanced", GUID_TYPICAL_POWER_SAVINGS);
+    FakeAddPlan(GUID_MIN_POWER_SAVINGS, L"High performance", GUID_MIN_POWER_SAVINGS);
+    FakeAddPlan(GUID_MAX_POWER_SAVINGS, L"Power saver", GUID_MAX_POWER_SAVINGS);
+
+    FILE* f = strcmp(scriptPath, "-") == 0 ? stdin : fopen(scriptPath, "r");
+    if (!f)
+    {
+        fprintf(stderr, "cannot open %s\n", scriptPath);
+        return 2;
+    }
+    const bool parsed = Parse(f);
+    if (f != stdin)
+        fclose(f);
+    if (!parsed)
+        return 2;
+    if (g_seedCache && !SeedPlanCache())
+    {
+        fprintf(stderr, "cannot write the plan cache\n");
+        return 2;
+    }
+    FakeResetCounts(); // The session starts here
+
+    TextScript script;
+    FakeSetScript(&script);
+    FakeSetCallSink(&OnCall);
+    if (g_startup.scenario[0])
+    {
+        printf("------ startup\n");
+        BeginMeasure(g_startup);
+    }
+    wchar_t cmdLine[] = L"";
+    const int exitCode = wWinMain((HINSTANCE)0x400000, nullptr, cmdLine, 0);
+    EndMeasure(); // Ended by the app, from its own menu
+    FakeSetCallSink(nullptr);
+    FakeSetScript(nullptr);
+    PrintSummary(exitCode);
+    return g_failures ? 1 : exitCode;
+}
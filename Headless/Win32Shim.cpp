@@ -0,0 +1,2227 @@
+// Win32Shim.cpp: The headless Win32 API over an in-memory fake system, recording every call.
+
+#include "FakeSystem.h"
+
+#include <iphlpapi.h>
+#include <pdh.h>
+#include <powrprof.h>
+#include <psapi.h>
+#include <shellapi.h>
+#include <strsafe.h>
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <wctype.h>
+
+// Nothing here allocates with operator new once the session runs: the app's
+// debug-build NoAllocScope checks stay meaningful under the shim.
+
+const GUID GUID_POWERSCHEME_PERSONALITY = { 0x245d8541, 0x3943, 0x4422, { 0xb0, 0x25, 0x13, 0xa7, 0x84, 0xf6, 0x79, 0xb7 } };
+const GUID GUID_MIN_POWER_SAVINGS = { 0x8c5e7fda, 0xe8bf, 0x4a96, { 0x9a, 0x85, 0xa6, 0xe2, 0x3a, 0x8c, 0x63, 0x5c } };
+const GUID GUID_MAX_POWER_SAVINGS = { 0xa1841308, 0x3541, 0x4fab, { 0xbc, 0x81, 0xf7, 0x15, 0x56, 0xf2, 0x0b, 0x4a } };
+const GUID GUID_TYPICAL_POWER_SAVINGS = { 0x381b4222, 0xf694, 0x41f0, { 0x96, 0x85, 0xff, 0x5b, 0xb2, 0x60, 0xdf, 0x2e } };
+const GUID GUID_ACDC_POWER_SOURCE = { 0x5d3e9a59, 0xe9d5, 0x4b00, { 0xa6, 0xbd, 0xff, 0x34, 0xff, 0x51, 0x65, 0x48 } };
+const GUID GUID_BATTERY_PERCENTAGE_REMAINING = { 0xa7ad8041, 0xb45a, 0x4cae, { 0x87, 0xa3, 0xee, 0xcb, 0xb4, 0x68, 0xa9, 0xe1 } };
+const GUID GUID_ENERGY_SAVER_STATUS = { 0x550e8400, 0xe29b, 0x41d4, { 0xa7, 0x16, 0x44, 0x66, 0x55, 0x44, 0x00, 0x00 } };
+
+// ===== Call log =====
+struct ApiStat
+{
+    const char* api;
+    FakeApiClass apiClass;
+    uint64_t calls;
+};
+static ApiStat g_apiStats[192];
+static size_t g_apiStatCount = 0;
+static uint64_t g_classCounts[API_CLASS_COUNT] = {};
+static void (*g_callSink)(const FakeCall& call) = nullptr;
+static const uint64_t kStartTickMs = 3600000; // An hour after boot
+static uint64_t g_tickMs = kStartTickMs;
+
+__attribute__((format(printf, 3, 4)))
+static void Record(FakeApiClass apiClass, const char* api, const char* format, ...)
+{
+    ++g_classCounts[apiClass];
+    size_t i = 0;
+    while (i < g_apiStatCount && strcmp(g_apiStats[i].api, api) != 0)
+        ++i;
+    if (i == g_apiStatCount && i < ARRAYSIZE(g_apiStats))
+        g_apiStats[g_apiStatCount++] = { api, apiClass, 0 };
+    if (i < g_apiStatCount)
+        ++g_apiStats[i].calls;
+    if (!g_callSink)
+        return;
+
+    FakeCall call;
+    call.tickMs = g_tickMs;
+    call.apiClass = apiClass;
+    call.api = api;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(call.detail, sizeof(call.detail), format, args);
+    va_end(args);
+    g_callSink(call);
+}
+
+// Details quote wide strings as UTF-8; a few rotating buffers cover one line
+static const char* Utf8(const wchar_t* text)
+{
+    static char buffers[4][160];
+    static size_t next = 0;
+    char* out = buffers[next++ % ARRAYSIZE(buffers)];
+    size_t n = 0;
+    for (; text && *text && n + 4 < sizeof(buffers[0]); ++text)
+    {
+        const uint32_t c = (uint32_t)*text;
+        if (c < 0x20) { out[n++] = ' '; } // Keep each call on one line
+        else if (c < 0x80) { out[n++] = (char)c; }
+        else if (c < 0x800) { out[n++] = (char)(0xC0 | (c >> 6)); out[n++] = (char)(0x80 | (c & 0x3F)); }
+        else if (c < 0x10000) { out[n++] = (char)(0xE0 | (c >> 12)); out[n++] = (char)(0x80 | ((c >> 6) & 0x3F)); out[n++] = (char)(0x80 | (c & 0x3F)); }
+        else { out[n++] = '?'; }
+    }
+    out[n] = '\0';
+    return out;
+}
+
+static bool SameText(const wchar_t* a, const wchar_t* b)
+{
+    for (; *a && *b; ++a, ++b)
+    {
+        if (towlower(*a) != towlower(*b))
+            return false;
+    }
+    return *a == *b;
+}
+
+static void CopyText(wchar_t* dest, size_t cch, const wchar_t* src)
+{
+    size_t n = 0;
+    for (; src && src[n] && n + 1 < cch; ++n)
+        dest[n] = src[n];
+    dest[n] = L'\0';
+}
+
+static const wchar_t* BaseName(const wchar_t* path)
+{
+    const wchar_t* slash = wcsrchr(path, L'\\');
+    return slash ? slash + 1 : path;
+}
+
+// ===== Clock =====
+static int64_t g_unixMsAtStart = 1704099600000LL; // Monday 2024-01-01 09:00 UTC
+static const uint64_t kUnixEpochAsFileTime = 116444736000000000ULL;
+
+static uint64_t UnixNowMs()
+{
+    return (uint64_t)g_unixMsAtStart + (g_tickMs - kStartTickMs);
+}
+
+static void SplitFileTime(uint64_t value, FILETIME* out)
+{
+    out->dwLowDateTime = (DWORD)value;
+    out->dwHighDateTime = (DWORD)(value >> 32);
+}
+
+void FakeSetWallClock(int64_t unixMs) { g_unixMsAtStart = unixMs; }
+uint64_t FakeStartTickMs() { return kStartTickMs; }
+uint64_t FakeTickMs() { return g_tickMs; }
+
+ULONGLONG GetTickCount64()
+{
+    Record(API_CLOCK, "GetTickCount64", "%s", "");
+    return g_tickMs;
+}
+
+DWORD GetTickCount()
+{
+    Record(API_CLOCK, "GetTickCount", "%s", "");
+    return (DWORD)g_tickMs;
+}
+
+// Latency histograms time the app's own work, so the counter is real
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count)
+{
+    Record(API_CLOCK, "QueryPerformanceCounter", "%s", "");
+    count->QuadPart = (LONGLONG)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count() / 100;
+    return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency)
+{
+    Record(API_CLOCK, "QueryPerformanceFrequency", "%s", "");
+    frequency->QuadPart = 10000000;
+    return TRUE;
+}
+
+void GetSystemTimeAsFileTime(FILETIME* time)
+{
+    Record(API_CLOCK, "GetSystemTimeAsFileTime", "%s", "");
+    SplitFileTime(UnixNowMs() * 10000ULL + kUnixEpochAsFileTime, time);
+}
+
+void GetLocalTime(SYSTEMTIME* time)
+{
+    Record(API_CLOCK, "GetLocalTime", "%s", "");
+    const uint64_t ms = UnixNowMs();
+    const time_t t = (time_t)(ms / 1000);
+    struct tm local;
+    localtime_r(&t, &local);
+    time->wYear = (WORD)(local.tm_year + 1900);
+    time->wMonth = (WORD)(local.tm_mon + 1);
+    time->wDayOfWeek = (WORD)local.tm_wday;
+    time->wDay = (WORD)local.tm_mday;
+    time->wHour = (WORD)local.tm_hour;
+    time->wMinute = (WORD)local.tm_min;
+    time->wSecond = (WORD)local.tm_sec;
+    time->wMilliseconds = (WORD)(ms % 1000);
+}
+
+// ===== Handles =====
+enum HandleKind
+{
+    HANDLE_FREE,
+    HANDLE_MUTEX,
+    HANDLE_FILE,
+    HANDLE_PROCESS,
+    HANDLE_KEY,
+    HANDLE_POWER_NOTIFY,
+    HANDLE_HOOK,
+    HANDLE_PDH_QUERY,
+    HANDLE_PDH_COUNTER
+};
+
+struct HandleSlot
+{
+    HandleKind kind;
+    size_t object;   // Index into the kind's own table
+    size_t position; // Files: read or write offset
+};
+static HandleSlot g_handles[128];
+static const uintptr_t kHandleBase = 0x10000;
+
+static void* OpenHandle(HandleKind kind, size_t object)
+{
+    for (size_t i = 0; i < ARRAYSIZE(g_handles); ++i)
+    {
+        if (g_handles[i].kind == HANDLE_FREE)
+        {
+            g_handles[i] = { kind, object, 0 };
+            return (void*)(kHandleBase + i * 4);
+        }
+    }
+    return nullptr;
+}
+
+static HandleSlot* FindHandle(const void* handle, HandleKind kind)
+{
+    const uintptr_t value = (uintptr_t)handle;
+    if (value < kHandleBase || (value - kHandleBase) % 4 != 0)
+        return nullptr;
+    const size_t i = (value - kHandleBase) / 4;
+    if (i >= ARRAYSIZE(g_handles) || g_handles[i].kind != kind)
+        return nullptr;
+    return &g_handles[i];
+}
+
+static bool CloseFakeHandle(const void* handle, HandleKind kind)
+{
+    HandleSlot* slot = FindHandle(handle, kind);
+    if (!slot)
+        return false;
+    slot->kind = HANDLE_FREE;
+    return true;
+}
+
+size_t FakeOpenHandles()
+{
+    size_t n = 0;
+    for (const HandleSlot& slot : g_handles)
+        n += slot.kind != HANDLE_FREE;
+    return n;
+}
+
+// ===== Kernel =====
+static DWORD g_lastError = 0;
+static SIZE_T g_workingSetBytes = 6 * 1024 * 1024;
+
+DWORD GetLastError() { return g_lastError; }
+void SetLastError(DWORD error) { g_lastError = error; }
+
+static wchar_t g_mutexNames[4][64];
+
+HANDLE CreateMutexW(SECURITY_ATTRIBUTES*, BOOL, LPCWSTR name)
+{
+    Record(API_KERNEL, "CreateMutexW", "%s", Utf8(name));
+    size_t free = ARRAYSIZE(g_mutexNames);
+    for (size_t i = 0; i < ARRAYSIZE(g_mutexNames); ++i)
+    {
+        if (name && g_mutexNames[i][0] && SameText(g_mutexNames[i], name))
+        {
+            SetLastError(ERROR_ALREADY_EXISTS);
+            return OpenHandle(HANDLE_MUTEX, i);
+        }
+        if (!g_mutexNames[i][0] && free == ARRAYSIZE(g_mutexNames))
+            free = i;
+    }
+    if (free == ARRAYSIZE(g_mutexNames))
+        return nullptr;
+    CopyText(g_mutexNames[free], ARRAYSIZE(g_mutexNames[free]), name ? name : L"?");
+    SetLastError(ERROR_SUCCESS);
+    return OpenHandle(HANDLE_MUTEX, free);
+}
+
+BOOL ReleaseMutex(HANDLE mutex)
+{
+    Record(API_KERNEL, "ReleaseMutex", "%s", "");
+    return FindHandle(mutex, HANDLE_MUTEX) != nullptr;
+}
+
+static bool CloseFile(HandleSlot* slot);
+
+BOOL CloseHandle(HANDLE handle)
+{
+    Record(API_KERNEL, "CloseHandle", "%s", "");
+    if (HandleSlot* slot = FindHandle(handle, HANDLE_FILE))
+        return CloseFile(slot);
+    if (HandleSlot* slot = FindHandle(handle, HANDLE_MUTEX))
+    {
+        // The name goes with the last handle; the app holds only one
+        g_mutexNames[slot->object][0] = L'\0';
+        slot->kind = HANDLE_FREE;
+        return TRUE;
+    }
+    return CloseFakeHandle(handle, HANDLE_PROCESS);
+}
+
+HLOCAL LocalAlloc(UINT, SIZE_T bytes)
+{
+    Record(API_KERNEL, "LocalAlloc", "%zu bytes", (size_t)bytes);
+    return malloc(bytes ? bytes : 1);
+}
+
+HLOCAL LocalFree(HLOCAL mem)
+{
+    Record(API_KERNEL, "LocalFree", "%s", "");
+    free(mem);
+    return nullptr;
+}
+
+HANDLE GetProcessHeap()
+{
+    Record(API_KERNEL, "GetProcessHeap", "%s", "");
+    return (HANDLE)0x50;
+}
+
+SIZE_T HeapCompact(HANDLE, DWORD)
+{
+    Record(API_KERNEL, "HeapCompact", "%s", "");
+    return 64 * 1024;
+}
+
+HANDLE GetCurrentProcess()
+{
+    Record(API_KERNEL, "GetCurrentProcess", "%s", "");
+    return (HANDLE)(LONG_PTR)-1;
+}
+
+BOOL SetProcessWorkingSetSizeEx(HANDLE, SIZE_T minimum, SIZE_T maximum, DWORD)
+{
+    Record(API_KERNEL, "SetProcessWorkingSetSizeEx", "%s", minimum == (SIZE_T)-1 && maximum == (SIZE_T)-1 ? "empty" : "limits");
+    if (minimum == (SIZE_T)-1 && maximum == (SIZE_T)-1)
+        g_workingSetBytes = 1200 * 1024;
+    return TRUE;
+}
+
+BOOL GetProcessMemoryInfo(HANDLE, PROCESS_MEMORY_COUNTERS* counters, DWORD bytes)
+{
+    Record(API_KERNEL, "GetProcessMemoryInfo", "%s", "");
+    if (bytes < sizeof(*counters))
+        return FALSE;
+    memset(counters, 0, sizeof(*counters));
+    counters->cb = sizeof(*counters);
+    counters->WorkingSetSize = g_workingSetBytes;
+    counters->PeakWorkingSetSize = 6 * 1024 * 1024;
+    return TRUE;
+}
+
+// Modules: user32 and Shcore, with just the DPI entry points the app looks
+// up, and ntdll for the process snapshot
+static const uintptr_t kUser32 = 0x70001;
+static const uintptr_t kShcore = 0x70002;
+static const uintptr_t kNtdll = 0x70003;
+static UINT g_dpi = 96;
+
+static UINT WINAPI FakeGetDpiForWindow(HWND)
+{
+    Record(API_USER, "GetDpiForWindow", "%u", g_dpi);
+    return g_dpi;
+}
+
+static int WINAPI FakeGetSystemMetricsForDpi(int index, UINT dpi)
+{
+    Record(API_USER, "GetSystemMetricsForDpi", "%d at %u dpi", index, dpi);
+    return index == SM_CXSMICON || index == SM_CYSMICON ? (int)(16 * dpi / 96) : 0;
+}
+
+static BOOL WINAPI FakeSetProcessDpiAwarenessContext(HANDLE context)
+{
+    Record(API_USER, "SetProcessDpiAwarenessContext", "%ld", (long)(LONG_PTR)context);
+    return TRUE;
+}
+
+HMODULE GetModuleHandleW(LPCWSTR name)
+{
+    Record(API_KERNEL, "GetModuleHandleW", "%s", Utf8(name));
+    if (name && SameText(name, L"user32.dll"))
+        return (HMODULE)kUser32;
+    return name && SameText(name, L"ntdll.dll") ? (HMODULE)kNtdll : nullptr;
+}
+
+HMODULE LoadLibraryW(LPCWSTR name)
+{
+    Record(API_KERNEL, "LoadLibraryW", "%s", Utf8(name));
+    return name && SameText(name, L"Shcore.dll") ? (HMODULE)kShcore : nullptr;
+}
+
+BOOL FreeLibrary(HMODULE module)
+{
+    Record(API_KERNEL, "FreeLibrary", "%s", "");
+    return (uintptr_t)module == kShcore;
+}
+
+static LONG WINAPI FakeNtQuerySystemInformation(int infoClass, void* buffer, ULONG bytes, ULONG* needed);
+
+FARPROC GetProcAddress(HMODULE module, LPCSTR name)
+{
+    Record(API_KERNEL, "GetProcAddress", "%s", name);
+    if ((uintptr_t)module == kNtdll && strcmp(name, "NtQuerySystemInformation") == 0)
+        return reinterpret_cast<FARPROC>(&FakeNtQuerySystemInformation);
+    if ((uintptr_t)module != kUser32)
+        return nullptr;
+    if (strcmp(name, "GetDpiForWindow") == 0)
+        return reinterpret_cast<FARPROC>(&FakeGetDpiForWindow);
+    if (strcmp(name, "GetSystemMetricsForDpi") == 0)
+        return reinterpret_cast<FARPROC>(&FakeGetSystemMetricsForDpi);
+    if (strcmp(name, "SetProcessDpiAwarenessContext") == 0)
+        return reinterpret_cast<FARPROC>(&FakeSetProcessDpiAwarenessContext);
+    return nullptr;
+}
+
+DWORD GetModuleFileNameW(HMODULE, LPWSTR path, DWORD cch)
+{
+    Record(API_KERNEL, "GetModuleFileNameW", "%s", "");
+    static const wchar_t kPath[] = L"C:\\Program Files\\PowerPlanTray\\PowerPlanTray.exe";
+    CopyText(path, cch, kPath);
+    return (DWORD)wcslen(path);
+}
+
+DWORD GetEnvironmentVariableW(LPCWSTR name, LPWSTR buffer, DWORD cch)
+{
+    Record(API_KERNEL, "GetEnvironmentVariableW", "%s", Utf8(name));
+    static const wchar_t kLocalAppData[] = L"C:\\Users\\User\\AppData\\Local";
+    if (!SameText(name, L"LOCALAPPDATA"))
+    {
+        SetLastError(203); // ERROR_ENVVAR_NOT_FOUND
+        return 0;
+    }
+    const DWORD len = (DWORD)wcslen(kLocalAppData);
+    if (cch <= len)
+        return len + 1;
+    CopyText(buffer, cch, kLocalAppData);
+    return len;
+}
+
+LANGID GetUserDefaultUILanguage()
+{
+    Record(API_KERNEL, "GetUserDefaultUILanguage", "%s", "");
+    return 0x0409; // en-US, the first language in Strings.rc
+}
+
+void OutputDebugStringW(LPCWSTR text)
+{
+    Record(API_KERNEL, "OutputDebugStringW", "%s", Utf8(text));
+}
+
+void OutputDebugStringA(LPCSTR text)
+{
+    Record(API_KERNEL, "OutputDebugStringA", "%s", text);
+}
+
+static wchar_t g_commandLine[256] = L"PowerPlanTray.exe";
+
+void FakeSetCommandLine(const wchar_t* args)
+{
+    swprintf(g_commandLine, ARRAYSIZE(g_commandLine), L"PowerPlanTray.exe%ls%ls", *args ? L" " : L"", args);
+}
+
+LPWSTR GetCommandLineW()
+{
+    Record(API_KERNEL, "GetCommandLineW", "%s", "");
+    return g_commandLine;
+}
+
+// Words split at spaces, double quotes group; no backslash rules, which the
+// app's verbs never need. Counted as kernel: it reads the process's own line.
+LPWSTR* CommandLineToArgvW(LPCWSTR cmdLine, int* argc)
+{
+    Record(API_KERNEL, "CommandLineToArgvW", "%s", Utf8(cmdLine));
+    const size_t len = wcslen(cmdLine);
+    const size_t maxArgs = len / 2 + 2;
+    LPWSTR* argv = (LPWSTR*)LocalAlloc(LMEM_FIXED, maxArgs * sizeof(LPWSTR) + (len + 1) * sizeof(wchar_t));
+    wchar_t* out = (wchar_t*)(argv + maxArgs);
+    int n = 0;
+    for (const wchar_t* p = cmdLine;;)
+    {
+        while (*p == L' ' || *p == L'\t')
+            ++p;
+        if (!*p)
+            break;
+        argv[n++] = out;
+        bool quoted = false;
+        for (; *p && (quoted || (*p != L' ' && *p != L'\t')); ++p)
+        {
+            if (*p == L'"')
+                quoted = !quoted;
+            else
+                *out++ = *p;
+        }
+        *out++ = L'\0';
+    }
+    argv[n] = nullptr;
+    *argc = n;
+    return argv;
+}
+
+int WideCharToMultiByte(UINT, DWORD, LPCWSTR text, int cch, LPSTR out, int bytes, LPCSTR, BOOL*)
+{
+    Record(API_KERNEL, "WideCharToMultiByte", "%d chars", cch);
+    // Only ever asked for UTF-8 of a counted string
+    int n = 0;
+    for (int i = 0; i < cch; ++i)
+    {
+        char utf8[8];
+        const int len = (int)wcrtomb(utf8, text[i], nullptr);
+        if (len < 0 || n + len > bytes)
+            return 0;
+        memcpy(out + n, utf8, (size_t)len);
+        n += len;
+    }
+    return n;
+}
+
+// ===== Console =====
+// Standard output and error are redirected, to the run's own output, one
+// tagged line per line written
+static HANDLE const kStdOut = (HANDLE)0x50001;
+static HANDLE const kStdErr = (HANDLE)0x50002;
+
+static void PrintStd(HANDLE handle, const char* text, size_t bytes)
+{
+    const char* tag = handle == kStdOut ? "stdout" : "stderr";
+    while (bytes)
+    {
+        const char* nl = (const char*)memchr(text, '\n', bytes);
+        const size_t len = nl ? (size_t)(nl - text) : bytes;
+        printf("%s| %.*s\n", tag, (int)len, text);
+        const size_t used = nl ? len + 1 : len;
+        text += used;
+        bytes -= used;
+    }
+}
+
+HANDLE GetStdHandle(DWORD stdHandle)
+{
+    Record(API_KERNEL, "GetStdHandle", "%d", (int)stdHandle);
+    return stdHandle == STD_OUTPUT_HANDLE ? kStdOut : stdHandle == STD_ERROR_HANDLE ? kStdErr : nullptr;
+}
+
+BOOL AttachConsole(DWORD)
+{
+    Record(API_KERNEL, "AttachConsole", "%s", "");
+    g_lastError = ERROR_ACCESS_DENIED; // Already has one
+    return FALSE;
+}
+
+BOOL GetConsoleMode(HANDLE, LPDWORD mode)
+{
+    Record(API_KERNEL, "GetConsoleMode", "%s", "");
+    *mode = 0;
+    g_lastError = ERROR_INVALID_HANDLE; // Not a console
+    return FALSE;
+}
+
+BOOL WriteConsoleW(HANDLE, const void*, DWORD cch, LPDWORD written, LPVOID)
+{
+    Record(API_KERNEL, "WriteConsoleW", "%u chars", (unsigned)cch);
+    *written = 0;
+    g_lastError = ERROR_INVALID_HANDLE;
+    return FALSE;
+}
+
+// ===== CPU, disk and network counters =====
+static uint32_t g_cpuBusyPercent = 5;
+static uint64_t g_cpuTickMs = kStartTickMs;
+static uint64_t g_cpuIdle = 0, g_cpuKernel = 0, g_cpuUser = 0; // 100 ns units
+
+static void IntegrateCpu()
+{
+    const uint64_t elapsed = (g_tickMs - g_cpuTickMs) * 10000ULL;
+    const uint64_t busy = elapsed * g_cpuBusyPercent / 100;
+    g_cpuIdle += elapsed - busy;
+    g_cpuKernel += elapsed - busy + busy / 2; // Kernel time includes idle time
+    g_cpuUser += busy - busy / 2;
+    g_cpuTickMs = g_tickMs;
+}
+
+void FakeSetCpuBusyPercent(uint32_t percent)
+{
+    IntegrateCpu();
+    g_cpuBusyPercent = percent > 100 ? 100 : percent;
+}
+
+BOOL GetSystemTimes(FILETIME* idle, FILETIME* kernel, FILETIME* user)
+{
+    Record(API_KERNEL, "GetSystemTimes", "%s", "");
+    IntegrateCpu();
+    SplitFileTime(g_cpuIdle, idle);
+    SplitFileTime(g_cpuKernel, kernel);
+    SplitFileTime(g_cpuUser, user);
+    return TRUE;
+}
+
+PDH_STATUS PdhOpenQueryW(LPCWSTR, DWORD_PTR, PDH_HQUERY* query)
+{
+    Record(API_KERNEL, "PdhOpenQueryW", "%s", "");
+    *query = OpenHandle(HANDLE_PDH_QUERY, 0);
+    return *query ? ERROR_SUCCESS : ERROR_INVALID_HANDLE;
+}
+
+PDH_STATUS PdhAddEnglishCounterW(PDH_HQUERY query, LPCWSTR path, DWORD_PTR, PDH_HCOUNTER* counter)
+{
+    Record(API_KERNEL, "PdhAddEnglishCounterW", "%s", Utf8(path));
+    if (!FindHandle(query, HANDLE_PDH_QUERY))
+        return ERROR_INVALID_HANDLE;
+    *counter = OpenHandle(HANDLE_PDH_COUNTER, 0);
+    return *counter ? ERROR_SUCCESS : ERROR_INVALID_HANDLE;
+}
+
+PDH_STATUS PdhCollectQueryData(PDH_HQUERY query)
+{
+    Record(API_KERNEL, "PdhCollectQueryData", "%s", "");
+    return FindHandle(query, HANDLE_PDH_QUERY) ? ERROR_SUCCESS : ERROR_INVALID_HANDLE;
+}
+
+// The disk is quiet: a running total that never moves
+PDH_STATUS PdhGetRawCounterValue(PDH_HCOUNTER counter, LPDWORD type, PDH_RAW_COUNTER* value)
+{
+    Record(API_KERNEL, "PdhGetRawCounterValue", "%s", "");
+    if (!FindHandle(counter, HANDLE_PDH_COUNTER))
+        return ERROR_INVALID_HANDLE;
+    if (type) *type = 0;
+    memset(value, 0, sizeof(*value));
+    return ERROR_SUCCESS;
+}
+
+// Closing the query closes its counters
+PDH_STATUS PdhCloseQuery(PDH_HQUERY query)
+{
+    Record(API_KERNEL, "PdhCloseQuery", "%s", "");
+    if (!CloseFakeHandle(query, HANDLE_PDH_QUERY))
+        return ERROR_INVALID_HANDLE;
+    for (HandleSlot& slot : g_handles)
+    {
+        if (slot.kind == HANDLE_PDH_COUNTER)
+            slot.kind = HANDLE_FREE;
+    }
+    return ERROR_SUCCESS;
+}
+
+// One quiet physical adapter
+DWORD GetIfTable2(MIB_IF_TABLE2** table)
+{
+    Record(API_KERNEL, "GetIfTable2", "%s", "");
+    *table = (MIB_IF_TABLE2*)calloc(1, sizeof(MIB_IF_TABLE2));
+    if (!*table)
+        return 8; // ERROR_NOT_ENOUGH_MEMORY
+    (*table)->NumEntries = 1;
+    (*table)->Table[0].InterfaceAndOperStatusFlags.HardwareInterface = 1;
+    return NO_ERROR;
+}
+
+void FreeMibTable(PVOID memory)
+{
+    Record(API_KERNEL, "FreeMibTable", "%s", "");
+    free(memory);
+}
+
+// ===== Files =====
+// A few small in-memory files; enough for the plan cache and its temp file
+struct FakeFile
+{
+    bool used;
+    wchar_t path[MAX_PATH];
+    size_t size;
+    BYTE data[64 * 1024];
+};
+static FakeFile g_files[3];
+
+static FakeFile* FindFile(LPCWSTR path)
+{
+    for (FakeFile& file : g_files)
+    {
+        if (file.used && SameText(file.path, path))
+            return &file;
+    }
+    return nullptr;
+}
+
+HANDLE CreateFileW(LPCWSTR path, DWORD access, DWORD, SECURITY_ATTRIBUTES*, DWORD disposition, DWORD, HANDLE)
+{
+    Record(API_FILE, "CreateFileW", "%s %s", (access & GENERIC_WRITE) ? "write" : "read", Utf8(path));
+    FakeFile* file = FindFile(path);
+    if (disposition == CREATE_ALWAYS)
+    {
+        for (size_t i = 0; !file && i < ARRAYSIZE(g_files); ++i)
+        {
+            if (!g_files[i].used)
+            {
+                file = &g_files[i];
+                file->used = true;
+                CopyText(file->path, ARRAYSIZE(file->path), path);
+            }
+        }
+        if (file)
+            file->size = 0;
+    }
+    if (!file)
+    {
+        SetLastError(ERROR_FILE_NOT_FOUND);
+        return INVALID_HANDLE_VALUE;
+    }
+    HANDLE handle = OpenHandle(HANDLE_FILE, (size_t)(file - g_files));
+    return handle ? handle : INVALID_HANDLE_VALUE;
+}
+
+static bool CloseFile(HandleSlot* slot)
+{
+    slot->kind = HANDLE_FREE;
+    return true;
+}
+
+BOOL ReadFile(HANDLE handle, LPVOID buffer, DWORD bytes, LPDWORD read, LPOVERLAPPED)
+{
+    HandleSlot* slot = FindHandle(handle, HANDLE_FILE);
+    Record(API_FILE, "ReadFile", "%u bytes", bytes);
+    if (!slot)
+        return FALSE;
+    const FakeFile& file = g_files[slot->object];
+    const size_t left = file.size > slot->position ? file.size - slot->position : 0;
+    const size_t n = left < bytes ? left : bytes;
+    memcpy(buffer, file.data + slot->position, n);
+    slot->position += n;
+    if (read) *read = (DWORD)n;
+    return TRUE;
+}
+
+BOOL WriteFile(HANDLE handle, LPCVOID buffer, DWORD bytes, LPDWORD written, LPOVERLAPPED)
+{
+    if (handle == kStdOut || handle == kStdErr)
+    {
+        Record(API_FILE, "WriteFile", "%s %u bytes", handle == kStdOut ? "stdout" : "stderr", (unsigned)bytes);
+        PrintStd(handle, (const char*)buffer, bytes);
+        if (written) *written = bytes;
+        return TRUE;
+    }
+    HandleSlot* slot = FindHandle(handle, HANDLE_FILE);
+    Record(API_FILE, "WriteFile", "%u bytes", bytes);
+    if (!slot)
+        return FALSE;
+    FakeFile& file = g_files[slot->object];
+    if (slot->position + bytes > sizeof(file.data))
+    {
+        SetLastError(112); // ERROR_DISK_FULL
+        return FALSE;
+    }
+    memcpy(file.data + slot->position, buffer, bytes);
+    slot->position += bytes;
+    if (slot->position > file.size) file.size = slot->position;
+    if (written) *written = bytes;
+    return TRUE;
+}
+
+BOOL CreateDirectoryW(LPCWSTR path, SECURITY_ATTRIBUTES*)
+{
+    Record(API_FILE, "CreateDirectoryW", "%s", Utf8(path));
+    SetLastError(ERROR_ALREADY_EXISTS); // Directories are not modelled
+    return FALSE;
+}
+
+BOOL MoveFileExW(LPCWSTR from, LPCWSTR to, DWORD flags)
+{
+    Record(API_FILE, "MoveFileExW", "%s", Utf8(to));
+    FakeFile* src = FindFile(from);
+    FakeFile* dest = FindFile(to);
+    if (!src || (dest && !(flags & MOVEFILE_REPLACE_EXISTING)))
+        return FALSE;
+    if (dest)
+        dest->used = false;
+    CopyText(src->path, ARRAYSIZE(src->path), to);
+    return TRUE;
+}
+
+BOOL DeleteFileW(LPCWSTR path)
+{
+    Record(API_FILE, "DeleteFileW", "%s", Utf8(path));
+    FakeFile* file = FindFile(path);
+    if (!file)
+        return FALSE;
+    file->used = false;
+    return TRUE;
+}
+
+// ===== Processes =====
+struct FakeProcess
+{
+    bool used;
+    DWORD pid;
+    wchar_t image[MAX_PATH];
+    uint64_t createTime; // FILETIME
+};
+static FakeProcess g_processes[32];
+static DWORD g_nextPid = 1000;
+static DWORD g_foregroundPid = 0;
+
+static FakeProcess* FindProcess(DWORD pid)
+{
+    for (FakeProcess& p : g_processes)
+    {
+        if (p.used && p.pid == pid)
+            return &p;
+    }
+    return nullptr;
+}
+
+static FakeProcess* FindProcessByImage(const wchar_t* image)
+{
+    for (FakeProcess& p : g_processes)
+    {
+        if (p.used && (SameText(p.image, image) || SameText(BaseName(p.image), image)))
+            return &p;
+    }
+    return nullptr;
+}
+
+// A bare image name runs from a made-up install directory
+DWORD FakeStartProcess(const wchar_t* imagePath)
+{
+    for (FakeProcess& p : g_processes)
+    {
+        if (p.used)
+            continue;
+        p.used = true;
+        p.pid = g_nextPid += 4;
+        if (wcschr(imagePath, L'\\'))
+            CopyText(p.image, ARRAYSIZE(p.image), imagePath);
+        else
+            swprintf(p.image, ARRAYSIZE(p.image), L"C:\\Apps\\%ls", imagePath);
+        p.createTime = UnixNowMs() * 10000ULL + kUnixEpochAsFileTime;
+        return p.pid;
+    }
+    return 0;
+}
+
+bool FakeStopProcess(const wchar_t* imagePath)
+{
+    FakeProcess* p = FindProcessByImage(imagePath);
+    if (!p)
+        return false;
+    if (p->pid == g_foregroundPid)
+        g_foregroundPid = 0;
+    p->used = false;
+    return true;
+}
+
+// SystemProcessInformation records as ntdll lays them out, each followed by
+// its image's file name
+struct FakeProcessRecord
+{
+    ULONG nextEntryOffset;
+    ULONG numberOfThreads;
+    LONGLONG workingSetPrivateSize;
+    ULONG hardFaultCount;
+    ULONG numberOfThreadsHighWatermark;
+    ULONGLONG cycleTime;
+    LONGLONG createTime;
+    LONGLONG userTime;
+    LONGLONG kernelTime;
+    USHORT imageNameLength;
+    USHORT imageNameMaximumLength;
+    wchar_t* imageName;
+    LONG basePriority;
+    HANDLE uniqueProcessId;
+};
+
+static size_t FakeProcessRecordBytes(const FakeProcess& p)
+{
+    const size_t bytes = sizeof(FakeProcessRecord) + (wcslen(BaseName(p.image)) + 1) * sizeof(wchar_t);
+    return (bytes + 7) & ~(size_t)7;
+}
+
+static LONG WINAPI FakeNtQuerySystemInformation(int infoClass, void* buffer, ULONG bytes, ULONG* needed)
+{
+    Record(API_KERNEL, "NtQuerySystemInformation", "%d", infoClass);
+    if (infoClass != 5)
+        return (LONG)0xC0000003; // STATUS_INVALID_INFO_CLASS
+    // The idle process leads, with no name, as on Windows
+    size_t total = sizeof(FakeProcessRecord);
+    for (const FakeProcess& p : g_processes)
+    {
+        if (p.used)
+            total += FakeProcessRecordBytes(p);
+    }
+    if (needed)
+        *needed = (ULONG)total;
+    if (total > bytes)
+        return (LONG)0xC0000004; // STATUS_INFO_LENGTH_MISMATCH
+    memset(buffer, 0, total);
+    BYTE* at = static_cast<BYTE*>(buffer);
+    FakeProcessRecord* last = reinterpret_cast<FakeProcessRecord*>(at);
+    last->nextEntryOffset = sizeof(FakeProcessRecord);
+    at += sizeof(FakeProcessRecord);
+    for (const FakeProcess& p : g_processes)
+    {
+        if (!p.used)
+            continue;
+        FakeProcessRecord* r = reinterpret_cast<FakeProcessRecord*>(at);
+        const wchar_t* name = BaseName(p.image);
+        wchar_t* copy = reinterpret_cast<wchar_t*>(r + 1);
+        memcpy(copy, name, (wcslen(name) + 1) * sizeof(wchar_t));
+        r->imageName = copy;
+        r->imageNameLength = (USHORT)(wcslen(name) * sizeof(wchar_t));
+        r->imageNameMaximumLength = (USHORT)(r->imageNameLength + sizeof(wchar_t));
+        r->createTime = (LONGLONG)p.createTime;
+        r->uniqueProcessId = (HANDLE)(ULONG_PTR)p.pid;
+        r->nextEntryOffset = (ULONG)FakeProcessRecordBytes(p);
+        last = r;
+        at += r->nextEntryOffset;
+    }
+    last->nextEntryOffset = 0;
+    return 0;
+}
+
+HANDLE OpenProcess(DWORD, BOOL, DWORD pid)
+{
+    Record(API_KERNEL, "OpenProcess", "%u", pid);
+    FakeProcess* p = FindProcess(pid);
+    if (!p)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return nullptr;
+    }
+    return OpenHandle(HANDLE_PROCESS, (size_t)(p - g_processes));
+}
+
+BOOL QueryFullProcessImageNameW(HANDLE process, DWORD, LPWSTR path, DWORD* cch)
+{
+    HandleSlot* slot = FindHandle(process, HANDLE_PROCESS);
+    const FakeProcess* p = slot ? &g_processes[slot->object] : nullptr;
+    Record(API_KERNEL, "QueryFullProcessImageNameW", "%s", p && p->used ? Utf8(p->image) : "?");
+    if (!p || !p->used || wcslen(p->image) >= *cch)
+        return FALSE;
+    CopyText(path, *cch, p->image);
+    *cch = (DWORD)wcslen(path);
+    return TRUE;
+}
+
+// ===== Registry =====
+// HKEY_CURRENT_USER only. Keys are full paths; values live in one flat table.
+struct FakeKey
+{
+    bool used;
+    wchar_t path[128];
+};
+struct FakeValue
+{
+    bool used;
+    size_t key;
+    wchar_t name[64];
+    DWORD type;
+    DWORD size;
+    BYTE data[2048];
+};
+static FakeKey g_keys[32];
+static FakeValue g_values[96];
+
+static size_t FindKey(const wchar_t* path)
+{
+    for (size_t i = 0; i < ARRAYSIZE(g_keys); ++i)
+    {
+        if (g_keys[i].used && SameText(g_keys[i].path, path))
+            return i;
+    }
+    return SIZE_MAX;
+}
+
+static size_t CreateKey(const wchar_t* path)
+{
+    size_t i = FindKey(path);
+    for (size_t k = 0; i == SIZE_MAX && k < ARRAYSIZE(g_keys); ++k)
+    {
+        if (!g_keys[k].used)
+        {
+            g_keys[k].used = true;
+            CopyText(g_keys[k].path, ARRAYSIZE(g_keys[k].path), path);
+            i = k;
+        }
+    }
+    return i;
+}
+
+// Full path of hKey\subKey, or false for a handle that is not a key
+static bool KeyPath(HKEY key, LPCWSTR subKey, wchar_t* path, size_t cch)
+{
+    path[0] = L'\0';
+    if (key != HKEY_CURRENT_USER)
+    {
+        HandleSlot* slot = FindHandle(key, HANDLE_KEY);
+        if (!slot)
+            return false;
+        CopyText(path, cch, g_keys[slot->object].path);
+    }
+    if (subKey && *subKey)
+    {
+        if (path[0])
+            StringCchCatW(path, cch, L"\\");
+        StringCchCatW(path, cch, subKey);
+    }
+    return true;
+}
+
+static FakeValue* FindValue(size_t key, const wchar_t* name)
+{
+    for (FakeValue& v : g_values)
+    {
+        if (v.used && v.key == key && SameText(v.name, name ? name : L""))
+            return &v;
+    }
+    return nullptr;
+}
+
+static LSTATUS SetValue(size_t key, const wchar_t* name, DWORD type, const void* data, DWORD bytes)
+{
+    FakeValue* value = FindValue(key, name);
+    for (size_t i = 0; !value && i < ARRAYSIZE(g_values); ++i)
+    {
+        if (!g_values[i].used)
+        {
+            value = &g_values[i];
+            value->used = true;
+            value->key = key;
+            CopyText(value->name, ARRAYSIZE(value->name), name ? name : L"");
+        }
+    }
+    if (!value || bytes > sizeof(value->data))
+        return 1450; // ERROR_NO_SYSTEM_RESOURCES
+    value->type = type;
+    value->size = bytes;
+    memcpy(value->data, data, bytes);
+    return ERROR_SUCCESS;
+}
+
+bool FakeRegSet(const wchar_t* key, const wchar_t* name, DWORD type, const void* data, DWORD bytes)
+{
+    const size_t k = CreateKey(key);
+    return k != SIZE_MAX && SetValue(k, name, type, data, bytes) == ERROR_SUCCESS;
+}
+
+LSTATUS RegOpenKeyExW(HKEY key, LPCWSTR subKey, DWORD, DWORD, HKEY* result)
+{
+    wchar_t path[256];
+    const bool valid = KeyPath(key, subKey, path, ARRAYSIZE(path));
+    Record(API_REGISTRY, "RegOpenKeyExW", "%s", Utf8(path));
+    const size_t k = valid ? FindKey(path) : SIZE_MAX;
+    if (k == SIZE_MAX)
+        return ERROR_FILE_NOT_FOUND;
+    *result = (HKEY)OpenHandle(HANDLE_KEY, k);
+    return *result ? ERROR_SUCCESS : ERROR_INVALID_HANDLE;
+}
+
+LSTATUS RegCreateKeyExW(HKEY key, LPCWSTR subKey, DWORD, LPWSTR, DWORD, DWORD, SECURITY_ATTRIBUTES*, HKEY* result, LPDWORD disposition)
+{
+    wchar_t path[256];
+    const bool valid = KeyPath(key, subKey, path, ARRAYSIZE(path));
+    Record(API_REGISTRY, "RegCreateKeyExW", "%s", Utf8(path));
+    const bool existed = valid && FindKey(path) != SIZE_MAX;
+    const size_t k = valid ? CreateKey(path) : SIZE_MAX;
+    if (k == SIZE_MAX)
+        return ERROR_FILE_NOT_FOUND;
+    if (disposition) *disposition = existed ? 2 : 1; // REG_OPENED_EXISTING_KEY : REG_CREATED_NEW_KEY
+    *result = (HKEY)OpenHandle(HANDLE_KEY, k);
+    return *result ? ERROR_SUCCESS : ERROR_INVALID_HANDLE;
+}
+
+LSTATUS RegCloseKey(HKEY key)
+{
+    Record(API_REGISTRY, "RegCloseKey", "%s", "");
+    return CloseFakeHandle(key, HANDLE_KEY) ? ERROR_SUCCESS : ERROR_INVALID_HANDLE;
+}
+
+static DWORD TypeFlag(DWORD type)
+{
+    switch (type)
+    {
+    case REG_SZ: return RRF_RT_REG_SZ;
+    case REG_BINARY: return RRF_RT_REG_BINARY;
+    case REG_DWORD: return RRF_RT_REG_DWORD;
+    case REG_QWORD: return RRF_RT_REG_QWORD;
+    default: return 0;
+    }
+}
+
+LSTATUS RegGetValueW(HKEY key, LPCWSTR subKey, LPCWSTR value, DWORD flags, LPDWORD type, PVOID data, LPDWORD bytes)
+{
+    wchar_t path[256];
+    const bool valid = KeyPath(key, subKey, path, ARRAYSIZE(path));
+    Record(API_REGISTRY, "RegGetValueW", "%s\\%s", Utf8(path), Utf8(value));
+    const size_t k = valid ? FindKey(path) : SIZE_MAX;
+    const FakeValue* v = k != SIZE_MAX ? FindValue(k, value) : nullptr;
+    if (!v)
+        return ERROR_FILE_NOT_FOUND;
+    if (!(TypeFlag(v->type) & flags))
+        return ERROR_UNSUPPORTED_TYPE;
+    if (type) *type = v->type;
+    if (!bytes)
+        return data ? ERROR_INVALID_PARAMETER : ERROR_SUCCESS;
+    if (data && *bytes < v->size)
+    {
+        *bytes = v->size;
+        return ERROR_MORE_DATA;
+    }
+    if (data)
+        memcpy(data, v->data, v->size);
+    *bytes = v->size;
+    return ERROR_SUCCESS;
+}
+
+LSTATUS RegSetValueExW(HKEY key, LPCWSTR value, DWORD, DWORD type, const BYTE* data, DWORD bytes)
+{
+    Record(API_REGISTRY, "RegSetValueExW", "%s (%u bytes)", Utf8(value), bytes);
+    HandleSlot* slot = FindHandle(key, HANDLE_KEY);
+    if (!slot)
+        return ERROR_INVALID_HANDLE;
+    return SetValue(slot->object, value, type, data, bytes);
+}
+
+LSTATUS RegDeleteValueW(HKEY key, LPCWSTR value)
+{
+    Record(API_REGISTRY, "RegDeleteValueW", "%s", Utf8(value));
+    HandleSlot* slot = FindHandle(key, HANDLE_KEY);
+    if (!slot)
+        return ERROR_INVALID_HANDLE;
+    FakeValue* v = FindValue(slot->object, value);
+    if (!v)
+        return ERROR_FILE_NOT_FOUND;
+    v->used = false;
+    return ERROR_SUCCESS;
+}
+
+LSTATUS RegEnumValueW(HKEY key, DWORD index, LPWSTR name, LPDWORD nameCch, LPDWORD, LPDWORD type, LPBYTE data, LPDWORD bytes)
+{
+    Record(API_REGISTRY, "RegEnumValueW", "#%u", index);
+    HandleSlot* slot = FindHandle(key, HANDLE_KEY);
+    if (!slot)
+        return ERROR_INVALID_HANDLE;
+    DWORD seen = 0;
+    for (const FakeValue& v : g_values)
+    {
+        if (!v.used || v.key != slot->object || seen++ != index)
+            continue;
+        const DWORD len = (DWORD)wcslen(v.name);
+        if (len >= *nameCch || (data && bytes && *bytes < v.size))
+            return ERROR_MORE_DATA;
+        CopyText(name, *nameCch, v.name);
+        *nameCch = len;
+        if (type) *type = v.type;
+        if (data && bytes) memcpy(data, v.data, v.size);
+        if (bytes) *bytes = v.size;
+        return ERROR_SUCCESS;
+    }
+    return ERROR_NO_MORE_ITEMS;
+}
+
+// ===== Power schemes =====
+struct FakePlan
+{
+    GUID guid;
+    GUID personality;
+    wchar_t name[128];
+};
+static FakePlan g_plans[16];
+static size_t g_planCount = 0;
+static size_t g_activePlan = 0;
+
+// Power settings the app can subscribe to; the value is what a broadcast carries
+struct PowerSettingState
+{
+    const GUID* setting;
+    DWORD value;
+    size_t registrations;
+    alignas(POWERBROADCAST_SETTING) BYTE broadcast[sizeof(POWERBROADCAST_SETTING) + sizeof(GUID)];
+};
+static PowerSettingState g_powerSettings[] = {
+    { &GUID_POWERSCHEME_PERSONALITY, 0, 0, {} },
+    { &GUID_ACDC_POWER_SOURCE, 0, 0, {} },
+    { &GUID_BATTERY_PERCENTAGE_REMAINING, 100, 0, {} },
+    { &GUID_ENERGY_SAVER_STATUS, 0, 0, {} },
+};
+
+static const char* PlanText(const GUID& guid)
+{
+    if (const wchar_t* name = FakePlanName(guid))
+        return Utf8(name);
+    static char buffers[2][40];
+    static size_t next = 0;
+    char* out = buffers[next++ % ARRAYSIZE(buffers)];
+    snprintf(out, sizeof(buffers[0]), "{%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x}",
+        guid.Data1, guid.Data2, guid.Data3, guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
+        guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7]);
+    return out;
+}
+
+static size_t FindPlan(const GUID& guid)
+{
+    for (size_t i = 0; i < g_planCount; ++i)
+    {
+        if (IsEqualGUID(g_plans[i].guid, guid))
+            return i;
+    }
+    return SIZE_MAX;
+}
+
+bool FakeAddPlan(const GUID& guid, const wchar_t* name, const GUID& personality)
+{
+    if (g_planCount == ARRAYSIZE(g_plans) || FindPlan(guid) != SIZE_MAX)
+        return false;
+    FakePlan& plan = g_plans[g_planCount++];
+    plan.guid = guid;
+    plan.personality = personality;
+    CopyText(plan.name, ARRAYSIZE(plan.name), name);
+    return true;
+}
+
+bool FakeFindPlan(const wchar_t* name, GUID& out)
+{
+    for (size_t i = 0; i < g_planCount; ++i)
+    {
+        if (SameText(g_plans[i].name, name))
+        {
+            out = g_plans[i].guid;
+            return true;
+        }
+    }
+    return false;
+}
+
+const wchar_t* FakePlanName(const GUID& guid)
+{
+    const size_t i = FindPlan(guid);
+    return i == SIZE_MAX ? nullptr : g_plans[i].name;
+}
+
+const GUID& FakeActivePlan()
+{
+    static const GUID kNone{};
+    return g_planCount ? g_plans[g_activePlan].guid : kNone;
+}
+
+static void Broadcast(PowerSettingState& state, const void* data, DWORD size);
+static PowerSettingState* FindPowerSetting(const GUID& setting);
+
+// Windows broadcasts the personality when a switch changes it, whoever switched
+static void ActivatePlan(size_t index)
+{
+    const GUID before = g_plans[g_activePlan].personality;
+    g_activePlan = index;
+    const GUID& after = g_plans[index].personality;
+    PowerSettingState* state = FindPowerSetting(GUID_POWERSCHEME_PERSONALITY);
+    if (!IsEqualGUID(before, after) && state->registrations)
+        Broadcast(*state, &after, sizeof(after));
+}
+
+static bool g_plansLocked = false;
+
+void FakeLockPlans(bool locked)
+{
+    g_plansLocked = locked;
+}
+
+bool FakeSwitchPlan(const GUID& guid)
+{
+    const size_t i = FindPlan(guid);
+    if (i == SIZE_MAX)
+        return false;
+    ActivatePlan(i);
+    return true;
+}
+
+DWORD PowerEnumerate(HKEY, const GUID*, const GUID*, POWER_DATA_ACCESSOR, ULONG index, UCHAR* buffer, DWORD* bufferSize)
+{
+    Record(API_POWRPROF, "PowerEnumerate", "#%u", index);
+    if (index >= g_planCount)
+        return ERROR_NO_MORE_ITEMS;
+    if (!buffer || *bufferSize < sizeof(GUID))
+    {
+        *bufferSize = sizeof(GUID);
+        return buffer ? ERROR_MORE_DATA : ERROR_SUCCESS;
+    }
+    memcpy(buffer, &g_plans[index].guid, sizeof(GUID));
+    *bufferSize = sizeof(GUID);
+    return ERROR_SUCCESS;
+}
+
+DWORD PowerReadFriendlyName(HKEY, const GUID* schemeGuid, const GUID*, const GUID*, UCHAR* buffer, DWORD* bufferSize)
+{
+    Record(API_POWRPROF, "PowerReadFriendlyName", "%s", PlanText(*schemeGuid));
+    const size_t i = FindPlan(*schemeGuid);
+    if (i == SIZE_MAX)
+        return ERROR_FILE_NOT_FOUND;
+    const DWORD size = (DWORD)((wcslen(g_plans[i].name) + 1) * sizeof(wchar_t));
+    if (!buffer || *bufferSize < size)
+    {
+        *bufferSize = size;
+        return buffer ? ERROR_MORE_DATA : ERROR_SUCCESS;
+    }
+    memcpy(buffer, g_plans[i].name, size);
+    *bufferSize = size;
+    return ERROR_SUCCESS;
+}
+
+DWORD PowerGetActiveScheme(HKEY, GUID** activePolicyGuid)
+{
+    Record(API_POWRPROF, "PowerGetActiveScheme", "%s", g_planCount ? PlanText(g_plans[g_activePlan].guid) : "none");
+    if (!g_planCount)
+        return ERROR_FILE_NOT_FOUND;
+    // The caller frees it with LocalFree, which the shim records separately
+    *activePolicyGuid = (GUID*)malloc(sizeof(GUID));
+    if (!*activePolicyGuid)
+        return 8; // ERROR_NOT_ENOUGH_MEMORY
+    **activePolicyGuid = g_plans[g_activePlan].guid;
+    return ERROR_SUCCESS;
+}
+
+DWORD PowerSetActiveScheme(HKEY, const GUID* schemeGuid)
+{
+    Record(API_POWRPROF, "PowerSetActiveScheme", "%s", PlanText(*schemeGuid));
+    const size_t i = FindPlan(*schemeGuid);
+    if (i == SIZE_MAX)
+        return ERROR_INVALID_PARAMETER;
+    if (g_plansLocked)
+        return ERROR_ACCESS_DENIED;
+    ActivatePlan(i);
+    return ERROR_SUCCESS;
+}
+
+NTSTATUS CallNtPowerInformation(POWER_INFORMATION_LEVEL level, PVOID, ULONG, PVOID output, ULONG outputLength)
+{
+    Record(API_POWRPROF, "CallNtPowerInformation", "level %d", (int)level);
+    if (level != SystemExecutionState || outputLength < sizeof(ULONG))
+        return (NTSTATUS)0xC000000DL; // STATUS_INVALID_PARAMETER
+    const ULONG state = 0; // Nobody is holding the system or display awake
+    memcpy(output, &state, sizeof(state));
+    return 0;
+}
+
+// ===== Windows and the message queue =====
+static WNDPROC g_windowProc = nullptr;
+static wchar_t g_className[64];
+static HWND const kWindow = (HWND)0x20000;
+static bool g_windowAlive = false;
+static FakeScript* g_script = nullptr;
+static MSG g_queue[256];
+static size_t g_queueHead = 0, g_queueCount = 0;
+// Everything else is the main thread's; the queue also takes posts from the
+// app's worker threads, which are not recorded since the log is not theirs
+static std::mutex g_queueLock;
+static const std::thread::id g_mainThread = std::this_thread::get_id();
+static bool g_quit = false;
+static int g_quitCode = 0;
+static LONG g_messageTime = 0;
+static wchar_t g_registeredMessages[8][64];
+static const UINT kWinEventMessage = 0x7FFF; // Private: an out-of-context WinEvent, hwnd null
+
+struct FakeTimer
+{
+    bool used;
+    UINT_PTR id;
+    UINT periodMs;
+    uint64_t dueMs;
+};
+static FakeTimer g_timers[32];
+
+void FakeSetScript(FakeScript* script) { g_script = script; }
+void FakeSetCallSink(void (*sink)(const FakeCall& call)) { g_callSink = sink; }
+
+static bool Enqueue(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    std::lock_guard<std::mutex> guard(g_queueLock);
+    if (g_queueCount == ARRAYSIZE(g_queue))
+        return false;
+    MSG& msg = g_queue[(g_queueHead + g_queueCount++) % ARRAYSIZE(g_queue)];
+    msg = { hWnd, message, wParam, lParam, (DWORD)g_tickMs, { 0, 0 } };
+    return true;
+}
+
+ATOM RegisterClassExW(const WNDCLASSEXW* wc)
+{
+    Record(API_USER, "RegisterClassExW", "%s", Utf8(wc->lpszClassName));
+    if (g_windowProc)
+        return 0; // One class is all the app registers
+    g_windowProc = wc->lpfnWndProc;
+    CopyText(g_className, ARRAYSIZE(g_className), wc->lpszClassName);
+    return 0xC100;
+}
+
+HWND CreateWindowExW(DWORD, LPCWSTR className, LPCWSTR title, DWORD, int, int, int, int, HWND, HMENU, HINSTANCE, LPVOID)
+{
+    Record(API_USER, "CreateWindowExW", "%s", Utf8(title));
+    if (!g_windowProc || g_windowAlive || !SameText(className, g_className))
+        return nullptr;
+    g_windowAlive = true;
+    if (g_windowProc(kWindow, WM_CREATE, 0, 0) == -1)
+    {
+        g_windowAlive = false;
+        return nullptr;
+    }
+    return kWindow;
+}
+
+BOOL DestroyWindow(HWND hWnd)
+{
+    Record(API_USER, "DestroyWindow", "%s", "");
+    if (hWnd != kWindow || !g_windowAlive)
+        return FALSE;
+    g_windowProc(kWindow, WM_DESTROY, 0, 0);
+    g_windowAlive = false;
+    for (FakeTimer& timer : g_timers)
+        timer.used = false;
+    return TRUE;
+}
+
+UINT RegisterWindowMessageW(LPCWSTR name)
+{
+    Record(API_USER, "RegisterWindowMessageW", "%s", Utf8(name));
+    for (size_t i = 0; i < ARRAYSIZE(g_registeredMessages); ++i)
+    {
+        if (!g_registeredMessages[i][0])
+            CopyText(g_registeredMessages[i], ARRAYSIZE(g_registeredMessages[i]), name);
+        if (SameText(g_registeredMessages[i], name))
+            return 0xC000 + (UINT)i;
+    }
+    return 0;
+}
+
+static FakeTimer* NextTimer()
+{
+    FakeTimer* next = nullptr;
+    for (FakeTimer& timer : g_timers)
+    {
+        if (timer.used && (!next || timer.dueMs < next->dueMs))
+            next = &timer;
+    }
+    return next;
+}
+
+// Posted messages first; once the queue is empty, whichever is due first of
+// the next timer and the script's next event. The clock jumps straight to it.
+BOOL GetMessageW(MSG* msg, HWND, UINT, UINT)
+{
+    Record(API_MESSAGE, "GetMessageW", "%s", "");
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> guard(g_queueLock);
+            if (g_queueCount)
+            {
+                *msg = g_queue[g_queueHead];
+                g_queueHead = (g_queueHead + 1) % ARRAYSIZE(g_queue);
+                --g_queueCount;
+                return TRUE;
+            }
+        }
+        if (g_quit)
+            break;
+        FakeTimer* timer = g_windowAlive ? NextTimer() : nullptr;
+        uint64_t eventMs = 0;
+        const bool event = g_script && g_script->NextEventMs(eventMs);
+        if (event && (!timer || eventMs <= timer->dueMs))
+        {
+            if (eventMs > g_tickMs) g_tickMs = eventMs;
+            g_script->RunEvent();
+            continue;
+        }
+        if (!timer)
+            break; // Nothing will ever happen again
+        if (timer->dueMs > g_tickMs) g_tickMs = timer->dueMs;
+        timer->dueMs = g_tickMs + timer->periodMs;
+        *msg = { kWindow, WM_TIMER, timer->id, 0, (DWORD)g_tickMs, { 0, 0 } };
+        return TRUE;
+    }
+    *msg = { nullptr, 0x0012 /* WM_QUIT */, (WPARAM)g_quitCode, 0, (DWORD)g_tickMs, { 0, 0 } };
+    return FALSE;
+}
+
+BOOL TranslateMessage(const MSG*)
+{
+    Record(API_MESSAGE, "TranslateMessage", "%s", "");
+    return FALSE;
+}
+
+static WINEVENTPROC g_winEventProc = nullptr;
+static HWND ForegroundWindowOf(DWORD pid) { return (HWND)(uintptr_t)(0x30000 + pid); }
+
+LRESULT DispatchMessageW(const MSG* msg)
+{
+    Record(API_MESSAGE, "DispatchMessageW", "0x%04x", msg->message);
+    g_messageTime = (LONG)msg->time;
+    if (!msg->hwnd && msg->message == kWinEventMessage)
+    {
+        if (g_winEventProc)
+            g_winEventProc((HWINEVENTHOOK)nullptr, EVENT_SYSTEM_FOREGROUND, (HWND)msg->lParam, 0, 0, 0, msg->time);
+        return 0;
+    }
+    if (msg->hwnd != kWindow || !g_windowAlive)
+        return 0;
+    return g_windowProc(msg->hwnd, msg->message, msg->wParam, msg->lParam);
+}
+
+BOOL PostMessageW(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    if (std::this_thread::get_id() == g_mainThread)
+        Record(API_USER, "PostMessageW", "0x%04x %zu", message, (size_t)wParam);
+    return hWnd == kWindow && g_windowAlive && Enqueue(hWnd, message, wParam, lParam);
+}
+
+LRESULT SendMessageW(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    Record(API_USER, "SendMessageW", "0x%04x", message);
+    if (hWnd != kWindow || !g_windowAlive)
+        return 0;
+    return g_windowProc(hWnd, message, wParam, lParam);
+}
+
+// The window of another instance, as the script plays it: whatever the app
+// sends it by WM_COPYDATA is kept for the script to read
+static HWND const kPeerWindow = (HWND)0x20001;
+static unsigned char g_peerReply[32768];
+static DWORD g_peerReplyBytes = 0;
+static ULONG_PTR g_peerReplyTag = 0;
+static bool g_peerAnswered = false;
+
+LRESULT SendMessageTimeoutW(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam, UINT, UINT timeoutMs,
+    DWORD_PTR* result)
+{
+    Record(API_USER, "SendMessageTimeoutW", "0x%04x %u ms", message, timeoutMs);
+    LRESULT answer = 0;
+    if (hWnd == kPeerWindow && message == WM_COPYDATA)
+    {
+        const COPYDATASTRUCT* data = reinterpret_cast<const COPYDATASTRUCT*>(lParam);
+        g_peerAnswered = data->cbData <= sizeof(g_peerReply);
+        if (g_peerAnswered)
+        {
+            memcpy(g_peerReply, data->lpData, data->cbData);
+            g_peerReplyBytes = data->cbData;
+            g_peerReplyTag = data->dwData;
+        }
+        answer = TRUE;
+    }
+    else if (hWnd == kWindow && g_windowAlive)
+    {
+        answer = g_windowProc(hWnd, message, wParam, lParam);
+    }
+    else
+    {
+        g_lastError = 1400; // ERROR_INVALID_WINDOW_HANDLE
+        return 0;
+    }
+    if (result) *result = (DWORD_PTR)answer;
+    return TRUE;
+}
+
+HWND FindWindowW(LPCWSTR className, LPCWSTR)
+{
+    Record(API_USER, "FindWindowW", "%s", Utf8(className));
+    return g_windowAlive && SameText(className, g_className) ? kWindow : nullptr;
+}
+
+bool FakeCopyData(ULONG_PTR tag, const void* data, DWORD bytes, DWORD_PTR& result)
+{
+    if (!g_windowAlive)
+        return false;
+    g_peerAnswered = false;
+    COPYDATASTRUCT copy = { tag, bytes, const_cast<void*>(data) };
+    result = (DWORD_PTR)g_windowProc(kWindow, WM_COPYDATA, reinterpret_cast<WPARAM>(kPeerWindow),
+        reinterpret_cast<LPARAM>(&copy));
+    return true;
+}
+
+const void* FakeCopyDataReply(ULONG_PTR& tag, DWORD& bytes)
+{
+    if (!g_peerAnswered)
+        return nullptr;
+    tag = g_peerReplyTag;
+    bytes = g_peerReplyBytes;
+    return g_peerReply;
+}
+
+LRESULT DefWindowProcW(HWND hWnd, UINT message, WPARAM, LPARAM)
+{
+    Record(API_MESSAGE, "DefWindowProcW", "0x%04x", message);
+    if (message == WM_CLOSE)
+        DestroyWindow(hWnd);
+    return 0;
+}
+
+void PostQuitMessage(int exitCode)
+{
+    Record(API_USER, "PostQuitMessage", "%d", exitCode);
+    g_quit = true;
+    g_quitCode = exitCode;
+}
+
+LONG GetMessageTime()
+{
+    Record(API_MESSAGE, "GetMessageTime", "%s", "");
+    return g_messageTime;
+}
+
+UINT_PTR SetTimer(HWND hWnd, UINT_PTR id, UINT elapseMs, TIMERPROC)
+{
+    Record(API_USER, "SetTimer", "#%zu %u ms", (size_t)id, elapseMs);
+    if (hWnd != kWindow || !g_windowAlive)
+        return 0;
+    if (elapseMs < 10) elapseMs = 10; // USER_TIMER_MINIMUM
+    FakeTimer* slot = nullptr;
+    for (FakeTimer& timer : g_timers)
+    {
+        if (timer.used && timer.id == id) { slot = &timer; break; }
+        if (!timer.used && !slot) slot = &timer;
+    }
+    if (!slot)
+        return 0;
+    *slot = { true, id, elapseMs, g_tickMs + elapseMs };
+    return id;
+}
+
+BOOL KillTimer(HWND, UINT_PTR id)
+{
+    Record(API_USER, "KillTimer", "#%zu", (size_t)id);
+    for (FakeTimer& timer : g_timers)
+    {
+        if (timer.used && timer.id == id)
+        {
+            timer.used = false;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static wchar_t g_lastMessageBox[2048];
+
+int MessageBoxW(HWND, LPCWSTR text, LPCWSTR caption, UINT)
+{
+    Record(API_USER, "MessageBoxW", "%s", Utf8(caption));
+    CopyText(g_lastMessageBox, ARRAYSIZE(g_lastMessageBox), text);
+    return IDOK;
+}
+
+const wchar_t* FakeLastMessageBox() { return g_lastMessageBox; }
+
+HWND GetForegroundWindow()
+{
+    Record(API_USER, "GetForegroundWindow", "%s", "");
+    return g_foregroundPid ? ForegroundWindowOf(g_foregroundPid) : nullptr;
+}
+
+BOOL SetForegroundWindow(HWND)
+{
+    Record(API_USER, "SetForegroundWindow", "%s", "");
+    return TRUE;
+}
+
+DWORD GetWindowThreadProcessId(HWND hWnd, LPDWORD pid)
+{
+    Record(API_USER, "GetWindowThreadProcessId", "%s", "");
+    const uintptr_t value = (uintptr_t)hWnd;
+    const DWORD owner = value > 0x30000 && FindProcess((DWORD)(value - 0x30000)) ? (DWORD)(value - 0x30000) : 0;
+    if (pid) *pid = owner;
+    return owner ? 1 : 0;
+}
+
+BOOL GetCursorPos(POINT* pt)
+{
+    Record(API_USER, "GetCursorPos", "%s", "");
+    pt->x = 1800;
+    pt->y = 1060;
+    return TRUE;
+}
+
+// ===== Resources =====
+struct FakeString
+{
+    UINT id;
+    wchar_t text[96];
+};
+static FakeString g_strings[128];
+static size_t g_stringCount = 0;
+static size_t g_liveIcons = 0;
+static uintptr_t g_nextIcon = 0x60000;
+
+HICON LoadIconW(HINSTANCE, LPCWSTR name)
+{
+    Record(API_USER, "LoadIconW", "%u", (unsigned)(uintptr_t)name);
+    return (HICON)(0x50000 + (uintptr_t)name); // Shared: never destroyed
+}
+
+HCURSOR LoadCursorW(HINSTANCE, LPCWSTR name)
+{
+    Record(API_USER, "LoadCursorW", "%u", (unsigned)(uintptr_t)name);
+    return (HCURSOR)(0x50000 + (uintptr_t)name);
+}
+
+HANDLE LoadImageW(HINSTANCE, LPCWSTR name, UINT, int cx, int cy, UINT)
+{
+    Record(API_USER, "LoadImageW", "%u %dx%d", (unsigned)(uintptr_t)name, cx, cy);
+    ++g_liveIcons;
+    return (HANDLE)(g_nextIcon += 4);
+}
+
+BOOL DestroyIcon(HICON icon)
+{
+    Record(API_USER, "DestroyIcon", "%s", "");
+    if ((uintptr_t)icon <= 0x60000 || !g_liveIcons)
+        return FALSE;
+    --g_liveIcons;
+    return TRUE;
+}
+
+size_t FakeLiveIcons() { return g_liveIcons; }
+
+int LoadStringW(HINSTANCE, UINT id, LPWSTR buffer, int cch)
+{
+    Record(API_USER, "LoadStringW", "%u", id);
+    for (size_t i = 0; i < g_stringCount; ++i)
+    {
+        if (g_strings[i].id == id && cch > 0)
+        {
+            CopyText(buffer, (size_t)cch, g_strings[i].text);
+            return (int)wcslen(buffer);
+        }
+    }
+    return 0;
+}
+
+int GetSystemMetrics(int index)
+{
+    Record(API_USER, "GetSystemMetrics", "%d", index);
+    return index == SM_CXSMICON || index == SM_CYSMICON ? 16 : 0; // At the system DPI
+}
+
+static char* ReadText(const char* path)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return nullptr;
+    fseek(f, 0, SEEK_END);
+    const long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* text = size >= 0 ? (char*)malloc((size_t)size + 1) : nullptr;
+    if (text)
+        text[fread(text, 1, (size_t)size, f)] = '\0';
+    fclose(f);
+    return text;
+}
+
+// "#define IDS_X 2001" lines give the ids, then each "IDS_X "text"" line in
+// the string tables; the first table to name an id wins, which is English
+bool FakeLoadStrings(const char* resourceHeaderPath, const char* stringsRcPath)
+{
+    char* header = ReadText(resourceHeaderPath);
+    char* rc = ReadText(stringsRcPath);
+    bool ok = header && rc;
+    for (char* line = rc; ok && line && *line;)
+    {
+        char* next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        char name[64];
+        const char* quote = strchr(line, '"');
+        if (quote && sscanf(line, " %63[A-Za-z0-9_]", name) == 1 && strncmp(name, "IDS_", 4) == 0)
+        {
+            // Look the id up in the header
+            char pattern[80];
+            snprintf(pattern, sizeof(pattern), "#define %s", name);
+            const char* def = strstr(header, pattern);
+            const size_t len = strlen(pattern);
+            unsigned id = 0;
+            if (def && (def[len] == ' ' || def[len] == '\t') && sscanf(def + len, "%u", &id) == 1 &&
+                g_stringCount < ARRAYSIZE(g_strings))
+            {
+                bool known = false;
+                for (size_t i = 0; i < g_stringCount; ++i) known |= g_strings[i].id == id;
+                if (!known)
+                {
+                    FakeString& s = g_strings[g_stringCount++];
+                    s.id = id;
+                    // UTF-8 between the quotes; "" is a literal quote
+                    size_t n = 0;
+                    for (const unsigned char* p = (const unsigned char*)quote + 1; *p && n + 1 < ARRAYSIZE(s.text); ++p)
+                    {
+                        uint32_t c = *p;
+                        if (c == '"')
+                        {
+                            if (p[1] != '"') break;
+                            ++p;
+                        }
+                        else if (c >= 0xE0 && p[1] && p[2]) { c = ((c & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F); p += 2; }
+                        else if (c >= 0xC0 && p[1]) { c = ((c & 0x1F) << 6) | (p[1] & 0x3F); ++p; }
+                        s.text[n++] = (wchar_t)c;
+                    }
+                    s.text[n] = L'\0';
+                }
+            }
+        }
+        line = next;
+    }
+    free(header);
+    free(rc);
+    return ok && g_stringCount > 0;
+}
+
+// ===== Menus =====
+struct FakeMenuItem
+{
+    UINT flags;
+    UINT_PTR id; // The submenu for MF_POPUP
+    wchar_t text[64];
+};
+struct FakeMenu
+{
+    bool used;
+    size_t count;
+    FakeMenuItem items[80];
+};
+static FakeMenu g_menus[40];
+static const uintptr_t kMenuBase = 0x40000;
+static wchar_t g_menuChoice[256];
+static bool g_menuChoiceSet = false;
+static bool g_menuChoiceFound = false;
+
+static FakeMenu* FindMenu(HMENU menu)
+{
+    const uintptr_t value = (uintptr_t)menu;
+    if (value < kMenuBase || value >= kMenuBase + ARRAYSIZE(g_menus))
+        return nullptr;
+    FakeMenu* m = &g_menus[value - kMenuBase];
+    return m->used ? m : nullptr;
+}
+
+HMENU CreatePopupMenu()
+{
+    Record(API_USER, "CreatePopupMenu", "%s", "");
+    for (size_t i = 0; i < ARRAYSIZE(g_menus); ++i)
+    {
+        if (!g_menus[i].used)
+        {
+            g_menus[i].used = true;
+            g_menus[i].count = 0;
+            return (HMENU)(kMenuBase + i);
+        }
+    }
+    return nullptr;
+}
+
+BOOL AppendMenuW(HMENU menu, UINT flags, UINT_PTR id, LPCWSTR text)
+{
+    Record(API_USER, "AppendMenuW", "%s", (flags & MF_SEPARATOR) ? "-" : Utf8(text));
+    FakeMenu* m = FindMenu(menu);
+    if (!m || m->count == ARRAYSIZE(m->items))
+        return FALSE;
+    FakeMenuItem& item = m->items[m->count++];
+    item.flags = flags;
+    item.id = id;
+    CopyText(item.text, ARRAYSIZE(item.text), (flags & MF_SEPARATOR) ? nullptr : text);
+    return TRUE;
+}
+
+// A submenu attached with MF_POPUP goes with its parent
+BOOL DestroyMenu(HMENU menu)
+{
+    Record(API_USER, "DestroyMenu", "%s", "");
+    FakeMenu* m = FindMenu(menu);
+    if (!m)
+        return FALSE;
+    m->used = false;
+    for (size_t i = 0; i < m->count; ++i)
+    {
+        if (m->items[i].flags & MF_POPUP)
+        {
+            FakeMenu* sub = FindMenu((HMENU)m->items[i].id);
+            if (sub) DestroyMenu((HMENU)m->items[i].id);
+        }
+    }
+    return TRUE;
+}
+
+size_t FakeLiveMenus()
+{
+    size_t n = 0;
+    for (const FakeMenu& m : g_menus)
+        n += m.used;
+    return n;
+}
+
+// Command id of the enabled item at "Submenu/Item", or 0
+static UINT_PTR ResolveChoice(HMENU menu, const wchar_t* path)
+{
+    const FakeMenu* m = FindMenu(menu);
+    const wchar_t* slash = wcschr(path, L'/');
+    const size_t len = slash ? (size_t)(slash - path) : wcslen(path);
+    for (size_t i = 0; m && i < m->count; ++i)
+    {
+        const FakeMenuItem& item = m->items[i];
+        if ((item.flags & (MF_SEPARATOR | MF_GRAYED)) || wcslen(item.text) != len || wcsncmp(item.text, path, len) != 0)
+            continue;
+        if (item.flags & MF_POPUP)
+            return slash ? ResolveChoice((HMENU)item.id, slash + 1) : 0;
+        return slash ? 0 : item.id;
+    }
+    return 0;
+}
+
+void FakeRightClick(const wchar_t* choice)
+{
+    g_menuChoiceSet = choice != nullptr;
+    CopyText(g_menuChoice, ARRAYSIZE(g_menuChoice), choice);
+    Enqueue(kWindow, WM_APP + 1, 1, WM_CONTEXTMENU); // The app's WM_TRAYICON, NOTIFYICON_VERSION_4 layout
+}
+
+bool FakeMenuChoiceFound() { return g_menuChoiceFound; }
+
+// Modal on Windows; here the menu shows, the choice is made and the command
+// is posted, as it is once TrackPopupMenu returns
+BOOL TrackPopupMenu(HMENU menu, UINT, int, int, int, HWND hWnd, const RECT*)
+{
+    const FakeMenu* m = FindMenu(menu);
+    Record(API_USER, "TrackPopupMenu", "%zu items", m ? m->count : (size_t)0);
+    if (!m || hWnd != kWindow)
+        return FALSE;
+    if (g_workingSetBytes < 3500 * 1024)
+        g_workingSetBytes = 3500 * 1024; // Showing a menu faults its pages back in
+    SendMessageW(hWnd, WM_INITMENUPOPUP, (WPARAM)menu, 0);
+    const UINT_PTR id = g_menuChoiceSet ? ResolveChoice(menu, g_menuChoice) : 0;
+    g_menuChoiceFound = !g_menuChoiceSet || id != 0;
+    g_menuChoiceSet = false;
+    if (id)
+        Enqueue(hWnd, WM_COMMAND, id, 0);
+    return TRUE;
+}
+
+// ===== Input =====
+static uint64_t g_lastInputMs = kStartTickMs;
+static bool g_inputSink = false;
+
+BOOL RegisterRawInputDevices(PCRAWINPUTDEVICE devices, UINT count, UINT size)
+{
+    Record(API_USER, "RegisterRawInputDevices", "%s", count && (devices[0].dwFlags & RIDEV_REMOVE) ? "remove" : "sink");
+    if (!count || size != sizeof(RAWINPUTDEVICE))
+        return FALSE;
+    g_inputSink = !(devices[0].dwFlags & RIDEV_REMOVE) && devices[0].hwndTarget == kWindow;
+    return TRUE;
+}
+
+bool FakeInputSink() { return g_inputSink; }
+
+void FakeUserInput()
+{
+    g_lastInputMs = g_tickMs;
+    if (g_inputSink)
+        Enqueue(kWindow, WM_INPUT, 1 /* RIM_INPUTSINK */, 0);
+}
+
+BOOL GetLastInputInfo(LASTINPUTINFO* info)
+{
+    Record(API_USER, "GetLastInputInfo", "%s", "");
+    info->dwTime = (DWORD)g_lastInputMs;
+    return TRUE;
+}
+
+// ===== Foreground events =====
+HWINEVENTHOOK SetWinEventHook(DWORD, DWORD, HMODULE, WINEVENTPROC proc, DWORD, DWORD, DWORD)
+{
+    Record(API_USER, "SetWinEventHook", "%s", "");
+    if (g_winEventProc)
+        return nullptr;
+    g_winEventProc = proc;
+    return (HWINEVENTHOOK)OpenHandle(HANDLE_HOOK, 0);
+}
+
+BOOL UnhookWinEvent(HWINEVENTHOOK hook)
+{
+    Record(API_USER, "UnhookWinEvent", "%s", "");
+    if (!CloseFakeHandle(hook, HANDLE_HOOK))
+        return FALSE;
+    g_winEventProc = nullptr;
+    return TRUE;
+}
+
+bool FakeSetForeground(const wchar_t* imagePath)
+{
+    const FakeProcess* p = FindProcessByImage(imagePath);
+    if (!p)
+        return false;
+    g_foregroundPid = p->pid;
+    if (g_winEventProc)
+        Enqueue(nullptr, kWinEventMessage, 0, (LPARAM)ForegroundWindowOf(p->pid));
+    return true;
+}
+
+// ===== Power broadcasts =====
+static PowerSettingState* FindPowerSetting(const GUID& setting)
+{
+    for (PowerSettingState& state : g_powerSettings)
+    {
+        if (IsEqualGUID(*state.setting, setting))
+            return &state;
+    }
+    return nullptr;
+}
+
+// The payload lives in the setting's own buffer until the message is handled
+static void Broadcast(PowerSettingState& state, const void* data, DWORD size)
+{
+    POWERBROADCAST_SETTING* setting = reinterpret_cast<POWERBROADCAST_SETTING*>(state.broadcast);
+    setting->PowerSetting = *state.setting;
+    setting->DataLength = size;
+    memcpy(setting->Data, data, size);
+    Enqueue(kWindow, WM_POWERBROADCAST, PBT_POWERSETTINGCHANGE, (LPARAM)setting);
+}
+
+// Windows sends the current value right after registering
+HPOWERNOTIFY RegisterPowerSettingNotification(HANDLE recipient, const GUID* setting, DWORD)
+{
+    PowerSettingState* state = FindPowerSetting(*setting);
+    Record(API_POWRPROF, "RegisterPowerSettingNotification", "%s",
+        state == &g_powerSettings[0] ? "personality" : state == &g_powerSettings[1] ? "AC/DC" :
+        state == &g_powerSettings[2] ? "battery" : state ? "energy saver" : "?");
+    if (!state || recipient != (HANDLE)kWindow)
+        return nullptr;
+    HPOWERNOTIFY handle = OpenHandle(HANDLE_POWER_NOTIFY, (size_t)(state - g_powerSettings));
+    if (!handle)
+        return nullptr;
+    ++state->registrations;
+    if (state == &g_powerSettings[0])
+        Broadcast(*state, &g_plans[g_activePlan].personality, sizeof(GUID));
+    else
+        Broadcast(*state, &state->value, sizeof(DWORD));
+    return handle;
+}
+
+BOOL UnregisterPowerSettingNotification(HPOWERNOTIFY handle)
+{
+    Record(API_POWRPROF, "UnregisterPowerSettingNotification", "%s", "");
+    HandleSlot* slot = FindHandle(handle, HANDLE_POWER_NOTIFY);
+    if (!slot)
+        return FALSE;
+    --g_powerSettings[slot->object].registrations;
+    slot->kind = HANDLE_FREE;
+    return TRUE;
+}
+
+bool FakePowerSetting(const GUID& setting, DWORD value)
+{
+    PowerSettingState* state = FindPowerSetting(setting);
+    if (!state || state == &g_powerSettings[0])
+        return false;
+    state->value = value;
+    if (!state->registrations)
+        return false;
+    Broadcast(*state, &value, sizeof(value));
+    return true;
+}
+
+// ===== Shell =====
+static bool g_trayIconShown = false;
+static wchar_t g_trayTip[128];
+
+BOOL Shell_NotifyIconW(DWORD message, NOTIFYICONDATAW* data)
+{
+    static const char* kMessages[] = { "NIM_ADD", "NIM_MODIFY", "NIM_DELETE", "NIM_SETFOCUS", "NIM_SETVERSION" };
+    Record(API_SHELL, "Shell_NotifyIconW", "%s%s%s", message < ARRAYSIZE(kMessages) ? kMessages[message] : "?",
+        (data->uFlags & NIF_TIP) && message <= NIM_MODIFY ? " tip=" : "",
+        (data->uFlags & NIF_TIP) && message <= NIM_MODIFY ? Utf8(data->szTip) : "");
+    switch (message)
+    {
+    case NIM_ADD:
+        if (g_trayIconShown)
+            return FALSE;
+        g_trayIconShown = true;
+        break;
+    case NIM_MODIFY:
+    case NIM_SETVERSION:
+        if (!g_trayIconShown)
+            return FALSE;
+        break;
+    case NIM_DELETE:
+        if (!g_trayIconShown)
+            return FALSE;
+        g_trayIconShown = false;
+        g_trayTip[0] = L'\0';
+        return TRUE;
+    default:
+        return FALSE;
+    }
+    if (data->uFlags & NIF_TIP)
+        CopyText(g_trayTip, ARRAYSIZE(g_trayTip), data->szTip);
+    return TRUE;
+}
+
+bool FakeTrayIconShown() { return g_trayIconShown; }
+const wchar_t* FakeTrayTip() { return g_trayTip; }
+
+// Explorer restarted: every window hears the registered message
+void FakeTaskbarCreated()
+{
+    g_trayIconShown = false;
+    g_trayTip[0] = L'\0';
+    for (size_t i = 0; i < ARRAYSIZE(g_registeredMessages); ++i)
+    {
+        if (SameText(g_registeredMessages[i], L"TaskbarCreated"))
+            Enqueue(kWindow, 0xC000 + (UINT)i, 0, 0);
+    }
+}
+
+void FakeDpiChanged(UINT dpi)
+{
+    g_dpi = dpi;
+    Enqueue(kWindow, WM_DPICHANGED, ((WPARAM)dpi << 16) | dpi, 0);
+}
+
+void FakeResume()
+{
+    Enqueue(kWindow, WM_POWERBROADCAST, PBT_APMRESUMEAUTOMATIC, 0);
+}
+
+void FakeTimeChange()
+{
+    Enqueue(kWindow, WM_TIMECHANGE, 0, 0);
+}
+
+void FakeClose()
+{
+    Enqueue(kWindow, WM_CLOSE, 0, 0);
+}
+
+// ===== Observations =====
+uint64_t FakeClassCount(FakeApiClass apiClass) { return g_classCounts[apiClass]; }
+
+const char* FakeClassName(FakeApiClass apiClass)
+{
+    static const char* kNames[API_CLASS_COUNT] = {
+        "powrprof", "registry", "shell", "user", "kernel", "file", "clock", "message"
+    };
+    return kNames[apiClass];
+}
+
+size_t FakeApiCount() { return g_apiStatCount; }
+
+void FakeApiAt(size_t index, const char*& api, FakeApiClass& apiClass, uint64_t& calls)
+{
+    api = g_apiStats[index].api;
+    apiClass = g_apiStats[index].apiClass;
+    calls = g_apiStats[index].calls;
+}
+
+void FakeResetCounts()
+{
+    memset(g_classCounts, 0, sizeof(g_classCounts));
+    g_apiStatCount = 0;
+}
+
+// ===== Strings =====
+// Windows formats read %s and %c as wide in the W functions; glibc reads them
+// as narrow. Rewrite the format to say so before handing it on.
+static bool WidenFormat(const wchar_t* format, wchar_t* out, size_t cch)
+{
+    size_t n = 0;
+    for (const wchar_t* p = format; *p; ++p)
+    {
+        if (n + 3 >= cch)
+            return false;
+        out[n++] = *p;
+        if (*p != L'%')
+            continue;
+        ++p;
+        while (*p && wcschr(L"-+ #0123456789.*", *p))
+        {
+            if (n + 3 >= cch) return false;
+            out[n++] = *p++;
+        }
+        bool sized = false;
+        while (*p && wcschr(L"hlLqjzt", *p))
+        {
+            if (n + 3 >= cch) return false;
+            sized = true;
+            out[n++] = *p++;
+        }
+        if (!*p)
+            break;
+        if ((*p == L's' || *p == L'c') && !sized)
+            out[n++] = L'l';
+        out[n++] = *p;
+    }
+    out[n] = L'\0';
+    return true;
+}
+
+HRESULT StringCchCopyW(LPWSTR dest, size_t cch, LPCWSTR src)
+{
+    if (!cch)
+        return STRSAFE_E_INVALID_PARAMETER;
+    CopyText(dest, cch, src);
+    return wcslen(src) < cch ? S_OK : STRSAFE_E_INSUFFICIENT_BUFFER;
+}
+
+HRESULT StringCchCatW(LPWSTR dest, size_t cch, LPCWSTR src)
+{
+    const size_t len = wcsnlen(dest, cch);
+    if (len == cch)
+        return STRSAFE_E_INVALID_PARAMETER;
+    return StringCchCopyW(dest + len, cch - len, src);
+}
+
+HRESULT StringCchPrintfW(LPWSTR dest, size_t cch, LPCWSTR format, ...)
+{
+    if (!cch)
+        return STRSAFE_E_INVALID_PARAMETER;
+    wchar_t wide[512];
+    if (!WidenFormat(format, wide, ARRAYSIZE(wide)))
+    {
+        dest[0] = L'\0';
+        return STRSAFE_E_INVALID_PARAMETER;
+    }
+    va_list args;
+    va_start(args, format);
+    const int n = vswprintf(dest, cch, wide, args);
+    va_end(args);
+    if (n < 0)
+    {
+        dest[cch - 1] = L'\0';
+        return STRSAFE_E_INSUFFICIENT_BUFFER;
+    }
+    return S_OK;
+}
@@ -0,0 +1,3 @@
+// SDKDDKVer.h: Headless stand-in; there are no platform versions to pick.
+
+#pragma once
@@ -0,0 +1,384 @@
+// Win32Shim.h: The slice of the Windows SDK the tray app uses, for headless builds on Linux.
+
+#pragma once
+
+// Declarations only, laid out like the SDK. Every function is implemented by
+// Win32Shim.cpp against an in-memory fake system (see FakeSystem.h) that
+// records each call, so PowerPlanTray.cpp builds and runs unmodified.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <wchar.h>
+
+#define WINAPI
+#define CALLBACK
+#define APIENTRY
+#define _In_
+#define _In_opt_
+#define _Out_
+#define _Inout_
+
+// ===== Base types =====
+// Widths follow Win64: DWORD and LONG stay 32-bit on LP64
+typedef int BOOL;
+typedef uint8_t BYTE, UCHAR, BOOLEAN;
+typedef uint16_t WORD, USHORT, LANGID;
+typedef uint32_t DWORD, ULONG, UINT;
+typedef int32_t LONG, INT, HRESULT, LSTATUS, NTSTATUS, PDH_STATUS;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG, ULONG64, DWORD64;
+typedef uintptr_t UINT_PTR, ULONG_PTR, DWORD_PTR, WPARAM, SIZE_T;
+typedef intptr_t INT_PTR, LONG_PTR, LPARAM, LRESULT;
+typedef wchar_t WCHAR;
+typedef WCHAR* LPWSTR;
+typedef const WCHAR* LPCWSTR;
+typedef char* LPSTR;
+typedef const char* LPCSTR;
+typedef void* PVOID;
+typedef void* LPVOID;
+typedef const void* LPCVOID;
+typedef DWORD* LPDWORD;
+typedef BYTE* LPBYTE;
+typedef WORD ATOM;
+
+#define DECLARE_HANDLE(name) struct name##__ { int unused; }; typedef struct name##__* name
+typedef void* HANDLE;
+DECLARE_HANDLE(HWND);
+DECLARE_HANDLE(HINSTANCE);
+DECLARE_HANDLE(HICON);
+DECLARE_HANDLE(HMENU);
+DECLARE_HANDLE(HKEY);
+DECLARE_HANDLE(HBRUSH);
+DECLARE_HANDLE(HWINEVENTHOOK);
+typedef HICON HCURSOR;
+typedef HINSTANCE HMODULE;
+typedef void* HLOCAL;
+typedef void* HPOWERNOTIFY;
+// void(*)() rather than the SDK's INT_PTR(*)(): GCC accepts casts from it without -Wcast-function-type
+typedef void (WINAPI *FARPROC)();
+
+#define TRUE 1
+#define FALSE 0
+#define MAX_PATH 260
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define _countof ARRAYSIZE
+#define LOWORD(l) ((WORD)(((DWORD_PTR)(l)) & 0xffff))
+#define HIWORD(l) ((WORD)((((DWORD_PTR)(l)) >> 16) & 0xffff))
+#define MAKEINTRESOURCEW(i) ((LPWSTR)((ULONG_PTR)((WORD)(i))))
+#define MAKEINTRESOURCE MAKEINTRESOURCEW
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#define S_OK ((HRESULT)0)
+#define INVALID_HANDLE_VALUE ((HANDLE)(LONG_PTR)-1)
+
+#define ERROR_SUCCESS 0L
+#define NO_ERROR 0L
+#define ERROR_FILE_NOT_FOUND 2L
+#define ERROR_ACCESS_DENIED 5L
+#define ERROR_INVALID_HANDLE 6L
+#define ERROR_INVALID_PARAMETER 87L
+#define ERROR_INSUFFICIENT_BUFFER 122L
+#define ERROR_ALREADY_EXISTS 183L
+#define ERROR_MORE_DATA 234L
+#define ERROR_NO_MORE_ITEMS 259L
+#define ERROR_UNSUPPORTED_TYPE 1630L
+
+typedef struct _GUID
+{
+    uint32_t Data1;
+    uint16_t Data2;
+    uint16_t Data3;
+    uint8_t Data4[8];
+} GUID;
+
+inline bool IsEqualGUID(const GUID& a, const GUID& b) { return memcmp(&a, &b, sizeof(GUID)) == 0; }
+inline bool operator==(const GUID& a, const GUID& b) { return IsEqualGUID(a, b); }
+inline bool operator!=(const GUID& a, const GUID& b) { return !IsEqualGUID(a, b); }
+
+typedef union _LARGE_INTEGER
+{
+    struct { DWORD LowPart; LONG HighPart; };
+    LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+typedef struct _FILETIME { DWORD dwLowDateTime; DWORD dwHighDateTime; } FILETIME;
+typedef struct _SYSTEMTIME
+{
+    WORD wYear, wMonth, wDayOfWeek, wDay, wHour, wMinute, wSecond, wMilliseconds;
+} SYSTEMTIME;
+typedef struct _SECURITY_ATTRIBUTES { DWORD nLength; LPVOID lpSecurityDescriptor; BOOL bInheritHandle; } SECURITY_ATTRIBUTES;
+typedef struct _OVERLAPPED OVERLAPPED, *LPOVERLAPPED;
+
+// ===== Kernel =====
+DWORD GetLastError();
+void SetLastError(DWORD error);
+BOOL CloseHandle(HANDLE handle);
+HANDLE CreateMutexW(SECURITY_ATTRIBUTES* attributes, BOOL initialOwner, LPCWSTR name);
+BOOL ReleaseMutex(HANDLE mutex);
+HLOCAL LocalAlloc(UINT flags, SIZE_T bytes);
+HLOCAL LocalFree(HLOCAL mem);
+#define LMEM_FIXED 0
+HANDLE GetProcessHeap();
+SIZE_T HeapCompact(HANDLE heap, DWORD flags);
+HANDLE GetCurrentProcess();
+BOOL SetProcessWorkingSetSizeEx(HANDLE process, SIZE_T minimum, SIZE_T maximum, DWORD flags);
+HMODULE GetModuleHandleW(LPCWSTR name);
+HMODULE LoadLibraryW(LPCWSTR name);
+BOOL FreeLibrary(HMODULE module);
+FARPROC GetProcAddress(HMODULE module, LPCSTR name);
+DWORD GetModuleFileNameW(HMODULE module, LPWSTR path, DWORD cch);
+DWORD GetEnvironmentVariableW(LPCWSTR name, LPWSTR buffer, DWORD cch);
+LANGID GetUserDefaultUILanguage();
+void OutputDebugStringW(LPCWSTR text);
+void OutputDebugStringA(LPCSTR text);
+LPWSTR GetCommandLineW();
+#define CP_UTF8 65001
+int WideCharToMultiByte(UINT codePage, DWORD flags, LPCWSTR text, int cch, LPSTR out, int bytes,
+    LPCSTR defaultChar, BOOL* usedDefault);
+#define _wcsicmp wcscasecmp
+
+// Console
+#define STD_OUTPUT_HANDLE ((DWORD)-11)
+#define STD_ERROR_HANDLE ((DWORD)-12)
+#define ATTACH_PARENT_PROCESS ((DWORD)-1)
+HANDLE GetStdHandle(DWORD stdHandle);
+BOOL AttachConsole(DWORD pid);
+BOOL GetConsoleMode(HANDLE console, LPDWORD mode);
+BOOL WriteConsoleW(HANDLE console, const void* text, DWORD cch, LPDWORD written, LPVOID reserved);
+
+// Clocks
+ULONGLONG GetTickCount64();
+DWORD GetTickCount();
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency);
+void GetSystemTimeAsFileTime(FILETIME* time);
+void GetLocalTime(SYSTEMTIME* time);
+BOOL GetSystemTimes(FILETIME* idle, FILETIME* kernel, FILETIME* user);
+inline void _tzset() { tzset(); }
+
+// Files
+#define GENERIC_READ 0x80000000
+#define GENERIC_WRITE 0x40000000
+#define FILE_SHARE_READ 0x1
+#define FILE_SHARE_WRITE 0x2
+#define FILE_SHARE_DELETE 0x4
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define FILE_FLAG_SEQUENTIAL_SCAN 0x08000000
+#define MOVEFILE_REPLACE_EXISTING 0x1
+HANDLE CreateFileW(LPCWSTR path, DWORD access, DWORD share, SECURITY_ATTRIBUTES* attributes,
+    DWORD disposition, DWORD flags, HANDLE templateFile);
+BOOL ReadFile(HANDLE file, LPVOID buffer, DWORD bytes, LPDWORD read, LPOVERLAPPED overlapped);
+BOOL WriteFile(HANDLE file, LPCVOID buffer, DWORD bytes, LPDWORD written, LPOVERLAPPED overlapped);
+BOOL CreateDirectoryW(LPCWSTR path, SECURITY_ATTRIBUTES* attributes);
+BOOL MoveFileExW(LPCWSTR from, LPCWSTR to, DWORD flags);
+BOOL DeleteFileW(LPCWSTR path);
+
+// Processes
+#define PROCESS_QUERY_LIMITED_INFORMATION 0x1000
+HANDLE OpenProcess(DWORD access, BOOL inherit, DWORD pid);
+BOOL QueryFullProcessImageNameW(HANDLE process, DWORD flags, LPWSTR path, DWORD* cch);
+
+// ===== Registry =====
+#define HKEY_CURRENT_USER ((HKEY)(ULONG_PTR)0x80000001)
+#define KEY_QUERY_VALUE 0x0001
+#define KEY_SET_VALUE 0x0002
+#define KEY_READ 0x20019
+#define KEY_WRITE 0x20006
+#define REG_SZ 1
+#define REG_BINARY 3
+#define REG_DWORD 4
+#define REG_QWORD 11
+#define RRF_RT_REG_SZ 0x00000002
+#define RRF_RT_REG_BINARY 0x00000008
+#define RRF_RT_REG_DWORD 0x00000010
+#define RRF_RT_REG_QWORD 0x00000040
+#define RRF_RT_ANY 0x0000ffff
+LSTATUS RegOpenKeyExW(HKEY key, LPCWSTR subKey, DWORD options, DWORD access, HKEY* result);
+LSTATUS RegCreateKeyExW(HKEY key, LPCWSTR subKey, DWORD reserved, LPWSTR className, DWORD options,
+    DWORD access, SECURITY_ATTRIBUTES* attributes, HKEY* result, LPDWORD disposition);
+LSTATUS RegCloseKey(HKEY key);
+LSTATUS RegGetValueW(HKEY key, LPCWSTR subKey, LPCWSTR value, DWORD flags, LPDWORD type, PVOID data, LPDWORD bytes);
+LSTATUS RegSetValueExW(HKEY key, LPCWSTR value, DWORD reserved, DWORD type, const BYTE* data, DWORD bytes);
+LSTATUS RegDeleteValueW(HKEY key, LPCWSTR value);
+LSTATUS RegEnumValueW(HKEY key, DWORD index, LPWSTR name, LPDWORD nameCch, LPDWORD reserved,
+    LPDWORD type, LPBYTE data, LPDWORD bytes);
+
+// ===== Windows, messages and timers =====
+typedef struct tagPOINT { LONG x, y; } POINT;
+typedef struct tagRECT { LONG left, top, right, bottom; } RECT;
+typedef struct tagMSG
+{
+    HWND hwnd;
+    UINT message;
+    WPARAM wParam;
+    LPARAM lParam;
+    DWORD time;
+    POINT pt;
+} MSG;
+typedef LRESULT (CALLBACK *WNDPROC)(HWND, UINT, WPARAM, LPARAM);
+typedef void (CALLBACK *TIMERPROC)(HWND, UINT, UINT_PTR, DWORD);
+typedef struct tagWNDCLASSEXW
+{
+    UINT cbSize;
+    UINT style;
+    WNDPROC lpfnWndProc;
+    int cbClsExtra;
+    int cbWndExtra;
+    HINSTANCE hInstance;
+    HICON hIcon;
+    HCURSOR hCursor;
+    HBRUSH hbrBackground;
+    LPCWSTR lpszMenuName;
+    LPCWSTR lpszClassName;
+    HICON hIconSm;
+} WNDCLASSEXW;
+#define WNDCLASSEX WNDCLASSEXW
+
+#define WM_CREATE 0x0001
+#define WM_DESTROY 0x0002
+#define WM_CLOSE 0x0010
+#define WM_ENDSESSION 0x0016
+#define WM_COPYDATA 0x004A
+#define WM_TIMECHANGE 0x001E
+#define WM_CONTEXTMENU 0x007B
+#define WM_INPUT 0x00FF
+#define WM_COMMAND 0x0111
+#define WM_TIMER 0x0113
+#define WM_INITMENUPOPUP 0x0117
+#define WM_RBUTTONUP 0x0205
+#define WM_POWERBROADCAST 0x0218
+#define WM_DPICHANGED 0x02E0
+#define WM_APP 0x8000
+#define CS_VREDRAW 0x0001
+#define CS_HREDRAW 0x0002
+#define COLOR_WINDOW 5
+#define WS_OVERLAPPEDWINDOW 0x00CF0000
+#define CW_USEDEFAULT ((int)0x80000000)
+#define USER_TIMER_MAXIMUM 0x7FFFFFFF
+#define IDOK 1
+#define MB_OK 0x00000000
+#define MB_ICONINFORMATION 0x00000040
+#define IDC_ARROW MAKEINTRESOURCEW(32512)
+#define HWND_MESSAGE ((HWND)(LONG_PTR)-3)
+#define SMTO_NORMAL 0x0000
+#define SMTO_ABORTIFHUNG 0x0002
+
+typedef struct tagCOPYDATASTRUCT
+{
+    ULONG_PTR dwData;
+    DWORD cbData;
+    PVOID lpData;
+} COPYDATASTRUCT;
+
+ATOM RegisterClassExW(const WNDCLASSEXW* wc);
+HWND CreateWindowExW(DWORD exStyle, LPCWSTR className, LPCWSTR title, DWORD style, int x, int y,
+    int width, int height, HWND parent, HMENU menu, HINSTANCE instance, LPVOID param);
+#define CreateWindowW(className, title, style, x, y, width, height, parent, menu, instance, param) \
+    CreateWindowExW(0, className, title, style, x, y, width, height, parent, menu, instance, param)
+BOOL DestroyWindow(HWND hWnd);
+UINT RegisterWindowMessageW(LPCWSTR name);
+#define RegisterWindowMessage RegisterWindowMessageW
+BOOL GetMessageW(MSG* msg, HWND hWnd, UINT filterMin, UINT filterMax);
+#define GetMessage GetMessageW
+BOOL TranslateMessage(const MSG* msg);
+LRESULT DispatchMessageW(const MSG* msg);
+#define DispatchMessage DispatchMessageW
+BOOL PostMessageW(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
+#define PostMessage PostMessageW
+LRESULT SendMessageW(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
+#define SendMessage SendMessageW
+LRESULT SendMessageTimeoutW(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam, UINT flags, UINT timeoutMs,
+    DWORD_PTR* result);
+HWND FindWindowW(LPCWSTR className, LPCWSTR title);
+LRESULT DefWindowProcW(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
+#define DefWindowProc DefWindowProcW
+void PostQuitMessage(int exitCode);
+LONG GetMessageTime();
+UINT_PTR SetTimer(HWND hWnd, UINT_PTR id, UINT elapseMs, TIMERPROC proc);
+BOOL KillTimer(HWND hWnd, UINT_PTR id);
+int MessageBoxW(HWND hWnd, LPCWSTR text, LPCWSTR caption, UINT type);
+HWND GetForegroundWindow();
+BOOL SetForegroundWindow(HWND hWnd);
+DWORD GetWindowThreadProcessId(HWND hWnd, LPDWORD pid);
+BOOL GetCursorPos(POINT* pt);
+
+// Resources
+#define IMAGE_ICON 1
+#define LR_DEFAULTCOLOR 0x0000
+#define SM_CXSMICON 49
+#define SM_CYSMICON 50
+HICON LoadIconW(HINSTANCE instance, LPCWSTR name);
+#define LoadIcon LoadIconW
+HCURSOR LoadCursorW(HINSTANCE instance, LPCWSTR name);
+#define LoadCursor LoadCursorW
+HANDLE LoadImageW(HINSTANCE instance, LPCWSTR name, UINT type, int cx, int cy, UINT flags);
+BOOL DestroyIcon(HICON icon);
+int LoadStringW(HINSTANCE instance, UINT id, LPWSTR buffer, int cch);
+int GetSystemMetrics(int index);
+
+// Menus
+#define MF_STRING 0x0000
+#define MF_ENABLED 0x0000
+#define MF_GRAYED 0x0001
+#define MF_CHECKED 0x0008
+#define MF_POPUP 0x0010
+#define MF_SEPARATOR 0x0800
+#define TPM_RIGHTBUTTON 0x0002
+#define TPM_BOTTOMALIGN 0x0020
+HMENU CreatePopupMenu();
+BOOL AppendMenuW(HMENU menu, UINT flags, UINT_PTR id, LPCWSTR text);
+#define AppendMenu AppendMenuW
+BOOL TrackPopupMenu(HMENU menu, UINT flags, int x, int y, int reserved, HWND hWnd, const RECT* rect);
+BOOL DestroyMenu(HMENU menu);
+
+// Raw input
+#define RIDEV_REMOVE 0x00000001
+#define RIDEV_INPUTSINK 0x00000100
+typedef struct tagRAWINPUTDEVICE
+{
+    USHORT usUsagePage;
+    USHORT usUsage;
+    DWORD dwFlags;
+    HWND hwndTarget;
+} RAWINPUTDEVICE;
+typedef const RAWINPUTDEVICE* PCRAWINPUTDEVICE;
+BOOL RegisterRawInputDevices(PCRAWINPUTDEVICE devices, UINT count, UINT size);
+
+typedef struct tagLASTINPUTINFO { UINT cbSize; DWORD dwTime; } LASTINPUTINFO;
+BOOL GetLastInputInfo(LASTINPUTINFO* info);
+
+// Foreground events
+#define EVENT_SYSTEM_FOREGROUND 0x0003
+#define WINEVENT_OUTOFCONTEXT 0x0000
+#define WINEVENT_SKIPOWNPROCESS 0x0002
+typedef void (CALLBACK *WINEVENTPROC)(HWINEVENTHOOK, DWORD, HWND, LONG, LONG, DWORD, DWORD);
+HWINEVENTHOOK SetWinEventHook(DWORD eventMin, DWORD eventMax, HMODULE module, WINEVENTPROC proc,
+    DWORD pid, DWORD tid, DWORD flags);
+BOOL UnhookWinEvent(HWINEVENTHOOK hook);
+
+// Power broadcasts
+#define PBT_APMRESUMEAUTOMATIC 0x0012
+#define PBT_POWERSETTINGCHANGE 0x8013
+#define DEVICE_NOTIFY_WINDOW_HANDLE 0x00000000
+typedef struct
+{
+    GUID PowerSetting;
+    DWORD DataLength;
+    UCHAR Data[1];
+} POWERBROADCAST_SETTING;
+HPOWERNOTIFY RegisterPowerSettingNotification(HANDLE recipient, const GUID* setting, DWORD flags);
+BOOL UnregisterPowerSettingNotification(HPOWERNOTIFY handle);
+extern const GUID GUID_POWERSCHEME_PERSONALITY;
+extern const GUID GUID_MIN_POWER_SAVINGS;
+extern const GUID GUID_MAX_POWER_SAVINGS;
+extern const GUID GUID_TYPICAL_POWER_SAVINGS;
+extern const GUID GUID_ACDC_POWER_SOURCE;
+extern const GUID GUID_BATTERY_PERCENTAGE_REMAINING;
+extern const GUID GUID_ENERGY_SAVER_STATUS;
+
+#define ES_SYSTEM_REQUIRED 0x00000001
+#define ES_DISPLAY_REQUIRED 0x00000002
@@ -0,0 +1,19 @@
+// crtdbg.h: Headless debug CRT subset; see Win32Shim.h.
+
+#pragma once
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#define _ASSERTE(expr) assert(expr)
+
+template <size_t N>
+inline int sprintf_s(char (&buffer)[N], const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    const int n = vsnprintf(buffer, N, format, args);
+    va_end(args);
+    return n;
+}
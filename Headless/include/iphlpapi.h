@@ -0,0 +1,34 @@
+// iphlpapi.h: Headless interface table declarations; see Win32Shim.h.
+
+#pragma once
+
+#include "Win32Shim.h"
+
+// Only the fields the app reads; the rest of the SDK row is omitted
+typedef struct _MIB_IF_ROW2
+{
+    ULONG64 InterfaceLuid;
+    ULONG InterfaceIndex;
+    struct
+    {
+        BOOLEAN HardwareInterface : 1;
+        BOOLEAN FilterInterface : 1;
+        BOOLEAN ConnectorPresent : 1;
+        BOOLEAN NotAuthenticated : 1;
+        BOOLEAN NotMediaConnected : 1;
+        BOOLEAN Paused : 1;
+        BOOLEAN LowPower : 1;
+        BOOLEAN EndPointInterface : 1;
+    } InterfaceAndOperStatusFlags;
+    ULONG64 InOctets;
+    ULONG64 OutOctets;
+} MIB_IF_ROW2;
+
+typedef struct _MIB_IF_TABLE2
+{
+    ULONG NumEntries;
+    MIB_IF_ROW2 Table[1];
+} MIB_IF_TABLE2;
+
+DWORD GetIfTable2(MIB_IF_TABLE2** table);
+void FreeMibTable(PVOID memory);
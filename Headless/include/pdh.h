@@ -0,0 +1,23 @@
+// pdh.h: Headless performance counter declarations; see Win32Shim.h.
+
+#pragma once
+
+#include "Win32Shim.h"
+
+typedef HANDLE PDH_HQUERY;
+typedef HANDLE PDH_HCOUNTER;
+
+typedef struct _PDH_RAW_COUNTER
+{
+    DWORD CStatus;
+    FILETIME TimeStamp;
+    LONGLONG FirstValue;
+    LONGLONG SecondValue;
+    DWORD MultiCount;
+} PDH_RAW_COUNTER;
+
+PDH_STATUS PdhOpenQueryW(LPCWSTR dataSource, DWORD_PTR userData, PDH_HQUERY* query);
+PDH_STATUS PdhAddEnglishCounterW(PDH_HQUERY query, LPCWSTR path, DWORD_PTR userData, PDH_HCOUNTER* counter);
+PDH_STATUS PdhCollectQueryData(PDH_HQUERY query);
+PDH_STATUS PdhGetRawCounterValue(PDH_HCOUNTER counter, LPDWORD type, PDH_RAW_COUNTER* value);
+PDH_STATUS PdhCloseQuery(PDH_HQUERY query);
@@ -0,0 +1,24 @@
+// powrprof.h: Headless power scheme declarations; see Win32Shim.h.
+
+#pragma once
+
+#include "Win32Shim.h"
+
+typedef enum _POWER_DATA_ACCESSOR
+{
+    ACCESS_SCHEME = 16,
+} POWER_DATA_ACCESSOR;
+
+typedef enum
+{
+    SystemExecutionState = 16,
+} POWER_INFORMATION_LEVEL;
+
+DWORD PowerEnumerate(HKEY rootPowerKey, const GUID* schemeGuid, const GUID* subGroupGuid,
+    POWER_DATA_ACCESSOR accessFlags, ULONG index, UCHAR* buffer, DWORD* bufferSize);
+DWORD PowerReadFriendlyName(HKEY rootPowerKey, const GUID* schemeGuid, const GUID* subGroupGuid,
+    const GUID* settingGuid, UCHAR* buffer, DWORD* bufferSize);
+DWORD PowerGetActiveScheme(HKEY userRootPowerKey, GUID** activePolicyGuid);
+DWORD PowerSetActiveScheme(HKEY userRootPowerKey, const GUID* schemeGuid);
+NTSTATUS CallNtPowerInformation(POWER_INFORMATION_LEVEL level, PVOID input, ULONG inputLength,
+    PVOID output, ULONG outputLength);
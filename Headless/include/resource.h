@@ -0,0 +1,5 @@
+// resource.h: The app includes its Resource.h by this name; Linux file names are case-sensitive.
+
+#pragma once
+
+#include "../../PowerPlanTray/Resource.h"
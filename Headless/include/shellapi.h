@@ -0,0 +1,44 @@
+// shellapi.h: Headless notification area declarations; see Win32Shim.h.
+
+#pragma once
+
+#include "Win32Shim.h"
+
+typedef struct _NOTIFYICONDATAW
+{
+    DWORD cbSize;
+    HWND hWnd;
+    UINT uID;
+    UINT uFlags;
+    UINT uCallbackMessage;
+    HICON hIcon;
+    WCHAR szTip[128];
+    DWORD dwState;
+    DWORD dwStateMask;
+    WCHAR szInfo[256];
+    union
+    {
+        UINT uTimeout;
+        UINT uVersion;
+    };
+    WCHAR szInfoTitle[64];
+    DWORD dwInfoFlags;
+    GUID guidItem;
+    HICON hBalloonIcon;
+} NOTIFYICONDATAW;
+#define NOTIFYICONDATA NOTIFYICONDATAW
+
+#define NIM_ADD 0x00000000
+#define NIM_MODIFY 0x00000001
+#define NIM_DELETE 0x00000002
+#define NIM_SETVERSION 0x00000004
+#define NIF_MESSAGE 0x00000001
+#define NIF_ICON 0x00000002
+#define NIF_TIP 0x00000004
+#define NOTIFYICON_VERSION_4 4
+
+BOOL Shell_NotifyIconW(DWORD message, NOTIFYICONDATAW* data);
+#define Shell_NotifyIcon Shell_NotifyIconW
+
+// The array and its strings are one LocalAlloc block, freed with LocalFree
+LPWSTR* CommandLineToArgvW(LPCWSTR cmdLine, int* argc);
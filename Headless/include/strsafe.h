@@ -0,0 +1,16 @@
+// strsafe.h: Headless bounded string functions; see Win32Shim.h.
+
+#pragma once
+
+#include "Win32Shim.h"
+
+#define STRSAFE_E_INSUFFICIENT_BUFFER ((HRESULT)0x8007007AL)
+#define STRSAFE_E_INVALID_PARAMETER ((HRESULT)0x80070057L)
+
+// Formats take the Windows meaning: %s and %c are wide in the W functions
+HRESULT StringCchCopyW(LPWSTR dest, size_t cch, LPCWSTR src);
+HRESULT StringCchCatW(LPWSTR dest, size_t cch, LPCWSTR src);
+HRESULT StringCchPrintfW(LPWSTR dest, size_t cch, LPCWSTR format, ...);
+#define StringCchCopy StringCchCopyW
+#define StringCchCat StringCchCatW
+#define StringCchPrintf StringCchPrintfW
@@ -0,0 +1,5 @@
+// tchar.h: Headless stand-in; the app uses the wide functions directly.
+
+#pragma once
+
+#include <wchar.h>
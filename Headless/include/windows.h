@@ -0,0 +1,5 @@
+// windows.h: Headless stand-in; see Win32Shim.h.
+
+#pragma once
+
+#include "Win32Shim.h"
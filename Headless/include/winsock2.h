@@ -0,0 +1,5 @@
+// winsock2.h: Headless stand-in; only the types iphlpapi.h needs.
+
+#pragma once
+
+#include "Win32Shim.h"
@@ -0,0 +1,154 @@
+// ActivityVetoCheck.cpp: The AFK veto's thresholds and baseline, alone and holding a stage off in the engine.
+
+#include "Checks.h"
+
+#include "ActivityVeto.h"
+
+static const uint64_t kSecond = 1000;
+static const uint64_t kMinute = 60 * kSecond;
+
+// Counters as they stand after ms more of the given activity
+struct Counters
+{
+    ActivitySample sample{};
+
+    const ActivitySample& Run(uint64_t ms, double cpuPercent, uint64_t diskPerSec, uint64_t netPerSec, bool request)
+    {
+        const uint64_t ticks = ms * 10; // 100 ns ticks per millisecond, as GetSystemTimes counts
+        sample.timeMs += ms;
+        sample.cpuTotal += ticks;
+        sample.cpuIdle += ticks - (uint64_t)(ticks * cpuPercent / 100.0);
+        sample.diskBytes += diskPerSec * ms / 1000;
+        sample.netBytes += netPerSec * ms / 1000;
+        sample.powerRequest = request;
+        return sample;
+    }
+};
+
+// ===== Thresholds =====
+static void CheckThresholds(CheckLog& log)
+{
+    const ActivityVeto::Config config; // 25% CPU, 2 MB/s disk, 256 KB/s network, power requests
+    ActivityVeto veto(config);
+    Counters c;
+    c.sample.timeMs = 5000;
+    log.Expect(veto.Enabled() && !veto.Primed(), "a default veto on, with no baseline");
+    log.Expect(!veto.Sample(c.sample) && veto.Primed() && veto.Reasons() == 0, "the first sample only a baseline");
+    log.Expect(!veto.Sample(c.sample), "a sample at the baseline's own time not compared");
+
+    struct Case
+    {
+        double cpu;
+        uint64_t disk;
+        uint64_t net;
+        bool request;
+        uint32_t reasons;
+        const char* what;
+    };
+    const Case kCases[] = {
+        { 0, 0, 0, false, 0, "an idle machine" },
+        { 24, 0, 0, false, 0, "CPU just under the threshold" },
+        { 25, 0, 0, false, ActivityVeto::VETO_CPU, "CPU at the threshold" },
+        { 0, config.diskBytesPerSec - 1024, 0, false, 0, "disk just under the threshold" },
+        { 0, config.diskBytesPerSec, 0, false, ActivityVeto::VETO_DISK, "disk at the threshold" },
+        { 0, 0, config.netBytesPerSec - 1024, false, 0, "network just under the threshold" },
+        { 0, 0, config.netBytesPerSec, false, ActivityVeto::VETO_NETWORK, "network at the threshold" },
+        { 0, 0, 0, true, ActivityVeto::VETO_POWER_REQUEST, "a power request" },
+        { 90, 8 * config.diskBytesPerSec, 4 * config.netBytesPerSec, true,
+            ActivityVeto::VETO_CPU | ActivityVeto::VETO_DISK | ActivityVeto::VETO_NETWORK | ActivityVeto::VETO_POWER_REQUEST,
+            "everything at once" },
+    };
+    for (const Case& k : kCases)
+    {
+        const bool compared = veto.Sample(c.Run(10 * kSecond, k.cpu, k.disk, k.net, k.request));
+        log.Expect(compared && veto.Reasons() == k.reasons, "reasons %x for %s, not %x", k.reasons, k.what, veto.Reasons());
+    }
+
+    // Counters that went backwards (a device removed) count as no activity
+    c.sample.diskBytes = 0;
+    c.sample.netBytes = 0;
+    log.Expect(veto.Sample(c.Run(10 * kSecond, 0, 0, 0, false)) && veto.Reasons() == 0, "no veto from counters that went back");
+
+    // A zero threshold turns its veto off
+    ActivityVeto::Config off;
+    off.cpuPercent = 0;
+    off.diskBytesPerSec = 0;
+    off.netBytesPerSec = 0;
+    off.powerRequests = false;
+    ActivityVeto none(off);
+    log.Expect(!none.Enabled(), "a veto with every threshold off disabled");
+    none.Sample(c.sample);
+    log.Expect(none.Sample(c.Run(10 * kSecond, 100, 100 * config.diskBytesPerSec, 100 * config.netBytesPerSec, true)) &&
+            none.Reasons() == 0,
+        "no reasons from a disabled veto");
+
+    // Reset forgets the baseline: the next sample is one again
+    veto.Reset();
+    log.Expect(!veto.Primed() && veto.Reasons() == 0, "no baseline after a reset");
+    log.Expect(!veto.Sample(c.Run(10 * kSecond, 90, 0, 0, false)) && veto.Reasons() == 0, "a busy sample after a reset only a baseline");
+}
+
+// ===== Holding a stage =====
+// Samples whatever the check last made the machine do
+class VetoHost : public CheckHost
+{
+public:
+    Counters counters;
+
+    void CollectActivity(ActivitySample& out) override { out = counters.sample; }
+};
+
+static void CheckHolding(CheckLog& log)
+{
+    const PlanId manual = CheckPlan(1), saver = CheckPlan(2);
+    VetoHost host;
+    host.active = manual;
+    PlanEngine engine(host);
+    engine.SetVetoConfig(ActivityVeto::Config());
+    engine.Ladder().Set((uint32_t)(5 * kMinute), saver);
+    uint64_t now = 10 * kMinute;
+    host.counters.sample.timeMs = now;
+    engine.Start(manual, now);
+    engine.AfkTick(now, 0);
+
+    // A tick one window ahead of the stage lays the baseline; busy over the
+    // window, the stage is held off
+    const uint64_t ahead = 5 * kMinute - PlanEngine::kVetoWindowMs;
+    host.counters.Run(ahead, 0, 0, 0, false);
+    now += ahead;
+    engine.AfkTick(now, ahead);
+    log.Expect(engine.Veto().Primed() && engine.Afk().Stage() == -1, "a baseline one window before the stage");
+    host.counters.Run(PlanEngine::kVetoWindowMs, 60, 0, 0, false);
+    now += PlanEngine::kVetoWindowMs;
+    engine.AfkTick(now, 5 * kMinute);
+    log.Expect(engine.Afk().Stage() == -1 && engine.Afk().VetoHeld() && host.active == manual,
+        "the stage held off while the CPU is busy");
+    log.Expect((engine.Veto().Reasons() & ActivityVeto::VETO_CPU) != 0, "CPU named as the reason");
+
+    // Quiet over the next window: the stage goes in
+    host.counters.Run(PlanEngine::kVetoWindowMs, 2, 0, 0, false);
+    now += PlanEngine::kVetoWindowMs;
+    engine.AfkTick(now, 5 * kMinute + PlanEngine::kVetoWindowMs);
+    log.Expect(engine.Afk().Stage() == 0 && host.active == saver, "the stage applied once the machine is quiet");
+    engine.UserInput(now + kSecond);
+    now += 2 * kSecond;
+    log.Expect(host.active == manual && !engine.Veto().Primed(), "the plan back on return, and the baseline forgotten");
+
+    // A stage due with no baseline (the tick one window ahead never came)
+    // waits a window for a rate to judge by, even on a quiet machine
+    const uint64_t lastInput = now;
+    host.counters.Run(6 * kMinute, 0, 0, 0, false);
+    now += 6 * kMinute;
+    engine.AfkTick(now, now - lastInput);
+    log.Expect(engine.Afk().Stage() == -1 && engine.Veto().Primed(), "no stage on the first sample alone");
+    host.counters.Run(PlanEngine::kVetoWindowMs, 0, 0, 0, false);
+    now += PlanEngine::kVetoWindowMs;
+    engine.AfkTick(now, now - lastInput);
+    log.Expect(engine.Afk().Stage() == 0 && host.active == saver, "the stage applied a window later");
+}
+
+void CheckActivityVeto(CheckLog& log, uint64_t /*seed*/)
+{
+    CheckThresholds(log);
+    CheckHolding(log);
+}
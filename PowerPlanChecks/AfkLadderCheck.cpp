@@ -0,0 +1,287 @@
+// AfkLadderCheck.cpp: The AFK ladder against a plain list, input traces replayed through the engine, returns and edits.
+
+#include "Checks.h"
+
+#include "AfkLadder.h"
+
+#include <algorithm>
+#include <vector>
+
+static const uint64_t kSecond = 1000;
+static const uint64_t kMinute = 60 * kSecond;
+
+// Distinct thresholds, sorted, at most four; the first four set are kept
+struct ReferenceLadder
+{
+    std::vector<AfkStage> stages;
+
+    bool Set(uint32_t thresholdMs, int plan)
+    {
+        if (!thresholdMs)
+            return false;
+        for (AfkStage& s : stages)
+        {
+            if (s.thresholdMs == thresholdMs) { s.plan = CheckPlan(plan); return true; }
+        }
+        if (stages.size() >= AfkLadder::kMaxStages)
+            return false;
+        stages.push_back({ thresholdMs, CheckPlan(plan) });
+        std::sort(stages.begin(), stages.end(), [](const AfkStage& a, const AfkStage& b) { return a.thresholdMs < b.thresholdMs; });
+        return true;
+    }
+    int StageFor(uint64_t idleMs) const
+    {
+        int stage = -1;
+        for (size_t i = 0; i < stages.size(); ++i)
+            if (idleMs >= stages[i].thresholdMs) stage = (int)i;
+        return stage;
+    }
+    uint64_t UntilNext(uint64_t idleMs) const
+    {
+        for (const AfkStage& s : stages)
+            if (s.thresholdMs > idleMs) return s.thresholdMs - idleMs;
+        return AfkLadder::kNever;
+    }
+};
+
+static uint32_t RandomThreshold(CheckRandom& rng)
+{
+    // Minutes mostly, as the menu offers, with odd seconds and zero now and then
+    switch (rng.Below(8))
+    {
+    case 0: return 0;
+    case 1: return (uint32_t)(1 + rng.Below(3600)) * 1000U;
+    default: return (uint32_t)((1 + rng.Below(60)) * kMinute);
+    }
+}
+
+// ===== Ladder =====
+static void CheckLadder(CheckLog& log, uint64_t seed, uint32_t rounds)
+{
+    CheckRandom rng(seed);
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        AfkLadder ladder;
+        ReferenceLadder ref;
+        for (uint32_t op = rng.Below(12); op; --op)
+        {
+            if (rng.Below(5) == 0 && ladder.Count())
+            {
+                const size_t i = rng.Below((uint32_t)ladder.Count());
+                ladder.Remove(i);
+                ref.stages.erase(ref.stages.begin() + (ptrdiff_t)i);
+                continue;
+            }
+            const uint32_t threshold = RandomThreshold(rng);
+            const int plan = 2 + (int)rng.Below(4);
+            const bool got = ladder.Set(threshold, CheckPlan(plan)), want = ref.Set(threshold, plan);
+            log.Expect(got == want, "Set(%u ms) to return %d (seed %llu, round %u)", threshold, want,
+                (unsigned long long)seed, round);
+        }
+        bool same = ladder.Count() == ref.stages.size();
+        for (size_t i = 0; same && i < ref.stages.size(); ++i)
+            same = ladder.At(i).thresholdMs == ref.stages[i].thresholdMs && ladder.At(i).plan == ref.stages[i].plan;
+        log.Expect(same, "the same %zu stages in order (seed %llu, round %u)", ref.stages.size(), (unsigned long long)seed, round);
+
+        // Each threshold and its neighbours, and some idle times anywhere
+        std::vector<uint64_t> probes = { 0, 1, AfkLadder::kNever - 1 };
+        for (const AfkStage& s : ref.stages)
+        {
+            probes.push_back(s.thresholdMs - 1);
+            probes.push_back(s.thresholdMs);
+            probes.push_back(s.thresholdMs + 1);
+        }
+        for (int i = 0; i < 20; ++i)
+            probes.push_back(rng.Below((uint32_t)(90 * kMinute)));
+        for (uint64_t idle : probes)
+        {
+            log.Expect(ladder.StageFor(idle) == ref.StageFor(idle) && ladder.UntilNextStageMs(idle) == ref.UntilNext(idle),
+                "stage %d, next in %llu ms at %llu ms idle, not %d and %llu (seed %llu, round %u)", ref.StageFor(idle),
+                (unsigned long long)ref.UntilNext(idle), (unsigned long long)idle, ladder.StageFor(idle),
+                (unsigned long long)ladder.UntilNextStageMs(idle), (unsigned long long)seed, round);
+        }
+    }
+}
+
+// ===== Trace replay =====
+// A day of input: bursts of activity, then breaks that are short, near a
+// threshold (either side, to the millisecond), or long enough for every stage
+static std::vector<uint64_t> MakeTrace(CheckRandom& rng, const ReferenceLadder& ref, uint64_t startMs)
+{
+    std::vector<uint64_t> inputs;
+    uint64_t t = startMs;
+    while (t < startMs + 24 * 60 * kMinute)
+    {
+        const uint64_t busyUntil = t + (1 + rng.Below(60)) * kMinute;
+        while (t < busyUntil)
+        {
+            t += 1 + rng.Below((uint32_t)(20 * kSecond));
+            inputs.push_back(t);
+        }
+        switch (rng.Below(4))
+        {
+        case 0: t += rng.Below((uint32_t)(2 * kMinute)); break;
+        case 1:
+        {
+            const AfkStage& s = ref.stages[rng.Below((uint32_t)ref.stages.size())];
+            t += s.thresholdMs + rng.Below(3) - 1; // One ms short of it, on it, or past it
+            break;
+        }
+        case 2: t += rng.Below((uint32_t)(90 * kMinute)); break;
+        default: t += (3 + rng.Below(10)) * 60 * kMinute; break;
+        }
+        inputs.push_back(t);
+    }
+    return inputs;
+}
+
+// The trace through a PlanEngine as the tray drives it: input goes to
+// UserInput while the engine wants it, otherwise the next AfkTick sees the
+// idle time drop. After every event the stage and plan must be the ones
+// the idle time calls for, and the timer must be due no later than the next
+// threshold, so no stage is ever applied late.
+static void CheckReplay(CheckLog& log, uint64_t seed, uint32_t traces)
+{
+    CheckRandom rng(seed ^ 0xAF4);
+    const PlanId manual = CheckPlan(1);
+    uint64_t ticks = 0, applied = 0, crossings = 0;
+    for (uint32_t trace = 0; trace < traces; ++trace)
+    {
+        ReferenceLadder ref;
+        for (uint32_t n = 1 + rng.Below(4); ref.stages.size() < n;)
+            ref.Set((uint32_t)((1 + rng.Below(60)) * kMinute) + rng.Below(2) * 500, 2 + (int)rng.Below(4));
+
+        const uint64_t startMs = 5 * 60 * kMinute, appliedBefore = applied;
+        uint64_t now = startMs;
+        CheckClockHost host(now);
+        host.active = manual;
+        PlanEngine engine(host);
+        CheckEngineDefaults(engine);
+        SwitchGovernor::Config governor;
+        governor.minDwellMs = 0; // Every decision shows at once
+        governor.burst = 1u << 30;
+        engine.SetGovernorConfig(governor);
+        for (const AfkStage& s : ref.stages)
+            engine.Ladder().Set(s.thresholdMs, s.plan);
+        engine.Start(manual, now);
+        uint64_t lastInput = now;
+        engine.AfkTick(now, 0);
+
+        const std::vector<uint64_t> inputs = MakeTrace(rng, ref, startMs);
+        size_t next = 0;
+        int lastStage = -1;
+        while (next < inputs.size())
+        {
+            if (inputs[next] <= host.afkDueMs)
+            {
+                now = lastInput = inputs[next++];
+                if (engine.InputSink())
+                    engine.UserInput(now);
+            }
+            else
+            {
+                now = host.afkDueMs;
+                engine.AfkTick(now, now - lastInput);
+                ++ticks;
+            }
+            const uint64_t idle = now - lastInput;
+            const int want = ref.StageFor(idle);
+            const int stage = engine.Afk().Stage();
+            const PlanId wantPlan = want >= 0 ? ref.stages[(size_t)want].plan : manual;
+            if (!log.Expect(stage == want && host.active == wantPlan,
+                    "stage %d (plan %d) at %llu ms idle, not %d (plan %d) (seed %llu, trace %u)", want,
+                    CheckPlanNumber(wantPlan), (unsigned long long)idle, stage, CheckPlanNumber(host.active),
+                    (unsigned long long)seed, trace))
+                break;
+            const uint64_t until = ref.UntilNext(idle);
+            if (!log.Expect(until == AfkLadder::kNever || host.afkDueMs <= now + until,
+                    "a tick due by the next threshold in %llu ms, not in %llu (seed %llu, trace %u)", (unsigned long long)until,
+                    (unsigned long long)(host.afkDueMs - now), (unsigned long long)seed, trace))
+                break;
+            if (stage > lastStage) applied += (uint64_t)(stage - lastStage);
+            lastStage = stage;
+        }
+        // Input landing on a threshold comes first, so a stage needs idle time past it
+        uint64_t crossed = 0;
+        for (size_t i = 0; i < next; ++i)
+            crossed += (uint64_t)(ref.StageFor((inputs[i] - (i ? inputs[i - 1] : startMs)) - 1) + 1);
+        log.Expect(applied - appliedBefore == crossed, "%llu stages applied, one per threshold crossed, not %llu (seed %llu, trace %u)",
+            (unsigned long long)crossed, (unsigned long long)(applied - appliedBefore), (unsigned long long)seed, trace);
+        crossings += crossed;
+    }
+    log.Note("%u traces, %llu AFK ticks, %llu stages applied, %llu thresholds crossed", traces, (unsigned long long)ticks,
+        (unsigned long long)applied, (unsigned long long)crossings);
+}
+
+// ===== Return inside the dwell =====
+// Under the default governor, a user back two seconds after a stage went in
+// gets their plan at once, whether the sink or the next tick sees them
+static void CheckReturnInDwell(CheckLog& log)
+{
+    const PlanId manual = CheckPlan(1), saver = CheckPlan(2);
+    CheckHost host;
+    host.active = manual;
+    PlanEngine engine(host);
+    CheckEngineDefaults(engine);
+    engine.Ladder().Set((uint32_t)(5 * kMinute), saver);
+    uint64_t now = 1000;
+    engine.Start(manual, now);
+    engine.AfkTick(now, 0);
+
+    now += 5 * kMinute;
+    engine.AfkTick(now, 5 * kMinute);
+    log.Expect(host.active == saver, "the stage applied at its threshold");
+    now += 2 * kSecond;
+    engine.UserInput(now);
+    log.Expect(host.active == manual, "the plan back on input two seconds into the dwell");
+    log.Expect(engine.Governor().NextDueMs() == SwitchGovernor::kNever && host.armedMs[PlanEngine::TIMER_GOVERNOR] == PlanEngine::kNever,
+        "nothing left parked with the governor");
+
+    // The same through the tick, as when the sink could not be set up
+    const uint64_t lastInput = now;
+    now += 5 * kMinute;
+    engine.AfkTick(now, now - lastInput);
+    log.Expect(host.active == saver, "the stage applied again");
+    now += 2 * kSecond;
+    engine.AfkTick(now, 500);
+    log.Expect(host.active == manual, "the plan back on the next tick two seconds into the dwell");
+}
+
+// ===== Re-targeted stage =====
+// A menu edit that gives the applied stage another plan leaves the machine on
+// the same stage; the new plan must still go in, and the return undo it
+static void CheckRetarget(CheckLog& log)
+{
+    const PlanId manual = CheckPlan(1), saver = CheckPlan(2), deeper = CheckPlan(3);
+    CheckHost host;
+    host.active = manual;
+    PlanEngine engine(host);
+    CheckEngineDefaults(engine);
+    engine.Ladder().Set((uint32_t)(5 * kMinute), saver);
+    engine.Ladder().Set((uint32_t)(20 * kMinute), deeper);
+    uint64_t now = 1000;
+    engine.Start(manual, now);
+    engine.AfkTick(now, 0);
+
+    now += 5 * kMinute;
+    engine.AfkTick(now, 5 * kMinute);
+    log.Expect(host.active == saver && engine.Afk().Stage() == 0, "the first stage applied at its threshold");
+    now += kMinute;
+    engine.Ladder().Set((uint32_t)(5 * kMinute), deeper);
+    engine.AfkTick(now, 6 * kMinute);
+    log.Expect(host.active == deeper && engine.Afk().Stage() == 0, "the stage's new plan in force once edited");
+    now += kMinute;
+    engine.AfkTick(now, 7 * kMinute);
+    log.Expect(host.applied == 2, "one switch for the edit, not one per tick: %u", host.applied);
+    now += kSecond;
+    engine.UserInput(now);
+    log.Expect(host.active == manual, "the plan back on return from the edited stage");
+}
+
+void CheckAfkLadder(CheckLog& log, uint64_t seed)
+{
+    CheckLadder(log, seed, 2000);
+    CheckReplay(log, seed, 300);
+    CheckReturnInDwell(log);
+    CheckRetarget(log);
+}
@@ -0,0 +1,273 @@
+// AppRulesCheck.cpp: The foreground rule table against a plain list, the rules' place among the other sources, and process triggers.
+
+#include "Checks.h"
+
+#include "AppRules.h"
+
+#include <string>
+#include <vector>
+
+#include <wchar.h>
+#include <wctype.h>
+
+static const uint64_t kMinute = 60000;
+
+// ===== Matcher =====
+static void CheckFixedCases(CheckLog& log)
+{
+    AppRuleTable t;
+    log.Expect(t.Match(L"devenv.exe") == nullptr, "no match in an empty table");
+    log.Expect(t.Add(L"DevEnv.exe", CheckPlan(1)), "a mixed-case name to be added");
+    log.Expect(t.Add(L"C:\\Program Files\\Blender\\blender.exe", CheckPlan(2)), "a full path to be added by its file name");
+    log.Expect(t.Count() == 2 && wcscmp(t.At(1).image, L"blender.exe") == 0, "rules stored as lowercase file names");
+
+    const AppRule* r = t.Match(L"C:\\Program Files\\Microsoft Visual Studio\\Common7\\IDE\\devenv.exe");
+    log.Expect(r && r->plan == CheckPlan(1), "a Windows path to match its file name");
+    r = t.Match(L"/opt/blender/BLENDER.EXE");
+    log.Expect(r && r->plan == CheckPlan(2), "a forward-slash path to match case-insensitively");
+    log.Expect(t.Match(L"devenv.exe.bak") == nullptr, "no match on a longer name");
+    log.Expect(t.Match(L"devenv.ex") == nullptr, "no match on a prefix");
+    log.Expect(t.Match(L"C:\\devenv.exe\\") == nullptr, "no match on a path ending in a separator");
+    log.Expect(t.Match(L"") == nullptr && t.Match(nullptr) == nullptr, "no match on an empty or null path");
+
+    log.Expect(t.Add(L"devenv.exe", CheckPlan(3)) && t.Count() == 2, "a repeated name to re-target its rule");
+    r = t.Match(L"DEVENV.EXE");
+    log.Expect(r && r->plan == CheckPlan(3), "the re-targeted plan");
+
+    log.Expect(!t.Add(L"", CheckPlan(1)) && !t.Add(L"C:\\dir\\", CheckPlan(1)), "empty names refused");
+    std::wstring longName(64, L'x');
+    log.Expect(!t.Add(longName.c_str(), CheckPlan(1)), "a 64-character name refused (no room for the terminator)");
+    longName.resize(63);
+    log.Expect(t.Add(longName.c_str(), CheckPlan(4)), "a 63-character name accepted");
+
+    // Beyond ASCII, case folds only as far as the C library's towlower does
+    log.Expect(t.Add(L"\u00E9diteur.exe", CheckPlan(5)), "a non-ASCII name to be added");
+    r = t.Match(L"D:\\Apps\\\u00E9DITEUR.EXE");
+    log.Expect(r && r->plan == CheckPlan(5), "a non-ASCII name to match with its ASCII part in another case");
+
+    AppRuleTable full;
+    bool allAdded = true;
+    for (size_t i = 0; i < AppRuleTable::kMaxRules; ++i)
+    {
+        wchar_t name[32];
+        swprintf(name, 32, L"app%zu.exe", i);
+        allAdded &= full.Add(name, CheckPlan(1 + (int)(i % 7)));
+    }
+    log.Expect(allAdded && full.Count() == AppRuleTable::kMaxRules, "%zu rules to fit", AppRuleTable::kMaxRules);
+    log.Expect(!full.Add(L"one-more.exe", CheckPlan(1)), "a new rule refused once full");
+    log.Expect(full.Add(L"APP7.EXE", CheckPlan(9)), "a full table to still re-target an existing rule");
+    r = full.Match(L"app7.exe");
+    log.Expect(r && r->plan == CheckPlan(9), "the re-targeted rule in a full table");
+    bool allFound = true;
+    for (size_t i = 0; i < AppRuleTable::kMaxRules; ++i)
+    {
+        wchar_t name[32];
+        swprintf(name, 32, L"APP%zu.exe", i);
+        allFound &= full.Match(name) != nullptr;
+    }
+    log.Expect(allFound, "every rule of a full table found");
+}
+
+// ===== Against a reference =====
+struct RefRule
+{
+    std::wstring name; // Lowercase file name
+    int plan;
+};
+
+static std::wstring Lower(const std::wstring& s)
+{
+    std::wstring out(s);
+    for (wchar_t& c : out) c = (wchar_t)towlower(c);
+    return out;
+}
+
+// Short names over a few letters, so prefixes, near misses and probe chains are common
+static std::wstring RandomName(CheckRandom& rng)
+{
+    static const wchar_t kLetters[] = L"abAB.e";
+    std::wstring s;
+    const uint32_t len = 1 + rng.Below(rng.Below(8) == 0 ? 70 : 6);
+    for (uint32_t i = 0; i < len; ++i)
+        s += kLetters[rng.Below(6)];
+    return s;
+}
+
+static std::wstring RandomPath(CheckRandom& rng, const std::wstring& name)
+{
+    switch (rng.Below(4))
+    {
+    case 0: return name;
+    case 1: return L"C:\\Program Files\\" + name;
+    case 2: return L"/usr/bin/" + name;
+    default: return L"D:\\a/b\\" + name;
+    }
+}
+
+static void CheckAgainstReference(CheckLog& log, uint64_t seed, uint32_t rounds)
+{
+    CheckRandom rng(seed);
+    uint64_t mismatches = 0;
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        AppRuleTable t;
+        std::vector<RefRule> ref;
+        const uint32_t adds = rng.Below(100);
+        for (uint32_t i = 0; i < adds; ++i)
+        {
+            const std::wstring name = RandomName(rng);
+            const int plan = 1 + (int)rng.Below(9);
+            const bool added = t.Add(RandomPath(rng, name).c_str(), CheckPlan(plan));
+
+            const std::wstring key = Lower(name);
+            size_t at = 0;
+            while (at < ref.size() && ref[at].name != key) ++at;
+            bool want = key.size() < 64;
+            if (want && at < ref.size()) ref[at].plan = plan;
+            else if (want && ref.size() < AppRuleTable::kMaxRules) ref.push_back({ key, plan });
+            else want = false;
+            mismatches += !log.Expect(added == want, "Add of \"%ls\" to return %d (seed %llu, round %u)",
+                name.c_str(), want, (unsigned long long)seed, round);
+        }
+        mismatches += !log.Expect(t.Count() == ref.size(), "%zu rules, not %zu (seed %llu, round %u)", ref.size(),
+            t.Count(), (unsigned long long)seed, round);
+        for (uint32_t q = 0; q < 200; ++q)
+        {
+            std::wstring name = q % 2 && !ref.empty() ? ref[rng.Below((uint32_t)ref.size())].name : RandomName(rng);
+            if (rng.Below(2))
+                for (wchar_t& c : name) c = (wchar_t)towupper(c);
+            const std::wstring key = Lower(name);
+            int want = 0;
+            for (const RefRule& r : ref)
+                if (r.name == key) want = r.plan;
+            const AppRule* got = t.Match(RandomPath(rng, name).c_str());
+            mismatches += !log.Expect(got ? CheckPlanNumber(got->plan) == want : want == 0,
+                "\"%ls\" to match plan %d, not %d (seed %llu, round %u)", name.c_str(), want,
+                got ? CheckPlanNumber(got->plan) : 0, (unsigned long long)seed, round);
+        }
+    }
+    log.Note("%u random tables, %llu mismatches", rounds, (unsigned long long)mismatches);
+}
+
+// ===== Arbitration =====
+// A foreground change claims the matched plan for SOURCE_APP_RULE, or
+// withdraws the claim when nothing matches
+static void CheckArbitration(CheckLog& log)
+{
+    const PlanId balanced = CheckPlan(1), performance = CheckPlan(2), saver = CheckPlan(3), quiet = CheckPlan(4);
+    CheckHost host;
+    host.active = balanced;
+    PlanEngine engine(host);
+    CheckEngineDefaults(engine);
+    AppRuleTable& rules = engine.AppRules();
+    rules.Add(L"devenv.exe", performance);
+    rules.Add(L"blender.exe", performance);
+    rules.Add(L"slack.exe", quiet);
+    engine.Ladder().Set((uint32_t)(5 * kMinute), saver);
+    uint64_t now = 10 * kMinute;
+    engine.Start(balanced, now);
+
+    now += kMinute;
+    engine.ForegroundChanged(L"C:\\VS\\devenv.exe", now);
+    log.Expect(host.active == performance, "a rule's plan applied when its app comes to the front");
+    const uint32_t applied = host.applied;
+    now += kMinute;
+    engine.ForegroundChanged(L"C:\\Blender\\blender.exe", now);
+    log.Expect(host.active == performance && host.applied == applied, "no switch between two apps with the same plan");
+
+    // AFK outranks the rule, and hands back to it
+    now += 6 * kMinute;
+    engine.AfkTick(now, 6 * kMinute);
+    log.Expect(host.active == saver, "an AFK stage to take over from an app rule");
+    now += kMinute;
+    engine.UserInput(now);
+    log.Expect(host.active == performance, "the rule's plan back when the user returns, not the manual one");
+
+    // Nothing matches: the claim goes, and the user's own plan is back
+    now += kMinute;
+    engine.ForegroundChanged(L"C:\\Windows\\explorer.exe", now);
+    log.Expect(host.active == balanced, "the manual plan back when no rule matches");
+    log.Expect(!engine.Policy().Has(SOURCE_APP_RULE), "no app-rule claim left behind");
+
+    // A menu pick applies at once; the next rule match still outranks it
+    now += kMinute;
+    engine.PlanPicked(saver, now);
+    log.Expect(host.active == saver, "a menu pick applied at once");
+    now += kMinute;
+    engine.ForegroundChanged(L"slack.exe", now);
+    log.Expect(host.active == quiet, "a rule to outrank the last menu pick");
+    now += kMinute;
+    engine.ForegroundChanged(L"notepad.exe", now);
+    log.Expect(host.active == saver, "the menu pick back when the rule lets go");
+
+    // A hold on the menu pick outranks rules until it runs out
+    engine.SetManualHoldMinutes(30);
+    now += kMinute;
+    engine.PlanPicked(balanced, now);
+    now += kMinute;
+    engine.ForegroundChanged(L"devenv.exe", now);
+    log.Expect(host.active == balanced, "a held menu pick to keep its plan against a rule");
+    now += 30 * kMinute;
+    engine.ClaimsExpire(now);
+    log.Expect(host.active == performance, "the rule's plan once the hold expires");
+
+    // An image that could not be read matches nothing
+    now += kMinute;
+    engine.ForegroundChanged(nullptr, now);
+    log.Expect(!engine.Policy().Has(SOURCE_APP_RULE), "no app-rule claim for an unknown foreground process");
+}
+
+// ===== Process triggers =====
+// Processes come and go by PID and creation time; while any matched one runs,
+// the first configured trigger among them holds SOURCE_PROCESS
+static void CheckProcessTriggers(CheckLog& log)
+{
+    const PlanId balanced = CheckPlan(1), performance = CheckPlan(2), quiet = CheckPlan(3);
+    CheckHost host;
+    host.active = balanced;
+    PlanEngine engine(host);
+    CheckEngineDefaults(engine);
+    engine.ProcessTriggers().Add(L"obs64.exe", performance);
+    engine.ProcessTriggers().Add(L"zoom.exe", quiet);
+    uint64_t now = 10 * kMinute;
+    engine.Start(balanced, now);
+
+    engine.ProcessStarted(100, 1, L"explorer.exe");
+    engine.ProcessStarted(200, 1, L"Zoom.exe");
+    engine.ProcessesScanned(now);
+    log.Expect(host.active == quiet && engine.WatchedProcesses() == 1, "a trigger's plan while its process runs");
+    now += kMinute;
+    engine.ProcessStarted(300, 1, L"obs64.exe");
+    engine.ProcessesScanned(now);
+    log.Expect(host.active == performance, "the first configured trigger to win when two run");
+
+    // A reused PID is another process: the old one's exit leaves the new one watched
+    now += kMinute;
+    engine.ProcessExited(300, 1);
+    engine.ProcessStarted(300, 2, L"obs64.exe");
+    engine.ProcessesScanned(now);
+    log.Expect(host.active == performance && engine.WatchedProcesses() == 2, "a reused PID still watched");
+    now += kMinute;
+    engine.ProcessExited(300, 1); // Already gone
+    engine.ProcessExited(300, 2);
+    engine.ProcessesScanned(now);
+    log.Expect(host.active == quiet, "the other trigger's plan once the first one's process exits");
+    now += kMinute;
+    engine.ProcessExited(200, 1);
+    engine.ProcessesScanned(now);
+    log.Expect(host.active == balanced && !engine.Policy().Has(SOURCE_PROCESS), "the manual plan back with no trigger running");
+
+    // A full table drops further matches and counts them
+    for (uint32_t pid = 1000; pid < 1100; ++pid)
+        engine.ProcessStarted(pid, 1, L"zoom.exe");
+    log.Expect(engine.WatchedProcesses() == 64 && engine.WatchedDropped() == 36, "64 watched and 36 dropped, not %zu and %u",
+        engine.WatchedProcesses(), engine.WatchedDropped());
+}
+
+void CheckAppRules(CheckLog& log, uint64_t seed)
+{
+    CheckFixedCases(log);
+    CheckAgainstReference(log, seed, 500);
+    CheckArbitration(log);
+    CheckProcessTriggers(log);
+}
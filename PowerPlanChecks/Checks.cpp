@@ -0,0 +1,87 @@
+// Checks.cpp: Shared pieces of the self-checks for the portable cores.
+
+#include "Checks.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+bool CheckLog::Expect(bool ok, const char* format, ...)
+{
+    ++m_expectations;
+    if (ok)
+        return true;
+    if (++m_failures <= kShownFailures)
+    {
+        fputs("  expected ", stdout);
+        va_list args;
+        va_start(args, format);
+        vprintf(format, args);
+        va_end(args);
+        fputc('\n', stdout);
+    }
+    else if (m_failures == kShownFailures + 1)
+    {
+        puts("  (further failures not shown)");
+    }
+    return false;
+}
+
+void CheckLog::Note(const char* format, ...)
+{
+    if (!m_verbose)
+        return;
+    fputs("  ", stdout);
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    fputc('\n', stdout);
+}
+
+uint32_t CheckRandom::Next()
+{
+    m_state ^= m_state >> 12;
+    m_state ^= m_state << 25;
+    m_state ^= m_state >> 27;
+    return (uint32_t)((m_state * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+PlanId CheckPlan(int n)
+{
+    PlanId id{};
+    id.bytes[0] = (uint8_t)n;
+    return id;
+}
+
+int CheckPlanNumber(const PlanId& plan)
+{
+    return plan.bytes[0];
+}
+
+CheckHost::CheckHost()
+{
+    for (uint64_t& ms : armedMs) ms = PlanEngine::kNever;
+}
+
+void CheckHost::CollectActivity(ActivitySample& out)
+{
+    out = ActivitySample{};
+}
+
+// A weekday morning; nothing the checks use depends on it
+void CheckHost::LocalTime(uint32_t& weekday, uint32_t& minute, uint32_t& msIntoMinute)
+{
+    weekday = 2;
+    minute = 10 * 60;
+    msIntoMinute = 0;
+}
+
+void CheckEngineDefaults(PlanEngine& engine)
+{
+    ActivityVeto::Config veto;
+    veto.cpuPercent = 0;
+    veto.diskBytesPerSec = 0;
+    veto.netBytesPerSec = 0;
+    veto.powerRequests = false;
+    engine.SetVetoConfig(veto);
+}
@@ -0,0 +1,110 @@
+// Checks.h: Shared pieces of the self-checks for the portable cores.
+
+#pragma once
+
+#include "PlanEngine.h"
+#include "PlanId.h"
+
+#include <stdint.h>
+
+// What a check reports to. A failed expectation is printed (the first few of
+// them) and counted, and the check carries on, so one run shows every way it
+// went wrong.
+class CheckLog
+{
+public:
+    explicit CheckLog(bool verbose) : m_verbose(verbose) {}
+
+    // printf-style description of what was expected; returns ok
+    bool Expect(bool ok, const char* format, ...)
+#ifdef __GNUC__
+        __attribute__((format(printf, 3, 4)))
+#endif
+        ;
+    // Printed with --verbose only
+    void Note(const char* format, ...)
+#ifdef __GNUC__
+        __attribute__((format(printf, 2, 3)))
+#endif
+        ;
+
+    uint64_t Expectations() const { return m_expectations; }
+    uint64_t Failures() const { return m_failures; }
+
+private:
+    static const uint64_t kShownFailures = 20;
+
+    bool m_verbose;
+    uint64_t m_expectations = 0;
+    uint64_t m_failures = 0;
+};
+
+// xorshift64*: the same seed gives the same sequence everywhere
+class CheckRandom
+{
+public:
+    explicit CheckRandom(uint64_t seed) : m_state(seed ? seed : 0x9E3779B97F4A7C15ull) {}
+
+    uint32_t Next();
+    uint32_t Below(uint32_t n) { return n ? Next() % n : 0; }
+
+private:
+    uint64_t m_state;
+};
+
+// Plan n (n > 0) as the checks name them: n in the first byte
+PlanId CheckPlan(int n);
+int CheckPlanNumber(const PlanId& plan); // 0 for null
+
+// Hosts a plan engine with nothing behind it: the plan in force is whatever
+// was last applied, timers are only recorded, and the machine is never busy
+class CheckHost : public PlanEngine::Host
+{
+public:
+    CheckHost();
+
+    PlanId active{};
+    uint32_t applied = 0;                      // ApplyPlan calls
+    uint64_t armedMs[PlanEngine::TIMER_COUNT]; // Delay last armed, kNever if none
+
+    bool ReadActivePlan(PlanId& out) override { out = active; return true; }
+    void ApplyPlan(const PlanId& plan) override { active = plan; ++applied; }
+    void ArmTimer(PlanEngine::Timer timer, uint64_t delayMs) override { armedMs[timer] = delayMs; }
+    void CollectActivity(ActivitySample& out) override;
+    bool SetInputSink(bool) override { return true; }
+    void LocalTime(uint32_t& weekday, uint32_t& minute, uint32_t& msIntoMinute) override;
+};
+
+// A CheckHost on a virtual clock, so an armed AFK delay becomes a due time
+class CheckClockHost : public CheckHost
+{
+public:
+    explicit CheckClockHost(const uint64_t& clock) : m_clock(clock) {}
+
+    uint64_t afkDueMs = PlanEngine::kNever;
+
+    void ArmTimer(PlanEngine::Timer timer, uint64_t delayMs) override
+    {
+        CheckHost::ArmTimer(timer, delayMs);
+        if (timer == PlanEngine::TIMER_AFK)
+            afkDueMs = delayMs == PlanEngine::kNever ? PlanEngine::kNever : m_clock + delayMs;
+    }
+
+private:
+    const uint64_t& m_clock;
+};
+
+// An engine on a CheckHost with the veto off, as every check wants it
+void CheckEngineDefaults(PlanEngine& engine);
+
+// ===== The checks =====
+// Each takes the run's seed for whatever it randomizes
+void CheckActivityVeto(CheckLog& log, uint64_t seed);
+void CheckAfkLadder(CheckLog& log, uint64_t seed);
+void CheckAppRules(CheckLog& log, uint64_t seed);
+void CheckCli(CheckLog& log, uint64_t seed);
+void CheckPolicy(CheckLog& log, uint64_t seed);
+void CheckPowerSource(CheckLog& log, uint64_t seed);
+void CheckProcessDiff(CheckLog& log, uint64_t seed);
+void CheckSchedule(CheckLog& log, uint64_t seed);
+void CheckTickWrap(CheckLog& log, uint64_t seed);
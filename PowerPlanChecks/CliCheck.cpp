@@ -0,0 +1,203 @@
+// CliCheck.cpp: Command-line parsing, the forwarded request's checks, and plan GUID text both ways.
+
+#include "Checks.h"
+
+#include "CliCommand.h"
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include <wchar.h>
+
+// ===== Parsing =====
+struct ParseCase
+{
+    std::vector<const wchar_t*> args; // After the program name
+    bool ok;
+    uint32_t verb;
+    uint32_t minutes;
+    const wchar_t* plan;
+};
+
+static bool Parse(const std::vector<const wchar_t*>& args, CliRequest& out)
+{
+    std::vector<const wchar_t*> argv(1, L"PowerPlanTray.exe");
+    argv.insert(argv.end(), args.begin(), args.end());
+    return CliParse((int)argv.size(), argv.data(), out);
+}
+
+static void CheckParse(CheckLog& log)
+{
+    static const ParseCase kCases[] = {
+        { {}, true, CLI_NONE, 0, L"" },
+        { { L"--help" }, true, CLI_HELP, 0, L"" },
+        { { L"/?" }, true, CLI_HELP, 0, L"" },
+        { { L"--help", L"--set" }, false, CLI_HELP, 0, L"" },
+        { { L"--set", L"Power", L"saver" }, true, CLI_SET, 0, L"Power saver" },
+        { { L"--set", L"{381b4222-f694-41f0-9685-ff5bb260df2e}" }, true, CLI_SET, 0, L"{381b4222-f694-41f0-9685-ff5bb260df2e}" },
+        { { L"--set" }, false, CLI_SET, 0, L"" },
+        { { L"--get" }, true, CLI_GET, 0, L"" },
+        { { L"--get", L"now" }, false, CLI_GET, 0, L"" },
+        { { L"--list" }, true, CLI_LIST, 0, L"" },
+        { { L"--toggle" }, true, CLI_TOGGLE, 0, L"" },
+        { { L"--afk", L"5", L"Power", L"saver" }, true, CLI_AFK, 5, L"Power saver" },
+        { { L"--afk", L"0" }, true, CLI_AFK, 0, L"" },
+        { { L"--afk", L"1440" }, true, CLI_AFK, 1440, L"" },
+        { { L"--afk", L"1441" }, false, CLI_AFK, 0, L"" },
+        { { L"--afk", L"-1" }, false, CLI_AFK, 0, L"" },
+        { { L"--afk", L"5min" }, false, CLI_AFK, 0, L"" },
+        { { L"--afk", L"" }, false, CLI_AFK, 0, L"" },
+        { { L"--afk" }, false, CLI_AFK, 0, L"" },
+        { { L"--SET", L"Balanced" }, false, CLI_NONE, 0, L"" },
+        { { L"Balanced" }, false, CLI_NONE, 0, L"" },
+    };
+    for (const ParseCase& c : kCases)
+    {
+        std::wstring line;
+        for (const wchar_t* a : c.args)
+            line += std::wstring(L" ") + a;
+        CliRequest r;
+        const bool ok = Parse(c.args, r);
+        log.Expect(ok == c.ok, "\"%ls\" to %s", line.c_str(), c.ok ? "parse" : "be refused");
+        if (ok && c.ok)
+        {
+            log.Expect(r.version == kCliVersion && r.verb == c.verb && r.minutes == c.minutes && wcscmp(r.plan, c.plan) == 0,
+                "\"%ls\" as verb %u, %u min, \"%ls\", not verb %u, %u min, \"%ls\"", line.c_str(), c.verb, c.minutes,
+                c.plan, r.verb, r.minutes, r.plan);
+        }
+    }
+
+    // The joined plan name has to fit with its terminator
+    std::wstring name(kCliArgMax - 1, L'x');
+    CliRequest r;
+    log.Expect(Parse({ L"--set", name.c_str() }, r) && wcslen(r.plan) == kCliArgMax - 1,
+        "a %zu-character name to fit", kCliArgMax - 1);
+    name += L'x';
+    log.Expect(!Parse({ L"--set", name.c_str() }, r), "a %zu-character name refused", kCliArgMax);
+    name.resize(kCliArgMax / 2);
+    log.Expect(!Parse({ L"--set", name.c_str(), name.c_str() }, r), "two words too long once joined refused");
+}
+
+// ===== Decoding =====
+static bool SameRequest(const CliRequest& a, const CliRequest& b)
+{
+    return a.version == b.version && a.verb == b.verb && a.minutes == b.minutes && wcscmp(a.plan, b.plan) == 0;
+}
+
+static void CheckDecode(CheckLog& log, uint64_t seed, uint32_t rounds)
+{
+    CliRequest sent;
+    Parse({ L"--afk", L"20", L"Power", L"saver" }, sent);
+    CliRequest got;
+    log.Expect(CliDecode(kCliRequestTag, &sent, sizeof(sent), got) && SameRequest(sent, got), "a parsed request to decode as sent");
+    log.Expect(!CliDecode(kCliReplyTag, &sent, sizeof(sent), got), "another tag refused");
+    log.Expect(!CliDecode(kCliRequestTag, &sent, sizeof(sent) - 1, got) && !CliDecode(kCliRequestTag, nullptr, sizeof(sent), got),
+        "a short or missing request refused");
+
+    CliRequest bad = sent;
+    bad.version = kCliVersion + 1;
+    log.Expect(!CliDecode(kCliRequestTag, &bad, sizeof(bad), got), "another version refused");
+    for (uint32_t verb : { (uint32_t)CLI_NONE, (uint32_t)CLI_HELP, (uint32_t)CLI_VERB_COUNT, 0xFFFFFFFFu })
+    {
+        bad = sent;
+        bad.verb = verb;
+        log.Expect(!CliDecode(kCliRequestTag, &bad, sizeof(bad), got), "verb %u refused", verb);
+    }
+    bad = sent;
+    bad.minutes = kCliMaxAfkMinutes + 1;
+    log.Expect(!CliDecode(kCliRequestTag, &bad, sizeof(bad), got), "%u AFK minutes refused", bad.minutes);
+    bad.verb = CLI_SET; // Minutes mean nothing to other verbs
+    log.Expect(CliDecode(kCliRequestTag, &bad, sizeof(bad), got), "stray minutes on --set let through");
+    bad = sent;
+    wmemset(bad.plan, L'x', kCliArgMax);
+    log.Expect(!CliDecode(kCliRequestTag, &bad, sizeof(bad), got), "a plan name without its terminator refused");
+
+    // Whatever arrives, a request that passes is one the tray can act on
+    CheckRandom rng(seed);
+    uint64_t accepted = 0;
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        CliRequest r = sent;
+        uint8_t* bytes = reinterpret_cast<uint8_t*>(&r);
+        for (uint32_t n = 1 + rng.Below(4); n; --n)
+        {
+            const uint32_t at = rng.Below(rng.Below(2) ? 12 : (uint32_t)sizeof(r));
+            bytes[at] = (uint8_t)rng.Next();
+        }
+        if (rng.Below(4) == 0)
+            wmemset(r.plan, (wchar_t)(L'a' + rng.Below(26)), kCliArgMax - rng.Below(2));
+        if (!CliDecode(kCliRequestTag, &r, sizeof(r), got))
+            continue;
+        ++accepted;
+        log.Expect(got.version == kCliVersion && got.verb > CLI_HELP && got.verb < CLI_VERB_COUNT &&
+                (got.verb != CLI_AFK || got.minutes <= kCliMaxAfkMinutes) && wmemchr(got.plan, L'\0', kCliArgMax),
+            "only well-formed requests through: verb %u, %u min (seed %llu, round %u)", got.verb, got.minutes,
+            (unsigned long long)seed, round);
+    }
+    log.Note("%u damaged requests, %llu still well-formed and accepted", rounds, (unsigned long long)accepted);
+}
+
+// ===== Plan GUID text =====
+static void CheckPlanIdText(CheckLog& log, uint64_t seed, uint32_t rounds)
+{
+    // Balanced: Data1..Data3 little-endian in memory, the last 8 bytes as written
+    PlanId id;
+    log.Expect(ParsePlanId(L"{381b4222-f694-41f0-9685-ff5bb260df2e}", id), "Balanced's GUID to parse");
+    static const uint8_t kBalanced[16] = { 0x22, 0x42, 0x1b, 0x38, 0x94, 0xf6, 0xf0, 0x41,
+        0x96, 0x85, 0xff, 0x5b, 0xb2, 0x60, 0xdf, 0x2e };
+    log.Expect(memcmp(id.bytes, kBalanced, 16) == 0, "Balanced's GUID in memory order");
+    PlanId again;
+    log.Expect(ParsePlanId(L"381B4222-F694-41F0-9685-FF5BB260DF2E", again) && again == id,
+        "the same GUID without braces and in upper case");
+
+    static const wchar_t* const kMalformed[] = {
+        L"",
+        L"{}",
+        L"{381b4222-f694-41f0-9685-ff5bb260df2e",
+        L"381b4222-f694-41f0-9685-ff5bb260df2e}",
+        L"{381b4222f694-41f0-9685-ff5bb260df2e}",
+        L"{381b4222-f694-41f0-9685-ff5bb260df2}",
+        L"{381b4222-f694-41f0-9685-ff5bb260df2e0}",
+        L"{381b4222-f694-41f0-9685-ff5bb260df2g}",
+        L"{381b422-2f694-41f0-9685-ff5bb260df2e}",
+        L" {381b4222-f694-41f0-9685-ff5bb260df2e}",
+        L"{381b4222-f694-41f0-9685-ff5bb260df2e} ",
+        L"{{381b4222-f694-41f0-9685-ff5bb260df2e}}",
+        L"Balanced",
+    };
+    for (const wchar_t* text : kMalformed)
+    {
+        PlanId out = CheckPlan(7);
+        log.Expect(!ParsePlanId(text, out) && out == CheckPlan(7), "\"%ls\" refused, the output untouched", text);
+    }
+
+    CheckRandom rng(seed ^ 0xC11);
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        PlanId random;
+        for (uint8_t& b : random.bytes)
+            b = (uint8_t)rng.Next();
+        wchar_t text[40];
+        FormatPlanId(random, text, 40);
+        PlanId back;
+        const bool formed = wcslen(text) == 38 && text[0] == L'{' && text[37] == L'}';
+        log.Expect(formed && ParsePlanId(text, back) && back == random, "\"%ls\" to read back as written (seed %llu, round %u)",
+            text, (unsigned long long)seed, round);
+        // Every strict prefix of it, and the same with one digit spoiled
+        const size_t cut = 1 + rng.Below(37);
+        std::wstring partial(text, cut);
+        log.Expect(!ParsePlanId(partial.c_str(), back), "\"%ls\" (cut short) refused", partial.c_str());
+        std::wstring spoiled(text);
+        size_t at = 1 + rng.Below(36);
+        while (spoiled[at] == L'-') ++at;
+        spoiled[at] = L"gz -{}"[rng.Below(6)];
+        log.Expect(!ParsePlanId(spoiled.c_str(), back), "\"%ls\" refused", spoiled.c_str());
+    }
+}
+
+void CheckCli(CheckLog& log, uint64_t seed)
+{
+    CheckParse(log);
+    CheckDecode(log, seed, 20000);
+    CheckPlanIdText(log, seed, 5000);
+}
@@ -0,0 +1,143 @@
+// PolicyCheck.cpp: The cached-winner arbitration against a full scan of every claim.
+
+#include "Checks.h"
+
+#include "PolicyEngine.h"
+
+// Every claim kept in full and the winner found by looking at all of them,
+// the way the header describes it
+struct ReferencePolicy
+{
+    bool held[PolicyEngine::kMaxSources] = {};
+    int plan[PolicyEngine::kMaxSources] = {};
+    int priority[PolicyEngine::kMaxSources] = {};
+    uint64_t expiresMs[PolicyEngine::kMaxSources] = {};
+
+    int Winner() const
+    {
+        int w = -1;
+        for (int s = 0; s < PolicyEngine::kMaxSources; ++s)
+        {
+            if (held[s] && (w < 0 || priority[s] > priority[w]))
+                w = s;
+        }
+        return w;
+    }
+    int Effective() const { const int w = Winner(); return w < 0 ? 0 : plan[w]; }
+    int Count() const
+    {
+        int n = 0;
+        for (bool h : held) n += h;
+        return n;
+    }
+    uint64_t NextExpiry() const
+    {
+        uint64_t next = PolicyEngine::kNever;
+        for (int s = 0; s < PolicyEngine::kMaxSources; ++s)
+        {
+            if (held[s] && expiresMs[s] != PolicyEngine::kNever && expiresMs[s] < next)
+                next = expiresMs[s];
+        }
+        return next;
+    }
+};
+
+static bool Same(CheckLog& log, const PolicyEngine& engine, const ReferencePolicy& ref, const char* op, uint64_t seed,
+    uint32_t sequence, uint32_t step)
+{
+    bool held = true;
+    for (int s = 0; s < PolicyEngine::kMaxSources; ++s)
+        held &= engine.Has(s) == ref.held[s];
+    return log.Expect(CheckPlanNumber(engine.Effective()) == ref.Effective() && engine.Winner() == ref.Winner() &&
+            engine.ClaimCount() == ref.Count() && engine.NextExpiryMs() == ref.NextExpiry() && held,
+        "plan %d from source %d with %d claims after %s, not plan %d from %d with %d (seed %llu, sequence %u, step %u)",
+        ref.Effective(), ref.Winner(), ref.Count(), op, CheckPlanNumber(engine.Effective()), engine.Winner(),
+        engine.ClaimCount(), (unsigned long long)seed, sequence, step);
+}
+
+// Few priorities, so ties (lower source wins) are common; the tray's own
+// fixed priorities are one case of this
+static void CheckSequences(CheckLog& log, uint64_t seed, uint32_t sequences)
+{
+    CheckRandom rng(seed);
+    uint64_t ops = 0, rescansExpected = 0;
+    for (uint32_t sequence = 0; sequence < sequences; ++sequence)
+    {
+        PolicyEngine engine;
+        ReferencePolicy ref;
+        uint64_t now = 1000;
+        uint32_t rescans = 0;
+        const uint32_t steps = 1 + rng.Below(200);
+        const int sources = 1 + (int)rng.Below(PolicyEngine::kMaxSources);
+        for (uint32_t step = 0; step < steps; ++step, ++ops)
+        {
+            if (rng.Below(3) == 0)
+                now += rng.Below(5000);
+            const int before = ref.Effective(), winner = ref.Winner();
+            const char* op;
+            bool changed;
+            const uint32_t kind = rng.Below(10);
+            if (kind < 6)
+            {
+                op = "Submit";
+                const int s = (int)rng.Below((uint32_t)sources);
+                const int plan = 1 + (int)rng.Below(4);
+                const int priority = (int)rng.Below(4) * 10;
+                const uint64_t lifetime = rng.Below(3) == 0 ? 1 + rng.Below(20000) : 0;
+                rescans += s == winner && priority < ref.priority[s]; // The winner weakened
+                changed = engine.Submit(s, CheckPlan(plan), priority, now, lifetime);
+                ref.held[s] = true;
+                ref.plan[s] = plan;
+                ref.priority[s] = priority;
+                ref.expiresMs[s] = lifetime ? now + lifetime : PolicyEngine::kNever;
+            }
+            else if (kind < 8)
+            {
+                op = "Withdraw";
+                const int s = (int)rng.Below((uint32_t)sources);
+                rescans += s == winner;
+                const bool had = ref.held[s];
+                const bool withdrew = engine.Withdraw(s);
+                ref.held[s] = false;
+                changed = withdrew;
+                log.Expect(had || !withdrew, "Withdraw of an absent claim to report no change (seed %llu, sequence %u, step %u)",
+                    (unsigned long long)seed, sequence, step);
+            }
+            else
+            {
+                op = "Expire";
+                rescans += winner >= 0 && ref.expiresMs[winner] <= now;
+                changed = engine.Expire(now);
+                for (int s = 0; s < PolicyEngine::kMaxSources; ++s)
+                    ref.held[s] &= ref.expiresMs[s] > now;
+            }
+            log.Expect(changed == (ref.Effective() != before), "%s to report %s (seed %llu, sequence %u, step %u)", op,
+                ref.Effective() != before ? "a change" : "no change", (unsigned long long)seed, sequence, step);
+            Same(log, engine, ref, op, seed, sequence, step);
+        }
+        // Only a winner that leaves or weakens costs a scan of the others
+        log.Expect(engine.Rescans() == rescans, "%u rescans, not %u (seed %llu, sequence %u)", rescans, engine.Rescans(),
+            (unsigned long long)seed, sequence);
+        rescansExpected += rescans;
+    }
+    log.Note("%u sequences, %llu operations, %llu rescans", sequences, (unsigned long long)ops,
+        (unsigned long long)rescansExpected);
+}
+
+// Claims out of range are refused and change nothing
+static void CheckBounds(CheckLog& log)
+{
+    PolicyEngine engine;
+    log.Expect(!engine.Submit(-1, CheckPlan(1), 10, 0, 0) && !engine.Submit(PolicyEngine::kMaxSources, CheckPlan(1), 10, 0, 0),
+        "sources out of range refused");
+    log.Expect(engine.ClaimCount() == 0 && engine.Winner() == -1 && engine.Effective().IsNull(), "nothing held after them");
+    log.Expect(!engine.Withdraw(-1) && !engine.Withdraw(PolicyEngine::kMaxSources) && !engine.Expire(UINT64_MAX - 1),
+        "no change from withdrawing or expiring nothing");
+    log.Expect(engine.NextExpiryMs() == PolicyEngine::kNever, "no expiry without claims");
+}
+
+void CheckPolicy(CheckLog& log, uint64_t seed)
+{
+    CheckBounds(log);
+    CheckSequences(log, seed, 2000);
+}
@@ -0,0 +1,110 @@
+// PowerPlanChecks.cpp: Self-checks of the portable cores, runnable anywhere.
+//
+// Builds from the cores' own sources:
+//   g++ -O2 -std=c++17 -IPowerPlanTray PowerPlanChecks/*.cpp PowerPlanTray/ActivityVeto.cpp
+//       PowerPlanTray/AfkLadder.cpp PowerPlanTray/AfkMachine.cpp PowerPlanTray/AppRules.cpp
+//       PowerPlanTray/CliCommand.cpp PowerPlanTray/LoadSwitcher.cpp PowerPlanTray/PlanEngine.cpp PowerPlanTray/PlanSchedule.cpp
+//       PowerPlanTray/PolicyEngine.cpp PowerPlanTray/ReturnPredictor.cpp PowerPlanTray/SwitchGovernor.cpp
+//       -o powerplanchecks
+//
+// Each check prints PASS or FAIL with the expectations it tested; the run
+// exits non-zero if any failed. Randomized checks take their seed from
+// --seed, so a failure can be replayed.
+
+#include "Checks.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct CheckEntry
+{
+    const char* name;
+    void (*run)(CheckLog& log, uint64_t seed);
+    const char* what;
+};
+
+static const CheckEntry kChecks[] = {
+    { "activityveto", CheckActivityVeto, "AFK veto thresholds and baseline, and a stage held off in the engine" },
+    { "afkladder", CheckAfkLadder, "AFK ladder against a plain list, and input traces replayed through the engine" },
+    { "cli", CheckCli, "command-line parsing, forwarded-request checks and plan GUID text" },
+    { "apprules", CheckAppRules, "foreground rule matcher against a plain list, its arbitration, and process triggers" },
+    { "policy", CheckPolicy, "claim arbitration against a full scan, 2000 random sequences" },
+    { "power", CheckPowerSource, "AC/DC, low-battery and energy-saver precedence, and its engine claim" },
+    { "processdiff", CheckProcessDiff, "process-snapshot diff against a set difference, with PID reuse" },
+    { "schedule", CheckSchedule, "a year of schedule timers in five time zones, DST days included, and the engine's claim" },
+    { "tickwrap", CheckTickWrap, "three years of AFK decisions through every 49.7-day tick wrap" },
+};
+
+static void Usage()
+{
+    fputs(
+        "usage: powerplanchecks [options] [check...]   (all checks by default)\n"
+        "  --seed N     seed for the randomized checks (default 1)\n"
+        "  --verbose    print what each check covered\n"
+        "  --list       list the checks\n",
+        stderr);
+}
+
+static const CheckEntry* FindCheck(const char* name)
+{
+    for (const CheckEntry& c : kChecks)
+        if (strcmp(c.name, name) == 0)
+            return &c;
+    return nullptr;
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t seed = 1;
+    bool verbose = false;
+    const CheckEntry* chosen[sizeof(kChecks) / sizeof(kChecks[0])];
+    size_t chosenCount = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* a = argv[i];
+        if (strcmp(a, "--seed") == 0 && i + 1 < argc) seed = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(a, "--verbose") == 0) verbose = true;
+        else if (strcmp(a, "--list") == 0)
+        {
+            for (const CheckEntry& c : kChecks)
+                printf("%-12s %s\n", c.name, c.what);
+            return 0;
+        }
+        else if (const CheckEntry* c = FindCheck(a))
+        {
+            if (chosenCount < sizeof(chosen) / sizeof(chosen[0]))
+                chosen[chosenCount++] = c;
+        }
+        else
+        {
+            Usage();
+            return 2;
+        }
+    }
+    if (!chosenCount)
+    {
+        for (const CheckEntry& c : kChecks)
+            chosen[chosenCount++] = &c;
+    }
+
+    int failed = 0;
+    for (size_t i = 0; i < chosenCount; ++i)
+    {
+        const CheckEntry& c = *chosen[i];
+        CheckLog log(verbose);
+        const auto start = std::chrono::steady_clock::now();
+        c.run(log, seed);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        const bool ok = log.Failures() == 0;
+        printf("%s %-12s %llu expectations", ok ? "PASS" : "FAIL", c.name, (unsigned long long)log.Expectations());
+        if (!ok)
+            printf(", %llu failed", (unsigned long long)log.Failures());
+        printf(" (%.0f ms)\n", ms);
+        failed += !ok;
+    }
+    if (failed)
+        printf("%d of %zu checks failed (seed %llu)\n", failed, chosenCount, (unsigned long long)seed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,134 @@
+// PowerSourceCheck.cpp: The AC/DC, low-battery and energy-saver mapping against its stated precedence, and through the engine.
+
+#include "Checks.h"
+
+#include "PolicySources.h"
+
+static const uint64_t kMinute = 60000;
+
+// ===== Mapping =====
+// The precedence as the header states it, one rule at a time
+static int ReferenceWant(const int (&plans)[4], bool onBattery, uint32_t percent, bool saverOn, uint32_t lowPercent)
+{
+    enum { AC, DC, LOW, SAVER };
+    if (saverOn && plans[SAVER])
+        return plans[SAVER];
+    if (!onBattery)
+        return plans[AC];
+    if (percent <= lowPercent && plans[LOW])
+        return plans[LOW];
+    return plans[DC];
+}
+
+static void CheckMapping(CheckLog& log)
+{
+    const PlanId ac = CheckPlan(1), dc = CheckPlan(2), low = CheckPlan(3), saver = CheckPlan(4);
+    PowerSourceMap map;
+    map.onAc = ac;
+    map.onDc = dc;
+    map.lowBattery = low;
+    map.energySaver = saver;
+    map.lowBatteryPercent = 20;
+    log.Expect(map.Want(false, 100, false) == ac && map.Want(true, 100, false) == dc, "AC and DC plans by the power source");
+    log.Expect(map.Want(true, 20, false) == low && map.Want(true, 21, false) == dc, "a low battery from 20%% down, not at 21%%");
+    log.Expect(map.Want(false, 5, false) == ac, "no low-battery plan on AC, whatever the percentage says");
+    log.Expect(map.Want(true, 5, true) == saver && map.Want(false, 100, true) == saver, "energy saver ahead of everything");
+
+    // Every mapping set or not, on both sources, across the threshold
+    static const uint32_t kThresholds[] = { 0, 20, 100 };
+    uint32_t cases = 0;
+    for (int mask = 0; mask < 16; ++mask)
+    {
+        const int plans[4] = { mask & 1 ? 1 : 0, mask & 2 ? 2 : 0, mask & 4 ? 3 : 0, mask & 8 ? 4 : 0 };
+        PowerSourceMap m;
+        m.onAc = plans[0] ? CheckPlan(plans[0]) : PlanId{};
+        m.onDc = plans[1] ? CheckPlan(plans[1]) : PlanId{};
+        m.lowBattery = plans[2] ? CheckPlan(plans[2]) : PlanId{};
+        m.energySaver = plans[3] ? CheckPlan(plans[3]) : PlanId{};
+        for (uint32_t lowPercent : kThresholds)
+        {
+            m.lowBatteryPercent = lowPercent;
+            for (uint32_t percent = 0; percent <= 100; ++percent)
+            {
+                for (int flags = 0; flags < 4; ++flags)
+                {
+                    const bool onBattery = (flags & 1) != 0, saverOn = (flags & 2) != 0;
+                    const int want = ReferenceWant(plans, onBattery, percent, saverOn, lowPercent);
+                    const int got = CheckPlanNumber(m.Want(onBattery, percent, saverOn));
+                    log.Expect(got == want, "plan %d, not %d (mappings %x, %s, %u%% of %u%%, saver %s)", want, got, mask,
+                        onBattery ? "DC" : "AC", percent, lowPercent, saverOn ? "on" : "off");
+                    ++cases;
+                }
+            }
+        }
+    }
+    log.Note("%u mapping cases", cases);
+}
+
+// ===== Through the engine =====
+// Each change re-claims SOURCE_POWER_SOURCE; the battery draining without
+// crossing the threshold costs no switch, and a higher source still wins
+static void CheckEngine(CheckLog& log)
+{
+    const PlanId manual = CheckPlan(1), ac = CheckPlan(2), dc = CheckPlan(3), low = CheckPlan(4), saver = CheckPlan(5),
+        game = CheckPlan(6);
+    CheckHost host;
+    host.active = manual;
+    PlanEngine engine(host);
+    CheckEngineDefaults(engine);
+    PowerSourceMap map;
+    map.onAc = ac;
+    map.onDc = dc;
+    map.lowBattery = low;
+    map.energySaver = saver;
+    engine.SetPowerSourceMap(map);
+    uint64_t now = 10 * kMinute;
+    engine.Start(manual, now);
+
+    now += kMinute;
+    engine.PowerSource(false, now);
+    log.Expect(host.active == ac, "the AC plan on AC");
+    now += kMinute;
+    engine.PowerSource(true, now);
+    log.Expect(host.active == dc, "the DC plan once unplugged");
+    const uint32_t applied = host.applied;
+    for (uint32_t percent = 99; percent > 20; --percent)
+    {
+        now += kMinute;
+        engine.BatteryPercent(percent, now);
+    }
+    log.Expect(host.active == dc && host.applied == applied, "no switch while the battery drains down to 21%%");
+    now += kMinute;
+    engine.BatteryPercent(20, now);
+    log.Expect(host.active == low, "the low-battery plan at 20%%");
+    now += kMinute;
+    engine.EnergySaver(true, now);
+    log.Expect(host.active == saver, "energy saver over the low battery");
+    now += kMinute;
+    engine.EnergySaver(false, now);
+    log.Expect(host.active == low, "the low-battery plan back when energy saver goes off");
+    now += kMinute;
+    engine.PowerSource(false, now);
+    log.Expect(host.active == ac, "the AC plan once plugged in, the percentage still low");
+
+    // Below a process trigger, above the user's own choice
+    now += kMinute;
+    engine.Claim(SOURCE_PROCESS, game, now);
+    log.Expect(host.active == game, "a process trigger to outrank the power source");
+    now += kMinute;
+    engine.Claim(SOURCE_PROCESS, PlanId{}, now);
+    log.Expect(host.active == ac, "the power source's plan back when the trigger lets go");
+
+    // Nothing mapped for AC: the claim goes and the user's plan is back
+    map.onAc = PlanId{};
+    engine.SetPowerSourceMap(map);
+    now += kMinute;
+    engine.PowerSource(false, now);
+    log.Expect(host.active == manual && !engine.Policy().Has(SOURCE_POWER_SOURCE), "no claim where nothing is mapped");
+}
+
+void CheckPowerSource(CheckLog& log, uint64_t /*seed*/)
+{
+    CheckMapping(log);
+    CheckEngine(log);
+}
@@ -0,0 +1,129 @@
+// ProcessDiffCheck.cpp: The process-snapshot diff against a plain set difference, PID reuse included.
+
+#include "Checks.h"
+
+#include "ProcessSetDiff.h"
+
+#include <algorithm>
+#include <vector>
+
+struct DiffEvents
+{
+    std::vector<ProcessKey> added, removed;
+};
+
+static DiffEvents Diff(ProcessSetDiff& diff, std::vector<ProcessKey> snapshot)
+{
+    DiffEvents out;
+    diff.Update(snapshot.data(), snapshot.size(),
+        [&](const ProcessKey& k) { out.added.push_back(k); },
+        [&](const ProcessKey& k) { out.removed.push_back(k); });
+    return out;
+}
+
+static bool Is(const ProcessKey& k, uint32_t pid, uint64_t createTime)
+{
+    return k.pid == pid && k.createTime == createTime;
+}
+
+// ===== Fixed cases =====
+static void CheckFixedCases(CheckLog& log)
+{
+    ProcessSetDiff diff;
+    DiffEvents e = Diff(diff, { { 8, 0, 100 }, { 4, 1, 50 }, { 12, 2, 120 } });
+    log.Expect(e.added.size() == 3 && e.removed.empty(), "every process new on the first scan");
+    log.Expect(e.added.size() == 3 && Is(e.added[0], 4, 50) && Is(e.added[2], 12, 120), "additions in PID order");
+    log.Expect(e.added.size() == 3 && e.added[0].tag == 1, "an addition to carry the caller's tag");
+
+    e = Diff(diff, { { 4, 7, 50 }, { 8, 8, 100 }, { 12, 9, 120 } });
+    log.Expect(e.added.empty() && e.removed.empty(), "nothing reported for the same processes under new tags");
+
+    // PID 8 exits and a new process takes it before the next scan
+    e = Diff(diff, { { 4, 0, 50 }, { 8, 1, 130 }, { 12, 2, 120 } });
+    log.Expect(e.removed.size() == 1 && Is(e.removed[0], 8, 100), "a reused PID's old owner removed");
+    log.Expect(e.added.size() == 1 && Is(e.added[0], 8, 130) && e.added[0].tag == 1, "a reused PID's new owner added");
+
+    e = Diff(diff, { { 12, 0, 120 }, { 12, 1, 120 }, { 16, 2, 140 } });
+    log.Expect(e.removed.size() == 2 && e.added.size() == 1 && Is(e.added[0], 16, 140),
+        "a repeated process counted once");
+    log.Expect(diff.Count() == 2, "two processes remembered, not %zu", diff.Count());
+
+    e = Diff(diff, {});
+    log.Expect(e.removed.size() == 2 && e.added.empty() && diff.Count() == 0, "an empty snapshot removes everything");
+    diff.Reset();
+    e = Diff(diff, { { 4, 0, 50 } });
+    log.Expect(e.added.size() == 1 && e.removed.empty(), "Reset to forget the last snapshot");
+}
+
+// ===== Against a reference =====
+// Processes come and go over a small PID space, so reuse is frequent; each
+// scan's events must be exactly the set differences of the two snapshots
+static void CheckAgainstReference(CheckLog& log, uint64_t seed, uint32_t rounds)
+{
+    CheckRandom rng(seed);
+    uint64_t reused = 0;
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        ProcessSetDiff diff;
+        std::vector<ProcessKey> live, prev;
+        uint64_t clock = 1;
+        for (uint32_t scan = 0; scan < 50; ++scan)
+        {
+            // Some exit, some start; a start takes a free PID from 4..256
+            for (size_t i = 0; i < live.size();)
+            {
+                if (rng.Below(5) == 0) { live[i] = live.back(); live.pop_back(); }
+                else ++i;
+            }
+            for (uint32_t n = rng.Below(12); n; --n)
+            {
+                const uint32_t pid = 4 * (1 + rng.Below(64));
+                bool taken = false;
+                for (const ProcessKey& k : live) taken |= k.pid == pid;
+                if (taken)
+                    continue;
+                for (const ProcessKey& k : prev) reused += k.pid == pid;
+                live.push_back({ pid, 0, clock++ });
+            }
+
+            std::vector<ProcessKey> snapshot(live);
+            for (size_t i = 0; i < snapshot.size(); ++i)
+                snapshot[i].tag = (uint32_t)i;
+            const std::vector<ProcessKey> given(snapshot);
+            const DiffEvents e = Diff(diff, snapshot);
+
+            std::vector<ProcessKey> wantAdded, wantRemoved;
+            for (const ProcessKey& k : given)
+            {
+                const bool known = std::any_of(prev.begin(), prev.end(), [&](const ProcessKey& p) { return Is(p, k.pid, k.createTime); });
+                if (!known) wantAdded.push_back(k);
+            }
+            for (const ProcessKey& p : prev)
+            {
+                const bool kept = std::any_of(given.begin(), given.end(), [&](const ProcessKey& k) { return Is(k, p.pid, p.createTime); });
+                if (!kept) wantRemoved.push_back(p);
+            }
+            const auto byPid = [](const ProcessKey& a, const ProcessKey& b) { return a.pid < b.pid; };
+            std::sort(wantAdded.begin(), wantAdded.end(), byPid);
+            std::sort(wantRemoved.begin(), wantRemoved.end(), byPid);
+
+            bool same = e.added.size() == wantAdded.size() && e.removed.size() == wantRemoved.size();
+            for (size_t i = 0; same && i < wantAdded.size(); ++i)
+                same = Is(e.added[i], wantAdded[i].pid, wantAdded[i].createTime) && e.added[i].tag == wantAdded[i].tag;
+            for (size_t i = 0; same && i < wantRemoved.size(); ++i)
+                same = Is(e.removed[i], wantRemoved[i].pid, wantRemoved[i].createTime);
+            log.Expect(same, "+%zu -%zu, not +%zu -%zu (seed %llu, round %u, scan %u)", wantAdded.size(),
+                wantRemoved.size(), e.added.size(), e.removed.size(), (unsigned long long)seed, round, scan);
+            log.Expect(diff.Count() == live.size(), "%zu processes remembered, not %zu (seed %llu, round %u, scan %u)",
+                live.size(), diff.Count(), (unsigned long long)seed, round, scan);
+            prev = given;
+        }
+    }
+    log.Note("%u runs of 50 scans, %llu starts on a PID seen in the scan before", rounds, (unsigned long long)reused);
+}
+
+void CheckProcessDiff(CheckLog& log, uint64_t seed)
+{
+    CheckFixedCases(log);
+    CheckAgainstReference(log, seed, 200);
+}
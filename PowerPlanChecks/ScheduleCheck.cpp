@@ -0,0 +1,232 @@
+// ScheduleCheck.cpp: A year of the schedule's timer under a virtual clock, DST days included, in several time zones, and its engine claim.
+
+#include "Checks.h"
+
+#include "PlanSchedule.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <time.h>
+
+static const int64_t kMinuteMs = 60000;
+static const int64_t kYearStartMs = 1767225600000LL; // 2026-01-01 00:00 UTC
+static const int64_t kYearEndMs = 1798761600000LL;   // 2027-01-01 00:00 UTC
+
+// Zones as TZ strings, with the rules spelled out so no zone database is
+// needed. The MSVC runtime reads only the names and offsets and applies US
+// rules to any zone with DST, so on Windows only the zones that agree run.
+struct CheckZone
+{
+    const char* tz;
+    bool onWindows;
+    // Times the two Sunday-night windows were entered over the year, or -1
+    // where only the reference says
+    int repeatEntries;
+    int gapEntries;
+};
+
+static const CheckZone kZones[] = {
+    { "UTC0", true, 52, 52 },
+    // 2 am Sundays in March and November: 01:15 comes twice on Nov 1, 02:15 never on Mar 8
+    { "EST5EDT,M3.2.0,M11.1.0", true, 53, 51 },
+    // 1 am and 2 am: 01:15 is skipped on Mar 29 and comes twice on Oct 25
+    { "GMT0BST,M3.5.0/1,M10.5.0", false, 52, 52 },
+    // 2 am and 3 am: 02:15 is skipped on Mar 29 and comes twice on Oct 25
+    { "CET-1CEST,M3.5.0,M10.5.0/3", false, 52, 52 },
+    // Southern hemisphere, half-hour shift: 02:00 becomes 02:30 in October
+    { "LHST-10:30LHDT-11,M10.1.0,M4.1.0", false, -1, -1 },
+};
+
+static void SetZone(const char* tz)
+{
+#ifdef _WIN32
+    _putenv_s("TZ", tz ? tz : "");
+    _tzset();
+#else
+    if (tz) setenv("TZ", tz, 1); else unsetenv("TZ");
+    tzset();
+#endif
+}
+
+static bool Local(int64_t ms, struct tm& out)
+{
+    const time_t t = (time_t)(ms / 1000);
+#ifdef _WIN32
+    return localtime_s(&out, &t) == 0;
+#else
+    return localtime_r(&t, &out) != nullptr;
+#endif
+}
+
+// The rules read straight off the wall clock, one day at a time: a window
+// holds on its own days from its start, and the next morning until its end
+// when it runs past midnight
+static int ReferencePlan(const ScheduleRule* rules, size_t count, int defaultPlan, const struct tm& t)
+{
+    const int minute = t.tm_hour * 60 + t.tm_min;
+    const int yesterday = (t.tm_wday + 6) % 7;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const ScheduleRule& r = rules[i];
+        const bool today = (r.days >> t.tm_wday) & 1, before = (r.days >> yesterday) & 1;
+        if (r.startMinute == r.endMinute)
+        {
+            if (today) return CheckPlanNumber(r.plan);
+        }
+        else if (r.startMinute < r.endMinute)
+        {
+            if (today && minute >= r.startMinute && minute < r.endMinute) return CheckPlanNumber(r.plan);
+        }
+        else if ((today && minute >= r.startMinute) || (before && minute < r.endMinute))
+        {
+            return CheckPlanNumber(r.plan);
+        }
+    }
+    return defaultPlan;
+}
+
+enum
+{
+    PLAN_DEFAULT = 1,
+    PLAN_WORK = 2,
+    PLAN_NIGHT = 3,
+    PLAN_REPEAT = 4, // Sun 01:15-01:45, inside the hour some zones repeat
+    PLAN_GAP = 5,    // Sun 02:15-02:45, inside the hour some zones skip
+};
+
+static void WalkYear(CheckLog& log, const CheckZone& zone, CheckRandom& rng)
+{
+    static const struct { const wchar_t* text; int plan; } kRules[] = {
+        { L"Sun 01:15-01:45", PLAN_REPEAT },
+        { L"Sun 02:15-02:45", PLAN_GAP },
+        { L"Mon-Fri 08:00-18:30", PLAN_WORK },
+        { L"Daily 22:00-06:00", PLAN_NIGHT },
+    };
+    PlanSchedule schedule;
+    ScheduleRule rules[4];
+    for (size_t i = 0; i < 4; ++i)
+    {
+        log.Expect(PlanSchedule::Parse(kRules[i].text, rules[i]), "\"%ls\" to parse", kRules[i].text);
+        rules[i].plan = CheckPlan(kRules[i].plan);
+        schedule.Add(rules[i]);
+    }
+    schedule.SetDefault(CheckPlan(PLAN_DEFAULT));
+
+    // As the tray does: evaluate, arm one timer, wake (a little late, as
+    // timers do) and evaluate again. Every minute in between is checked
+    // against the reference, so a missed or early transition shows.
+    int64_t nowMs = kYearStartMs + 17000;
+    struct tm t;
+    Local(nowMs, t);
+    int lastDst = t.tm_isdst;
+    int refPlan = ReferencePlan(rules, 4, PLAN_DEFAULT, t);
+    uint32_t wakes = 0, dstWakes = 0, idleWakes = 0, missed = 0, refChanges = 0;
+    int walkEntries[6] = {}, refEntries[6] = {};
+    ++refEntries[refPlan];
+    int walkPlan = 0;
+    while (nowMs < kYearEndMs)
+    {
+        ++wakes;
+        Local(nowMs, t);
+        const int plan = CheckPlanNumber(schedule.PlanAt(nowMs));
+        const int want = ReferencePlan(rules, 4, PLAN_DEFAULT, t);
+        log.Expect(plan == want, "plan %d at %04d-%02d-%02d %02d:%02d:%02d, not %d (%s)", want, t.tm_year + 1900,
+            t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, plan, zone.tz);
+        if (plan != walkPlan)
+            ++walkEntries[plan];
+        else if (t.tm_isdst == lastDst)
+            ++idleWakes;
+        if (t.tm_isdst != lastDst)
+            ++dstWakes;
+        walkPlan = plan;
+        lastDst = t.tm_isdst;
+
+        const uint64_t delay = schedule.NextTransitionMs(nowMs);
+        if (!log.Expect(delay != PlanSchedule::kNever && delay > 0, "a transition ahead (%s)", zone.tz))
+            return;
+        const int64_t due = nowMs + (int64_t)delay;
+        for (int64_t m = (nowMs / kMinuteMs + 1) * kMinuteMs; m <= due && m < kYearEndMs; m += kMinuteMs)
+        {
+            struct tm mt;
+            Local(m, mt);
+            const int p = ReferencePlan(rules, 4, PLAN_DEFAULT, mt);
+            if (p != refPlan)
+            {
+                ++refEntries[p];
+                ++refChanges;
+            }
+            refPlan = p;
+            if (m < due && p != plan && !missed++)
+                log.Expect(false, "plan %d from %04d-%02d-%02d %02d:%02d, before the timer at +%llu ms (%s)", p,
+                    mt.tm_year + 1900, mt.tm_mon + 1, mt.tm_mday, mt.tm_hour, mt.tm_min, (unsigned long long)delay, zone.tz);
+        }
+        nowMs = due + (rng.Below(4) == 0 ? (int64_t)rng.Below(1500) : 0);
+    }
+
+    log.Expect(missed == 0, "no transition missed, not %u (%s)", missed, zone.tz);
+    log.Expect(idleWakes == 0, "no wake with nothing to do, not %u (%s)", idleWakes, zone.tz);
+    const bool hasDst = strchr(zone.tz, ',') != nullptr;
+    log.Expect(dstWakes == (hasDst ? 2u : 0u), "%u DST shifts seen, not %u (%s)", hasDst ? 2u : 0u, dstWakes, zone.tz);
+    for (int p = PLAN_DEFAULT; p <= PLAN_GAP; ++p)
+        log.Expect(walkEntries[p] == refEntries[p], "plan %d entered %d times as on the wall clock, not %d (%s)", p,
+            refEntries[p], walkEntries[p], zone.tz);
+    if (zone.repeatEntries >= 0)
+        log.Expect(walkEntries[PLAN_REPEAT] == zone.repeatEntries, "the 01:15 window entered %d times, not %d (%s)",
+            zone.repeatEntries, walkEntries[PLAN_REPEAT], zone.tz);
+    if (zone.gapEntries >= 0)
+        log.Expect(walkEntries[PLAN_GAP] == zone.gapEntries, "the 02:15 window entered %d times, not %d (%s)",
+            zone.gapEntries, walkEntries[PLAN_GAP], zone.tz);
+    log.Note("%-34s %u wakes, %u at DST shifts, %u changes on the wall clock; 01:15 x%d, 02:15 x%d", zone.tz, wakes,
+        dstWakes, refChanges, walkEntries[PLAN_REPEAT], walkEntries[PLAN_GAP]);
+}
+
+// ===== Through the engine =====
+// The schedule claims SOURCE_SCHEDULE and keeps one timer armed for the next
+// transition; with nothing scheduled it stays out of the way
+static void CheckEngineSchedule(CheckLog& log)
+{
+    SetZone("UTC0");
+    const PlanId balanced = CheckPlan(1), performance = CheckPlan(2), quiet = CheckPlan(3);
+    CheckHost host;
+    host.active = balanced;
+    PlanEngine engine(host);
+    CheckEngineDefaults(engine);
+    uint64_t now = 1000;
+    engine.Start(balanced, now);
+    engine.ScheduleDue(now, kYearStartMs);
+    log.Expect(host.armedMs[PlanEngine::TIMER_SCHEDULE] == PlanEngine::kNever && engine.ScheduleDueWallMs() == 0 &&
+        !engine.Policy().Has(SOURCE_SCHEDULE), "no claim and no timer with nothing scheduled");
+
+    ScheduleRule rule{};
+    log.Expect(PlanSchedule::Parse(L"Mon-Fri 08:00-18:00", rule), "the rule to parse");
+    rule.plan = performance;
+    engine.Schedule().Add(rule);
+    engine.Schedule().SetDefault(quiet);
+    // 2026-01-01 is a Thursday
+    engine.ScheduleDue(now, kYearStartMs);
+    log.Expect(host.active == quiet && host.armedMs[PlanEngine::TIMER_SCHEDULE] == (uint64_t)(8 * 60 * kMinuteMs) &&
+        engine.ScheduleDueWallMs() == kYearStartMs + 8 * 60 * kMinuteMs, "the default until 08:00, and the timer armed for it");
+    now += 8 * 60 * kMinuteMs;
+    engine.ScheduleDue(now, kYearStartMs + 8 * 60 * kMinuteMs);
+    log.Expect(host.active == performance && host.armedMs[PlanEngine::TIMER_SCHEDULE] == (uint64_t)(10 * 60 * kMinuteMs),
+        "the rule's plan from 08:00 until 18:00");
+}
+
+void CheckSchedule(CheckLog& log, uint64_t seed)
+{
+    const char* saved = getenv("TZ");
+    const std::string savedTz = saved ? saved : "";
+    CheckRandom rng(seed);
+    for (const CheckZone& zone : kZones)
+    {
+#ifdef _WIN32
+        if (!zone.onWindows)
+            continue;
+#endif
+        SetZone(zone.tz);
+        WalkYear(log, zone, rng);
+    }
+    CheckEngineSchedule(log);
+    SetZone(saved ? savedTz.c_str() : nullptr);
+}
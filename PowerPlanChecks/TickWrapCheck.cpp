@@ -0,0 +1,199 @@
+// TickWrapCheck.cpp: Years of AFK decisions on a virtual clock, through every 49.7-day wrap of the input tick.
+
+#include "Checks.h"
+
+#include "AfkMachine.h"
+
+#include <vector>
+
+static const uint64_t kSecond = 1000;
+static const uint64_t kMinute = 60 * kSecond;
+static const uint64_t kHour = 60 * kMinute;
+static const uint64_t kDay = 24 * kHour;
+static const uint64_t kWrap = 1ull << 32; // GetTickCount's period, about 49.7 days
+
+// The tray's clock is GetTickCount64, but the last input comes back from
+// GetLastInputInfo as a 32-bit tick. IdleMsFromTicks must give the true idle
+// time through every wrap; an input stamp is the clock cut to 32 bits, as
+// Windows keeps it.
+struct WrapRun
+{
+    uint64_t startMs;
+    const char* what;
+};
+
+static const WrapRun kRuns[] = {
+    { 0, "from boot" },
+    { kWrap - 5 * kMinute, "five minutes before the first wrap" },
+    { 5 * kWrap - 90 * kSecond, "90 s before the fifth wrap" },
+};
+
+// Busy stretches of input every few seconds, and breaks from seconds to days.
+// Nothing jumps a wrap: each one gets a break across it whose last input
+// comes up to the deepest stage before it (mostly less, so stages are still
+// to come after it) and which lasts past the deepest stage.
+static std::vector<uint64_t> MakeInputs(CheckRandom& rng, uint64_t startMs, uint64_t endMs, uint64_t deepestMs)
+{
+    const uint64_t kApproach = 8 * kHour;
+    std::vector<uint64_t> inputs;
+    uint64_t t = startMs;
+    uint64_t nextWrap = (startMs / kWrap + 1) * kWrap;
+    while (t < endMs)
+    {
+        uint64_t busyUntil = t + (1 + rng.Below(180)) * kMinute;
+        if (busyUntil + kApproach > nextWrap)
+            busyUntil = nextWrap > kApproach + t ? nextWrap - kApproach : t;
+        while (t < busyUntil)
+        {
+            t += 1 + rng.Below((uint32_t)(30 * kSecond));
+            inputs.push_back(t);
+        }
+        if (t + kApproach >= nextWrap)
+        {
+            const uint64_t before = rng.Below((uint32_t)(rng.Below(4) ? deepestMs : deepestMs + 10 * kMinute));
+            if (nextWrap > before + t)
+                t = nextWrap - before;
+            inputs.push_back(t);
+            t += deepestMs + 1 + rng.Below((uint32_t)(3 * kHour));
+            nextWrap += kWrap;
+        }
+        else
+        {
+            uint64_t pause;
+            switch (rng.Below(5))
+            {
+            case 0: pause = rng.Below((uint32_t)(2 * kMinute)); break;
+            case 1: pause = rng.Below((uint32_t)(deepestMs + kMinute)); break;
+            case 2: pause = (1 + rng.Below(10)) * kHour; break;
+            case 3: pause = (1 + rng.Below(3)) * kDay; break; // A weekend away
+            default: pause = rng.Below((uint32_t)(90 * kMinute)); break;
+            }
+            t = t + pause + kApproach > nextWrap ? nextWrap - kApproach : t + pause;
+        }
+        inputs.push_back(t);
+    }
+    return inputs;
+}
+
+static void RunYears(CheckLog& log, const WrapRun& run, CheckRandom& rng, uint64_t seed, uint64_t years,
+    uint64_t& ticks, uint64_t& wrapsCrossed, uint64_t& naiveWrong)
+{
+    const PlanId manual = CheckPlan(1);
+    AfkLadder ref;
+    ref.Set((uint32_t)(5 * kMinute), CheckPlan(2));
+    ref.Set((uint32_t)(20 * kMinute), CheckPlan(3));
+    ref.Set((uint32_t)(60 * kMinute), CheckPlan(4));
+    const uint64_t deepest = ref.At(ref.Count() - 1).thresholdMs;
+
+    uint64_t now = run.startMs;
+    CheckClockHost host(now);
+    host.active = manual;
+    PlanEngine engine(host);
+    CheckEngineDefaults(engine);
+    SwitchGovernor::Config governor;
+    governor.minDwellMs = 0; // Every decision shows at once
+    governor.burst = 1u << 30;
+    engine.SetGovernorConfig(governor);
+    for (size_t i = 0; i < ref.Count(); ++i)
+        engine.Ladder().Set(ref.At(i).thresholdMs, ref.At(i).plan);
+    engine.Start(manual, now);
+
+    const uint64_t endMs = run.startMs + years * 365 * kDay;
+    const std::vector<uint64_t> inputs = MakeInputs(rng, now, endMs, deepest);
+    uint64_t lastInput = now;
+    uint32_t lastInputTick = (uint32_t)now;
+    engine.AfkTick(now, 0);
+    size_t next = 0;
+    uint32_t failures = 0;
+    uint64_t lastWrapSeen = now / kWrap;
+    while (next < inputs.size() && failures < 5)
+    {
+        if (inputs[next] <= host.afkDueMs)
+        {
+            now = lastInput = inputs[next++];
+            lastInputTick = (uint32_t)now;
+            if (engine.InputSink())
+                engine.UserInput(now);
+        }
+        else
+        {
+            now = host.afkDueMs;
+            const uint32_t idle = IdleMsFromTicks((uint32_t)now, lastInputTick);
+            engine.AfkTick(now, idle);
+            ++ticks;
+            if (now / kWrap != lastInput / kWrap && now / kWrap != lastWrapSeen)
+            {
+                lastWrapSeen = now / kWrap;
+                ++wrapsCrossed;
+            }
+            // What widening the clock alone (GetTickCount64() - dwTime) would have read
+            naiveWrong += (now - lastInputTick) != now - lastInput;
+            failures += !log.Expect(idle == now - lastInput, "%llu ms idle read as %u at tick %llu (%s, seed %llu)",
+                (unsigned long long)(now - lastInput), idle, (unsigned long long)now, run.what, (unsigned long long)seed);
+        }
+        const uint64_t trueIdle = now - lastInput;
+        const int want = ref.StageFor(trueIdle);
+        const PlanId wantPlan = want >= 0 ? ref.At((size_t)want).plan : manual;
+        failures += !log.Expect(engine.Afk().Stage() == want && host.active == wantPlan,
+            "stage %d at %llu ms idle, not %d, at tick %llu (%s, seed %llu)", want, (unsigned long long)trueIdle,
+            engine.Afk().Stage(), (unsigned long long)now, run.what, (unsigned long long)seed);
+        const uint64_t until = ref.UntilNextStageMs(trueIdle);
+        failures += !log.Expect(until == AfkLadder::kNever || host.afkDueMs <= now + until,
+            "a tick due by the next threshold in %llu ms at tick %llu (%s, seed %llu)", (unsigned long long)until,
+            (unsigned long long)now, run.what, (unsigned long long)seed);
+    }
+    log.Expect(now >= endMs - 7 * kDay, "%llu years replayed (%s)", (unsigned long long)years, run.what);
+}
+
+// GetLastInputInfo can stamp input a little after the tick the tray read:
+// that is no idle time, also when the wrap falls between the two, and must
+// not read as 49 days and bring on the deepest stage
+static void CheckStampAhead(CheckLog& log)
+{
+    log.Expect(IdleMsFromTicks(1000, 1015) == 0 && IdleMsFromTicks(0xFFFFFFF0u, 5) == 0, "a stamp ahead of the tick read as no idle time");
+    log.Expect(IdleMsFromTicks(5, 0xFFFFFFF0u) == 21, "21 ms idle across the wrap");
+    log.Expect(IdleMsFromTicks(0x7FFFFFFFu, 0) == 0x7FFFFFFFu && IdleMsFromTicks(0x80000000u, 0) == 0,
+        "idle time up to 2^31 - 1 ms as it is, and none from 2^31 on");
+
+    const PlanId manual = CheckPlan(1);
+    uint64_t now = kWrap - 20 * kMinute;
+    CheckClockHost host(now);
+    host.active = manual;
+    PlanEngine engine(host);
+    CheckEngineDefaults(engine);
+    engine.Ladder().Set((uint32_t)(5 * kMinute), CheckPlan(2));
+    engine.Ladder().Set((uint32_t)(60 * kMinute), CheckPlan(3));
+    engine.Start(manual, now);
+    engine.AfkTick(now, 0);
+    // Input 15 ms ahead of a tick read just before the wrap, then idle until the first stage
+    uint64_t stamp = kWrap + 10;
+    now = kWrap - 5;
+    engine.AfkTick(now, IdleMsFromTicks((uint32_t)now, (uint32_t)stamp));
+    log.Expect(engine.Afk().Stage() == -1 && host.active == manual, "no stage for input stamped after the tick, not stage %d",
+        engine.Afk().Stage());
+    now = stamp + 5 * kMinute;
+    engine.AfkTick(now, IdleMsFromTicks((uint32_t)now, (uint32_t)stamp));
+    log.Expect(engine.Afk().Stage() == 0 && host.active == CheckPlan(2), "the first stage five minutes on, not stage %d",
+        engine.Afk().Stage());
+    // And once a stage is in: a stamp ahead is the user back
+    stamp = now + 20;
+    engine.AfkTick(now, IdleMsFromTicks((uint32_t)now, (uint32_t)stamp));
+    log.Expect(engine.Afk().Stage() == -1 && host.active == manual, "the plan back for input stamped after the tick, not stage %d",
+        engine.Afk().Stage());
+}
+
+void CheckTickWrap(CheckLog& log, uint64_t seed)
+{
+    CheckStampAhead(log);
+    CheckRandom rng(seed);
+    uint64_t ticks = 0, wrapsCrossed = 0, naiveWrong = 0;
+    for (const WrapRun& run : kRuns)
+        RunYears(log, run, rng, seed, 3, ticks, wrapsCrossed, naiveWrong);
+    // The traces have to reach the case the wrap-safe subtraction is for
+    log.Expect(wrapsCrossed >= 60, "a stage decided across at least 60 wraps, not %llu",
+        (unsigned long long)wrapsCrossed);
+    log.Expect(naiveWrong > 0, "widening only the clock to read wrong somewhere");
+    log.Note("%zu runs of 3 years, %llu AFK ticks, %llu wraps ticked across; widening the clock alone misread %llu",
+        sizeof(kRuns) / sizeof(kRuns[0]), (unsigned long long)ticks, (unsigned long long)wrapsCrossed,
+        (unsigned long long)naiveWrong);
+}
@@ -0,0 +1,657 @@
+// PowerPlanIpcLoad.cpp: Load test for the tray's IPC endpoint: many clients, mixed requests, subscribers.
+//
+// Builds from the protocol and server sources only, so it runs anywhere:
+//   g++ -O2 -std=c++17 -pthread -IPowerPlanTray PowerPlanIpcLoad/*.cpp PowerPlanTray/IpcProtocol.cpp
+//       PowerPlanTray/IpcServer.cpp PowerPlanTray/LatencyHistogram.cpp -o powerplanipcload
+//
+// Every client keeps one request in flight: each thread sends on all of its
+// connections, then collects the replies, so --clients requests are
+// outstanding at once. With --serve the tool plays the tray itself, switching
+// plans on a timer, so the server can be loaded where the tray does not run.
+
+#include "IpcServer.h"
+#include "LatencyHistogram.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+static void Usage()
+{
+    fputs(
+        "usage: powerplanipcload [options]\n"
+        "  --clients N        connections, each with a request in flight (default 200)\n"
+        "  --threads N        client threads (default 8)\n"
+        "  --seconds S        how long to run (default 5)\n"
+        "  --mix OP=W,...     weights of get, list, set and batch (default get=8,list=1,batch=1)\n"
+        "  --subscribe        every client also subscribes and counts events\n"
+        "  --endpoint PATH    instead of the tray's own\n"
+        "  --serve            stand in for the tray: serve the endpoint in this process, and\n"
+        "                     check an oversize batch comes back TOO_LARGE\n"
+        "  --switch-ms N      with --serve, change plan this often (default 100, 0 = never)\n",
+        stderr);
+}
+
+// ===== Options =====
+enum LoadOp { OP_GET, OP_LIST, OP_SET, OP_BATCH, OP_COUNT };
+static const char* const kOpNames[OP_COUNT] = { "get", "list", "set", "batch" };
+
+struct Options
+{
+    unsigned clients = 200;
+    unsigned threads = 8;
+    double seconds = 5.0;
+    unsigned weights[OP_COUNT] = { 8, 1, 0, 1 };
+    bool subscribe = false;
+    char endpoint[128] = {};
+    bool serve = false;
+    unsigned switchMs = 100;
+};
+
+static bool ParseMix(const char* spec, Options& o)
+{
+    memset(o.weights, 0, sizeof(o.weights));
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    unsigned total = 0;
+    for (char* item = strtok(buf, ","); item; item = strtok(nullptr, ","))
+    {
+        char* eq = strchr(item, '=');
+        if (!eq)
+            return false;
+        *eq = '\0';
+        int op = 0;
+        while (op < OP_COUNT && strcmp(item, kOpNames[op]) != 0)
+            ++op;
+        if (op == OP_COUNT)
+            return false;
+        o.weights[op] = (unsigned)strtoul(eq + 1, nullptr, 10);
+        total += o.weights[op];
+    }
+    return total != 0;
+}
+
+// ===== Connection =====
+struct Link
+{
+#ifdef _WIN32
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+    uint8_t in[2 * kIpcMaxFrame];
+    size_t inLen = 0;
+    uint8_t out[kIpcMaxRequest];
+    Clock::time_point sent;
+    uint16_t tag = 0;
+    uint32_t lastGeneration = 0;
+};
+
+static bool Connect(Link& l, const char* endpoint)
+{
+#ifdef _WIN32
+    for (int attempt = 0; attempt < 50; ++attempt)
+    {
+        l.pipe = CreateFileA(endpoint, GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+        if (l.pipe != INVALID_HANDLE_VALUE)
+            return true;
+        // Every listening instance taken: wait for the server to add one
+        if (GetLastError() != ERROR_PIPE_BUSY || !WaitNamedPipeA(endpoint, 200))
+            return false;
+    }
+    return false;
+#else
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", endpoint);
+    l.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    return l.fd >= 0 && connect(l.fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+#endif
+}
+
+static void Disconnect(Link& l)
+{
+#ifdef _WIN32
+    if (l.pipe != INVALID_HANDLE_VALUE) CloseHandle(l.pipe);
+    l.pipe = INVALID_HANDLE_VALUE;
+#else
+    if (l.fd >= 0) close(l.fd);
+    l.fd = -1;
+#endif
+}
+
+static bool SendAll(Link& l, const uint8_t* data, size_t bytes)
+{
+    while (bytes)
+    {
+#ifdef _WIN32
+        DWORD n = 0;
+        if (!WriteFile(l.pipe, data, (DWORD)bytes, &n, nullptr))
+            return false;
+#else
+        const ssize_t n = send(l.fd, data, bytes, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+#endif
+        data += n;
+        bytes -= (size_t)n;
+    }
+    return true;
+}
+
+// Blocks until a whole frame is at the front of l.in
+static bool ReadFrame(Link& l, IpcHeader& h)
+{
+    for (;;)
+    {
+        const IpcFrameCheck check = IpcCheckFrame(l.in, l.inLen, kIpcMaxFrame, h);
+        if (check == IPC_FRAME_READY)
+            return true;
+        if (check == IPC_FRAME_BAD)
+            return false;
+#ifdef _WIN32
+        DWORD n = 0;
+        if (!ReadFile(l.pipe, l.in + l.inLen, (DWORD)(sizeof(l.in) - l.inLen), &n, nullptr) || !n)
+            return false;
+#else
+        const ssize_t n = recv(l.fd, l.in + l.inLen, sizeof(l.in) - l.inLen, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+#endif
+        l.inLen += (size_t)n;
+    }
+}
+
+static void PopFrame(Link& l, const IpcHeader& h)
+{
+    memmove(l.in, l.in + h.size, l.inLen - h.size);
+    l.inLen -= h.size;
+}
+
+// ===== Workers =====
+struct WorkerStats
+{
+    LatencyHistogram latency; // Nanoseconds, send to reply
+    uint64_t requests[OP_COUNT] = {};
+    uint64_t failed = 0;      // Replies with a status other than OK or BUSY
+    uint64_t busy = 0;
+    uint64_t events = 0;
+    uint64_t stale = 0;       // Events whose generation did not move forward
+    uint64_t broken = 0;      // Connections lost or unparseable replies
+    uint64_t connectFailures = 0;
+};
+
+struct Shared
+{
+    const Options* options;
+    std::vector<PlanId> plans; // From one LIST before the run, for SET
+    Clock::time_point deadline;
+};
+
+static size_t EncodeOne(IpcWriter& w, LoadOp op, uint16_t tag, const Shared& shared, uint32_t& rng)
+{
+    const size_t frame = w.Begin(op == OP_LIST ? IPC_LIST : op == OP_SET ? IPC_SET : IPC_GET, 0, tag);
+    if (op == OP_SET)
+        w.Id(shared.plans[rng % shared.plans.size()]);
+    w.End(frame);
+    return w.Length();
+}
+
+static size_t Encode(Link& l, LoadOp op, const Shared& shared, uint32_t& rng)
+{
+    IpcWriter w(l.out, sizeof(l.out));
+    if (op != OP_BATCH)
+        return EncodeOne(w, op, l.tag, shared, rng);
+    // A typical agent's poll: state, plan list, and the state again
+    const size_t frame = w.Begin(IPC_BATCH, 0, l.tag);
+    w.U16(3);
+    EncodeOne(w, OP_GET, 0, shared, rng);
+    EncodeOne(w, OP_LIST, 1, shared, rng);
+    EncodeOne(w, OP_GET, 2, shared, rng);
+    w.End(frame);
+    return w.Length();
+}
+
+// Takes an event off the front, checking its generation moved on
+static void CountEvent(Link& l, const IpcHeader& h, WorkerStats& stats)
+{
+    IpcReader r(l.in + kIpcHeaderBytes, h.size - kIpcHeaderBytes);
+    r.U8();
+    IpcState state;
+    r.State(state);
+    ++stats.events;
+    if (!r.Ok() || state.generation <= l.lastGeneration)
+        ++stats.stale;
+    l.lastGeneration = state.generation;
+}
+
+static LoadOp PickOp(const Options& o, uint32_t& rng)
+{
+    rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+    unsigned total = 0;
+    for (unsigned w : o.weights) total += w;
+    unsigned pick = rng % total;
+    int op = 0;
+    while (pick >= o.weights[op])
+        pick -= o.weights[op++];
+    return (LoadOp)op;
+}
+
+static void Worker(const Shared& shared, unsigned index, WorkerStats& stats)
+{
+    const Options& o = *shared.options;
+    const unsigned count = o.clients / o.threads + (index < o.clients % o.threads ? 1 : 0);
+    std::vector<Link*> links;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        Link* l = new Link;
+        if (!Connect(*l, o.endpoint))
+        {
+            ++stats.connectFailures;
+            delete l;
+            continue;
+        }
+        if (o.subscribe)
+        {
+            IpcWriter w(l->out, sizeof(l->out));
+            w.End(w.Begin(IPC_SUBSCRIBE, 0, 0));
+            IpcHeader h;
+            if (!SendAll(*l, l->out, w.Length()) || !ReadFrame(*l, h) || h.status != IPC_OK)
+            {
+                ++stats.broken;
+                Disconnect(*l);
+                delete l;
+                continue;
+            }
+            IpcReader r(l->in + kIpcHeaderBytes, h.size - kIpcHeaderBytes);
+            IpcState state;
+            r.State(state);
+            l->lastGeneration = state.generation;
+            PopFrame(*l, h);
+        }
+        links.push_back(l);
+    }
+
+    uint32_t rng = 0x9E3779B9u * (index + 1);
+    LoadOp ops[kIpcMaxBatch];
+    while (!links.empty() && Clock::now() < shared.deadline)
+    {
+        // Send on every connection first, so all of them have one in flight
+        for (size_t i = 0; i < links.size(); ++i)
+        {
+            Link& l = *links[i];
+            ops[i % kIpcMaxBatch] = PickOp(o, rng);
+            if (ops[i % kIpcMaxBatch] == OP_SET && shared.plans.empty())
+                ops[i % kIpcMaxBatch] = OP_GET;
+            ++l.tag;
+            const size_t bytes = Encode(l, ops[i % kIpcMaxBatch], shared, rng);
+            l.sent = Clock::now();
+            if (!SendAll(l, l.out, bytes))
+                l.tag = 0; // Dropped below
+        }
+        for (size_t i = 0; i < links.size();)
+        {
+            Link& l = *links[i];
+            bool ok = l.tag != 0;
+            IpcHeader h;
+            while (ok && (ok = ReadFrame(l, h)) && h.op == IPC_EVENT)
+            {
+                CountEvent(l, h, stats);
+                PopFrame(l, h);
+            }
+            if (!ok || h.tag != l.tag)
+            {
+                ++stats.broken;
+                Disconnect(l);
+                delete links[i];
+                links.erase(links.begin() + (ptrdiff_t)i);
+                continue;
+            }
+            stats.latency.Record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - l.sent).count());
+            ++stats.requests[ops[i % kIpcMaxBatch]];
+            if (h.status == IPC_BUSY) ++stats.busy;
+            else if (h.status != IPC_OK) ++stats.failed;
+            PopFrame(l, h);
+            ++i;
+        }
+    }
+    for (Link* l : links)
+    {
+        Disconnect(*l);
+        delete l;
+    }
+}
+
+// The plan list, once, so SET has something valid to ask for
+static bool FetchPlans(const char* endpoint, std::vector<PlanId>& out)
+{
+    Link* l = new Link;
+    bool ok = Connect(*l, endpoint);
+    if (ok)
+    {
+        IpcWriter w(l->out, sizeof(l->out));
+        w.End(w.Begin(IPC_LIST, 0, 1));
+        IpcHeader h;
+        ok = SendAll(*l, l->out, w.Length()) && ReadFrame(*l, h) && h.status == IPC_OK;
+        if (ok)
+        {
+            IpcReader r(l->in + kIpcHeaderBytes, h.size - kIpcHeaderBytes);
+            const uint16_t count = r.U16();
+            wchar_t name[kIpcNameMax];
+            for (uint16_t i = 0; i < count && r.Ok(); ++i)
+            {
+                out.push_back(r.Id());
+                r.Name(name, kIpcNameMax);
+            }
+            ok = r.Ok();
+        }
+    }
+    Disconnect(*l);
+    delete l;
+    return ok;
+}
+
+// ===== Oversize batch =====
+// Two lists of 64 long names pass kIpcMaxFrame, and a failing request after
+// them must not hide that: the whole batch has to come back TOO_LARGE, not
+// a reply holding a cut-off list. Served on an endpoint of its own, so the
+// stand-in's plans stay as they are for the load run.
+static void NoWake(void*) {}
+
+static bool CheckOversizeBatch(const char* endpoint)
+{
+    char path[sizeof(Options::endpoint) + 16];
+    snprintf(path, sizeof(path), "%s.oversize", endpoint);
+    IpcServer server;
+    if (!server.Start(&NoWake, nullptr, path))
+    {
+        printf("oversize    FAIL: cannot serve %s\n", path);
+        return false;
+    }
+    static IpcPlan plans[kIpcMaxPlans];
+    for (size_t i = 0; i < kIpcMaxPlans; ++i)
+    {
+        plans[i] = IpcPlan{};
+        plans[i].id.bytes[0] = (uint8_t)(i + 1);
+        for (size_t k = 0; k < 122; ++k)
+            plans[i].name[k] = (wchar_t)(L'a' + (i + k) % 26);
+    }
+    server.PublishPlans(plans, kIpcMaxPlans);
+    IpcState state;
+    state.active = plans[0].id;
+    server.PublishState(state);
+
+    Link* l = new Link;
+    bool ok = false;
+    uint8_t status = 0;
+    uint32_t size = 0;
+    // The first publish reaches the I/O thread on its wake; a LIST says when
+    for (int attempt = 0; attempt < 100 && !ok; ++attempt)
+    {
+        Disconnect(*l);
+        l->inLen = 0;
+        IpcWriter w(l->out, sizeof(l->out));
+        w.End(w.Begin(IPC_LIST, 0, 1));
+        IpcHeader h;
+        ok = Connect(*l, path) && SendAll(*l, l->out, w.Length()) && ReadFrame(*l, h) && h.status == IPC_OK;
+        if (!ok)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        else
+            PopFrame(*l, h);
+    }
+    if (ok)
+    {
+        IpcWriter w(l->out, sizeof(l->out));
+        const size_t frame = w.Begin(IPC_BATCH, 0, 2);
+        w.U16(3);
+        w.End(w.Begin(IPC_LIST, 0, 0));
+        w.End(w.Begin(IPC_LIST, 0, 1));
+        const size_t set = w.Begin(IPC_SET, 0, 2);
+        PlanId unknown{};
+        unknown.bytes[0] = 0xEE;
+        w.Id(unknown);
+        w.End(set);
+        w.End(frame);
+        IpcHeader h;
+        ok = SendAll(*l, l->out, w.Length()) && ReadFrame(*l, h);
+        status = h.status;
+        size = h.size;
+        ok = ok && h.op == IPC_BATCH && h.status == IPC_TOO_LARGE && h.size == kIpcHeaderBytes;
+    }
+    Disconnect(*l);
+    delete l;
+    server.Stop();
+    if (ok)
+        printf("oversize    BATCH of LIST, LIST, SET answered TOO_LARGE\n");
+    else
+        printf("oversize    FAIL: BATCH of LIST, LIST, SET answered status %u in %u bytes, not a bare TOO_LARGE\n",
+            status, size);
+    return ok;
+}
+
+// ===== Stand-in tray =====
+class StandIn
+{
+public:
+    bool Start(const char* endpoint, unsigned switchMs)
+    {
+        static const wchar_t* const kNames[] = { L"Balanced", L"High performance", L"Power saver" };
+        for (size_t i = 0; i < 3; ++i)
+        {
+            m_plans[i] = IpcPlan{};
+            m_plans[i].id.bytes[0] = (uint8_t)(i + 1);
+            wcsncpy(m_plans[i].name, kNames[i], kIpcNameMax - 1);
+        }
+        if (!m_server.Start(&StandIn::Wake, this, endpoint))
+            return false;
+        m_server.PublishPlans(m_plans, 3);
+        Publish(0);
+        m_thread = std::thread([this, switchMs] { Run(switchMs); });
+        return true;
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_stop = true;
+        }
+        m_cv.notify_one();
+        if (m_thread.joinable())
+            m_thread.join();
+        m_server.Stop();
+    }
+
+    IpcServer::Stats Stats() const { return m_server.GetStats(); }
+    uint64_t Switches() const { return m_switches; }
+
+private:
+    static void Wake(void* context)
+    {
+        StandIn* self = static_cast<StandIn*>(context);
+        {
+            std::lock_guard<std::mutex> guard(self->m_lock);
+            self->m_woken = true;
+        }
+        self->m_cv.notify_one();
+    }
+
+    void Publish(size_t plan)
+    {
+        IpcState state;
+        state.active = m_plans[plan].id;
+        wcscpy(state.name, m_plans[plan].name);
+        state.lastSwitchUnixMs = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        m_server.PublishState(state);
+        m_active = plan;
+    }
+
+    // The tray's UI thread: carries out switches and changes plan on its own
+    void Run(unsigned switchMs)
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        Clock::time_point next = Clock::now() + std::chrono::milliseconds(switchMs);
+        while (!m_stop)
+        {
+            if (switchMs)
+                m_cv.wait_until(lock, next, [this] { return m_stop || m_woken; });
+            else
+                m_cv.wait(lock, [this] { return m_stop || m_woken; });
+            m_woken = false;
+            lock.unlock();
+            PlanId wanted;
+            while (m_server.TakeSwitch(wanted))
+            {
+                for (size_t i = 0; i < 3; ++i)
+                    if (m_plans[i].id == wanted && i != m_active) { Publish(i); ++m_switches; }
+            }
+            if (switchMs && Clock::now() >= next)
+            {
+                Publish((m_active + 1) % 3);
+                ++m_switches;
+                next += std::chrono::milliseconds(switchMs);
+            }
+            lock.lock();
+        }
+    }
+
+    IpcServer m_server;
+    IpcPlan m_plans[3];
+    size_t m_active = 0;
+    std::atomic<uint64_t> m_switches{ 0 };
+    std::thread m_thread;
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    bool m_woken = false;
+    bool m_stop = false;
+};
+
+// ===== Report =====
+static void PrintReport(const Options& o, WorkerStats& total, double sec)
+{
+    uint64_t requests = 0;
+    for (uint64_t n : total.requests) requests += n;
+    printf("%u clients on %u threads for %.2f s: %llu requests, %.0f /s\n", o.clients, o.threads, sec,
+        (unsigned long long)requests, sec > 0 ? (double)requests / sec : 0.0);
+    printf("  ");
+    for (int op = 0; op < OP_COUNT; ++op)
+        printf("%s %llu%s", kOpNames[op], (unsigned long long)total.requests[op], op + 1 < OP_COUNT ? ", " : "\n");
+    const LatencyHistogram& h = total.latency;
+    printf("latency us  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n", h.Percentile(50) / 1000.0,
+        h.Percentile(90) / 1000.0, h.Percentile(99) / 1000.0, h.Percentile(99.9) / 1000.0, h.Max() / 1000.0);
+    if (o.subscribe)
+        printf("events      %llu (%llu stale)\n", (unsigned long long)total.events, (unsigned long long)total.stale);
+    printf("errors      %llu failed, %llu busy, %llu connections lost, %llu could not connect\n",
+        (unsigned long long)total.failed, (unsigned long long)total.busy, (unsigned long long)total.broken,
+        (unsigned long long)total.connectFailures);
+}
+
+int main(int argc, char** argv)
+{
+    Options o;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* a = argv[i];
+        const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = true;
+        if (strcmp(a, "--subscribe") == 0) o.subscribe = true;
+        else if (strcmp(a, "--serve") == 0) o.serve = true;
+        else if (!v) ok = false;
+        else if (strcmp(a, "--clients") == 0) o.clients = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(a, "--threads") == 0) o.threads = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(a, "--seconds") == 0) o.seconds = atof(argv[++i]);
+        else if (strcmp(a, "--mix") == 0) ok = ParseMix(argv[++i], o);
+        else if (strcmp(a, "--endpoint") == 0) snprintf(o.endpoint, sizeof(o.endpoint), "%s", argv[++i]);
+        else if (strcmp(a, "--switch-ms") == 0) o.switchMs = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else ok = false;
+        if (!ok)
+        {
+            Usage();
+            return 2;
+        }
+    }
+    if (!o.clients || !o.threads || o.seconds <= 0)
+    {
+        Usage();
+        return 2;
+    }
+    if (o.threads > o.clients)
+        o.threads = o.clients;
+    if (!o.endpoint[0] && !IpcEndpoint(o.endpoint, sizeof(o.endpoint)))
+    {
+        fprintf(stderr, "no endpoint name\n");
+        return 2;
+    }
+
+    StandIn standIn;
+    if (o.serve && !standIn.Start(o.endpoint, o.switchMs))
+    {
+        fprintf(stderr, "cannot serve %s: in use or not allowed\n", o.endpoint);
+        return 2;
+    }
+    Shared shared;
+    shared.options = &o;
+    if (!FetchPlans(o.endpoint, shared.plans))
+    {
+        fprintf(stderr, "nothing answers on %s\n", o.endpoint);
+        if (o.serve) standIn.Stop();
+        return 2;
+    }
+
+    std::vector<WorkerStats> stats(o.threads);
+    std::vector<std::thread> pool;
+    const Clock::time_point start = Clock::now();
+    shared.deadline = start + std::chrono::microseconds((int64_t)(o.seconds * 1e6));
+    for (unsigned t = 0; t < o.threads; ++t)
+        pool.emplace_back([&shared, &stats, t] { Worker(shared, t, stats[t]); });
+    for (std::thread& t : pool)
+        t.join();
+    const double sec = std::chrono::duration<double>(Clock::now() - start).count();
+
+    WorkerStats total;
+    for (const WorkerStats& s : stats)
+    {
+        total.latency.Merge(s.latency);
+        for (int op = 0; op < OP_COUNT; ++op) total.requests[op] += s.requests[op];
+        total.failed += s.failed;
+        total.busy += s.busy;
+        total.events += s.events;
+        total.stale += s.stale;
+        total.broken += s.broken;
+        total.connectFailures += s.connectFailures;
+    }
+    PrintReport(o, total, sec);
+    if (o.serve)
+    {
+        const IpcServer::Stats server = standIn.Stats();
+        standIn.Stop();
+        printf("server      peak %u clients, %llu requests, %llu events, %llu dropped; %llu plan switches\n",
+            server.peakClients, (unsigned long long)server.requests, (unsigned long long)server.events,
+            (unsigned long long)server.dropped, (unsigned long long)standIn.Switches());
+    }
+    const bool oversizeOk = !o.serve || CheckOversizeBatch(o.endpoint);
+    return total.failed || total.stale || total.broken || total.connectFailures || !oversizeOk ? 1 : 0;
+}
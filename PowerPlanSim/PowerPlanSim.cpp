@@ -0,0 +1,338 @@
+// PowerPlanSim.cpp: Offline replay of recorded traces through the plan engine.
+//
+// Builds from the portable engine sources only, so it runs anywhere:
+//   g++ -O2 -std=c++17 -pthread -IPowerPlanTray PowerPlanSim/*.cpp PowerPlanTray/ActivityVeto.cpp
+//       PowerPlanTray/AfkLadder.cpp PowerPlanTray/AfkMachine.cpp PowerPlanTray/AppRules.cpp
+//       PowerPlanTray/LoadSwitcher.cpp PowerPlanTray/PlanEngine.cpp PowerPlanTray/PlanSchedule.cpp
+//       PowerPlanTray/PolicyEngine.cpp PowerPlanTray/ReturnPredictor.cpp PowerPlanTray/SwitchGovernor.cpp
+//       -o powerplansim
+
+#include "Simulation.h"
+#include "Sweep.h"
+#include "TaskPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+static void Usage()
+{
+    fputs(
+        "usage: powerplansim [options] <trace>...   (- reads standard input)\n"
+        "  --watts NAME=W[,NAME=W...]   average draw per plan, for the energy estimate\n"
+        "  --plan NAME                  plan in force when the trace starts\n"
+        "  --afk MIN:NAME[,MIN:NAME...] AFK stages (up to four)\n"
+        "  --ac NAME  --dc NAME  --low-battery NAME  --low-battery-percent N  --saver NAME\n"
+        "  --load NAME  --load-high P  --load-low P  --load-dwell S\n"
+        "  --dwell S  --burst N  --refill S\n"
+        "  --veto P                     hold AFK off while CPU load is above P percent\n"
+        "  --predict-margin MIN  --predict-confidence P  --utc-offset MIN\n"
+        "  --expect-switches N  --expect-boosts N   fail (exit 1) unless the run gives these counts\n"
+        "  --stress N                   also replay on N engines at once, each checked against a serial run\n"
+        "sweep over all traces (axes: \"1..120\", \"10..60/10\" or \"0,10,30\"):\n"
+        "  --sweep-afk MIN  --sweep-dwell S  --sweep-veto P  --threads N  --csv PATH\n",
+        stderr);
+}
+
+static bool ReadAll(const char* path, std::vector<char>& out)
+{
+    FILE* f = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!f)
+        return false;
+    char chunk[1 << 16];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) != 0)
+        out.insert(out.end(), chunk, chunk + n);
+    if (f != stdin)
+        fclose(f);
+    return true;
+}
+
+static PlanId Plan(PlanTable& plans, const char* name)
+{
+    const int index = plans.Find(name, strlen(name));
+    if (index < 0)
+    {
+        fprintf(stderr, "too many plans (at most %d)\n", PlanTable::kMaxPlans);
+        exit(2);
+    }
+    return PlanTable::Id(index);
+}
+
+// "5:saver,20:deep" = stages after 5 and 20 minutes
+static bool ParseAfk(const char* spec, PlanTable& plans, AfkLadder& ladder)
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char* item = strtok(buf, ","); item; item = strtok(nullptr, ","))
+    {
+        char* colon = strchr(item, ':');
+        if (!colon)
+            return false;
+        *colon = '\0';
+        const unsigned long minutes = strtoul(item, nullptr, 10);
+        if (!minutes || !ladder.Set((uint32_t)(minutes * 60000UL), Plan(plans, colon + 1)))
+            return false;
+    }
+    return true;
+}
+
+static bool ParseWatts(const char* spec, PlanTable& plans)
+{
+    char buf[512];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char* item = strtok(buf, ","); item; item = strtok(nullptr, ","))
+    {
+        char* eq = strchr(item, '=');
+        if (!eq)
+            return false;
+        *eq = '\0';
+        plans.watts[PlanTable::Index(Plan(plans, item))] = atof(eq + 1);
+    }
+    return true;
+}
+
+static void PrintRun(const PlanTable& plans, const SimConfig& config, const SimResult& r, double parseSec, double runSec)
+{
+    printf("events      %llu (parse %.3f s, replay %.3f s, %.1f M events/s)\n", (unsigned long long)r.events,
+        parseSec, runSec, runSec > 0 ? (double)r.events / runSec / 1e6 : 0.0);
+    printf("simulated   %.2f days\n", (double)r.simulatedMs / 86400000.0);
+    printf("switches    %u (governor: applied %u, suppressed %u, superseded %u, bypassed %u)\n", r.switches,
+        r.governor.applied, r.governor.suppressed, r.governor.superseded, r.governor.bypassed);
+    printf("afk         %u stages applied, %u returns to an AFK plan\n", r.afkApplied, r.afkReturns);
+    if (config.vetoCpuPercent)
+        printf("veto        %u stages held off\n", r.vetoHolds);
+    if (config.predictMarginMinutes)
+        printf("prediction  %u hits, %u misses, %.1f min restored early\n", r.predictHits, r.predictMisses, (double)r.earlyMs / 60000.0);
+    if (!config.loadBoost.IsNull())
+        printf("load boost  %u times\n", r.loadBoosts);
+    printf("\n%-24s %12s %7s %10s\n", "plan", "hours", "share", "Wh");
+    for (int i = 0; i < plans.count; ++i)
+    {
+        const double hours = (double)r.residencyMs[i] / 3600000.0;
+        printf("%-24s %12.2f %6.1f%% %10.1f\n", plans.names[i], hours,
+            r.simulatedMs ? 100.0 * (double)r.residencyMs[i] / (double)r.simulatedMs : 0.0, plans.watts[i] * hours);
+    }
+    printf("%-24s %12s %7s %10.1f\n", "total", "", "", r.energyWh);
+}
+
+static void PrintSweep(const std::vector<SweepPoint>& points, size_t traces, unsigned threads, double sec)
+{
+    uint64_t events = 0;
+    size_t front = 0;
+    for (const SweepPoint& p : points)
+    {
+        events += p.events;
+        front += p.pareto;
+    }
+    printf("%zu points x %zu traces on %u threads in %.2f s (%.1f M events/s)\n", points.size(), traces, threads, sec,
+        sec > 0 ? (double)events / sec / 1e6 : 0.0);
+    printf("Pareto front, energy against returns to an AFK plan (%zu points):\n\n", front);
+    printf("%8s %8s %8s %12s %12s %12s\n", "afk min", "dwell s", "veto %", "Wh/day", "returns/day", "switches/day");
+    std::vector<const SweepPoint*> sorted;
+    for (const SweepPoint& p : points)
+        if (p.pareto) sorted.push_back(&p);
+    std::sort(sorted.begin(), sorted.end(), [](const SweepPoint* a, const SweepPoint* b) { return a->WhPerDay() < b->WhPerDay(); });
+    for (const SweepPoint* p : sorted)
+    {
+        printf("%8u %8u %8u %12.1f %12.2f %12.2f\n", p->afkMinutes, p->dwellSeconds, p->vetoPercent,
+            p->WhPerDay(), p->ReturnsPerDay(), p->Days() > 0 ? (double)p->switches / p->Days() : 0.0);
+    }
+}
+
+static bool WriteCsv(const char* path, const std::vector<SweepPoint>& points)
+{
+    FILE* f = fopen(path, "w");
+    if (!f)
+        return false;
+    fputs("afk_minutes,dwell_seconds,veto_percent,days,wh_per_day,returns_per_day,switches,pareto\n", f);
+    for (const SweepPoint& p : points)
+    {
+        fprintf(f, "%u,%u,%u,%.3f,%.3f,%.4f,%llu,%d\n", p.afkMinutes, p.dwellSeconds, p.vetoPercent, p.Days(),
+            p.WhPerDay(), p.ReturnsPerDay(), (unsigned long long)p.switches, p.pareto ? 1 : 0);
+    }
+    return fclose(f) == 0;
+}
+
+static bool SameResult(const SimResult& a, const SimResult& b)
+{
+    return a.events == b.events && a.simulatedMs == b.simulatedMs && a.switches == b.switches &&
+        memcmp(a.residencyMs, b.residencyMs, sizeof(a.residencyMs)) == 0 && a.energyWh == b.energyWh &&
+        a.afkApplied == b.afkApplied && a.vetoHolds == b.vetoHolds && a.afkReturns == b.afkReturns &&
+        a.predictHits == b.predictHits && a.predictMisses == b.predictMisses && a.earlyMs == b.earlyMs &&
+        a.loadBoosts == b.loadBoosts && a.governor.applied == b.governor.applied &&
+        a.governor.suppressed == b.governor.suppressed && a.governor.superseded == b.governor.superseded &&
+        a.governor.bypassed == b.governor.bypassed;
+}
+
+// Engine k runs the config with the dwell k seconds longer, so engines that
+// leaked state into each other would not agree by chance. Every variant is
+// replayed serially first; then all N start together on their own threads and
+// replay over and over, and every result must match its serial one.
+static bool RunStress(const SimConfig& base, const PlanTable& plans, const std::vector<TraceEvent>& trace, unsigned engines)
+{
+    std::vector<SimConfig> configs(engines, base);
+    std::vector<SimResult> serial(engines);
+    for (unsigned k = 0; k < engines; ++k)
+    {
+        configs[k].governor.minDwellMs += k * 1000U;
+        serial[k] = RunSimulation(configs[k], plans, trace.data(), trace.size());
+    }
+    // Enough rounds for the threads to overlap on a short trace
+    const uint64_t rounds = std::max<uint64_t>(1, 1000000 / std::max<size_t>(trace.size(), 1));
+
+    typedef std::chrono::steady_clock Clock;
+    std::atomic<unsigned> ready{ 0 };
+    std::vector<uint64_t> mismatches(engines), firstBad(engines);
+    std::vector<std::thread> pool;
+    const Clock::time_point t0 = Clock::now();
+    for (unsigned k = 0; k < engines; ++k)
+    {
+        pool.emplace_back([&, k]
+        {
+            ready.fetch_add(1);
+            while (ready.load() < engines)
+                std::this_thread::yield();
+            for (uint64_t round = 0; round < rounds; ++round)
+            {
+                const SimResult r = RunSimulation(configs[k], plans, trace.data(), trace.size());
+                if (!SameResult(r, serial[k]) && !mismatches[k]++)
+                    firstBad[k] = round;
+            }
+        });
+    }
+    for (std::thread& t : pool)
+        t.join();
+    const double sec = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    bool same = true;
+    for (unsigned k = 0; k < engines; ++k)
+    {
+        if (mismatches[k])
+        {
+            printf("FAIL: engine %u differed from its serial run in %llu of %llu replays, first in replay %llu\n", k,
+                (unsigned long long)mismatches[k], (unsigned long long)rounds, (unsigned long long)firstBad[k]);
+            same = false;
+        }
+    }
+    printf("stress      %u engines x %llu replays on %u threads in %.2f s, %s\n", engines, (unsigned long long)rounds,
+        engines, sec, same ? "all as run serially" : "MISMATCH");
+    return same;
+}
+
+int main(int argc, char** argv)
+{
+    PlanTable plans;
+    SimConfig config;
+    SweepGrid grid;
+    bool sweep = false;
+    unsigned threads = TaskPool::DefaultThreads();
+    const char* csvPath = nullptr;
+    long expectSwitches = -1, expectBoosts = -1; // -1 = not checked
+    unsigned stressEngines = 0;
+    std::vector<const char*> tracePaths;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* opt = argv[i];
+        const char* val = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = true;
+        if (opt[0] != '-' || strcmp(opt, "-") == 0) { tracePaths.push_back(opt); continue; }
+        if (!val) { Usage(); return 2; }
+        ++i;
+        if (!strcmp(opt, "--watts")) ok = ParseWatts(val, plans);
+        else if (!strcmp(opt, "--plan")) config.initialPlan = Plan(plans, val);
+        else if (!strcmp(opt, "--afk")) ok = ParseAfk(val, plans, config.afk);
+        else if (!strcmp(opt, "--ac")) config.power.onAc = Plan(plans, val);
+        else if (!strcmp(opt, "--dc")) config.power.onDc = Plan(plans, val);
+        else if (!strcmp(opt, "--low-battery")) config.power.lowBattery = Plan(plans, val);
+        else if (!strcmp(opt, "--low-battery-percent")) config.power.lowBatteryPercent = (uint32_t)atoi(val);
+        else if (!strcmp(opt, "--saver")) config.power.energySaver = Plan(plans, val);
+        else if (!strcmp(opt, "--load")) config.loadBoost = Plan(plans, val);
+        else if (!strcmp(opt, "--load-high")) config.load.highPercent = atof(val);
+        else if (!strcmp(opt, "--load-low")) config.load.lowPercent = atof(val);
+        else if (!strcmp(opt, "--load-dwell")) config.load.minDwellMs = (uint32_t)atoi(val) * 1000U;
+        else if (!strcmp(opt, "--dwell")) config.governor.minDwellMs = (uint32_t)atoi(val) * 1000U;
+        else if (!strcmp(opt, "--burst")) config.governor.burst = (uint32_t)atoi(val);
+        else if (!strcmp(opt, "--refill")) config.governor.refillMs = (uint32_t)atoi(val) * 1000U;
+        else if (!strcmp(opt, "--veto")) config.vetoCpuPercent = (uint32_t)atoi(val);
+        else if (!strcmp(opt, "--predict-margin")) config.predictMarginMinutes = (uint32_t)atoi(val);
+        else if (!strcmp(opt, "--predict-confidence")) config.predictConfidence = (uint32_t)atoi(val);
+        else if (!strcmp(opt, "--utc-offset")) config.utcOffsetMinutes = atoi(val);
+        else if (!strcmp(opt, "--sweep-afk")) ok = sweep = SweepGrid::ParseAxis(val, grid.afkMinutes);
+        else if (!strcmp(opt, "--sweep-dwell")) ok = sweep = SweepGrid::ParseAxis(val, grid.dwellSeconds);
+        else if (!strcmp(opt, "--sweep-veto")) ok = sweep = SweepGrid::ParseAxis(val, grid.vetoPercent);
+        else if (!strcmp(opt, "--threads")) threads = (unsigned)atoi(val);
+        else if (!strcmp(opt, "--csv")) csvPath = val;
+        else if (!strcmp(opt, "--expect-switches")) expectSwitches = atol(val);
+        else if (!strcmp(opt, "--expect-boosts")) expectBoosts = atol(val);
+        else if (!strcmp(opt, "--stress")) ok = (stressEngines = (unsigned)atoi(val)) != 0;
+        else ok = false;
+        if (!ok)
+        {
+            fprintf(stderr, "bad option: %s %s\n", opt, val);
+            Usage();
+            return 2;
+        }
+    }
+    if (tracePaths.empty() || (!sweep && tracePaths.size() != 1)) { Usage(); return 2; }
+    if (sweep && (expectSwitches >= 0 || expectBoosts >= 0 || stressEngines)) { Usage(); return 2; } // Counts are per run
+    if (config.governor.burst == 0) config.governor.burst = 1; // As the app does
+    if (threads == 0) threads = 1;
+
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point t0 = Clock::now();
+    std::vector<std::vector<TraceEvent>> traces(tracePaths.size());
+    for (size_t t = 0; t < tracePaths.size(); ++t)
+    {
+        std::vector<char> text;
+        if (!ReadAll(tracePaths[t], text))
+        {
+            fprintf(stderr, "cannot read %s\n", tracePaths[t]);
+            return 1;
+        }
+        char error[160];
+        if (!ParseTrace(text.data(), text.size(), plans, traces[t], error, sizeof(error)))
+        {
+            fprintf(stderr, "%s: %s\n", tracePaths[t], error);
+            return 1;
+        }
+    }
+    const Clock::time_point t1 = Clock::now();
+
+    if (sweep)
+    {
+        const std::vector<SweepPoint> points = RunSweep(config, plans, traces, grid, threads);
+        const Clock::time_point t2 = Clock::now();
+        PrintSweep(points, traces.size(), threads, std::chrono::duration<double>(t2 - t1).count());
+        if (csvPath && !WriteCsv(csvPath, points))
+        {
+            fprintf(stderr, "cannot write %s\n", csvPath);
+            return 1;
+        }
+        return 0;
+    }
+
+    const SimResult r = RunSimulation(config, plans, traces[0].data(), traces[0].size());
+    const Clock::time_point t2 = Clock::now();
+    PrintRun(plans, config, r, std::chrono::duration<double>(t1 - t0).count(), std::chrono::duration<double>(t2 - t1).count());
+
+    // A committed trace with known counts makes a regression check of the engine
+    bool expected = true;
+    if (expectSwitches >= 0 && r.switches != (uint32_t)expectSwitches)
+    {
+        printf("FAIL: %u switches, expected %ld\n", r.switches, expectSwitches);
+        expected = false;
+    }
+    if (expectBoosts >= 0 && r.loadBoosts != (uint32_t)expectBoosts)
+    {
+        printf("FAIL: %u load boosts, expected %ld\n", r.loadBoosts, expectBoosts);
+        expected = false;
+    }
+    if (stressEngines && !RunStress(config, plans, traces[0], stressEngines))
+        expected = false;
+    return expected ? 0 : 1;
+}
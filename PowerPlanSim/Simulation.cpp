@@ -0,0 +1,371 @@
+// Simulation.cpp: Replays recorded traces through the plan engine under a virtual clock.
+
+#include "Simulation.h"
+
+#include "PlanEngine.h"
+
+#include <stdio.h>
+#include <string.h>
+
+int PlanTable::Find(const char* name, size_t len)
+{
+    if (len >= (size_t)kNameMax)
+        len = kNameMax - 1;
+    for (int i = 0; i < count; ++i)
+    {
+        if (strncmp(names[i], name, len) == 0 && names[i][len] == '\0')
+            return i;
+    }
+    if (count >= kMaxPlans)
+        return -1;
+    memcpy(names[count], name, len);
+    names[count][len] = '\0';
+    return count++;
+}
+
+PlanId PlanTable::Id(int index)
+{
+    PlanId id{};
+    id.bytes[0] = (uint8_t)(index + 1);
+    return id;
+}
+
+// ----- Trace parsing -----
+// Hand-rolled over the whole buffer: a trace has millions of lines and this
+// is the part of a run that sees every byte.
+
+static bool IsBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+static bool Word(const char*& p, const char* end, const char*& word, size_t& len)
+{
+    while (p < end && IsBlank(*p)) ++p;
+    word = p;
+    while (p < end && !IsBlank(*p) && *p != '\n') ++p;
+    len = (size_t)(p - word);
+    return len != 0;
+}
+
+static bool Number(const char* word, size_t len, uint64_t& out)
+{
+    out = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        if (word[i] < '0' || word[i] > '9')
+            return false;
+        out = out * 10 + (uint64_t)(word[i] - '0');
+    }
+    return len != 0;
+}
+
+static bool Is(const char* word, size_t len, const char* name)
+{
+    return strlen(name) == len && memcmp(word, name, len) == 0;
+}
+
+bool ParseTrace(const char* text, size_t length, PlanTable& plans, std::vector<TraceEvent>& out, char* error, size_t errorSize)
+{
+    const char* p = text;
+    const char* end = text + length;
+    uint64_t line = 0, last = 0;
+    while (p < end)
+    {
+        ++line;
+        const char* word;
+        size_t len;
+        if (!Word(p, end, word, len) || *word == '#')
+        {
+            while (p < end && *p != '\n') ++p;
+            ++p;
+            continue;
+        }
+
+        TraceEvent e{};
+        uint64_t arg = 0;
+        bool ok = Number(word, len, e.timeMs) && e.timeMs >= last && Word(p, end, word, len);
+        if (ok)
+        {
+            if (Is(word, len, "input")) e.kind = TraceEvent::EVENT_INPUT;
+            else if (Is(word, len, "ac")) e.kind = TraceEvent::EVENT_AC;
+            else if (Is(word, len, "dc")) e.kind = TraceEvent::EVENT_DC;
+            else if (Is(word, len, "end")) e.kind = TraceEvent::EVENT_END;
+            else if (Is(word, len, "battery")) e.kind = TraceEvent::EVENT_BATTERY;
+            else if (Is(word, len, "saver")) e.kind = TraceEvent::EVENT_SAVER;
+            else if (Is(word, len, "cpu")) e.kind = TraceEvent::EVENT_CPU;
+            else if (Is(word, len, "plan")) e.kind = TraceEvent::EVENT_PLAN;
+            else ok = false;
+        }
+        if (ok && e.kind >= TraceEvent::EVENT_BATTERY && e.kind <= TraceEvent::EVENT_CPU)
+        {
+            ok = Word(p, end, word, len) && Number(word, len, arg) && arg <= 100;
+            e.value = (uint32_t)arg;
+        }
+        else if (ok && e.kind == TraceEvent::EVENT_PLAN)
+        {
+            const int index = Word(p, end, word, len) ? plans.Find(word, len) : -1;
+            ok = index >= 0;
+            e.value = (uint32_t)index;
+        }
+        if (!ok)
+        {
+            snprintf(error, errorSize, "line %llu: expected \"<ms> input|ac|dc|battery N|saver 0|1|cpu N|plan NAME|end\" with times in order",
+                (unsigned long long)line);
+            return false;
+        }
+        last = e.timeMs;
+        out.push_back(e);
+        while (p < end && *p != '\n') ++p;
+        ++p;
+    }
+    return true;
+}
+
+// ----- Replay -----
+
+namespace
+{
+
+// Hosts one plan engine the way the app does, with the Win32 calls replaced
+// by the trace and the timers by a virtual clock
+class Replay : public PlanEngine::Host
+{
+public:
+    Replay(const SimConfig& config, const PlanTable& plans);
+
+    void Start(uint64_t nowMs);
+    void Advance(uint64_t toMs);
+    void Handle(const TraceEvent& e);
+    void Finish(uint64_t nowMs);
+    SimResult& Result() { return m_result; }
+
+    // PlanEngine::Host
+    bool ReadActivePlan(PlanId& out) override { out = m_active; return true; }
+    void ApplyPlan(const PlanId& plan) override;
+    void ArmTimer(PlanEngine::Timer timer, uint64_t delayMs) override;
+    void CollectActivity(ActivitySample& out) override;
+    bool SetInputSink(bool) override { return true; } // Every input is in the trace
+    void LocalTime(uint32_t& weekday, uint32_t& minute, uint32_t& msIntoMinute) override;
+
+private:
+    void IntegrateCpu();
+    void CountAfk(const AfkMachine::Output& out);
+
+    const SimConfig& m_config;
+    const PlanTable& m_plans;
+    SimResult m_result;
+    PlanEngine m_engine;
+
+    // Virtual clock and the world the trace describes
+    uint64_t m_now = 0;
+    uint64_t m_lastInputMs = 0;
+    uint32_t m_cpuBusy = 0;
+    uint64_t m_cpuAtMs = 0;
+    uint64_t m_cpuIdle = 0;  // Cumulative, in ms x percent
+    uint64_t m_cpuTotal = 0;
+
+    // Timers, as absolute due times
+    uint64_t m_due[PlanEngine::TIMER_COUNT];
+
+    PlanId m_active{};
+    uint64_t m_activeSinceMs = 0;
+};
+
+Replay::Replay(const SimConfig& config, const PlanTable& plans)
+    : m_config(config), m_plans(plans), m_engine(*this)
+{
+    for (uint64_t& due : m_due) due = PlanEngine::kNever;
+    for (size_t i = 0; i < config.afk.Count(); ++i)
+        m_engine.Ladder().Set(config.afk.At(i).thresholdMs, config.afk.At(i).plan);
+    ReturnPredictor::Config predict;
+    predict.confidencePercent = config.predictConfidence;
+    m_engine.SetPrediction(config.predictMarginMinutes, predict);
+    // Traces record CPU load only
+    ActivityVeto::Config veto;
+    veto.cpuPercent = config.vetoCpuPercent;
+    veto.diskBytesPerSec = 0;
+    veto.netBytesPerSec = 0;
+    veto.powerRequests = false;
+    m_engine.SetVetoConfig(veto);
+    m_engine.SetGovernorConfig(config.governor);
+    m_engine.SetLoadBoost(config.loadBoost, config.load);
+    m_engine.SetPowerSourceMap(config.power);
+}
+
+void Replay::Start(uint64_t nowMs)
+{
+    m_now = m_lastInputMs = m_cpuAtMs = m_activeSinceMs = nowMs;
+    m_active = m_config.initialPlan;
+    if (!m_active.IsNull())
+        m_engine.Start(m_active, nowMs);
+    // The app hears the current power state right after subscribing
+    m_engine.PowerSource(false, nowMs);
+    m_engine.LoadSample(nowMs, 0, 0);
+    m_engine.AfkTick(nowMs, 0);
+}
+
+void Replay::ArmTimer(PlanEngine::Timer timer, uint64_t delayMs)
+{
+    m_due[timer] = delayMs == PlanEngine::kNever ? delayMs : m_now + delayMs;
+}
+
+void Replay::LocalTime(uint32_t& weekday, uint32_t& minute, uint32_t& msIntoMinute)
+{
+    const int64_t local = (int64_t)m_now + (int64_t)m_config.utcOffsetMinutes * 60000;
+    const int64_t day = local / 86400000;
+    weekday = (uint32_t)((day + 4) % 7); // 1970-01-01 was a Thursday
+    const int64_t ms = local - day * 86400000;
+    minute = (uint32_t)(ms / 60000);
+    msIntoMinute = (uint32_t)(ms % 60000);
+}
+
+void Replay::CollectActivity(ActivitySample& out)
+{
+    IntegrateCpu();
+    out = ActivitySample{};
+    out.timeMs = m_now;
+    out.cpuIdle = m_cpuIdle;
+    out.cpuTotal = m_cpuTotal;
+}
+
+void Replay::IntegrateCpu()
+{
+    const uint64_t dt = m_now - m_cpuAtMs;
+    m_cpuTotal += dt * 100;
+    m_cpuIdle += dt * (100 - m_cpuBusy);
+    m_cpuAtMs = m_now;
+}
+
+void Replay::ApplyPlan(const PlanId& plan)
+{
+    if (plan == m_active)
+        return;
+    const int index = PlanTable::Index(m_active);
+    if (index >= 0)
+        m_result.residencyMs[index] += m_now - m_activeSinceMs;
+    m_active = plan;
+    m_activeSinceMs = m_now;
+    ++m_result.switches;
+}
+
+void Replay::CountAfk(const AfkMachine::Output& out)
+{
+    if (out.returned) ++m_result.afkReturns;
+    if (out.action == AfkMachine::ACTION_APPLY) ++m_result.afkApplied;
+}
+
+// Fires every timer that falls due up to toMs, earliest first
+void Replay::Advance(uint64_t toMs)
+{
+    for (;;)
+    {
+        int timer = 0;
+        for (int t = 1; t < PlanEngine::TIMER_COUNT; ++t)
+        {
+            if (m_due[t] < m_due[timer]) timer = t;
+        }
+        const uint64_t due = m_due[timer];
+        if (due > toMs)
+            break;
+        if (due > m_now)
+            m_now = due;
+        m_due[timer] = PlanEngine::kNever;
+
+        switch ((PlanEngine::Timer)timer)
+        {
+        case PlanEngine::TIMER_AFK:
+            CountAfk(m_engine.AfkTick(m_now, m_now - m_lastInputMs));
+            break;
+        case PlanEngine::TIMER_LOAD:
+        {
+            const bool boosted = m_engine.Load().Boosted();
+            IntegrateCpu();
+            m_engine.LoadSample(m_now, m_cpuIdle, m_cpuTotal);
+            if (m_engine.Load().Boosted() && !boosted) ++m_result.loadBoosts;
+            break;
+        }
+        case PlanEngine::TIMER_GOVERNOR:
+            m_engine.GovernorDue(m_now);
+            break;
+        case PlanEngine::TIMER_EXPIRY:
+            m_engine.ClaimsExpire(m_now);
+            break;
+        default:
+            break;
+        }
+    }
+    if (toMs > m_now)
+        m_now = toMs;
+}
+
+void Replay::Handle(const TraceEvent& e)
+{
+    ++m_result.events;
+    switch (e.kind)
+    {
+    case TraceEvent::EVENT_INPUT:
+        m_lastInputMs = m_now;
+        CountAfk(m_engine.UserInput(m_now));
+        break;
+    case TraceEvent::EVENT_AC:
+    case TraceEvent::EVENT_DC:
+        m_engine.PowerSource(e.kind == TraceEvent::EVENT_DC, m_now);
+        break;
+    case TraceEvent::EVENT_BATTERY:
+        m_engine.BatteryPercent(e.value, m_now);
+        break;
+    case TraceEvent::EVENT_SAVER:
+        m_engine.EnergySaver(e.value != 0, m_now);
+        break;
+    case TraceEvent::EVENT_CPU:
+        IntegrateCpu();
+        m_cpuBusy = e.value;
+        break;
+    case TraceEvent::EVENT_PLAN:
+        m_engine.PlanPicked(PlanTable::Id((int)e.value), m_now);
+        break;
+    case TraceEvent::EVENT_END:
+        break;
+    }
+}
+
+void Replay::Finish(uint64_t nowMs)
+{
+    Advance(nowMs);
+    const int index = PlanTable::Index(m_active);
+    if (index >= 0)
+        m_result.residencyMs[index] += m_now - m_activeSinceMs;
+    m_activeSinceMs = m_now;
+
+    const AfkMachine::Counters& afk = m_engine.Afk().GetCounters();
+    m_result.vetoHolds = afk.vetoHolds;
+    m_result.predictHits = afk.predictHits;
+    m_result.predictMisses = afk.predictMisses;
+    m_result.earlyMs = afk.earlyMs;
+    m_result.governor = m_engine.Governor().GetCounters();
+    for (int i = 0; i < m_plans.count; ++i)
+        m_result.energyWh += m_plans.watts[i] * (double)m_result.residencyMs[i] / 3600000.0;
+}
+
+} // namespace
+
+SimResult RunSimulation(const SimConfig& config, const PlanTable& plans, const TraceEvent* events, size_t count)
+{
+    Replay engine(config, plans);
+    if (count == 0)
+        return engine.Result();
+    const uint64_t start = events[0].timeMs;
+    uint64_t end = events[count - 1].timeMs;
+    engine.Start(start);
+    for (size_t i = 0; i < count; ++i)
+    {
+        engine.Advance(events[i].timeMs);
+        engine.Handle(events[i]);
+        if (events[i].kind == TraceEvent::EVENT_END)
+        {
+            end = events[i].timeMs;
+            break;
+        }
+    }
+    engine.Finish(end);
+    engine.Result().simulatedMs = end - start;
+    return engine.Result();
+}
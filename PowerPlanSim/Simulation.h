@@ -0,0 +1,89 @@
+// Simulation.h: Replays recorded traces through the plan engine under a virtual clock.
+
+#pragma once
+
+#include "AfkLadder.h"
+#include "LoadSwitcher.h"
+#include "PolicySources.h"
+#include "SwitchGovernor.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Plans are named in the options and the trace; the id of plan i is i + 1 in
+// the first byte, which is all the engine needs to tell them apart.
+struct PlanTable
+{
+    static const int kMaxPlans = 16;
+    static const int kNameMax = 32;
+
+    char names[kMaxPlans][kNameMax] = {};
+    double watts[kMaxPlans] = {}; // Average system draw while the plan is active
+    int count = 0;
+
+    // Index of the named plan, added if new; -1 when the table is full
+    int Find(const char* name, size_t len);
+    static PlanId Id(int index);
+    static int Index(const PlanId& id) { return (int)id.bytes[0] - 1; }
+};
+
+// One recorded event. Times are Unix milliseconds so weekdays mean something.
+struct TraceEvent
+{
+    enum Kind : uint8_t
+    {
+        EVENT_INPUT,   // Keyboard or mouse
+        EVENT_AC,      // On mains power
+        EVENT_DC,      // On battery
+        EVENT_BATTERY, // value = percent remaining
+        EVENT_SAVER,   // value = energy saver on (1) or off (0)
+        EVENT_CPU,     // value = busy percent from now on
+        EVENT_PLAN,    // value = plan index the user picked
+        EVENT_END,     // Stop here
+    };
+    uint64_t timeMs;
+    Kind kind;
+    uint32_t value;
+};
+
+// Text trace: one "<unix ms> <event> [arg]" per line, times non-decreasing,
+// '#' starts a comment. Events: input, ac, dc, battery <percent>, saver <0|1>,
+// cpu <busy percent>, plan <name>, end. Returns false with a message on error.
+bool ParseTrace(const char* text, size_t length, PlanTable& plans, std::vector<TraceEvent>& out, char* error, size_t errorSize);
+
+// Everything a run can be tuned by; the defaults match the app's
+struct SimConfig
+{
+    AfkLadder afk;
+    PowerSourceMap power;
+    PlanId loadBoost{};      // Null = CPU-load boost off
+    LoadSwitcher::Config load;
+    SwitchGovernor::Config governor;
+    PlanId initialPlan{};
+    uint32_t vetoCpuPercent = 0;       // Hold AFK off above this CPU load; 0 = off
+    uint32_t predictMarginMinutes = 0; // 0 = return prediction off
+    uint32_t predictConfidence = 70;
+    int32_t utcOffsetMinutes = 0;      // Local time for the weekday histogram
+};
+
+struct SimResult
+{
+    uint64_t events = 0;
+    uint64_t simulatedMs = 0;
+    uint32_t switches = 0;
+    uint64_t residencyMs[PlanTable::kMaxPlans] = {};
+    double energyWh = 0.0;
+    uint32_t afkApplied = 0;     // Stages put in force
+    uint32_t vetoHolds = 0;      // Due stages held off by CPU activity
+    uint32_t afkReturns = 0;     // The user came back to an AFK plan
+    uint32_t predictHits = 0;    // ... and found their plan already restored
+    uint32_t predictMisses = 0;
+    uint64_t earlyMs = 0;        // Time restored ahead of a return
+    uint32_t loadBoosts = 0;
+    SwitchGovernor::Counters governor;
+};
+
+// Deterministic: the same trace and config always give the same result.
+// Keeps no state outside its arguments, so runs may go in parallel.
+SimResult RunSimulation(const SimConfig& config, const PlanTable& plans, const TraceEvent* events, size_t count);
@@ -0,0 +1,128 @@
+// Sweep.cpp: Evaluates a grid of settings over many traces and finds the Pareto front.
+
+#include "Sweep.h"
+#include "TaskPool.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+bool SweepGrid::ParseAxis(const char* spec, std::vector<uint32_t>& out)
+{
+    out.clear();
+    const char* dots = strstr(spec, "..");
+    if (dots)
+    {
+        char* end;
+        const unsigned long from = strtoul(spec, &end, 10);
+        if (end != dots)
+            return false;
+        const unsigned long to = strtoul(dots + 2, &end, 10);
+        unsigned long step = 1;
+        if (*end == '/')
+            step = strtoul(end + 1, &end, 10);
+        if (*end != '\0' || step == 0 || to < from)
+            return false;
+        for (unsigned long v = from; v <= to; v += step)
+            out.push_back((uint32_t)v);
+        return true;
+    }
+    for (const char* p = spec; *p;)
+    {
+        char* end;
+        out.push_back((uint32_t)strtoul(p, &end, 10));
+        if (end == p || (*end != ',' && *end != '\0'))
+            return false;
+        p = *end ? end + 1 : end;
+    }
+    return !out.empty();
+}
+
+static void MarkPareto(std::vector<SweepPoint>& points)
+{
+    // Sorted by energy, then returns: a point is on the front when it has
+    // fewer returns than every cheaper point before it
+    std::vector<size_t> order(points.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+    {
+        if (points[a].WhPerDay() != points[b].WhPerDay())
+            return points[a].WhPerDay() < points[b].WhPerDay();
+        return points[a].ReturnsPerDay() < points[b].ReturnsPerDay();
+    });
+    double best = 0.0;
+    for (size_t k = 0; k < order.size(); ++k)
+    {
+        SweepPoint& p = points[order[k]];
+        p.pareto = k == 0 || p.ReturnsPerDay() < best;
+        if (p.pareto) best = p.ReturnsPerDay();
+    }
+}
+
+std::vector<SweepPoint> RunSweep(const SimConfig& base, const PlanTable& plans,
+    const std::vector<std::vector<TraceEvent>>& traces, const SweepGrid& grid, unsigned threads)
+{
+    // An empty axis is the base value
+    const std::vector<uint32_t> afk = !grid.afkMinutes.empty() ? grid.afkMinutes
+        : std::vector<uint32_t>{ base.afk.Count() ? base.afk.At(0).thresholdMs / 60000U : 0U };
+    const std::vector<uint32_t> dwell = !grid.dwellSeconds.empty() ? grid.dwellSeconds
+        : std::vector<uint32_t>{ base.governor.minDwellMs / 1000U };
+    const std::vector<uint32_t> veto = !grid.vetoPercent.empty() ? grid.vetoPercent
+        : std::vector<uint32_t>{ base.vetoCpuPercent };
+
+    std::vector<SweepPoint> points;
+    for (uint32_t a : afk)
+        for (uint32_t d : dwell)
+            for (uint32_t v : veto)
+            {
+                SweepPoint p;
+                p.afkMinutes = a;
+                p.dwellSeconds = d;
+                p.vetoPercent = v;
+                points.push_back(p);
+            }
+
+    // Each worker sums into its own copy of the points; merged once at the end
+    if (threads == 0) threads = 1;
+    std::vector<std::vector<SweepPoint>> partial(threads, std::vector<SweepPoint>(points.size()));
+    const size_t traceCount = traces.size();
+    TaskPool::Run(points.size() * traceCount, threads, [&](unsigned worker, size_t task)
+    {
+        const size_t point = task / traceCount;
+        const std::vector<TraceEvent>& trace = traces[task % traceCount];
+        const SweepPoint& p = points[point];
+
+        SimConfig config = base;
+        if (p.afkMinutes && base.afk.Count())
+        {
+            // Re-time the first stage, keep its plan and any deeper stages
+            const PlanId plan = base.afk.At(0).plan;
+            config.afk.Remove(0);
+            config.afk.Set(p.afkMinutes * 60000U, plan);
+        }
+        config.governor.minDwellMs = p.dwellSeconds * 1000U;
+        config.vetoCpuPercent = p.vetoPercent;
+
+        const SimResult r = RunSimulation(config, plans, trace.data(), trace.size());
+        SweepPoint& sum = partial[worker][point];
+        sum.simulatedMs += r.simulatedMs;
+        sum.energyMilliWh += (uint64_t)(r.energyWh * 1000.0 + 0.5);
+        sum.switches += r.switches;
+        sum.afkReturns += r.afkReturns;
+        sum.events += r.events;
+    });
+
+    for (const std::vector<SweepPoint>& part : partial)
+    {
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            points[i].simulatedMs += part[i].simulatedMs;
+            points[i].energyMilliWh += part[i].energyMilliWh;
+            points[i].switches += part[i].switches;
+            points[i].afkReturns += part[i].afkReturns;
+            points[i].events += part[i].events;
+        }
+    }
+    MarkPareto(points);
+    return points;
+}
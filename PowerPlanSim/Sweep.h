@@ -0,0 +1,43 @@
+// Sweep.h: Evaluates a grid of settings over many traces and finds the Pareto front.
+
+#pragma once
+
+#include "Simulation.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Each axis lists the values to try; the grid is their cross product. An
+// empty axis keeps the base config's value.
+struct SweepGrid
+{
+    std::vector<uint32_t> afkMinutes;   // First AFK stage threshold
+    std::vector<uint32_t> dwellSeconds; // Governor minimum dwell
+    std::vector<uint32_t> vetoPercent;  // CPU veto threshold, 0 = off
+
+    // "1..120", "10..60/10" or "0,10,30"
+    static bool ParseAxis(const char* spec, std::vector<uint32_t>& out);
+};
+
+// One grid point, summed over every trace
+struct SweepPoint
+{
+    uint32_t afkMinutes = 0;
+    uint32_t dwellSeconds = 0;
+    uint32_t vetoPercent = 0;
+    uint64_t simulatedMs = 0;
+    uint64_t energyMilliWh = 0; // Integer so the sums do not depend on which worker ran what
+    uint64_t switches = 0;
+    uint64_t afkReturns = 0; // Times the user came back to an AFK plan: the responsiveness cost
+    uint64_t events = 0;
+    bool pareto = false;     // No other point is as good on both energy and returns, and better on one
+
+    double Days() const { return (double)simulatedMs / 86400000.0; }
+    double WhPerDay() const { return simulatedMs ? (double)energyMilliWh / 1000.0 / Days() : 0.0; }
+    double ReturnsPerDay() const { return simulatedMs ? (double)afkReturns / Days() : 0.0; }
+};
+
+// Runs every (trace, point) pair on `threads` workers, each with its own
+// engine; traces and plans are shared read-only
+std::vector<SweepPoint> RunSweep(const SimConfig& base, const PlanTable& plans,
+    const std::vector<std::vector<TraceEvent>>& traces, const SweepGrid& grid, unsigned threads);
@@ -0,0 +1,101 @@
+// TaskPool.cpp: Runs a range of independent tasks on worker threads with work stealing.
+
+#include "TaskPool.h"
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// One worker's slice, padded so neighbours do not share a cache line
+struct alignas(64) Slice
+{
+    std::atomic<uint64_t> range{ 0 };
+};
+
+inline uint64_t Pack(uint32_t begin, uint32_t end) { return (uint64_t)begin << 32 | end; }
+inline uint32_t Begin(uint64_t r) { return (uint32_t)(r >> 32); }
+inline uint32_t End(uint64_t r) { return (uint32_t)r; }
+
+bool TakeOwn(Slice& s, uint32_t& index)
+{
+    uint64_t r = s.range.load(std::memory_order_acquire);
+    while (Begin(r) < End(r))
+    {
+        if (s.range.compare_exchange_weak(r, Pack(Begin(r) + 1, End(r)), std::memory_order_acq_rel))
+        {
+            index = Begin(r);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Moves the back half of some other slice (all of it if only one task is
+// left) into the thief's own, which is empty at this point. A thief's own
+// slice is only ever written by the thief while nobody can take from it.
+bool Steal(Slice* slices, unsigned count, unsigned self)
+{
+    for (unsigned k = 1; k < count; ++k)
+    {
+        Slice& victim = slices[(self + k) % count];
+        uint64_t r = victim.range.load(std::memory_order_acquire);
+        while (Begin(r) < End(r))
+        {
+            const uint32_t mid = Begin(r) + (End(r) - Begin(r)) / 2;
+            if (victim.range.compare_exchange_weak(r, Pack(Begin(r), mid), std::memory_order_acq_rel))
+            {
+                slices[self].range.store(Pack(mid, End(r)), std::memory_order_release);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+unsigned TaskPool::DefaultThreads()
+{
+    const unsigned n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+void TaskPool::Run(size_t count, unsigned threads, const std::function<void(unsigned, size_t)>& task)
+{
+    if (count == 0)
+        return;
+    if (threads == 0) threads = 1;
+    if (threads > count) threads = (unsigned)count;
+    // Indices are 32-bit inside a slice; bigger runs go in rounds
+    const size_t kRound = UINT32_MAX;
+    for (size_t base = 0; base < count; base += kRound)
+    {
+        const uint32_t n = (uint32_t)(count - base < kRound ? count - base : kRound);
+        std::unique_ptr<Slice[]> slices(new Slice[threads]);
+        for (unsigned w = 0; w < threads; ++w)
+            slices[w].range.store(Pack((uint32_t)((uint64_t)n * w / threads), (uint32_t)((uint64_t)n * (w + 1) / threads)));
+
+        auto work = [&](unsigned w)
+        {
+            for (;;)
+            {
+                uint32_t index;
+                if (TakeOwn(slices[w], index))
+                    task(w, base + index);
+                else if (!Steal(slices.get(), threads, w))
+                    return; // Nothing left anywhere (stolen tasks in flight belong to their thief)
+            }
+        };
+        std::vector<std::thread> pool;
+        for (unsigned w = 1; w < threads; ++w)
+            pool.emplace_back(work, w);
+        work(0);
+        for (std::thread& t : pool)
+            t.join();
+    }
+}
@@ -0,0 +1,21 @@
+// TaskPool.h: Runs a range of independent tasks on worker threads with work stealing.
+
+#pragma once
+
+#include <functional>
+#include <stddef.h>
+
+// Each worker starts with an equal slice of [0, count) and takes tasks from
+// the front of its own slice. A worker that runs dry steals the back half of
+// another worker's slice, so uneven task costs even out without a shared
+// queue that every thread contends on. Slices are single 64-bit atomics
+// (begin and end, 32 bits each), so neither taking nor stealing locks.
+class TaskPool
+{
+public:
+    // Calls task(worker, index) once for every index, on `threads` threads
+    // (worker in [0, threads)), and returns when all have finished.
+    static void Run(size_t count, unsigned threads, const std::function<void(unsigned, size_t)>& task);
+    // Hardware threads, at least 1
+    static unsigned DefaultThreads();
+};
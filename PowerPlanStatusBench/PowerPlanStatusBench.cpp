@@ -0,0 +1,273 @@
+// PowerPlanStatusBench.cpp: Contention benchmark for the shared-memory status block, and a live watcher.
+//
+// Builds from the block's own sources, so it runs anywhere:
+//   g++ -O2 -std=c++17 -pthread -IPowerPlanTray PowerPlanStatusBench/*.cpp PowerPlanTray/StatusBlock.cpp
+//       PowerPlanTray/LatencyHistogram.cpp -o powerplanstatusbench
+//
+// The benchmark maps a private block, has one thread write it at a set rate
+// (or flat out) and the rest read it in a loop. Every record the writer puts
+// out is derived from one counter, so a reader can tell a torn snapshot from
+// a whole one; the run fails if it ever sees one.
+
+#include "StatusBlock.h"
+#include "LatencyHistogram.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+static void Usage()
+{
+    fputs(
+        "usage: powerplanstatusbench [options]\n"
+        "  --readers N      reader threads (default: one per core but the writer's)\n"
+        "  --seconds S      how long to run (default 3)\n"
+        "  --write-hz N     writes per second, 0 = as fast as possible (default 1000)\n"
+        "  --watch          instead, read the tray's block and print each change\n",
+        stderr);
+}
+
+struct Options
+{
+    unsigned readers = 0;
+    double seconds = 3.0;
+    unsigned writeHz = 1000;
+    bool watch = false;
+};
+
+// ===== Records =====
+// Everything in record k follows from k
+static void MakeRecord(uint64_t k, StatusSnapshot& out)
+{
+    memset(out.active.bytes, (int)(k & 0xFF), sizeof(out.active.bytes));
+    out.lastSwitchUnixMs = k;
+    out.idleSampledUnixMs = ~k;
+    out.idleSeconds = (uint32_t)k;
+    out.afkApplied = (k & 1) != 0;
+    out.afkStage = (int8_t)(k % 4);
+    swprintf(out.name, kStatusNameMax, L"Plan %llu", (unsigned long long)k);
+}
+
+static bool WholeRecord(const StatusSnapshot& s)
+{
+    const uint64_t k = s.lastSwitchUnixMs;
+    for (uint8_t b : s.active.bytes)
+        if (b != (uint8_t)(k & 0xFF)) return false;
+    wchar_t name[kStatusNameMax];
+    swprintf(name, kStatusNameMax, L"Plan %llu", (unsigned long long)k);
+    return s.idleSampledUnixMs == ~k && s.idleSeconds == (uint32_t)k && s.afkApplied == ((k & 1) != 0) &&
+        s.afkStage == (int8_t)(k % 4) && wcscmp(s.name, name) == 0;
+}
+
+// ===== Threads =====
+struct ReaderStats
+{
+    LatencyHistogram latency; // Nanoseconds per read, one read in every kSampleEvery
+    uint64_t reads = 0;
+    uint64_t retries = 0;     // Attempts that ran into a write
+    uint64_t busy = 0;        // Reads that gave up: the writer was preempted mid-write
+    uint64_t torn = 0;        // Reads that returned a mixed record: must stay 0
+    uint64_t backwards = 0;   // Generation went down: must stay 0
+};
+
+static const unsigned kSampleEvery = 16;
+
+static void Reader(const char* name, const std::atomic<bool>& stop, ReaderStats& stats)
+{
+    StatusReader reader;
+    if (!reader.Open(name))
+        return;
+    StatusSnapshot s;
+    uint32_t lastGeneration = 0;
+    while (!stop.load(std::memory_order_relaxed))
+    {
+        for (unsigned i = 0; i < kSampleEvery; ++i)
+        {
+            const bool timed = i == 0;
+            const Clock::time_point start = timed ? Clock::now() : Clock::time_point();
+            uint32_t retries = 0;
+            const StatusReader::Result result = reader.Read(s, &retries);
+            if (timed)
+                stats.latency.Record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+            ++stats.reads;
+            stats.retries += retries;
+            if (result == StatusReader::READ_BUSY)
+                ++stats.busy;
+            if (result != StatusReader::READ_OK)
+                continue;
+            if (!WholeRecord(s))
+                ++stats.torn;
+            if (s.generation < lastGeneration)
+                ++stats.backwards;
+            lastGeneration = s.generation;
+        }
+    }
+}
+
+struct WriterStats
+{
+    LatencyHistogram latency; // Nanoseconds per Publish
+    uint64_t writes = 0;
+};
+
+static void Writer(StatusWriter& writer, unsigned hz, const std::atomic<bool>& stop, WriterStats& stats)
+{
+    StatusSnapshot s;
+    const Clock::duration period = hz ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / hz))
+                                      : Clock::duration::zero();
+    Clock::time_point next = Clock::now();
+    for (uint64_t k = 2; !stop.load(std::memory_order_relaxed); ++k)
+    {
+        MakeRecord(k, s);
+        const Clock::time_point start = Clock::now();
+        writer.Publish(s);
+        stats.latency.Record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+        ++stats.writes;
+        if (hz)
+        {
+            next += period;
+            std::this_thread::sleep_until(next);
+        }
+    }
+}
+
+// ===== Modes =====
+static int Bench(const Options& o)
+{
+    char name[64];
+#ifdef _WIN32
+    snprintf(name, sizeof(name), "Local\\PowerPlanStatusBench.%lu", (unsigned long)GetCurrentProcessId());
+#else
+    snprintf(name, sizeof(name), "/PowerPlanStatusBench-%d", (int)getpid());
+#endif
+    StatusWriter writer;
+    if (!writer.Open(name))
+    {
+        fprintf(stderr, "cannot create %s\n", name);
+        return 2;
+    }
+    StatusSnapshot first;
+    MakeRecord(1, first);
+    writer.Publish(first);
+
+    std::atomic<bool> stop{ false };
+    std::vector<ReaderStats> readers(o.readers);
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < o.readers; ++i)
+        pool.emplace_back([&, i] { Reader(name, stop, readers[i]); });
+    WriterStats written;
+    std::thread writerThread([&] { Writer(writer, o.writeHz, stop, written); });
+
+    const Clock::time_point start = Clock::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(o.seconds));
+    stop.store(true);
+    writerThread.join();
+    for (std::thread& t : pool)
+        t.join();
+    const double sec = std::chrono::duration<double>(Clock::now() - start).count();
+    writer.Close();
+
+    ReaderStats total;
+    for (const ReaderStats& r : readers)
+    {
+        total.latency.Merge(r.latency);
+        total.reads += r.reads;
+        total.retries += r.retries;
+        total.busy += r.busy;
+        total.torn += r.torn;
+        total.backwards += r.backwards;
+    }
+    printf("%u readers, writer at %s for %.2f s\n", o.readers, o.writeHz ? "a set rate" : "full speed", sec);
+    printf("writes      %llu (%.0f /s)  ns p50 %llu  p99 %llu  max %llu\n", (unsigned long long)written.writes,
+        written.writes / sec, (unsigned long long)written.latency.Percentile(50),
+        (unsigned long long)written.latency.Percentile(99), (unsigned long long)written.latency.Max());
+    printf("reads       %llu (%.1f M/s, %.1f M/s per reader)\n", (unsigned long long)total.reads, total.reads / sec / 1e6,
+        o.readers ? total.reads / sec / 1e6 / o.readers : 0.0);
+    const LatencyHistogram& h = total.latency;
+    printf("read ns     p50 %llu  p90 %llu  p99 %llu  p99.9 %llu  max %llu\n", (unsigned long long)h.Percentile(50),
+        (unsigned long long)h.Percentile(90), (unsigned long long)h.Percentile(99), (unsigned long long)h.Percentile(99.9),
+        (unsigned long long)h.Max());
+    printf("retries     %llu (%.4f per read), %llu gave up\n", (unsigned long long)total.retries,
+        total.reads ? (double)total.retries / total.reads : 0.0, (unsigned long long)total.busy);
+    printf("torn        %llu, generation backwards %llu\n", (unsigned long long)total.torn, (unsigned long long)total.backwards);
+    return total.torn || total.backwards ? 1 : 0;
+}
+
+// What a sampling agent does: map once, then read as often as it likes
+static int Watch(const Options& o)
+{
+    StatusReader reader;
+    if (!reader.Open())
+    {
+        fprintf(stderr, "no status block: is the tray running?\n");
+        return 2;
+    }
+    const Clock::time_point end = Clock::now() + std::chrono::microseconds((int64_t)(o.seconds * 1e6));
+    uint64_t reads = 0;
+    uint32_t shown = 0;
+    StatusSnapshot s;
+    while (Clock::now() < end)
+    {
+        ++reads;
+        const StatusReader::Result result = reader.Read(s);
+        if (result == StatusReader::READ_CLOSED)
+        {
+            printf("tray closed the block\n");
+            break;
+        }
+        if (result != StatusReader::READ_OK || s.generation == shown)
+            continue;
+        shown = s.generation;
+        printf("gen %u  %ls  afk %s (stage %d)  idle %u s  last switch %llu\n", s.generation, s.name,
+            s.afkApplied ? "applied" : "off", s.afkStage, s.idleSeconds, (unsigned long long)s.lastSwitchUnixMs);
+        fflush(stdout);
+    }
+    printf("%llu reads\n", (unsigned long long)reads);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    Options o;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* a = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(a, "--watch") == 0) o.watch = true;
+        else if (strcmp(a, "--readers") == 0 && hasValue) o.readers = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(a, "--seconds") == 0 && hasValue) o.seconds = atof(argv[++i]);
+        else if (strcmp(a, "--write-hz") == 0 && hasValue) o.writeHz = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else
+        {
+            Usage();
+            return 2;
+        }
+    }
+    if (o.seconds <= 0)
+    {
+        Usage();
+        return 2;
+    }
+    if (o.watch)
+        return Watch(o);
+    if (!o.readers)
+    {
+        const unsigned cores = std::thread::hardware_concurrency();
+        o.readers = cores > 1 ? cores - 1 : 1;
+    }
+    return Bench(o);
+}
@@ -0,0 +1,42 @@
+// ActivityVeto.cpp: Holds off AFK while the machine is busy without the user.
+
+#include "ActivityVeto.h"
+
+// A counter that went backwards (device removed, wrapped) counts as no activity
+static uint64_t Delta(uint64_t now, uint64_t then)
+{
+    return now >= then ? now - then : 0;
+}
+
+bool ActivityVeto::Enabled() const
+{
+    return m_config.cpuPercent > 0.0 || m_config.diskBytesPerSec || m_config.netBytesPerSec || m_config.powerRequests;
+}
+
+bool ActivityVeto::Sample(const ActivitySample& sample)
+{
+    const bool primed = m_primed && sample.timeMs > m_last.timeMs;
+    const ActivitySample last = m_last;
+    m_last = sample;
+    m_primed = true;
+    if (!primed)
+        return false;
+
+    const double seconds = (double)(sample.timeMs - last.timeMs) / 1000.0;
+    const uint64_t dTotal = Delta(sample.cpuTotal, last.cpuTotal);
+    const uint64_t dIdle = Delta(sample.cpuIdle, last.cpuIdle);
+    m_cpuPercent = dTotal == 0 || dIdle >= dTotal ? 0.0 : 100.0 * (double)(dTotal - dIdle) / (double)dTotal;
+    m_diskRate = (double)Delta(sample.diskBytes, last.diskBytes) / seconds;
+    m_netRate = (double)Delta(sample.netBytes, last.netBytes) / seconds;
+
+    m_reasons = 0;
+    if (m_config.cpuPercent > 0.0 && m_cpuPercent >= m_config.cpuPercent)
+        m_reasons |= VETO_CPU;
+    if (m_config.diskBytesPerSec && m_diskRate >= (double)m_config.diskBytesPerSec)
+        m_reasons |= VETO_DISK;
+    if (m_config.netBytesPerSec && m_netRate >= (double)m_config.netBytesPerSec)
+        m_reasons |= VETO_NETWORK;
+    if (m_config.powerRequests && sample.powerRequest)
+        m_reasons |= VETO_POWER_REQUEST;
+    return true;
+}
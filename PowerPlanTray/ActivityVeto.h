@@ -0,0 +1,67 @@
+// ActivityVeto.h: Holds off AFK while the machine is busy without the user.
+
+#pragma once
+
+#include <stdint.h>
+
+// Cumulative counters as read from the system; only deltas between two
+// samples are ever used, so the units just have to stay the same.
+struct ActivitySample
+{
+    uint64_t timeMs;
+    uint64_t cpuIdle;    // Any tick unit, idle part of cpuTotal
+    uint64_t cpuTotal;
+    uint64_t diskBytes;  // Read + written
+    uint64_t netBytes;   // Received + sent
+    bool powerRequest;   // Something asks to keep the system or display on
+};
+
+// Compares the rates between consecutive samples against thresholds. A zero
+// threshold turns that veto off. The caller samples only when an AFK stage is
+// near or due, so an active user costs nothing.
+class ActivityVeto
+{
+public:
+    enum Reason
+    {
+        VETO_CPU = 1,
+        VETO_DISK = 2,
+        VETO_NETWORK = 4,
+        VETO_POWER_REQUEST = 8
+    };
+    struct Config
+    {
+        double cpuPercent = 25.0;
+        uint64_t diskBytesPerSec = 2 * 1024 * 1024;
+        uint64_t netBytesPerSec = 256 * 1024;
+        bool powerRequests = true;
+    };
+
+    ActivityVeto() {}
+    explicit ActivityVeto(const Config& config) : m_config(config) {}
+
+    bool Enabled() const;
+    // Takes a sample. Returns true when there was a previous one to compare
+    // against, in which case Reasons() and the rates describe the interval.
+    bool Sample(const ActivitySample& sample);
+    // Forget the baseline, e.g. after user input
+    void Reset() { m_primed = false; m_reasons = 0; }
+
+    bool Primed() const { return m_primed; }
+    uint64_t LastSampleMs() const { return m_last.timeMs; }
+    uint32_t Reasons() const { return m_reasons; }
+    double CpuPercent() const { return m_cpuPercent; }
+    double DiskBytesPerSec() const { return m_diskRate; }
+    double NetBytesPerSec() const { return m_netRate; }
+    const Config& GetConfig() const { return m_config; }
+    void SetConfig(const Config& config) { m_config = config; }
+
+private:
+    Config m_config;
+    bool m_primed = false;
+    ActivitySample m_last{};
+    uint32_t m_reasons = 0;
+    double m_cpuPercent = 0.0;
+    double m_diskRate = 0.0;
+    double m_netRate = 0.0;
+};
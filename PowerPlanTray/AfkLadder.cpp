@@ -0,0 +1,46 @@
+// AfkLadder.cpp: Idle-time thresholds that step down to progressively deeper plans.
+
+#include "AfkLadder.h"
+
+bool AfkLadder::Set(uint32_t thresholdMs, const PlanId& plan)
+{
+    if (thresholdMs == 0)
+        return false;
+    size_t i = 0;
+    while (i < m_count && m_stages[i].thresholdMs < thresholdMs) ++i;
+    if (i < m_count && m_stages[i].thresholdMs == thresholdMs)
+    {
+        m_stages[i].plan = plan;
+        return true;
+    }
+    if (m_count >= kMaxStages)
+        return false;
+    for (size_t j = m_count; j > i; --j) m_stages[j] = m_stages[j - 1];
+    m_stages[i] = { thresholdMs, plan };
+    ++m_count;
+    return true;
+}
+
+void AfkLadder::Remove(size_t index)
+{
+    if (index >= m_count)
+        return;
+    for (size_t j = index + 1; j < m_count; ++j) m_stages[j - 1] = m_stages[j];
+    --m_count;
+}
+
+int AfkLadder::StageFor(uint64_t idleMs) const
+{
+    int stage = -1;
+    for (size_t i = 0; i < m_count && idleMs >= m_stages[i].thresholdMs; ++i)
+        stage = (int)i;
+    return stage;
+}
+
+uint64_t AfkLadder::UntilNextStageMs(uint64_t idleMs) const
+{
+    const size_t next = (size_t)(StageFor(idleMs) + 1);
+    if (next >= m_count)
+        return kNever;
+    return m_stages[next].thresholdMs - idleMs;
+}
@@ -0,0 +1,44 @@
+// AfkLadder.h: Idle-time thresholds that step down to progressively deeper plans.
+
+#pragma once
+
+#include "PlanId.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct AfkStage
+{
+    uint32_t thresholdMs; // Idle time at which this stage takes over
+    PlanId plan;
+};
+
+// Stages are kept sorted by threshold, each threshold at most once. The stage
+// in force is the deepest one whose threshold the idle time has reached; the
+// caller restores the user's plan when that drops back to none.
+class AfkLadder
+{
+public:
+    static const size_t kMaxStages = 4;
+    static const uint64_t kNever = UINT64_MAX;
+
+    AfkLadder() { Clear(); }
+
+    void Clear() { m_count = 0; }
+    // Adds a stage, or re-targets the one with the same threshold. False when
+    // full or for a zero threshold.
+    bool Set(uint32_t thresholdMs, const PlanId& plan);
+    void Remove(size_t index);
+
+    size_t Count() const { return m_count; }
+    const AfkStage& At(size_t i) const { return m_stages[i]; }
+
+    // Index of the stage in force after idleMs without input, -1 for none
+    int StageFor(uint64_t idleMs) const;
+    // Idle time still to go before the next deeper stage, or kNever past the last
+    uint64_t UntilNextStageMs(uint64_t idleMs) const;
+
+private:
+    AfkStage m_stages[kMaxStages];
+    size_t m_count;
+};
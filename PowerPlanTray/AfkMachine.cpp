@@ -0,0 +1,92 @@
+// AfkMachine.cpp: AFK stage decisions as a pure state machine over injected readings.
+
+#include "AfkMachine.h"
+
+void AfkMachine::Returned(uint64_t nowMs, Output& out)
+{
+    out.returned = true;
+    if (m_preRestored)
+    {
+        ++m_counters.predictHits;
+        m_counters.earlyMs += nowMs - m_earlyStartMs;
+    }
+    m_preRestored = false;
+    m_predictSpent = false;
+}
+
+AfkMachine::Output AfkMachine::Step(const Input& in)
+{
+    Output out;
+    if (in.idleMs < m_lastIdleMs)
+        m_vetoHeld = false; // Input: whatever held the stage off is moot now
+    m_lastIdleMs = in.idleMs;
+
+    int stage = m_ladder.StageFor(in.idleMs);
+    bool reapply = false;
+    if (m_preRestored && stage >= 0)
+    {
+        // Restored for a predicted return that has not come (yet)
+        if (in.nowMs < m_earlyEndMs)
+            return out;
+        ++m_counters.predictMisses;
+        m_counters.earlyMs += in.nowMs - m_earlyStartMs;
+        m_preRestored = false;
+        m_predictSpent = true;
+        reapply = true;
+    }
+    if (stage > m_stage)
+    {
+        if (in.vetoHolds && !m_vetoHeld) ++m_counters.vetoHolds;
+        m_vetoHeld = in.vetoHolds;
+        if (in.vetoHolds) stage = m_stage;
+    }
+
+    if (stage != m_stage || (reapply && stage >= 0))
+    {
+        if (stage < 0)
+        {
+            Returned(in.nowMs, out);
+            out.action = ACTION_RESTORE;
+        }
+        else
+        {
+            out.action = ACTION_APPLY;
+            out.fresh = !reapply;
+        }
+        m_stage = stage;
+    }
+    else if (stage >= 0 && !m_predictSpent && in.predictDelayMs == 0)
+    {
+        // Likely back within the margin: have the user's plan ready for them
+        m_preRestored = true;
+        m_earlyStartMs = in.nowMs;
+        m_earlyEndMs = in.nowMs + in.predictWindowMs;
+        out.action = ACTION_RESTORE;
+        out.early = true;
+    }
+    return out;
+}
+
+AfkMachine::Output AfkMachine::UserReturned(uint64_t nowMs)
+{
+    Output out;
+    m_vetoHeld = false;
+    m_lastIdleMs = 0;
+    if (m_stage >= 0)
+    {
+        Returned(nowMs, out);
+        out.action = ACTION_RESTORE;
+        m_stage = -1;
+    }
+    return out;
+}
+
+uint64_t AfkMachine::NextStepMs(const Input& in) const
+{
+    if (m_preRestored)
+        return m_earlyEndMs > in.nowMs ? m_earlyEndMs - in.nowMs : 0;
+    uint64_t delay = m_ladder.UntilNextStageMs(in.idleMs);
+    if (m_stage >= 0 && !m_predictSpent && in.predictDelayMs < delay)
+        delay = in.predictDelayMs;
+    return delay;
+}
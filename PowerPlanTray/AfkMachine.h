@@ -0,0 +1,93 @@
+// AfkMachine.h: AFK stage decisions as a pure state machine over injected readings.
+
+#pragma once
+
+#include "AfkLadder.h"
+
+#include <stdint.h>
+
+// Idle time from the 32-bit last-input tick (LASTINPUTINFO::dwTime) and the
+// current tick cut to 32 bits. The unsigned difference wraps exactly as the
+// counter does, so it stays right across the 49.7-day rollover for any idle
+// time shorter than that; widening only one side of it does not. Input
+// stamped after the tick was read comes out as a difference of 2^31 or more
+// (not 49 days idle) and counts as none.
+inline uint32_t IdleMsFromTicks(uint32_t nowTick, uint32_t lastInputTick)
+{
+    const uint32_t idle = nowTick - lastInputTick;
+    return idle >= 0x80000000u ? 0 : idle;
+}
+
+// Which AFK stage should be in force, when the user is back, and when to look
+// again. The machine never reads a clock or calls the system: the host passes
+// in the time and the idle reading, answers the veto question when
+// WantsDeeper() says a stage is due, and carries out the returned action.
+// The same sequence of inputs always gives the same decisions.
+class AfkMachine
+{
+public:
+    static const uint64_t kNever = AfkLadder::kNever;
+
+    enum Action
+    {
+        ACTION_NONE,
+        ACTION_APPLY,   // Put Stage()'s plan in force
+        ACTION_RESTORE, // Withdraw the AFK plan: the user is (about to be) back
+    };
+
+    struct Input
+    {
+        uint64_t nowMs = 0;             // Monotonic clock
+        uint64_t idleMs = 0;            // Time since the last input
+        bool vetoHolds = false;         // Activity holds off the stage that is due
+        uint64_t predictDelayMs = kNever; // Until a return is likely enough to restore for
+        uint64_t predictWindowMs = 0;   // How long a restore ahead of time waits for the user
+    };
+
+    struct Output
+    {
+        Action action = ACTION_NONE;
+        bool fresh = false;    // APPLY for a newly crossed threshold (not taken back after a miss)
+        bool returned = false; // The user came back from an applied stage
+        bool early = false;    // RESTORE ahead of a predicted return
+    };
+
+    struct Counters
+    {
+        uint32_t vetoHolds = 0;     // Due stages held off by activity
+        uint32_t predictHits = 0;   // Restored early and the user did come back
+        uint32_t predictMisses = 0; // Restored early and had to take it back
+        uint64_t earlyMs = 0;       // Time spent restored early: the energy cost
+    };
+
+    explicit AfkMachine(const AfkLadder& ladder) : m_ladder(ladder) {}
+
+    // True when input arrived since the last step: idle time went down
+    bool InputSince(uint64_t idleMs) const { return idleMs < m_lastIdleMs; }
+    // True when a deeper stage than the current one is due, i.e. vetoHolds matters
+    bool WantsDeeper(uint64_t idleMs) const { return !m_preRestored && m_ladder.StageFor(idleMs) > m_stage; }
+
+    Output Step(const Input& in);
+    // The user is back, seen directly rather than through the idle time
+    Output UserReturned(uint64_t nowMs);
+    // Time until the machine next needs a Step, from the same kind of input
+    uint64_t NextStepMs(const Input& in) const;
+
+    int Stage() const { return m_stage; }
+    bool VetoHeld() const { return m_vetoHeld; }
+    bool PreRestored() const { return m_preRestored; }
+    const Counters& GetCounters() const { return m_counters; }
+
+private:
+    void Returned(uint64_t nowMs, Output& out);
+
+    const AfkLadder& m_ladder;
+    Counters m_counters;
+    int m_stage = -1;           // Stage in force, -1 while the user is present
+    uint64_t m_lastIdleMs = 0;
+    bool m_vetoHeld = false;
+    bool m_preRestored = false;
+    bool m_predictSpent = false; // One early restore per absence; a miss ends it
+    uint64_t m_earlyStartMs = 0;
+    uint64_t m_earlyEndMs = 0;
+};
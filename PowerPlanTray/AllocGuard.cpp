@@ -0,0 +1,70 @@
+// AllocGuard.cpp: Debug-build heap allocation checks for steady-state paths.
+
+#include "framework.h"
+#include "AllocGuard.h"
+
+#ifdef _DEBUG
+
+#include <crtdbg.h>
+#include <atomic>
+#include <new>
+
+static std::atomic<size_t> g_allocCount{ 0 };
+
+size_t AllocCount()
+{
+    return g_allocCount.load(std::memory_order_relaxed);
+}
+
+NoAllocScope::NoAllocScope(bool enabled, const char* what)
+    : m_start(AllocCount()), m_enabled(enabled), m_what(what)
+{
+}
+
+NoAllocScope::~NoAllocScope()
+{
+    if (!m_enabled)
+        return;
+    const size_t allocs = AllocCount() - m_start;
+    if (allocs != 0)
+    {
+        char msg[128];
+        sprintf_s(msg, "PowerPlanTray: %zu heap allocation(s) on steady-state path: %s\n", allocs, m_what);
+        OutputDebugStringA(msg);
+        _ASSERTE(allocs == 0 && "steady-state path allocated");
+    }
+}
+
+// Counting replacements for the global allocation functions
+void* operator new(size_t size)
+{
+    g_allocCount.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    if (void* p = malloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    g_allocCount.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+#endif
@@ -0,0 +1,38 @@
+// AllocGuard.h: Debug-build heap allocation checks for steady-state paths.
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef _DEBUG
+
+// Number of operator new calls made by the process so far
+size_t AllocCount();
+
+// Asserts that no operator new happens while the scope is alive. The tooltip,
+// poll, AFK and power-broadcast paths run for weeks; a regression that makes
+// them allocate trips this in every debug run.
+class NoAllocScope
+{
+public:
+    NoAllocScope(bool enabled, const char* what);
+    ~NoAllocScope();
+
+private:
+    NoAllocScope(const NoAllocScope&) = delete;
+    NoAllocScope& operator=(const NoAllocScope&) = delete;
+
+    size_t m_start;
+    bool m_enabled;
+    const char* m_what;
+};
+
+#else
+
+class NoAllocScope
+{
+public:
+    NoAllocScope(bool, const char*) {}
+};
+
+#endif
@@ -0,0 +1,96 @@
+// AppRules.cpp: Foreground-application plan rules keyed on the process image name.
+
+#include "AppRules.h"
+
+#include <wchar.h>
+#include <wctype.h>
+
+void AppRuleTable::Clear()
+{
+    m_count = 0;
+    for (auto& s : m_slots) s = -1;
+}
+
+const wchar_t* AppRuleTable::BaseName(const wchar_t* path, size_t& len)
+{
+    const wchar_t* base = path;
+    for (const wchar_t* p = path; *p; ++p)
+    {
+        if (*p == L'\\' || *p == L'/') base = p + 1;
+    }
+    len = wcslen(base);
+    return base;
+}
+
+wchar_t AppRuleTable::Fold(wchar_t c)
+{
+    if (c >= L'A' && c <= L'Z') return (wchar_t)(c + (L'a' - L'A'));
+    if (c < 0x80) return c;
+    return (wchar_t)towlower(c);
+}
+
+uint32_t AppRuleTable::Hash(const wchar_t* s, size_t len)
+{
+    // FNV-1a over the case-folded characters
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= (uint32_t)Fold(s[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int AppRuleTable::Find(const wchar_t* name, size_t len, uint32_t hash) const
+{
+    for (size_t probe = 0; probe < kSlots; ++probe)
+    {
+        const int16_t idx = m_slots[(hash + probe) & (kSlots - 1)];
+        if (idx < 0)
+            return -1;
+        const wchar_t* image = m_rules[idx].image;
+        size_t i = 0;
+        while (i < len && image[i] && image[i] == Fold(name[i])) ++i;
+        if (i == len && image[i] == L'\0')
+            return idx;
+    }
+    return -1;
+}
+
+bool AppRuleTable::Add(const wchar_t* image, const PlanId& plan)
+{
+    size_t len = 0;
+    const wchar_t* name = BaseName(image, len);
+    if (len == 0 || len >= sizeof(AppRule::image) / sizeof(wchar_t))
+        return false;
+
+    const uint32_t hash = Hash(name, len);
+    const int existing = Find(name, len, hash);
+    if (existing >= 0)
+    {
+        m_rules[existing].plan = plan;
+        return true;
+    }
+    if (m_count >= kMaxRules)
+        return false;
+
+    AppRule& rule = m_rules[m_count];
+    for (size_t i = 0; i < len; ++i) rule.image[i] = Fold(name[i]);
+    rule.image[len] = L'\0';
+    rule.plan = plan;
+
+    size_t slot = hash & (kSlots - 1);
+    while (m_slots[slot] >= 0) slot = (slot + 1) & (kSlots - 1);
+    m_slots[slot] = (int16_t)m_count++;
+    return true;
+}
+
+const AppRule* AppRuleTable::Match(const wchar_t* imagePath) const
+{
+    if (!imagePath || m_count == 0)
+        return nullptr;
+    size_t len = 0;
+    const wchar_t* name = BaseName(imagePath, len);
+    const int idx = Find(name, len, Hash(name, len));
+    return idx >= 0 ? &m_rules[idx] : nullptr;
+}
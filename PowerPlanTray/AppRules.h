@@ -0,0 +1,45 @@
+// AppRules.h: Foreground-application plan rules keyed on the process image name.
+
+#pragma once
+
+#include "PlanId.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct AppRule
+{
+    wchar_t image[64]; // Lowercase file name, e.g. L"devenv.exe"
+    PlanId plan;
+};
+
+// Fixed-capacity open-addressing table built once from the configured rules.
+// Match() hashes and compares the image name case-insensitively in place, so a
+// foreground change costs O(1) and never allocates.
+class AppRuleTable
+{
+public:
+    static const size_t kMaxRules = 64;
+    static const size_t kSlots = 128; // Power of two, load factor <= 0.5
+
+    AppRuleTable() { Clear(); }
+
+    void Clear();
+    // image may be a bare file name or a full path; returns false when full
+    bool Add(const wchar_t* image, const PlanId& plan);
+    // Accepts a full path (either separator) or a bare file name
+    const AppRule* Match(const wchar_t* imagePath) const;
+
+    size_t Count() const { return m_count; }
+    const AppRule& At(size_t i) const { return m_rules[i]; }
+
+private:
+    static const wchar_t* BaseName(const wchar_t* path, size_t& len);
+    static wchar_t Fold(wchar_t c);
+    static uint32_t Hash(const wchar_t* s, size_t len);
+    int Find(const wchar_t* name, size_t len, uint32_t hash) const;
+
+    AppRule m_rules[kMaxRules];
+    size_t m_count;
+    int16_t m_slots[kSlots]; // -1 = empty, else index into m_rules
+};
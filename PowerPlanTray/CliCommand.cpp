@@ -0,0 +1,159 @@
+// CliCommand.cpp: Command-line verbs and the request a second launch forwards to the running tray.
+
+#include "CliCommand.h"
+
+#include <stdio.h>
+#include <wchar.h>
+
+static const wchar_t* const kVerbNames[CLI_VERB_COUNT] = {
+    nullptr, L"--help", L"--set", L"--get", L"--list", L"--afk", L"--toggle"
+};
+
+static bool IsHelp(const wchar_t* arg)
+{
+    return wcscmp(arg, L"--help") == 0 || wcscmp(arg, L"-?") == 0 || wcscmp(arg, L"/?") == 0;
+}
+
+// Joins argv[first..] with single spaces; false if it does not fit
+static bool JoinArgs(int argc, const wchar_t* const* argv, int first, wchar_t* out, size_t cch)
+{
+    size_t n = 0;
+    out[0] = L'\0';
+    for (int i = first; i < argc; ++i)
+    {
+        const size_t len = wcslen(argv[i]);
+        if (n + (n ? 1 : 0) + len + 1 > cch) // Separator, word and terminator
+            return false;
+        if (n) out[n++] = L' ';
+        wmemcpy(out + n, argv[i], len);
+        n += len;
+        out[n] = L'\0';
+    }
+    return true;
+}
+
+bool CliParse(int argc, const wchar_t* const* argv, CliRequest& out)
+{
+    out = CliRequest{};
+    out.version = kCliVersion;
+    out.verb = CLI_NONE;
+    if (argc < 2)
+        return true;
+
+    const wchar_t* verb = argv[1];
+    if (IsHelp(verb))
+    {
+        out.verb = CLI_HELP;
+        return argc == 2;
+    }
+    size_t v = CLI_SET;
+    while (v < CLI_VERB_COUNT && wcscmp(verb, kVerbNames[v]) != 0)
+        ++v;
+    if (v == CLI_VERB_COUNT)
+        return false;
+    out.verb = (uint32_t)v;
+
+    switch (v)
+    {
+    case CLI_SET:
+        return argc > 2 && JoinArgs(argc, argv, 2, out.plan, kCliArgMax);
+    case CLI_AFK:
+    {
+        if (argc < 3)
+            return false;
+        wchar_t* end = nullptr;
+        const unsigned long minutes = wcstoul(argv[2], &end, 10);
+        if (!*argv[2] || *end || minutes > kCliMaxAfkMinutes)
+            return false;
+        out.minutes = (uint32_t)minutes;
+        return JoinArgs(argc, argv, 3, out.plan, kCliArgMax);
+    }
+    default:
+        return argc == 2;
+    }
+}
+
+bool CliDecode(uint32_t tag, const void* data, size_t bytes, CliRequest& out)
+{
+    if (tag != kCliRequestTag || !data || bytes != sizeof(CliRequest))
+        return false;
+    memcpy(&out, data, sizeof(out));
+    if (out.version != kCliVersion || out.verb <= CLI_HELP || out.verb >= CLI_VERB_COUNT)
+        return false;
+    if (wmemchr(out.plan, L'\0', kCliArgMax) == nullptr)
+        return false;
+    return out.verb != CLI_AFK || out.minutes <= kCliMaxAfkMinutes;
+}
+
+const wchar_t* CliUsage()
+{
+    return L"Usage: PowerPlanTray [verb]\n"
+        L"  (none)                    start the tray\n"
+        L"  --set <name|guid>         switch to a plan\n"
+        L"  --get                     print the active plan\n"
+        L"  --list                    print every plan, the active one marked *\n"
+        L"  --afk <minutes> [plan]    one AFK stage after that long idle; 0 turns AFK off\n"
+        L"  --toggle                  switch back to the plan before the current one\n"
+        L"With the tray running, a verb is handled by it; otherwise it runs on its own.\n";
+}
+
+// ===== GUID text =====
+static int HexDigit(wchar_t c)
+{
+    if (c >= L'0' && c <= L'9') return c - L'0';
+    if (c >= L'a' && c <= L'f') return c - L'a' + 10;
+    if (c >= L'A' && c <= L'F') return c - L'A' + 10;
+    return -1;
+}
+
+// Reads 2 * count hex digits as a big-endian number
+static bool ReadHex(const wchar_t*& p, size_t count, uint64_t& value)
+{
+    value = 0;
+    for (size_t i = 0; i < count * 2; ++i, ++p)
+    {
+        const int d = HexDigit(*p);
+        if (d < 0)
+            return false;
+        value = (value << 4) | (uint64_t)d;
+    }
+    return true;
+}
+
+bool ParsePlanId(const wchar_t* text, PlanId& out)
+{
+    const wchar_t* p = text;
+    const bool braced = *p == L'{';
+    if (braced) ++p;
+
+    // Data1, Data2 and Data3 are stored little-endian; the last 8 bytes as written
+    static const size_t kGroups[5] = { 4, 2, 2, 2, 6 };
+    PlanId id;
+    size_t at = 0;
+    for (size_t g = 0; g < 5; ++g)
+    {
+        if (g && *p++ != L'-')
+            return false;
+        uint64_t value;
+        if (!ReadHex(p, kGroups[g], value))
+            return false;
+        for (size_t i = 0; i < kGroups[g]; ++i)
+        {
+            const size_t shift = g < 3 ? i : kGroups[g] - 1 - i;
+            id.bytes[at++] = (uint8_t)(value >> (8 * shift));
+        }
+    }
+    if (braced && *p++ != L'}')
+        return false;
+    if (*p)
+        return false;
+    out = id;
+    return true;
+}
+
+void FormatPlanId(const PlanId& id, wchar_t* out, size_t cch)
+{
+    const uint8_t* b = id.bytes;
+    swprintf(out, cch, L"{%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x}",
+        b[3], b[2], b[1], b[0], b[5], b[4], b[7], b[6], b[8], b[9], b[10], b[11], b[12], b[13], b[14], b[15]);
+}
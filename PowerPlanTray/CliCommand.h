@@ -0,0 +1,63 @@
+// CliCommand.h: Command-line verbs and the request a second launch forwards to the running tray.
+
+#pragma once
+
+#include "PlanId.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum CliVerb
+{
+    CLI_NONE,   // No verb: start the tray
+    CLI_HELP,
+    CLI_SET,    // --set <name|guid>
+    CLI_GET,    // --get
+    CLI_LIST,   // --list
+    CLI_AFK,    // --afk <minutes> [name|guid], 0 turns AFK off
+    CLI_TOGGLE, // --toggle: back to the plan before the current one
+    CLI_VERB_COUNT
+};
+
+// Doubles as the process exit code
+enum CliStatus
+{
+    CLI_OK = 0,
+    CLI_FAILED = 1, // No such plan, nothing to toggle back to, ...
+    CLI_USAGE = 2
+};
+
+// WM_COPYDATA tags, and the bit the tray sets in its result once it has
+// answered, so an older tray that ignores the message is told apart
+const uint32_t kCliRequestTag = 0x4C435050; // "PPCL"
+const uint32_t kCliReplyTag = 0x52435050;   // "PPCR"
+const uint32_t kCliHandled = 0x100;
+const uint32_t kCliVersion = 1;
+const uint32_t kCliTimeoutMs = 2000;
+const uint32_t kCliMaxAfkMinutes = 24 * 60;
+
+// Room for a plan name or a braced GUID
+const size_t kCliArgMax = 160;
+// Room for --list: one line per plan, name and GUID
+const size_t kCliReplyMax = 64 * (kCliArgMax + 48);
+
+// Sent as is, so it is plain data of a fixed size
+struct CliRequest
+{
+    uint32_t version;
+    uint32_t verb;    // CliVerb
+    uint32_t minutes; // CLI_AFK
+    wchar_t plan[kCliArgMax]; // CLI_SET, CLI_AFK; empty if not given
+};
+
+// argv as from CommandLineToArgvW, program name first. Words after --set and
+// the AFK minutes are joined, so a plan name need not be quoted.
+bool CliParse(int argc, const wchar_t* const* argv, CliRequest& out);
+// Checks a request received from another process before it is acted on
+bool CliDecode(uint32_t tag, const void* data, size_t bytes, CliRequest& out);
+const wchar_t* CliUsage();
+
+// "{xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx}", braces optional on input. PlanId
+// bytes are in GUID memory order, which is little-endian on every Windows target.
+bool ParsePlanId(const wchar_t* text, PlanId& out);
+void FormatPlanId(const PlanId& id, wchar_t* out, size_t cch);
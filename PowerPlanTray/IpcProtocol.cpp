@@ -0,0 +1,242 @@
+// IpcProtocol.cpp: Frames of the local IPC protocol, shared by the tray's server and its clients.
+
+#include "IpcProtocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// ===== Writer =====
+uint8_t* IpcWriter::Reserve(size_t bytes)
+{
+    if (!m_ok || m_cap - m_len < bytes)
+    {
+        m_ok = false;
+        return nullptr;
+    }
+    uint8_t* p = m_buf + m_len;
+    m_len += bytes;
+    return p;
+}
+
+size_t IpcWriter::Begin(uint8_t op, uint8_t status, uint16_t tag)
+{
+    const size_t start = m_len;
+    U32(0);
+    U8(op);
+    U8(status);
+    U16(tag);
+    return start;
+}
+
+void IpcWriter::End(size_t start)
+{
+    if (!m_ok)
+        return;
+    const uint32_t size = (uint32_t)(m_len - start);
+    for (int i = 0; i < 4; ++i)
+        m_buf[start + i] = (uint8_t)(size >> (8 * i));
+}
+
+void IpcWriter::U8(uint8_t v)
+{
+    if (uint8_t* p = Reserve(1)) p[0] = v;
+}
+
+void IpcWriter::U16(uint16_t v)
+{
+    if (uint8_t* p = Reserve(2)) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+}
+
+void IpcWriter::U32(uint32_t v)
+{
+    if (uint8_t* p = Reserve(4))
+        for (int i = 0; i < 4; ++i) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+void IpcWriter::U64(uint64_t v)
+{
+    if (uint8_t* p = Reserve(8))
+        for (int i = 0; i < 8; ++i) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+void IpcWriter::Id(const PlanId& id)
+{
+    if (uint8_t* p = Reserve(sizeof(id.bytes))) memcpy(p, id.bytes, sizeof(id.bytes));
+}
+
+// wchar_t is UTF-16 on Windows and UTF-32 elsewhere; both go out as UTF-16
+void IpcWriter::Name(const wchar_t* text)
+{
+    const size_t countAt = m_len;
+    U16(0);
+    uint16_t units = 0;
+    for (const wchar_t* c = text; *c; ++c)
+    {
+        const uint32_t cp = (uint32_t)*c;
+        if (cp > 0xFFFF && cp <= 0x10FFFF)
+        {
+            U16((uint16_t)(0xD800 + ((cp - 0x10000) >> 10)));
+            U16((uint16_t)(0xDC00 + ((cp - 0x10000) & 0x3FF)));
+            units += 2;
+        }
+        else
+        {
+            U16((uint16_t)cp);
+            ++units;
+        }
+    }
+    PatchU16(countAt, units);
+}
+
+void IpcWriter::State(const IpcState& state)
+{
+    Id(state.active);
+    U32(state.generation);
+    U8((uint8_t)state.afkStage);
+    U8(state.flags);
+    U16(0);
+    U64(state.lastSwitchUnixMs);
+    Name(state.name);
+}
+
+void IpcWriter::PatchU16(size_t at, uint16_t v)
+{
+    if (!m_ok)
+        return;
+    m_buf[at] = (uint8_t)v;
+    m_buf[at + 1] = (uint8_t)(v >> 8);
+}
+
+void IpcWriter::Truncate(size_t length)
+{
+    if (length <= m_len)
+        m_len = length;
+    m_ok = true;
+}
+
+// ===== Reader =====
+const uint8_t* IpcReader::Take(size_t n)
+{
+    if (!m_ok || m_left < n)
+    {
+        m_ok = false;
+        return nullptr;
+    }
+    const uint8_t* p = m_p;
+    m_p += n;
+    m_left -= n;
+    return p;
+}
+
+uint8_t IpcReader::U8()
+{
+    const uint8_t* p = Take(1);
+    return p ? p[0] : 0;
+}
+
+uint16_t IpcReader::U16()
+{
+    const uint8_t* p = Take(2);
+    return p ? (uint16_t)(p[0] | (p[1] << 8)) : 0;
+}
+
+uint32_t IpcReader::U32()
+{
+    const uint8_t* p = Take(4);
+    uint32_t v = 0;
+    if (p)
+        for (int i = 3; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+}
+
+uint64_t IpcReader::U64()
+{
+    const uint8_t* p = Take(8);
+    uint64_t v = 0;
+    if (p)
+        for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+}
+
+PlanId IpcReader::Id()
+{
+    PlanId id{};
+    if (const uint8_t* p = Take(sizeof(id.bytes)))
+        memcpy(id.bytes, p, sizeof(id.bytes));
+    return id;
+}
+
+void IpcReader::Name(wchar_t* out, size_t cch)
+{
+    const uint16_t units = U16();
+    size_t n = 0;
+    for (uint16_t i = 0; i < units && m_ok; ++i)
+    {
+        uint32_t cp = U16();
+        // Pairs become one wchar_t where it is 32 bits wide
+        if (sizeof(wchar_t) == 4 && cp >= 0xD800 && cp < 0xDC00 && i + 1 < units)
+        {
+            const uint16_t low = U16();
+            ++i;
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        }
+        if (n + 1 < cch)
+            out[n++] = (wchar_t)cp;
+    }
+    if (cch)
+        out[n] = L'\0';
+}
+
+void IpcReader::State(IpcState& out)
+{
+    out.active = Id();
+    out.generation = U32();
+    out.afkStage = (int8_t)U8();
+    out.flags = U8();
+    U16();
+    out.lastSwitchUnixMs = U64();
+    Name(out.name, kIpcNameMax);
+}
+
+const uint8_t* IpcReader::Skip(size_t n)
+{
+    return Take(n);
+}
+
+IpcFrameCheck IpcCheckFrame(const uint8_t* data, size_t bytes, uint32_t maxSize, IpcHeader& out)
+{
+    if (bytes < kIpcHeaderBytes)
+        return IPC_FRAME_PARTIAL;
+    IpcReader r(data, kIpcHeaderBytes);
+    out.size = r.U32();
+    out.op = r.U8();
+    out.status = r.U8();
+    out.tag = r.U16();
+    if (out.size < kIpcHeaderBytes || out.size > maxSize)
+        return IPC_FRAME_BAD;
+    return bytes < out.size ? IPC_FRAME_PARTIAL : IPC_FRAME_READY;
+}
+
+bool IpcEndpoint(char* out, size_t bytes)
+{
+#ifdef _WIN32
+    // One pipe per logon session, so fast user switching gives each user theirs
+    DWORD session = 0;
+    if (!ProcessIdToSessionId(GetCurrentProcessId(), &session))
+        return false;
+    const int n = snprintf(out, bytes, "\\\\.\\pipe\\PowerPlanTray.%lu", (unsigned long)session);
+#else
+    const char* runtime = getenv("XDG_RUNTIME_DIR");
+    const int n = runtime && *runtime
+        ? snprintf(out, bytes, "%s/PowerPlanTray.sock", runtime)
+        : snprintf(out, bytes, "/tmp/PowerPlanTray-%u.sock", (unsigned)getuid());
+#endif
+    return n > 0 && (size_t)n < bytes;
+}
@@ -0,0 +1,176 @@
+// IpcProtocol.h: Frames of the local IPC protocol, shared by the tray's server and its clients.
+
+#pragma once
+
+#include "PlanId.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Every frame is an 8-byte header and a payload, integers little-endian:
+//   uint32 size    of the whole frame, header included
+//   uint8  op      IpcOp
+//   uint8  status  IpcStatus in replies, 0 in requests
+//   uint16 tag     chosen by the client and echoed in the reply, 0 in events
+// A string is a uint16 count of UTF-16 code units, then the units.
+//
+// Requests and their reply payloads:
+//   GET        -                    state
+//   SET        plan id              -      (queued for the tray, see IpcServer)
+//   LIST       -                    uint16 count, then count x (plan id, name)
+//   BATCH      uint16 count, then   uint16 count, then count reply frames,
+//              count request frames all answered from the same snapshot;
+//              GET, SET and LIST only
+//   SUBSCRIBE  -                    state; IPC_EVENT frames follow
+//   UNSUBSCRIBE -                   -
+// An IPC_EVENT payload is a uint8 IpcChange mask, then the state as it is now.
+// Events coalesce: a slow reader gets the latest state, not every step to it.
+// The state is the plan id, uint32 generation, int8 AFK stage (-1 = none),
+// uint8 IpcStateFlags, uint16 reserved, uint64 Unix ms of the last switch
+// (0 if none seen) and the plan name.
+
+const uint32_t kIpcHeaderBytes = 8;
+// The largest frame either side sends; LIST of kIpcMaxPlans long names fits
+const uint32_t kIpcMaxFrame = 20480;
+// The largest request, a full batch included
+const uint32_t kIpcMaxRequest = 4096;
+const uint16_t kIpcMaxBatch = 64;
+const size_t kIpcMaxPlans = 64;   // As kMaxPlans
+const size_t kIpcNameMax = 128;   // UTF-16 units with the terminator, as kPlanNameMax
+
+enum IpcOp : uint8_t
+{
+    IPC_GET = 1,
+    IPC_SET = 2,
+    IPC_LIST = 3,
+    IPC_BATCH = 4,
+    IPC_SUBSCRIBE = 5,
+    IPC_UNSUBSCRIBE = 6,
+    IPC_EVENT = 0x80,
+};
+
+enum IpcStatus : uint8_t
+{
+    IPC_OK = 0,
+    IPC_NO_PLAN = 1,     // SET of a plan the tray does not list
+    IPC_BAD_REQUEST = 2, // Malformed payload, or a batch inside a batch
+    IPC_BAD_OP = 3,
+    IPC_BUSY = 4,        // Too many switches waiting for the tray
+    IPC_NOT_READY = 5,   // The tray has not read the plans yet
+    IPC_TOO_LARGE = 6,   // The reply would pass kIpcMaxFrame: split the batch
+};
+
+enum IpcChange : uint8_t
+{
+    IPC_CHANGED_PLAN = 1,  // Active plan (or its name)
+    IPC_CHANGED_AFK = 2,   // AFK stage or flags
+    IPC_CHANGED_PLANS = 4, // The plan list: LIST again for it
+};
+
+enum IpcStateFlags : uint8_t
+{
+    IPC_AFK_APPLIED = 1,  // An AFK stage's plan is in force
+    IPC_AFK_ENABLED = 2,  // There is at least one stage
+};
+
+struct IpcHeader
+{
+    uint32_t size;
+    uint8_t op;
+    uint8_t status;
+    uint16_t tag;
+};
+
+struct IpcState
+{
+    PlanId active{};
+    uint32_t generation = 0; // Bumped by every published change
+    int8_t afkStage = -1;
+    uint8_t flags = 0;       // IpcStateFlags
+    uint64_t lastSwitchUnixMs = 0;
+    wchar_t name[kIpcNameMax] = {};
+};
+
+struct IpcPlan
+{
+    PlanId id;
+    wchar_t name[kIpcNameMax];
+};
+
+// Encodes into a caller's buffer; once something does not fit, every later
+// call is a no-op and Ok() is false, so callers check once at the end
+class IpcWriter
+{
+public:
+    IpcWriter(uint8_t* buffer, size_t capacity) : m_buf(buffer), m_cap(capacity) {}
+
+    // Starts a frame; End patches its size in
+    size_t Begin(uint8_t op, uint8_t status, uint16_t tag);
+    void End(size_t start);
+
+    void U8(uint8_t v);
+    void U16(uint16_t v);
+    void U32(uint32_t v);
+    void U64(uint64_t v);
+    void Id(const PlanId& id);
+    void Name(const wchar_t* text);
+    void State(const IpcState& state);
+    // Patches a uint16 written earlier, for counts known only at the end
+    void PatchU16(size_t at, uint16_t v);
+    // Drops everything from length on, and any overflow with it, even one
+    // from before length: check Ok() first where that can happen
+    void Truncate(size_t length);
+
+    bool Ok() const { return m_ok; }
+    size_t Length() const { return m_len; }
+
+private:
+    uint8_t* Reserve(size_t bytes);
+
+    uint8_t* m_buf;
+    size_t m_cap;
+    size_t m_len = 0;
+    bool m_ok = true;
+};
+
+class IpcReader
+{
+public:
+    IpcReader(const uint8_t* data, size_t bytes) : m_p(data), m_left(bytes) {}
+
+    uint8_t U8();
+    uint16_t U16();
+    uint32_t U32();
+    uint64_t U64();
+    PlanId Id();
+    // Truncates to cch - 1 units; always terminates
+    void Name(wchar_t* out, size_t cch);
+    void State(IpcState& out);
+    // Points at the next n bytes and skips them
+    const uint8_t* Skip(size_t n);
+
+    bool Ok() const { return m_ok; }
+    size_t Left() const { return m_left; }
+    const uint8_t* Position() const { return m_p; }
+
+private:
+    const uint8_t* Take(size_t n);
+
+    const uint8_t* m_p;
+    size_t m_left;
+    bool m_ok = true;
+};
+
+enum IpcFrameCheck
+{
+    IPC_FRAME_PARTIAL, // Read more
+    IPC_FRAME_READY,
+    IPC_FRAME_BAD,     // Size out of range: drop the connection
+};
+
+// Looks at the front of a receive buffer for a whole frame of at most maxSize
+IpcFrameCheck IpcCheckFrame(const uint8_t* data, size_t bytes, uint32_t maxSize, IpcHeader& out);
+
+// Where the tray listens: "\\.\pipe\PowerPlanTray.<session>" on Windows, a
+// Unix socket in $XDG_RUNTIME_DIR (else /tmp, per user) elsewhere
+bool IpcEndpoint(char* out, size_t bytes);
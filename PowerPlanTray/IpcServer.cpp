@@ -0,0 +1,911 @@
+// IpcServer.cpp: Local IPC endpoint for plan queries, switches and change events, served off the UI thread.
+
+#include "IpcServer.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Room for the largest reply with a little queued ahead of it. A client is
+// only read from while a whole reply fits, which bounds every buffer.
+static const size_t kOutBytes = kIpcMaxFrame + 4096;
+// Header, change mask, the fixed part of the state and a name of surrogates
+static const size_t kEventBytes = kIpcHeaderBytes + 1 + 32 + 2 + 4 * kIpcNameMax;
+static const size_t kMaxSwitches = 16;
+
+struct IpcConnection
+{
+    IpcConnection* prev;
+    IpcConnection* next;
+    bool closing;          // Closed; freed once no I/O is outstanding
+    bool subscribed;
+    uint8_t pendingEvents; // IpcChange bits not yet sent
+    size_t inLen;
+    size_t outLen;
+#ifdef _WIN32
+    HANDLE pipe;
+    OVERLAPPED readOv;     // ConnectNamedPipe, then ReadFile
+    OVERLAPPED writeOv;
+    bool connected;        // false while a listening instance
+    bool reading;
+    bool writing;
+#else
+    int fd;
+    uint32_t interest;     // epoll events asked for
+#endif
+    uint8_t in[kIpcMaxRequest];
+    uint8_t out[kOutBytes];
+};
+
+struct IpcServer::Impl
+{
+    WakeFn wake = nullptr;
+    void* context = nullptr;
+    char endpoint[128] = {};
+    std::thread thread;
+
+    // Shared with the owner's thread, under lock
+    std::mutex lock;
+    IpcState pubState;
+    bool statePublished = false;
+    IpcPlan pubPlans[kIpcMaxPlans];
+    size_t pubPlanCount = 0;
+    bool plansPublished = false;
+    uint8_t pubChanges = 0; // Since the I/O thread last looked
+    PlanId switches[kMaxSwitches];
+    size_t switchHead = 0;
+    size_t switchCount = 0;
+    std::atomic<bool> wakePending{ false };
+    std::atomic<bool> stopRequested{ false };
+
+    std::atomic<uint32_t> clients{ 0 };
+    std::atomic<uint32_t> peakClients{ 0 };
+    std::atomic<uint64_t> requests{ 0 };
+    std::atomic<uint64_t> events{ 0 };
+    std::atomic<uint64_t> dropped{ 0 };
+
+    // The I/O thread's own
+    IpcState state;
+    bool haveState = false;
+    IpcPlan plans[kIpcMaxPlans];
+    size_t planCount = 0;
+    bool havePlans = false;
+    IpcConnection* head = nullptr;
+    bool stopping = false;
+    bool reap = false;     // A connection closed since the last sweep
+#ifdef _WIN32
+    HANDLE port = nullptr;
+#else
+    int listenFd = -1;
+    int eventFd = -1;
+    int epollFd = -1;
+    int spareFd = -1;      // Held back so a client can be turned away when out of descriptors
+    bool acceptPaused = false; // Not even the spare: the listener waits for a client to leave
+    bool bound = false;    // The socket file is ours to remove
+#endif
+};
+
+typedef IpcServer::Impl Server;
+
+// ===== Connections =====
+static IpcConnection* NewConnection(Server& s)
+{
+    IpcConnection* c = static_cast<IpcConnection*>(calloc(1, sizeof(IpcConnection)));
+    if (!c)
+        return nullptr;
+    c->next = s.head;
+    if (s.head) s.head->prev = c;
+    s.head = c;
+    return c;
+}
+
+static void FreeConnection(Server& s, IpcConnection* c)
+{
+    if (c->prev) c->prev->next = c->next;
+    else s.head = c->next;
+    if (c->next) c->next->prev = c->prev;
+    free(c);
+}
+
+static void Connected(Server& s)
+{
+    const uint32_t now = s.clients.fetch_add(1, std::memory_order_relaxed) + 1;
+    uint32_t peak = s.peakClients.load(std::memory_order_relaxed);
+    while (now > peak && !s.peakClients.compare_exchange_weak(peak, now, std::memory_order_relaxed))
+    {
+    }
+}
+
+static size_t OutRoom(const IpcConnection& c)
+{
+    return kOutBytes - c.outLen;
+}
+
+// ===== Requests =====
+static uint8_t QueueSwitch(Server& s, const PlanId& plan)
+{
+    if (!s.havePlans)
+        return IPC_NOT_READY;
+    size_t i = 0;
+    while (i < s.planCount && s.plans[i].id != plan)
+        ++i;
+    if (i == s.planCount)
+        return IPC_NO_PLAN;
+    bool first;
+    {
+        std::lock_guard<std::mutex> guard(s.lock);
+        if (s.switchCount == kMaxSwitches)
+            return IPC_BUSY;
+        s.switches[(s.switchHead + s.switchCount++) % kMaxSwitches] = plan;
+        first = s.switchCount == 1;
+    }
+    // One wake covers everything queued until the owner drains it
+    if (first && s.wake)
+        s.wake(s.context);
+    return IPC_OK;
+}
+
+// Writes the reply frame for one request
+static void Answer(Server& s, IpcConnection& c, const IpcHeader& h, IpcReader& body, IpcWriter& w, bool nested)
+{
+    if (h.op != IPC_BATCH)
+        s.requests.fetch_add(1, std::memory_order_relaxed);
+    const size_t start = w.Length();
+    uint8_t status = IPC_OK;
+    size_t frame = w.Begin(h.op, IPC_OK, h.tag);
+    switch (h.op)
+    {
+    case IPC_GET:
+        if (body.Left()) status = IPC_BAD_REQUEST;
+        else if (!s.haveState) status = IPC_NOT_READY;
+        else w.State(s.state);
+        break;
+    case IPC_SET:
+    {
+        const PlanId plan = body.Id();
+        status = !body.Ok() || body.Left() ? (uint8_t)IPC_BAD_REQUEST : QueueSwitch(s, plan);
+        break;
+    }
+    case IPC_LIST:
+        if (body.Left()) status = IPC_BAD_REQUEST;
+        else if (!s.havePlans) status = IPC_NOT_READY;
+        else
+        {
+            w.U16((uint16_t)s.planCount);
+            for (size_t i = 0; i < s.planCount; ++i)
+            {
+                w.Id(s.plans[i].id);
+                w.Name(s.plans[i].name);
+            }
+        }
+        break;
+    case IPC_BATCH:
+    {
+        const uint16_t count = body.U16();
+        if (nested || !body.Ok() || count > kIpcMaxBatch)
+        {
+            status = IPC_BAD_REQUEST;
+            break;
+        }
+        w.U16(count);
+        for (uint16_t i = 0; i < count && status == IPC_OK; ++i)
+        {
+            IpcHeader sub;
+            if (IpcCheckFrame(body.Position(), body.Left(), kIpcMaxRequest, sub) != IPC_FRAME_READY ||
+                sub.op == IPC_BATCH || sub.op == IPC_SUBSCRIBE || sub.op == IPC_UNSUBSCRIBE)
+            {
+                status = IPC_BAD_REQUEST;
+                break;
+            }
+            IpcReader subBody(body.Skip(sub.size) + kIpcHeaderBytes, sub.size - kIpcHeaderBytes);
+            Answer(s, c, sub, subBody, w, true);
+            // Checked after each one: a later request that fails truncates
+            // back to its own start and would clear this overflow
+            if (!w.Ok())
+                status = IPC_TOO_LARGE;
+        }
+        if (status == IPC_OK && body.Left())
+            status = IPC_BAD_REQUEST;
+        break;
+    }
+    case IPC_SUBSCRIBE:
+    case IPC_UNSUBSCRIBE:
+        // Not subscribed unless the reply carries the state to follow on from
+        c.subscribed = h.op == IPC_SUBSCRIBE && !body.Left() && s.haveState;
+        c.pendingEvents = 0;
+        if (body.Left()) status = IPC_BAD_REQUEST;
+        else if (h.op == IPC_SUBSCRIBE && !s.haveState) status = IPC_NOT_READY;
+        else if (c.subscribed) w.State(s.state);
+        break;
+    default:
+        status = IPC_BAD_OP;
+        break;
+    }
+    if (status != IPC_OK)
+    {
+        // A failed request gets a bare status
+        w.Truncate(start);
+        frame = w.Begin(h.op, status, h.tag);
+    }
+    w.End(frame);
+}
+
+// Answers every whole request that has room for its reply; false when the
+// client sent something that is not a frame and has to go
+static bool ServeRequests(Server& s, IpcConnection& c)
+{
+    size_t used = 0;
+    for (;;)
+    {
+        IpcHeader h;
+        const IpcFrameCheck check = IpcCheckFrame(c.in + used, c.inLen - used, kIpcMaxRequest, h);
+        if (check == IPC_FRAME_BAD)
+            return false;
+        if (check == IPC_FRAME_PARTIAL || OutRoom(c) < kIpcMaxFrame)
+            break;
+        IpcWriter w(c.out + c.outLen, kIpcMaxFrame);
+        IpcReader body(c.in + used + kIpcHeaderBytes, h.size - kIpcHeaderBytes);
+        Answer(s, c, h, body, w, false);
+        c.outLen += w.Length();
+        used += h.size;
+    }
+    memmove(c.in, c.in + used, c.inLen - used);
+    c.inLen -= used;
+    return true;
+}
+
+// Sends the latest state to a subscriber with changes it has not seen,
+// once there is room; until then further changes merge into the same event
+static void FlushEvents(Server& s, IpcConnection& c)
+{
+    if (!c.subscribed || !c.pendingEvents || !s.haveState || OutRoom(c) < kEventBytes)
+        return;
+    IpcWriter w(c.out + c.outLen, OutRoom(c));
+    const size_t frame = w.Begin(IPC_EVENT, IPC_OK, 0);
+    w.U8(c.pendingEvents);
+    w.State(s.state);
+    w.End(frame);
+    c.outLen += w.Length();
+    c.pendingEvents = 0;
+    s.events.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void Pump(Server& s, IpcConnection* c);
+
+// Takes in what the owner published since the last wake and tells subscribers
+static void OnWake(Server& s)
+{
+    s.wakePending.store(false);
+    uint8_t changes;
+    {
+        std::lock_guard<std::mutex> guard(s.lock);
+        changes = s.pubChanges;
+        s.pubChanges = 0;
+        if (s.statePublished)
+        {
+            s.state = s.pubState;
+            s.haveState = true;
+        }
+        if ((changes & IPC_CHANGED_PLANS) || (s.plansPublished && !s.havePlans))
+        {
+            memcpy(s.plans, s.pubPlans, s.pubPlanCount * sizeof(IpcPlan));
+            s.planCount = s.pubPlanCount;
+            s.havePlans = s.plansPublished;
+        }
+    }
+    if (!changes)
+        return;
+    for (IpcConnection* c = s.head; c; c = c->next)
+    {
+        if (c->closing || !c->subscribed)
+            continue;
+        c->pendingEvents |= changes;
+        Pump(s, c);
+    }
+}
+
+#ifdef _WIN32
+// ===== Named pipe on a completion port =====
+static const ULONG_PTR kWakeKey = 1;
+static const ULONG_PTR kStopKey = 2;
+static const int kListeners = 4; // Instances waiting for a client at any time
+
+static void Close(Server& s, IpcConnection* c)
+{
+    if (c->closing)
+        return;
+    c->closing = true;
+    s.reap = true;
+    if (c->connected)
+        s.clients.fetch_sub(1, std::memory_order_relaxed);
+    // Outstanding I/O completes, aborted, and the connection is freed after it
+    CloseHandle(c->pipe);
+}
+
+static bool Listen(Server& s, bool first)
+{
+    IpcConnection* c = NewConnection(s);
+    if (!c)
+        return false;
+    // The first instance fails if another process already owns the name
+    c->pipe = CreateNamedPipeA(s.endpoint,
+        PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, PIPE_UNLIMITED_INSTANCES,
+        (DWORD)kOutBytes, kIpcMaxRequest, 0, nullptr);
+    if (c->pipe == INVALID_HANDLE_VALUE)
+    {
+        FreeConnection(s, c);
+        return false;
+    }
+    if (!CreateIoCompletionPort(c->pipe, s.port, reinterpret_cast<ULONG_PTR>(c), 0))
+    {
+        CloseHandle(c->pipe);
+        FreeConnection(s, c);
+        return false;
+    }
+    c->reading = true;
+    if (!ConnectNamedPipe(c->pipe, &c->readOv))
+    {
+        const DWORD error = GetLastError();
+        if (error == ERROR_PIPE_CONNECTED)
+        {
+            // The client beat us to it; nothing is queued for that, so queue it
+            PostQueuedCompletionStatus(s.port, 0, reinterpret_cast<ULONG_PTR>(c), &c->readOv);
+        }
+        else if (error != ERROR_IO_PENDING)
+        {
+            c->reading = false;
+            CloseHandle(c->pipe);
+            FreeConnection(s, c);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void Pump(Server& s, IpcConnection* c)
+{
+    // The read buffer belongs to the system while a read is out
+    if (!c->reading && !ServeRequests(s, *c))
+    {
+        s.dropped.fetch_add(1, std::memory_order_relaxed);
+        Close(s, c);
+        return;
+    }
+    FlushEvents(s, *c);
+    if (!c->writing && c->outLen)
+    {
+        ZeroMemory(&c->writeOv, sizeof(c->writeOv));
+        if (!WriteFile(c->pipe, c->out, (DWORD)c->outLen, nullptr, &c->writeOv) && GetLastError() != ERROR_IO_PENDING)
+        {
+            Close(s, c);
+            return;
+        }
+        c->writing = true;
+    }
+    if (!c->reading && OutRoom(*c) >= kIpcMaxFrame && c->inLen < kIpcMaxRequest)
+    {
+        ZeroMemory(&c->readOv, sizeof(c->readOv));
+        if (!ReadFile(c->pipe, c->in + c->inLen, (DWORD)(kIpcMaxRequest - c->inLen), nullptr, &c->readOv) &&
+            GetLastError() != ERROR_IO_PENDING)
+        {
+            Close(s, c);
+            return;
+        }
+        c->reading = true;
+    }
+}
+
+static void OnRead(Server& s, IpcConnection* c, BOOL ok, DWORD bytes)
+{
+    c->reading = false;
+    if (c->closing)
+        return;
+    if (!c->connected)
+    {
+        if (!s.stopping)
+            Listen(s, false);
+        if (!ok)
+        {
+            Close(s, c);
+            return;
+        }
+        c->connected = true;
+        Connected(s);
+    }
+    else if (!ok || !bytes)
+    {
+        Close(s, c);
+        return;
+    }
+    c->inLen += bytes;
+    Pump(s, c);
+}
+
+static void OnWrite(Server& s, IpcConnection* c, BOOL ok, DWORD bytes)
+{
+    c->writing = false;
+    if (c->closing)
+        return;
+    if (!ok)
+    {
+        Close(s, c);
+        return;
+    }
+    memmove(c->out, c->out + bytes, c->outLen - bytes);
+    c->outLen -= bytes;
+    Pump(s, c);
+}
+
+static bool OpenEndpoint(Server& s)
+{
+    s.port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+    if (!s.port || !Listen(s, true))
+        return false;
+    for (int i = 1; i < kListeners; ++i)
+        Listen(s, false);
+    return true;
+}
+
+static void CloseEndpoint(Server& s)
+{
+    if (s.port)
+        CloseHandle(s.port);
+    s.port = nullptr;
+}
+
+static void WakeThread(Server& s)
+{
+    PostQueuedCompletionStatus(s.port, 0, kWakeKey, nullptr);
+}
+
+static void StopThread(Server& s)
+{
+    PostQueuedCompletionStatus(s.port, 0, kStopKey, nullptr);
+}
+
+static void Run(Server* server)
+{
+    Server& s = *server;
+    for (;;)
+    {
+        DWORD bytes = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED* ov = nullptr;
+        const BOOL ok = GetQueuedCompletionStatus(s.port, &bytes, &key, &ov, INFINITE);
+        if (!ov)
+        {
+            if (!ok)
+                break; // The port itself failed
+            if (key == kStopKey && !s.stopping)
+            {
+                s.stopping = true;
+                for (IpcConnection* c = s.head; c; c = c->next)
+                    Close(s, c);
+            }
+            else if (key == kWakeKey && !s.stopping)
+            {
+                OnWake(s);
+            }
+        }
+        else
+        {
+            IpcConnection* c = reinterpret_cast<IpcConnection*>(key);
+            if (ov == &c->readOv)
+                OnRead(s, c, ok, bytes);
+            else
+                OnWrite(s, c, ok, bytes);
+            if (c->closing)
+                s.reap = true;
+        }
+        // Closed with nothing outstanding, or the last of its I/O just came back
+        for (IpcConnection* c = s.reap ? s.head : nullptr; c;)
+        {
+            IpcConnection* next = c->next;
+            if (c->closing && !c->reading && !c->writing) FreeConnection(s, c);
+            c = next;
+        }
+        s.reap = false;
+        if (s.stopping && !s.head)
+            break;
+    }
+}
+
+#else
+// ===== Unix socket under epoll =====
+static void Close(Server& s, IpcConnection* c)
+{
+    if (c->closing)
+        return;
+    c->closing = true;
+    s.reap = true;
+    s.clients.fetch_sub(1, std::memory_order_relaxed);
+    epoll_ctl(s.epollFd, EPOLL_CTL_DEL, c->fd, nullptr);
+    close(c->fd);
+    if (s.acceptPaused)
+    {
+        // A descriptor is free again: take back the spare, then listen
+        s.spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = &s.listenFd;
+        epoll_ctl(s.epollFd, EPOLL_CTL_MOD, s.listenFd, &ev);
+        s.acceptPaused = false;
+    }
+}
+
+// Sends what it can; false if the client is gone
+static bool Send(Server& s, IpcConnection* c)
+{
+    while (c->outLen)
+    {
+        const ssize_t n = send(c->fd, c->out, c->outLen, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            Close(s, c);
+            return false;
+        }
+        memmove(c->out, c->out + n, c->outLen - (size_t)n);
+        c->outLen -= (size_t)n;
+    }
+    return true;
+}
+
+static void Pump(Server& s, IpcConnection* c)
+{
+    for (;;)
+    {
+        const size_t before = c->inLen;
+        if (!ServeRequests(s, *c))
+        {
+            s.dropped.fetch_add(1, std::memory_order_relaxed);
+            Close(s, c);
+            return;
+        }
+        FlushEvents(s, *c);
+        if (!Send(s, c))
+            return;
+        // Go round again only if sending made room for requests still waiting
+        if (c->inLen == before || c->outLen || !c->inLen)
+            break;
+    }
+    const bool readable = OutRoom(*c) >= kIpcMaxFrame && c->inLen < kIpcMaxRequest;
+    const uint32_t interest = (readable ? (uint32_t)(EPOLLIN | EPOLLRDHUP) : 0U) | (c->outLen ? (uint32_t)EPOLLOUT : 0U);
+    if (interest != c->interest)
+    {
+        epoll_event ev = {};
+        ev.events = interest;
+        ev.data.ptr = c;
+        epoll_ctl(s.epollFd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->interest = interest;
+    }
+}
+
+static void Receive(Server& s, IpcConnection* c)
+{
+    while (c->inLen < kIpcMaxRequest)
+    {
+        const ssize_t n = recv(c->fd, c->in + c->inLen, kIpcMaxRequest - c->inLen, MSG_DONTWAIT);
+        if (n > 0)
+        {
+            c->inLen += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        Close(s, c); // End of stream or an error
+        return;
+    }
+    Pump(s, c);
+}
+
+static void Accept(Server& s)
+{
+    for (;;)
+    {
+        const int fd = accept4(s.listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EMFILE && errno != ENFILE)
+                return; // EAGAIN: nobody else waiting
+            // Out of descriptors. The listener is level-triggered, so leaving
+            // the client in the backlog would wake this thread again at once;
+            // the spare makes room to accept it and hang up
+            if (s.spareFd >= 0)
+            {
+                close(s.spareFd);
+                const int refused = accept4(s.listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (refused >= 0)
+                    close(refused);
+                s.spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                // EMFILE comes before the backlog is looked at, so stop once it is empty
+                if (s.spareFd >= 0 && refused >= 0)
+                    continue;
+                if (s.spareFd >= 0)
+                    return;
+            }
+            // Someone else took the spare's slot: stop listening until a
+            // client leaves
+            epoll_event ev = {};
+            ev.data.ptr = &s.listenFd;
+            epoll_ctl(s.epollFd, EPOLL_CTL_MOD, s.listenFd, &ev);
+            s.acceptPaused = true;
+            return;
+        }
+        IpcConnection* c = NewConnection(s);
+        epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = c;
+        if (!c || epoll_ctl(s.epollFd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            close(fd);
+            if (c) FreeConnection(s, c);
+            continue;
+        }
+        c->fd = fd;
+        c->interest = ev.events;
+        Connected(s);
+    }
+}
+
+static bool OpenEndpoint(Server& s)
+{
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (strlen(s.endpoint) >= sizeof(addr.sun_path))
+        return false;
+    strcpy(addr.sun_path, s.endpoint);
+    s.listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s.listenFd < 0)
+        return false;
+    if (bind(s.listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        if (errno != EADDRINUSE)
+            return false;
+        // Left behind by an instance that died, unless something answers on it
+        const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const bool live = probe >= 0 && connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        if (probe >= 0) close(probe);
+        if (live || unlink(s.endpoint) != 0 ||
+            bind(s.listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+            return false;
+    }
+    s.bound = true;
+    chmod(s.endpoint, 0600);
+    if (listen(s.listenFd, SOMAXCONN) != 0)
+        return false;
+    s.epollFd = epoll_create1(EPOLL_CLOEXEC);
+    s.eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    s.spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (s.epollFd < 0 || s.eventFd < 0)
+        return false;
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = &s.listenFd;
+    epoll_ctl(s.epollFd, EPOLL_CTL_ADD, s.listenFd, &ev);
+    ev.data.ptr = &s.eventFd;
+    epoll_ctl(s.epollFd, EPOLL_CTL_ADD, s.eventFd, &ev);
+    return true;
+}
+
+static void CloseEndpoint(Server& s)
+{
+    if (s.listenFd >= 0)
+        close(s.listenFd);
+    if (s.bound)
+        unlink(s.endpoint);
+    s.bound = false;
+    if (s.eventFd >= 0) close(s.eventFd);
+    if (s.epollFd >= 0) close(s.epollFd);
+    if (s.spareFd >= 0) close(s.spareFd);
+    s.listenFd = s.eventFd = s.epollFd = s.spareFd = -1;
+    s.acceptPaused = false;
+}
+
+static void WakeThread(Server& s)
+{
+    const uint64_t one = 1;
+    (void)!write(s.eventFd, &one, sizeof(one));
+}
+
+static void StopThread(Server& s)
+{
+    WakeThread(s);
+}
+
+static void Run(Server* server)
+{
+    Server& s = *server;
+    epoll_event events[64];
+    while (!s.stopping)
+    {
+        const int n = epoll_wait(s.epollFd, events, 64, -1);
+        if (n < 0 && errno != EINTR)
+            break;
+        for (int i = 0; i < n; ++i)
+        {
+            void* ptr = events[i].data.ptr;
+            if (ptr == &s.listenFd)
+            {
+                Accept(s);
+                continue;
+            }
+            if (ptr == &s.eventFd)
+            {
+                uint64_t count;
+                (void)!read(s.eventFd, &count, sizeof(count));
+                if (s.stopRequested.load())
+                    s.stopping = true;
+                else
+                    OnWake(s);
+                continue;
+            }
+            // A connection closed earlier in this batch is freed after it
+            IpcConnection* c = static_cast<IpcConnection*>(ptr);
+            if (c->closing)
+                continue;
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+                Receive(s, c);
+            else if (events[i].events & EPOLLOUT)
+                Pump(s, c);
+        }
+        for (IpcConnection* c = s.reap ? s.head : nullptr; c;)
+        {
+            IpcConnection* next = c->next;
+            if (c->closing) FreeConnection(s, c);
+            c = next;
+        }
+        s.reap = false;
+    }
+    while (s.head)
+    {
+        Close(s, s.head);
+        FreeConnection(s, s.head);
+    }
+}
+#endif
+
+// ===== Owner's side =====
+bool IpcServer::Start(WakeFn wake, void* context, const char* endpoint)
+{
+    if (m_impl)
+        return true;
+    Server* s = new Server;
+    s->wake = wake;
+    s->context = context;
+    const bool named = endpoint
+        ? snprintf(s->endpoint, sizeof(s->endpoint), "%s", endpoint) < (int)sizeof(s->endpoint)
+        : IpcEndpoint(s->endpoint, sizeof(s->endpoint));
+    if (!named || !OpenEndpoint(*s))
+    {
+        CloseEndpoint(*s);
+        delete s;
+        return false;
+    }
+    s->thread = std::thread(Run, s);
+    m_impl = s;
+    return true;
+}
+
+void IpcServer::Stop()
+{
+    if (!m_impl)
+        return;
+    m_impl->stopRequested.store(true);
+    StopThread(*m_impl);
+    m_impl->thread.join();
+    CloseEndpoint(*m_impl);
+    delete m_impl;
+    m_impl = nullptr;
+}
+
+static bool SameState(const IpcState& a, const IpcState& b)
+{
+    return a.active == b.active && a.afkStage == b.afkStage && a.flags == b.flags &&
+        a.lastSwitchUnixMs == b.lastSwitchUnixMs && wcscmp(a.name, b.name) == 0;
+}
+
+void IpcServer::PublishState(const IpcState& state)
+{
+    if (!m_impl)
+        return;
+    Server& s = *m_impl;
+    {
+        std::lock_guard<std::mutex> guard(s.lock);
+        if (s.statePublished && SameState(s.pubState, state))
+            return;
+        uint8_t changes = IPC_CHANGED_PLAN | IPC_CHANGED_AFK;
+        if (s.statePublished)
+        {
+            changes = 0;
+            if (s.pubState.active != state.active || wcscmp(s.pubState.name, state.name) != 0 ||
+                s.pubState.lastSwitchUnixMs != state.lastSwitchUnixMs)
+                changes |= IPC_CHANGED_PLAN;
+            if (s.pubState.afkStage != state.afkStage || s.pubState.flags != state.flags)
+                changes |= IPC_CHANGED_AFK;
+        }
+        const uint32_t generation = s.pubState.generation + 1;
+        s.pubState = state;
+        s.pubState.generation = generation;
+        s.statePublished = true;
+        s.pubChanges |= changes;
+    }
+    if (!s.wakePending.exchange(true))
+        WakeThread(s);
+}
+
+void IpcServer::PublishPlans(const IpcPlan* plans, size_t count)
+{
+    if (!m_impl)
+        return;
+    Server& s = *m_impl;
+    if (count > kIpcMaxPlans)
+        count = kIpcMaxPlans;
+    {
+        std::lock_guard<std::mutex> guard(s.lock);
+        bool same = s.plansPublished && s.pubPlanCount == count;
+        for (size_t i = 0; same && i < count; ++i)
+            same = s.pubPlans[i].id == plans[i].id && wcscmp(s.pubPlans[i].name, plans[i].name) == 0;
+        if (same)
+            return;
+        memcpy(s.pubPlans, plans, count * sizeof(IpcPlan));
+        s.pubPlanCount = count;
+        s.plansPublished = true;
+        s.pubChanges |= IPC_CHANGED_PLANS;
+    }
+    if (!s.wakePending.exchange(true))
+        WakeThread(s);
+}
+
+bool IpcServer::TakeSwitch(PlanId& plan)
+{
+    if (!m_impl)
+        return false;
+    Server& s = *m_impl;
+    std::lock_guard<std::mutex> guard(s.lock);
+    if (!s.switchCount)
+        return false;
+    plan = s.switches[s.switchHead];
+    s.switchHead = (s.switchHead + 1) % kMaxSwitches;
+    --s.switchCount;
+    return true;
+}
+
+IpcServer::Stats IpcServer::GetStats() const
+{
+    Stats stats;
+    if (!m_impl)
+        return stats;
+    stats.clients = m_impl->clients.load(std::memory_order_relaxed);
+    stats.peakClients = m_impl->peakClients.load(std::memory_order_relaxed);
+    stats.requests = m_impl->requests.load(std::memory_order_relaxed);
+    stats.events = m_impl->events.load(std::memory_order_relaxed);
+    stats.dropped = m_impl->dropped.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,63 @@
+// IpcServer.h: Local IPC endpoint for plan queries, switches and change events, served off the UI thread.
+
+#pragma once
+
+#include "IpcProtocol.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One I/O thread serves every client: overlapped named-pipe I/O on a
+// completion port on Windows, a non-blocking Unix socket under epoll
+// elsewhere. The UI thread only publishes snapshots and drains switches,
+// each a short copy under a lock, so no client can hold it up.
+//
+// The I/O thread answers GET, LIST and BATCH from its own copy of the last
+// published snapshot. A SET is checked against that plan list, queued and
+// acknowledged; the owner is woken to carry it out with TakeSwitch, and the
+// change reaches subscribers when the owner publishes the new state.
+//
+// Connection buffers come from malloc, not operator new, so the debug
+// allocation checks on the UI thread's steady-state paths stay exact.
+class IpcServer
+{
+public:
+    typedef void (*WakeFn)(void* context);
+
+    struct Stats
+    {
+        uint32_t clients = 0;     // Connected now
+        uint32_t peakClients = 0;
+        uint64_t requests = 0;    // Each request in a batch counts, the batch does not
+        uint64_t events = 0;      // Event frames queued to subscribers
+        uint64_t dropped = 0;     // Clients cut off for malformed frames
+    };
+
+    IpcServer() {}
+    ~IpcServer() { Stop(); }
+
+    // Opens the endpoint (IpcEndpoint's unless one is given) and starts the
+    // I/O thread. wake runs on that thread each time a switch is queued;
+    // false if another process has the endpoint.
+    bool Start(WakeFn wake, void* context, const char* endpoint = nullptr);
+    // Disconnects every client and joins the thread
+    void Stop();
+    bool Running() const { return m_impl != nullptr; }
+
+    // From the owner's thread. The generation is the server's own: a state
+    // equal to the last one is not a change and wakes nobody.
+    void PublishState(const IpcState& state);
+    void PublishPlans(const IpcPlan* plans, size_t count);
+    // The next queued switch, oldest first
+    bool TakeSwitch(PlanId& plan);
+
+    Stats GetStats() const;
+
+    struct Impl;
+
+private:
+    IpcServer(const IpcServer&) = delete;
+    IpcServer& operator=(const IpcServer&) = delete;
+
+    Impl* m_impl = nullptr;
+};
@@ -0,0 +1,84 @@
+// LatencyHistogram.cpp: Constant-memory log-bucketed latency histogram.
+
+#include "LatencyHistogram.h"
+
+#include <string.h>
+
+static int HighestBit(uint64_t v)
+{
+    int bit = 0;
+    while (v >>= 1) ++bit;
+    return bit;
+}
+
+void LatencyHistogram::Reset()
+{
+    memset(m_counts, 0, sizeof(m_counts));
+    m_count = 0;
+    m_max = 0;
+}
+
+int LatencyHistogram::BucketIndex(uint64_t value)
+{
+    if (value < (uint64_t)kSubBuckets)
+        return (int)value;
+    const int msb = HighestBit(value);
+    const int shift = msb - kSubBucketBits;
+    const int sub = (int)((value >> shift) & (kSubBuckets - 1));
+    return (shift + 1) * kSubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(int index)
+{
+    const int octave = index / kSubBuckets;
+    const int sub = index % kSubBuckets;
+    if (octave == 0)
+        return (uint64_t)sub;
+    const int shift = octave - 1;
+    const uint64_t lower = (uint64_t)(kSubBuckets + sub) << shift;
+    return lower + (((uint64_t)1 << shift) - 1);
+}
+
+void LatencyHistogram::Record(uint64_t value)
+{
+    uint32_t& c = m_counts[BucketIndex(value)];
+    if (c != UINT32_MAX) ++c; // saturate rather than wrap
+    ++m_count;
+    if (value > m_max) m_max = value;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other)
+{
+    for (int i = 0; i < kBucketCount; ++i)
+    {
+        const uint64_t sum = (uint64_t)m_counts[i] + other.m_counts[i];
+        m_counts[i] = sum > UINT32_MAX ? UINT32_MAX : (uint32_t)sum;
+    }
+    m_count += other.m_count;
+    if (other.m_max > m_max) m_max = other.m_max;
+}
+
+uint64_t LatencyHistogram::Percentile(double p) const
+{
+    if (m_count == 0)
+        return 0;
+    if (p <= 0.0) p = 0.0;
+    if (p >= 100.0) return m_max;
+
+    // Rank of the requested percentile, 1-based, rounded up
+    uint64_t rank = (uint64_t)(p / 100.0 * (double)m_count);
+    if ((double)rank < p / 100.0 * (double)m_count) ++rank;
+    if (rank == 0) rank = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < kBucketCount; ++i)
+    {
+        seen += m_counts[i];
+        if (seen >= rank)
+        {
+            uint64_t upper = BucketUpperBound(i);
+            return upper < m_max ? upper : m_max;
+        }
+    }
+    return m_max;
+}
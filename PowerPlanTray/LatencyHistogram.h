@@ -0,0 +1,36 @@
+// LatencyHistogram.h: Constant-memory log-bucketed latency histogram.
+
+#pragma once
+
+#include <stdint.h>
+
+// HDR-style histogram: values below kSubBuckets are counted exactly, larger
+// values fall into one of kSubBuckets linear sub-buckets per power of two,
+// so the relative error of any reported percentile stays below 1/kSubBuckets.
+class LatencyHistogram
+{
+public:
+    static const int kSubBucketBits = 4;
+    static const int kSubBuckets = 1 << kSubBucketBits;
+    static const int kBucketCount = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    LatencyHistogram() { Reset(); }
+
+    void Reset();
+    void Record(uint64_t value);
+    // Adds another histogram's counts, e.g. one kept per thread
+    void Merge(const LatencyHistogram& other);
+
+    uint64_t Count() const { return m_count; }
+    uint64_t Max() const { return m_max; }
+    // p in [0, 100]; returns the upper bound of the bucket holding that rank.
+    uint64_t Percentile(double p) const;
+
+private:
+    static int BucketIndex(uint64_t value);
+    static uint64_t BucketUpperBound(int index);
+
+    uint32_t m_counts[kBucketCount];
+    uint64_t m_count;
+    uint64_t m_max;
+};
@@ -0,0 +1,54 @@
+// LoadSwitcher.cpp: CPU-load driven plan boost with EWMA smoothing and hysteresis.
+
+#include "LoadSwitcher.h"
+
+#include <math.h>
+
+bool LoadSwitcher::Sample(uint64_t nowMs, uint64_t idleTicks, uint64_t totalTicks)
+{
+    if (!m_primed || nowMs <= m_lastMs || totalTicks < m_lastTotal || idleTicks < m_lastIdle)
+    {
+        // First sample, or counters went backwards: just take a new baseline
+        m_primed = true;
+        m_lastMs = nowMs;
+        m_lastIdle = idleTicks;
+        m_lastTotal = totalTicks;
+        if (m_lastChangeMs == 0) m_lastChangeMs = nowMs;
+        return false;
+    }
+
+    const uint64_t dTotal = totalTicks - m_lastTotal;
+    const uint64_t dIdle = idleTicks - m_lastIdle;
+    const uint64_t dtMs = nowMs - m_lastMs;
+    m_lastMs = nowMs;
+    m_lastIdle = idleTicks;
+    m_lastTotal = totalTicks;
+    if (dTotal == 0)
+        return false;
+
+    const double busy = dIdle >= dTotal ? 0.0 : 100.0 * (double)(dTotal - dIdle) / (double)dTotal;
+    // Time-aware smoothing so an adaptive sampling rate does not change the response
+    const double alpha = 1.0 - exp(-(double)dtMs / (double)(m_config.tauMs ? m_config.tauMs : 1));
+    m_ewma += alpha * (busy - m_ewma);
+
+    if (nowMs - m_lastChangeMs < m_config.minDwellMs)
+        return false;
+
+    const bool want = m_boosted ? m_ewma > m_config.lowPercent : m_ewma >= m_config.highPercent;
+    if (want == m_boosted)
+        return false;
+    m_boosted = want;
+    m_lastChangeMs = nowMs;
+    return true;
+}
+
+uint32_t LoadSwitcher::NextIntervalMs() const
+{
+    // Sample quickly only while the smoothed load is close to the threshold that
+    // could flip the state next; a quiet or saturated machine is sampled slowly.
+    const double edge = m_boosted ? m_config.lowPercent : m_config.highPercent;
+    const double margin = 15.0;
+    if (!m_primed || fabs(m_ewma - edge) <= margin)
+        return m_config.fastIntervalMs;
+    return m_config.slowIntervalMs;
+}
@@ -0,0 +1,44 @@
+// LoadSwitcher.h: CPU-load driven plan boost with EWMA smoothing and hysteresis.
+
+#pragma once
+
+#include <stdint.h>
+
+// Pure decision logic: feed cumulative CPU counters (any tick unit) with a
+// millisecond timestamp; the caller owns sampling and plan switching.
+class LoadSwitcher
+{
+public:
+    struct Config
+    {
+        double highPercent = 70.0;  // Boost when the smoothed load reaches this
+        double lowPercent = 40.0;   // Drop back when it falls to this
+        uint32_t tauMs = 10000;     // EWMA time constant
+        uint32_t minDwellMs = 60000; // Minimum time between state changes
+        uint32_t fastIntervalMs = 1000; // Sampling period near a threshold
+        uint32_t slowIntervalMs = 5000; // Sampling period far from both
+    };
+
+    LoadSwitcher() {}
+    explicit LoadSwitcher(const Config& config) : m_config(config) {}
+
+    // Returns true when Boosted() changed as a result of this sample
+    bool Sample(uint64_t nowMs, uint64_t idleTicks, uint64_t totalTicks);
+
+    bool Boosted() const { return m_boosted; }
+    double SmoothedPercent() const { return m_ewma; }
+    // How long to wait before the next sample
+    uint32_t NextIntervalMs() const;
+    const Config& GetConfig() const { return m_config; }
+    void SetConfig(const Config& config) { m_config = config; }
+
+private:
+    Config m_config;
+    bool m_primed = false;   // Have a previous sample to diff against
+    bool m_boosted = false;
+    double m_ewma = 0.0;
+    uint64_t m_lastMs = 0;
+    uint64_t m_lastIdle = 0;
+    uint64_t m_lastTotal = 0;
+    uint64_t m_lastChangeMs = 0;
+};
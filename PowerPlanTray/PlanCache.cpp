@@ -0,0 +1,199 @@
+// PlanCache.cpp: Persistent binary cache of the plan list for instant first paint.
+
+#include "PlanCache.h"
+
+#include <strsafe.h>
+
+static const uint32_t kCacheMagic = 0x43545050; // "PPTC"
+static const uint16_t kCacheVersion = 2;
+
+static uint32_t Crc32(const BYTE* data, size_t size)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc ^= data[i];
+        for (int k = 0; k < 8; ++k)
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+    return ~crc;
+}
+
+// Bounds-checked sequential writer into a caller-provided buffer
+struct CacheWriter
+{
+    BYTE* p;
+    size_t left;
+    bool ok;
+
+    void Bytes(const void* src, size_t n)
+    {
+        if (!ok || left < n) { ok = false; return; }
+        memcpy(p, src, n); p += n; left -= n;
+    }
+    void U16(uint16_t v)
+    {
+        BYTE b[2] = { (BYTE)(v & 0xFF), (BYTE)(v >> 8) };
+        Bytes(b, 2);
+    }
+    void U32(uint32_t v)
+    {
+        BYTE b[4] = { (BYTE)(v & 0xFF), (BYTE)(v >> 8), (BYTE)(v >> 16), (BYTE)(v >> 24) };
+        Bytes(b, 4);
+    }
+};
+
+// Bounds-checked sequential reader over the file image
+struct CacheReader
+{
+    const BYTE* p;
+    size_t left;
+
+    bool Bytes(void* dst, size_t n)
+    {
+        if (left < n) return false;
+        memcpy(dst, p, n); p += n; left -= n;
+        return true;
+    }
+    bool U16(uint16_t& v)
+    {
+        BYTE b[2];
+        if (!Bytes(b, 2)) return false;
+        v = (uint16_t)(b[0] | (b[1] << 8));
+        return true;
+    }
+    bool U32(uint32_t& v)
+    {
+        BYTE b[4];
+        if (!Bytes(b, 4)) return false;
+        v = (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+        return true;
+    }
+};
+
+size_t PlanCacheEncode(const PlanCacheData& data, BYTE* out, size_t cap)
+{
+    CacheWriter w{ out, cap, true };
+    w.U32(kCacheMagic);
+    w.U16(kCacheVersion);
+    w.U16((uint16_t)data.lang);
+    w.U16((uint16_t)data.plans.size());
+    w.U16(0);
+    w.Bytes(&data.active, sizeof(GUID));
+    w.Bytes(&data.previous, sizeof(GUID));
+    for (const auto& p : data.plans)
+    {
+        const size_t len = wcsnlen(p.name, kPlanNameMax - 1);
+        w.Bytes(&p.guid, sizeof(GUID));
+        w.U16((uint16_t)len);
+        w.Bytes(p.name, len * sizeof(wchar_t));
+    }
+    if (!w.ok)
+        return 0;
+    const size_t body = cap - w.left;
+    w.U32(Crc32(out, body));
+    return w.ok ? body + 4 : 0;
+}
+
+bool PlanCacheDecode(const BYTE* bytes, size_t size, PlanCacheData& out)
+{
+    if (!bytes || size < 4 || size > kPlanCacheMaxBytes)
+        return false;
+
+    CacheReader crcReader{ bytes + size - 4, 4 };
+    uint32_t crc = 0;
+    if (!crcReader.U32(crc) || crc != Crc32(bytes, size - 4))
+        return false;
+
+    CacheReader r{ bytes, size - 4 };
+    uint32_t magic = 0; uint16_t version = 0, lang = 0, count = 0, reserved = 0;
+    if (!r.U32(magic) || magic != kCacheMagic) return false;
+    if (!r.U16(version) || version != kCacheVersion) return false;
+    if (!r.U16(lang) || !r.U16(count) || !r.U16(reserved)) return false;
+    if (count > kMaxPlans) return false;
+
+    GUID active{}, previous{};
+    if (!r.Bytes(&active, sizeof(GUID)) || !r.Bytes(&previous, sizeof(GUID))) return false;
+    // Decode straight into the output list; only commit the header once it all checks out
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        PlanItem& item = out.plans.items[i];
+        uint16_t len = 0;
+        if (!r.Bytes(&item.guid, sizeof(GUID)) || !r.U16(len) || len >= kPlanNameMax)
+            return false;
+        if (len && !r.Bytes(item.name, len * sizeof(wchar_t)))
+            return false;
+        item.name[len] = L'\0';
+    }
+    if (r.left != 0)
+        return false;
+
+    out.lang = (LANGID)lang;
+    out.active = active;
+    out.previous = previous;
+    out.plans.count = count;
+    return true;
+}
+
+bool PlanCacheGetPath(wchar_t* path, size_t cch)
+{
+    wchar_t base[MAX_PATH] = {};
+    DWORD n = GetEnvironmentVariableW(L"LOCALAPPDATA", base, ARRAYSIZE(base));
+    if (n == 0 || n >= ARRAYSIZE(base))
+        return false;
+    return SUCCEEDED(StringCchPrintfW(path, cch, L"%s\\PowerPlanTray\\PlanCache.bin", base));
+}
+
+bool PlanCacheLoad(PlanCacheData& out)
+{
+    wchar_t path[MAX_PATH];
+    if (!PlanCacheGetPath(path, ARRAYSIZE(path)))
+        return false;
+
+    HANDLE hFile = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    // One read of at most kPlanCacheMaxBytes; a larger file is not ours
+    BYTE buf[kPlanCacheMaxBytes + 1];
+    DWORD read = 0;
+    BOOL ok = ReadFile(hFile, buf, sizeof(buf), &read, nullptr);
+    CloseHandle(hFile);
+    return ok && PlanCacheDecode(buf, read, out);
+}
+
+bool PlanCacheSave(const PlanCacheData& data)
+{
+    BYTE bytes[kPlanCacheMaxBytes];
+    const size_t size = PlanCacheEncode(data, bytes, sizeof(bytes));
+    if (!size)
+        return false;
+
+    wchar_t path[MAX_PATH];
+    if (!PlanCacheGetPath(path, ARRAYSIZE(path)))
+        return false;
+
+    // Ensure the directory exists (path minus the file name)
+    wchar_t dir[MAX_PATH];
+    StringCchCopyW(dir, ARRAYSIZE(dir), path);
+    wchar_t* slash = wcsrchr(dir, L'\\');
+    if (slash) { *slash = L'\0'; CreateDirectoryW(dir, nullptr); }
+
+    // Write a sibling temp file, then swap it in so readers never see a torn file
+    wchar_t tmp[MAX_PATH];
+    if (FAILED(StringCchPrintfW(tmp, ARRAYSIZE(tmp), L"%s.tmp", path)))
+        return false;
+    HANDLE hFile = CreateFileW(tmp, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+    DWORD written = 0;
+    BOOL ok = WriteFile(hFile, bytes, (DWORD)size, &written, nullptr) && written == size;
+    CloseHandle(hFile);
+    if (!ok || !MoveFileExW(tmp, path, MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileW(tmp);
+        return false;
+    }
+    return true;
+}
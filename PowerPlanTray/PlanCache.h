@@ -0,0 +1,32 @@
+// PlanCache.h: Persistent binary cache of the plan list for instant first paint.
+
+#pragma once
+
+#include "framework.h"
+#include "PowerPlanTray.h"
+
+// On-disk layout (little-endian), read in a single ReadFile:
+//   uint32 magic 'PPTC' | uint16 version | uint16 UI language | uint16 plan count
+//   uint16 reserved | GUID last active | GUID the plan before it
+//   { GUID, uint16 name length, UTF-16 name }*
+//   uint32 CRC-32 of everything before it
+// Any mismatch (magic, version, size, CRC) makes the cache a miss, never an error.
+struct PlanCacheData
+{
+    LANGID lang = 0;
+    GUID active{};
+    GUID previous{}; // Active before that, for --toggle; null if unknown
+    PlanList plans;
+};
+
+// Largest possible file image; callers encode into a buffer of this size
+const size_t kPlanCacheMaxBytes = 12 + 2 * sizeof(GUID) + kMaxPlans * (sizeof(GUID) + 2 + kPlanNameMax * sizeof(wchar_t)) + 4;
+
+// Returns the encoded size, or 0 if it does not fit in cap
+size_t PlanCacheEncode(const PlanCacheData& data, BYTE* out, size_t cap);
+bool PlanCacheDecode(const BYTE* bytes, size_t size, PlanCacheData& out);
+
+// %LOCALAPPDATA%\PowerPlanTray\PlanCache.bin
+bool PlanCacheGetPath(wchar_t* path, size_t cch);
+bool PlanCacheLoad(PlanCacheData& out);
+bool PlanCacheSave(const PlanCacheData& data);
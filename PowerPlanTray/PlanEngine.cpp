@@ -0,0 +1,346 @@
+// PlanEngine.cpp: Plan, AFK, trigger and power-source state for one session, driven by explicit events.
+
+#include "PlanEngine.h"
+
+static_assert(SOURCE_COUNT <= PolicyEngine::kMaxSources, "one engine slot per source");
+
+void PlanEngine::SetPrediction(uint32_t marginMinutes, const ReturnPredictor::Config& config)
+{
+    m_predictMarginMinutes = marginMinutes;
+    m_predictor.SetConfig(config);
+}
+
+void PlanEngine::SetLoadBoost(const PlanId& plan, const LoadSwitcher::Config& config)
+{
+    m_loadBoost = plan;
+    m_load.SetConfig(config);
+}
+
+// ===== Plan arbitration =====
+void PlanEngine::Start(const PlanId& active, uint64_t nowMs)
+{
+    m_active = active;
+    m_governor.SetCurrent(active);
+    Claim(SOURCE_MANUAL, active, nowMs);
+}
+
+void PlanEngine::PlanPicked(const PlanId& plan, uint64_t nowMs)
+{
+    // A click takes effect at once, whoever else holds a claim
+    m_host.ApplyPlan(plan);
+    m_active = plan;
+    m_governor.NoteBypass(plan, nowMs);
+    ArmGovernor(nowMs);
+    Claim(SOURCE_MANUAL, plan, nowMs);
+    if (m_manualHoldMinutes)
+        Claim(SOURCE_MANUAL_HOLD, plan, nowMs, m_manualHoldMinutes * 60000ULL);
+}
+
+bool PlanEngine::PlanChanged(const PlanId& plan, uint64_t nowMs)
+{
+    if (plan == m_active)
+        return false;
+    // Changed outside the app: treat it as the user's new choice
+    m_active = plan;
+    m_governor.NoteBypass(plan, nowMs);
+    ArmGovernor(nowMs);
+    Claim(SOURCE_MANUAL, plan, nowMs);
+    return true;
+}
+
+// Switch only if the effective plan changed as a result
+void PlanEngine::Claim(PolicySource source, const PlanId& plan, uint64_t nowMs, uint64_t lifetimeMs)
+{
+    const bool changed = plan.IsNull()
+        ? m_policy.Withdraw(source)
+        : m_policy.Submit(source, plan, kSourcePriority[source], nowMs, lifetimeMs);
+    if (changed)
+        Apply(nowMs);
+    if (lifetimeMs)
+        ArmExpiry(nowMs);
+}
+
+// Hand the effective plan to the governor, which may hold it back for a while
+void PlanEngine::Apply(uint64_t nowMs)
+{
+    const PlanId effective = m_policy.Effective();
+    if (effective.IsNull())
+        return;
+    PlanId cur;
+    if (m_host.ReadActivePlan(cur))
+        m_governor.SetCurrent(cur);
+    if (m_governor.Offer(effective, nowMs))
+        SwitchTo(effective);
+    ArmGovernor(nowMs);
+}
+
+// The effective plan at once, past the governor: for changes the user is
+// waiting on, which count against the dwell like a menu pick
+void PlanEngine::ApplyNow(uint64_t nowMs)
+{
+    const PlanId effective = m_policy.Effective();
+    if (effective.IsNull())
+        return;
+    SwitchTo(effective);
+    m_governor.NoteBypass(effective, nowMs);
+    ArmGovernor(nowMs);
+}
+
+void PlanEngine::SwitchTo(const PlanId& plan)
+{
+    PlanId cur;
+    if (m_host.ReadActivePlan(cur) && cur == plan)
+        return;
+    m_host.ApplyPlan(plan);
+    m_active = plan;
+}
+
+void PlanEngine::GovernorDue(uint64_t nowMs)
+{
+    PlanId due;
+    if (m_governor.TakeDue(nowMs, due))
+        SwitchTo(due);
+    ArmGovernor(nowMs);
+}
+
+void PlanEngine::ClaimsExpire(uint64_t nowMs)
+{
+    if (m_policy.Expire(nowMs))
+        Apply(nowMs);
+    ArmExpiry(nowMs);
+}
+
+// Claims the plan for now and arms the single timer for the next transition
+void PlanEngine::ScheduleDue(uint64_t nowMs, int64_t wallMs)
+{
+    if (m_schedule.Empty())
+        return;
+    Claim(SOURCE_SCHEDULE, m_schedule.PlanAt(wallMs), nowMs);
+    const uint64_t delay = m_schedule.NextTransitionMs(wallMs);
+    m_scheduleDueWallMs = delay == PlanSchedule::kNever ? 0 : wallMs + (int64_t)delay;
+    m_host.ArmTimer(TIMER_SCHEDULE, delay == PlanSchedule::kNever ? kNever : delay);
+}
+
+void PlanEngine::ForegroundChanged(const wchar_t* imagePath, uint64_t nowMs)
+{
+    const AppRule* rule = imagePath ? m_appRules.Match(imagePath) : nullptr;
+    Claim(SOURCE_APP_RULE, rule ? rule->plan : PlanId{}, nowMs);
+}
+
+// A new process is matched once, by name; only matches are remembered
+void PlanEngine::ProcessStarted(uint32_t pid, uint64_t createTime, const wchar_t* image)
+{
+    const AppRule* rule = m_processTriggers.Match(image);
+    if (!rule)
+        return;
+    if (m_watchedCount == kMaxWatched)
+    {
+        ++m_watchedDropped;
+        return;
+    }
+    m_watched[m_watchedCount++] = { pid, createTime, (size_t)(rule - &m_processTriggers.At(0)) };
+}
+
+void PlanEngine::ProcessExited(uint32_t pid, uint64_t createTime)
+{
+    for (size_t i = 0; i < m_watchedCount; ++i)
+    {
+        if (m_watched[i].pid == pid && m_watched[i].createTime == createTime)
+        {
+            m_watched[i] = m_watched[--m_watchedCount];
+            return;
+        }
+    }
+}
+
+// Lowest rule index (first configured) wins when several are running
+void PlanEngine::ProcessesScanned(uint64_t nowMs)
+{
+    size_t best = SIZE_MAX;
+    for (size_t i = 0; i < m_watchedCount; ++i)
+        best = m_watched[i].rule < best ? m_watched[i].rule : best;
+    Claim(SOURCE_PROCESS, best == SIZE_MAX ? PlanId{} : m_processTriggers.At(best).plan, nowMs);
+}
+
+// One timer for the parked target, if any
+void PlanEngine::ArmGovernor(uint64_t nowMs)
+{
+    const uint64_t due = m_governor.NextDueMs();
+    m_host.ArmTimer(TIMER_GOVERNOR, due == SwitchGovernor::kNever ? kNever : due > nowMs ? due - nowMs : 0);
+}
+
+void PlanEngine::ArmExpiry(uint64_t nowMs)
+{
+    const uint64_t next = m_policy.NextExpiryMs();
+    m_host.ArmTimer(TIMER_EXPIRY, next == PolicyEngine::kNever ? kNever : next > nowMs ? next - nowMs : 0);
+}
+
+// ===== Power source and CPU load =====
+void PlanEngine::PowerSource(bool onBattery, uint64_t nowMs)
+{
+    m_onBattery = onBattery;
+    PowerChanged(nowMs);
+}
+
+void PlanEngine::BatteryPercent(uint32_t percent, uint64_t nowMs)
+{
+    m_batteryPercent = percent;
+    PowerChanged(nowMs);
+}
+
+void PlanEngine::EnergySaver(bool on, uint64_t nowMs)
+{
+    m_saverOn = on;
+    PowerChanged(nowMs);
+}
+
+// Battery percentage ticks down constantly; resubmitting the same claim is a no-op
+void PlanEngine::PowerChanged(uint64_t nowMs)
+{
+    Claim(SOURCE_POWER_SOURCE, m_powerMap.Want(m_onBattery, m_batteryPercent, m_saverOn), nowMs);
+}
+
+void PlanEngine::LoadSample(uint64_t nowMs, uint64_t idleTicks, uint64_t totalTicks)
+{
+    if (m_loadBoost.IsNull())
+        return;
+    if (m_load.Sample(nowMs, idleTicks, totalTicks))
+        Claim(SOURCE_LOAD, m_load.Boosted() ? m_loadBoost : PlanId{}, nowMs);
+    m_host.ArmTimer(TIMER_LOAD, m_load.NextIntervalMs());
+}
+
+// ===== AFK =====
+// Milliseconds until the plan should be restored ahead of the user, 0 if
+// now, or kNever without a confident prediction for the rest of today
+uint64_t PlanEngine::PredictDelayMs()
+{
+    if (!m_predictMarginMinutes || m_afk.Stage() < 0)
+        return kNever;
+    uint32_t weekday, minute, intoMinute;
+    m_host.LocalTime(weekday, minute, intoMinute);
+    const uint32_t minutes = m_predictor.MinutesToLikelyReturn(weekday, minute);
+    if (minutes == ReturnPredictor::kNone)
+        return kNever;
+    if (minutes <= m_predictMarginMinutes)
+        return 0;
+    const uint64_t ms = (minutes - m_predictMarginMinutes) * 60000ULL;
+    return ms > intoMinute ? ms - intoMinute : 0;
+}
+
+// The clock and idle readings for one step of the AFK machine
+AfkMachine::Input PlanEngine::AfkInput(uint64_t nowMs, uint64_t idleMs)
+{
+    AfkMachine::Input in;
+    in.nowMs = nowMs;
+    in.idleMs = m_ladder.Count() ? idleMs : 0;
+    in.predictDelayMs = PredictDelayMs();
+    in.predictWindowMs = (m_predictMarginMinutes + ReturnPredictor::kWindowBins * ReturnPredictor::kBinMinutes) * 60000ULL;
+    return in;
+}
+
+// True to hold a due stage off because the machine is busy on its own.
+// Re-samples at most once per window while holding.
+bool PlanEngine::VetoHolds(uint64_t nowMs)
+{
+    if (m_afk.VetoHeld() && nowMs - m_veto.LastSampleMs() < kVetoWindowMs)
+        return true;
+    ActivitySample sample;
+    m_host.CollectActivity(sample);
+    if (!m_veto.Sample(sample))
+        return true; // Only a baseline so far; judge after one window
+    return m_veto.Reasons() != 0;
+}
+
+AfkMachine::Output PlanEngine::AfkTick(uint64_t nowMs, uint64_t idleMs)
+{
+    AfkMachine::Input in = AfkInput(nowMs, idleMs);
+    // Input since the last tick: the baseline covers time the user was around for
+    if (m_afk.InputSince(in.idleMs))
+        m_veto.Reset();
+    if (m_veto.Enabled())
+    {
+        if (m_afk.WantsDeeper(in.idleMs))
+        {
+            in.vetoHolds = VetoHolds(nowMs);
+        }
+        else if (!m_veto.Primed() && m_ladder.UntilNextStageMs(in.idleMs) <= kVetoWindowMs)
+        {
+            // Baseline one window ahead so the deadline has a rate to judge by
+            ActivitySample sample;
+            m_host.CollectActivity(sample);
+            m_veto.Sample(sample);
+        }
+    }
+    const AfkMachine::Output out = m_afk.Step(in);
+    AfkCarryOut(out, nowMs);
+    AfkArm(in);
+    return out;
+}
+
+AfkMachine::Output PlanEngine::UserInput(uint64_t nowMs)
+{
+    // With no stage applied there is nothing to undo; the next tick sees the
+    // idle time drop, as it does for input the sink never reports
+    AfkMachine::Output out;
+    if (m_afk.Stage() >= 0)
+    {
+        m_veto.Reset();
+        out = m_afk.UserReturned(nowMs);
+        AfkCarryOut(out, nowMs);
+    }
+    AfkArm(AfkInput(nowMs, 0));
+    return out;
+}
+
+// Does what the machine decided; the policy engine restores what was in force
+// once the AFK claim is withdrawn
+void PlanEngine::AfkCarryOut(const AfkMachine::Output& out, uint64_t nowMs)
+{
+    if (out.returned && m_predictMarginMinutes)
+    {
+        uint32_t weekday, minute, intoMinute;
+        m_host.LocalTime(weekday, minute, intoMinute);
+        m_predictor.Observe(weekday, minute);
+        m_host.ReturnLearned(m_predictor);
+    }
+    if (out.action == AfkMachine::ACTION_APPLY)
+        Claim(SOURCE_AFK, m_ladder.At((size_t)m_afk.Stage()).plan, nowMs);
+    else if (out.action == AfkMachine::ACTION_RESTORE && out.returned)
+    {
+        // The user is back and waiting: not held back by the dwell since the stage
+        if (m_policy.Withdraw(SOURCE_AFK))
+            ApplyNow(nowMs);
+    }
+    else if (out.action == AfkMachine::ACTION_RESTORE)
+        Claim(SOURCE_AFK, PlanId{}, nowMs);
+    else if (m_afk.Stage() >= 0 && m_policy.Has(SOURCE_AFK) &&
+        m_policy.Claimed(SOURCE_AFK) != m_ladder.At((size_t)m_afk.Stage()).plan)
+    {
+        // The stage in force was given another plan: same stage to the machine
+        Claim(SOURCE_AFK, m_ladder.At((size_t)m_afk.Stage()).plan, nowMs);
+    }
+    // The sink is up for as long as a stage is applied and not a moment longer
+    const bool sink = m_afk.Stage() >= 0;
+    if (sink != m_sink && m_host.SetInputSink(sink))
+        m_sink = sink;
+}
+
+// A single timer: when the machine next needs a step (a window early for the
+// veto baseline). The user's return comes from the input sink; only if that
+// could not be set up does an applied stage fall back to a 1 s watch.
+void PlanEngine::AfkArm(const AfkMachine::Input& in)
+{
+    if (m_ladder.Count() == 0)
+    {
+        m_host.ArmTimer(TIMER_AFK, kNever);
+        return;
+    }
+    uint64_t delay = m_afk.NextStepMs(in);
+    if (m_afk.VetoHeld())
+        delay = kVetoWindowMs; // Judge the held stage again
+    else if (m_veto.Enabled() && !m_veto.Primed() && delay != kNever && delay > kVetoWindowMs)
+        delay -= kVetoWindowMs;
+    if (m_afk.Stage() >= 0 && !m_sink && delay > 1000)
+        delay = 1000;
+    m_host.ArmTimer(TIMER_AFK, delay);
+}
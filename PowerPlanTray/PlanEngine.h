@@ -0,0 +1,179 @@
+// PlanEngine.h: Plan, AFK, trigger and power-source state for one session, driven by explicit events.
+
+#pragma once
+
+#include "ActivityVeto.h"
+#include "AfkLadder.h"
+#include "AfkMachine.h"
+#include "AppRules.h"
+#include "LoadSwitcher.h"
+#include "PlanSchedule.h"
+#include "PolicyEngine.h"
+#include "PolicySources.h"
+#include "ReturnPredictor.h"
+#include "SwitchGovernor.h"
+
+#include <stdint.h>
+
+// Everything that decides which plan is in force: the claims of every source,
+// the switch governor, the AFK stages with their veto and return prediction,
+// the CPU-load boost, the power-source mapping, the foreground-app rules, the
+// process triggers and the weekly schedule. Each event carries its own
+// time, and the engine reaches the system only through its Host, so it keeps
+// no state outside the instance. Engines on different threads (a simulator
+// sweep, one per session) never share anything; a single engine is driven
+// from one thread at a time.
+class PlanEngine
+{
+public:
+    static const uint64_t kNever = UINT64_MAX;
+    static const uint64_t kVetoWindowMs = 10000; // AFK veto rates are measured over this stretch
+
+    // One-shot timers; when one fires the host calls the event named here
+    enum Timer
+    {
+        TIMER_AFK,      // AfkTick
+        TIMER_LOAD,     // LoadSample
+        TIMER_GOVERNOR, // GovernorDue
+        TIMER_EXPIRY,   // ClaimsExpire
+        TIMER_SCHEDULE, // ScheduleDue
+        TIMER_COUNT
+    };
+
+    // What the engine needs from its surroundings
+    class Host
+    {
+    public:
+        virtual ~Host() {}
+        // The plan actually in force, when it can be read
+        virtual bool ReadActivePlan(PlanId& out) = 0;
+        virtual void ApplyPlan(const PlanId& plan) = 0;
+        // Replaces any earlier arming of the same timer; kNever cancels it
+        virtual void ArmTimer(Timer timer, uint64_t delayMs) = 0;
+        // Running totals for the AFK veto, stamped with the host's clock
+        virtual void CollectActivity(ActivitySample& out) = 0;
+        // Deliver input as UserInput while on; false if that is not possible
+        virtual bool SetInputSink(bool on) = 0;
+        // Weekday (0 = Sunday), minute of the day and ms into the minute, local time
+        virtual void LocalTime(uint32_t& weekday, uint32_t& minute, uint32_t& msIntoMinute) = 0;
+        // The return model learned a return; a host may persist it
+        virtual void ReturnLearned(const ReturnPredictor& /*model*/) {}
+    };
+
+    explicit PlanEngine(Host& host) : m_host(host), m_afk(m_ladder) {}
+    PlanEngine(const PlanEngine&) = delete; // m_afk refers to m_ladder
+    PlanEngine& operator=(const PlanEngine&) = delete;
+
+    // ----- Settings -----
+    AfkLadder& Ladder() { return m_ladder; } // Call AfkTick after editing
+    void SetVetoConfig(const ActivityVeto::Config& config) { m_veto.SetConfig(config); }
+    void SetPrediction(uint32_t marginMinutes, const ReturnPredictor::Config& config);
+    ReturnPredictor& Predictor() { return m_predictor; }
+    void SetGovernorConfig(const SwitchGovernor::Config& config) { m_governor.SetConfig(config); }
+    // A null plan turns the boost off
+    void SetLoadBoost(const PlanId& plan, const LoadSwitcher::Config& config);
+    void SetPowerSourceMap(const PowerSourceMap& map) { m_powerMap = map; }
+    void SetManualHoldMinutes(uint32_t minutes) { m_manualHoldMinutes = minutes; }
+    PlanSchedule& Schedule() { return m_schedule; } // Call ScheduleDue after editing
+    AppRuleTable& AppRules() { return m_appRules; } // Takes effect on the next foreground change
+    // Takes effect for processes that start from now on
+    AppRuleTable& ProcessTriggers() { return m_processTriggers; }
+
+    // ----- Events -----
+    // The plan found in force at startup; automation returns to it
+    void Start(const PlanId& active, uint64_t nowMs);
+    // A menu pick: applied at once and never held back
+    void PlanPicked(const PlanId& plan, uint64_t nowMs);
+    // The plan in force was changed by someone else; true if it is news
+    bool PlanChanged(const PlanId& plan, uint64_t nowMs);
+    // A source's claim, or its withdrawal for a null plan; lifetimeMs 0 = until withdrawn
+    void Claim(PolicySource source, const PlanId& plan, uint64_t nowMs, uint64_t lifetimeMs = 0);
+    void PowerSource(bool onBattery, uint64_t nowMs);
+    void BatteryPercent(uint32_t percent, uint64_t nowMs);
+    void EnergySaver(bool on, uint64_t nowMs);
+    // Cumulative CPU counters, any tick unit
+    void LoadSample(uint64_t nowMs, uint64_t idleTicks, uint64_t totalTicks);
+    AfkMachine::Output AfkTick(uint64_t nowMs, uint64_t idleMs);
+    // Input seen directly: through the host's sink, or a recorded trace
+    AfkMachine::Output UserInput(uint64_t nowMs);
+    void GovernorDue(uint64_t nowMs);
+    void ClaimsExpire(uint64_t nowMs);
+    // The schedule's plan at wallMs (Unix epoch), also after clock changes and resume
+    void ScheduleDue(uint64_t nowMs, int64_t wallMs);
+    // The foreground process's image path; null when it could not be read
+    void ForegroundChanged(const wchar_t* imagePath, uint64_t nowMs);
+    // A process scan: what started and exited since the last one (a process
+    // is its PID and creation time), then the claim for what is running
+    void ProcessStarted(uint32_t pid, uint64_t createTime, const wchar_t* image);
+    void ProcessExited(uint32_t pid, uint64_t createTime);
+    void ProcessesScanned(uint64_t nowMs);
+
+    // ----- State -----
+    const PlanId& Active() const { return m_active; } // Last plan known to be in force
+    const AfkLadder& Ladder() const { return m_ladder; }
+    const AfkMachine& Afk() const { return m_afk; }
+    const ActivityVeto& Veto() const { return m_veto; }
+    const ReturnPredictor& Predictor() const { return m_predictor; }
+    uint32_t PredictMarginMinutes() const { return m_predictMarginMinutes; }
+    const PolicyEngine& Policy() const { return m_policy; }
+    const SwitchGovernor& Governor() const { return m_governor; }
+    const LoadSwitcher& Load() const { return m_load; }
+    const PlanId& LoadBoostPlan() const { return m_loadBoost; }
+    bool InputSink() const { return m_sink; }
+    const PlanSchedule& Schedule() const { return m_schedule; }
+    int64_t ScheduleDueWallMs() const { return m_scheduleDueWallMs; } // 0 if no transition is armed
+    const AppRuleTable& ProcessTriggers() const { return m_processTriggers; }
+    size_t WatchedProcesses() const { return m_watchedCount; }
+    uint32_t WatchedDropped() const { return m_watchedDropped; } // Matches not watched: the table was full
+
+private:
+    void Apply(uint64_t nowMs);
+    void ApplyNow(uint64_t nowMs);
+    void SwitchTo(const PlanId& plan);
+    void ArmGovernor(uint64_t nowMs);
+    void ArmExpiry(uint64_t nowMs);
+    void PowerChanged(uint64_t nowMs);
+    AfkMachine::Input AfkInput(uint64_t nowMs, uint64_t idleMs);
+    uint64_t PredictDelayMs();
+    bool VetoHolds(uint64_t nowMs);
+    void AfkCarryOut(const AfkMachine::Output& out, uint64_t nowMs);
+    void AfkArm(const AfkMachine::Input& in);
+
+    Host& m_host;
+    PlanId m_active{};
+
+    PolicyEngine m_policy;
+    SwitchGovernor m_governor;
+    uint32_t m_manualHoldMinutes = 0; // 0 = menu choices do not hold off automation
+
+    AfkLadder m_ladder; // No stages = AFK off
+    AfkMachine m_afk;
+    ActivityVeto m_veto;
+    ReturnPredictor m_predictor;
+    uint32_t m_predictMarginMinutes = 0; // 0 = prediction off
+    bool m_sink = false;
+
+    LoadSwitcher m_load;
+    PlanId m_loadBoost{};
+
+    PowerSourceMap m_powerMap;
+    bool m_onBattery = false;
+    uint32_t m_batteryPercent = 100;
+    bool m_saverOn = false;
+
+    PlanSchedule m_schedule;
+    int64_t m_scheduleDueWallMs = 0;
+    AppRuleTable m_appRules;
+    AppRuleTable m_processTriggers;
+    // Running processes that matched a trigger, with the rule they matched
+    static const size_t kMaxWatched = 64;
+    struct WatchedProcess
+    {
+        uint32_t pid;
+        uint64_t createTime;
+        size_t rule;
+    };
+    WatchedProcess m_watched[kMaxWatched];
+    size_t m_watchedCount = 0;
+    uint32_t m_watchedDropped = 0;
+};
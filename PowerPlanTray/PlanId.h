@@ -0,0 +1,22 @@
+// PlanId.h: Platform-neutral 16-byte power plan identifier.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Same size and layout as a Win32 GUID so the Win32 layer can memcpy between
+// the two, while the policy code stays free of <windows.h>.
+struct PlanId
+{
+    uint8_t bytes[16];
+
+    bool IsNull() const
+    {
+        for (uint8_t b : bytes)
+            if (b) return false;
+        return true;
+    }
+    bool operator==(const PlanId& o) const { return memcmp(bytes, o.bytes, sizeof(bytes)) == 0; }
+    bool operator!=(const PlanId& o) const { return !(*this == o); }
+};
@@ -0,0 +1,242 @@
+// PlanSchedule.cpp: Weekday / time-of-day plan schedule with precomputed transitions.
+
+#include "PlanSchedule.h"
+
+#include <time.h>
+#include <wctype.h>
+
+static const uint32_t kDay = 24 * 60;
+static const uint32_t kWeek = 7 * kDay;
+
+static bool ToLocal(int64_t sec, struct tm& out)
+{
+    const time_t t = (time_t)sec;
+#ifdef _WIN32
+    return localtime_s(&out, &t) == 0;
+#else
+    return localtime_r(&t, &out) != nullptr;
+#endif
+}
+
+static uint32_t MinuteOfWeek(const struct tm& t)
+{
+    return (uint32_t)t.tm_wday * kDay + (uint32_t)t.tm_hour * 60 + (uint32_t)t.tm_min;
+}
+
+static uint32_t WindowLength(const ScheduleRule& r)
+{
+    if (r.endMinute > r.startMinute) return r.endMinute - r.startMinute;
+    return r.endMinute + kDay - r.startMinute; // Past midnight, or the whole day
+}
+
+void PlanSchedule::Clear()
+{
+    m_count = 0;
+    m_default = PlanId{};
+    m_boundaryCount = 0;
+}
+
+bool PlanSchedule::Add(const ScheduleRule& rule)
+{
+    if (m_count >= kMaxRules || (rule.days & 0x7F) == 0 || rule.startMinute >= kDay || rule.endMinute >= kDay)
+        return false;
+    m_rules[m_count++] = rule;
+
+    const uint32_t len = WindowLength(rule);
+    for (uint32_t d = 0; d < 7; ++d)
+    {
+        if (!(rule.days & (1u << d)))
+            continue;
+        const uint32_t open = d * kDay + rule.startMinute;
+        const uint16_t edges[2] = { (uint16_t)open, (uint16_t)((open + len) % kWeek) };
+        for (uint16_t e : edges)
+        {
+            // Sorted insert; the table is built once, so a linear shift is fine
+            size_t i = 0;
+            while (i < m_boundaryCount && m_boundaries[i] < e) ++i;
+            if (i < m_boundaryCount && m_boundaries[i] == e)
+                continue;
+            for (size_t j = m_boundaryCount; j > i; --j) m_boundaries[j] = m_boundaries[j - 1];
+            m_boundaries[i] = e;
+            ++m_boundaryCount;
+        }
+    }
+    return true;
+}
+
+PlanId PlanSchedule::PlanAtMinute(uint32_t minuteOfWeek) const
+{
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        const ScheduleRule& r = m_rules[i];
+        const uint32_t len = WindowLength(r);
+        for (uint32_t d = 0; d < 7; ++d)
+        {
+            if ((r.days & (1u << d)) && (minuteOfWeek + kWeek - (d * kDay + r.startMinute)) % kWeek < len)
+                return r.plan;
+        }
+    }
+    return m_default;
+}
+
+PlanId PlanSchedule::PlanAt(int64_t nowMs) const
+{
+    struct tm now;
+    if (!ToLocal(nowMs / 1000, now))
+        return m_default;
+    return PlanAtMinute(MinuteOfWeek(now));
+}
+
+// First second in (lo, hi] whose DST flag differs from lo's, or 0 if the flag
+// is the same at both ends. Offsets change on whole seconds, so this is exact.
+static int64_t NextDstShift(int64_t lo, int64_t hi, int isdst)
+{
+    struct tm t;
+    if (!ToLocal(hi, t) || t.tm_isdst == isdst)
+        return 0;
+    while (hi - lo > 1)
+    {
+        const int64_t mid = lo + (hi - lo) / 2;
+        if (!ToLocal(mid, t))
+            return 0;
+        if (t.tm_isdst == isdst) lo = mid; else hi = mid;
+    }
+    return hi;
+}
+
+uint64_t PlanSchedule::NextTransitionMs(int64_t nowMs) const
+{
+    if (m_boundaryCount == 0)
+        return kNever;
+    const int64_t nowSec = nowMs / 1000;
+    struct tm now;
+    if (!ToLocal(nowSec, now))
+        return kNever;
+
+    // Walk the boundaries after now, skipping those where the winner stays the same
+    const uint32_t mow = MinuteOfWeek(now);
+    const PlanId current = PlanAtMinute(mow);
+    size_t first = 0;
+    while (first < m_boundaryCount && m_boundaries[first] <= mow) ++first;
+    uint32_t ahead = 0;
+    for (size_t k = 0; k < m_boundaryCount; ++k)
+    {
+        const uint32_t b = m_boundaries[(first + k) % m_boundaryCount];
+        if (PlanAtMinute(b) != current)
+        {
+            ahead = (b + kWeek - mow) % kWeek;
+            if (ahead == 0) ahead = kWeek;
+            break;
+        }
+    }
+    if (ahead == 0)
+        return kNever;
+
+    // Between DST shifts local time runs in step with UTC, so the target is a
+    // plain offset from the start of this minute. If a shift comes first, wake
+    // there instead and re-read the wall clock.
+    int64_t targetSec = nowSec - now.tm_sec + (int64_t)ahead * 60;
+    if (const int64_t shift = NextDstShift(nowSec, targetSec, now.tm_isdst))
+        targetSec = shift;
+    const int64_t delay = targetSec * 1000 - nowMs;
+    return delay > 0 ? (uint64_t)delay : 1;
+}
+
+// ----- Parsing -----
+
+static const wchar_t* SkipSpace(const wchar_t* p)
+{
+    while (*p == L' ' || *p == L'\t') ++p;
+    return p;
+}
+
+static wchar_t Lower(wchar_t c)
+{
+    return (wchar_t)towlower(c);
+}
+
+static bool ParseDay(const wchar_t*& p, int& day)
+{
+    static const wchar_t* kNames[7] = { L"sun", L"mon", L"tue", L"wed", L"thu", L"fri", L"sat" };
+    for (int d = 0; d < 7; ++d)
+    {
+        int i = 0;
+        while (i < 3 && Lower(p[i]) == kNames[d][i]) ++i;
+        if (i == 3)
+        {
+            p += 3;
+            day = d;
+            return true;
+        }
+    }
+    return false;
+}
+
+// "H:MM" or "HH:MM"; 24:00 only where allowEndOfDay
+static bool ParseTime(const wchar_t*& p, bool allowEndOfDay, uint16_t& minute)
+{
+    int h = 0, digits = 0;
+    while (*p >= L'0' && *p <= L'9' && digits < 2) { h = h * 10 + (*p++ - L'0'); ++digits; }
+    if (digits == 0 || *p++ != L':')
+        return false;
+    if (!(p[0] >= L'0' && p[0] <= L'5' && p[1] >= L'0' && p[1] <= L'9'))
+        return false;
+    const int m = (p[0] - L'0') * 10 + (p[1] - L'0');
+    p += 2;
+    if (h == 24 && m == 0 && allowEndOfDay) { minute = 0; return true; }
+    if (h > 23)
+        return false;
+    minute = (uint16_t)(h * 60 + m);
+    return true;
+}
+
+bool PlanSchedule::Parse(const wchar_t* text, ScheduleRule& out)
+{
+    const wchar_t* p = SkipSpace(text);
+    uint8_t days = 0;
+    if (Lower(p[0]) == L'd' && Lower(p[1]) == L'a' && Lower(p[2]) == L'i' &&
+        Lower(p[3]) == L'l' && Lower(p[4]) == L'y')
+    {
+        days = 0x7F;
+        p += 5;
+    }
+    else
+    {
+        for (;;)
+        {
+            int from = 0, to = 0;
+            if (!ParseDay(p, from))
+                return false;
+            to = from;
+            if (*p == L'-')
+            {
+                ++p;
+                if (!ParseDay(p, to))
+                    return false;
+            }
+            // "Fri-Mon" wraps through the weekend
+            for (int d = from;; d = (d + 1) % 7)
+            {
+                days |= (uint8_t)(1u << d);
+                if (d == to) break;
+            }
+            if (*p != L',')
+                break;
+            ++p;
+        }
+    }
+
+    if (*p != L' ' && *p != L'\t')
+        return false;
+    p = SkipSpace(p);
+    uint16_t start = 0, end = 0;
+    if (!ParseTime(p, false, start) || *p++ != L'-' || !ParseTime(p, true, end))
+        return false;
+    if (*SkipSpace(p) != L'\0')
+        return false;
+
+    out.days = days;
+    out.startMinute = start;
+    out.endMinute = end;
+    return true;
+}
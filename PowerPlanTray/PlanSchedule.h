@@ -0,0 +1,60 @@
+// PlanSchedule.h: Weekday / time-of-day plan schedule with precomputed transitions.
+
+#pragma once
+
+#include "PlanId.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One weekly window. Bit 0 of days is Sunday through bit 6 = Saturday, as in
+// struct tm's tm_wday. A window whose end is not after its start runs past
+// midnight into the next day; equal start and end cover the whole day.
+struct ScheduleRule
+{
+    uint8_t days;
+    uint16_t startMinute; // Minutes after local midnight, 0..1439
+    uint16_t endMinute;
+    PlanId plan;
+};
+
+// Rules are matched in the order they were added: the first window holding the
+// current local time wins, otherwise the default plan (possibly null) applies.
+// Times are Unix epoch milliseconds; local time and DST come from the C runtime,
+// and the caller is expected to re-evaluate after clock changes and resume.
+class PlanSchedule
+{
+public:
+    static const size_t kMaxRules = 32;
+    static const uint64_t kNever = UINT64_MAX;
+
+    PlanSchedule() { Clear(); }
+
+    void Clear();
+    // Returns false when full or when the rule has no days
+    bool Add(const ScheduleRule& rule);
+    void SetDefault(const PlanId& plan) { m_default = plan; }
+
+    size_t Count() const { return m_count; }
+    bool Empty() const { return m_count == 0 && m_default.IsNull(); }
+
+    // Plan in force at nowMs; null if neither a rule nor a default applies
+    PlanId PlanAt(int64_t nowMs) const;
+    // Delay from nowMs until PlanAt can next change, or kNever. Never runs past
+    // a DST shift, so wall-clock windows inside a repeated hour are honoured.
+    uint64_t NextTransitionMs(int64_t nowMs) const;
+
+    // "Mon-Fri 08:00-18:30", "Sat,Sun 10:00-14:00", "Daily 22:00-06:00".
+    // Fills days and times only; the caller supplies the plan.
+    static bool Parse(const wchar_t* text, ScheduleRule& out);
+
+private:
+    PlanId PlanAtMinute(uint32_t minuteOfWeek) const;
+
+    ScheduleRule m_rules[kMaxRules];
+    size_t m_count;
+    PlanId m_default;
+    // Minutes of the week at which some window opens or closes, sorted, unique
+    uint16_t m_boundaries[kMaxRules * 14];
+    size_t m_boundaryCount;
+};
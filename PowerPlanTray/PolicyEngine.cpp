@@ -0,0 +1,103 @@
+// PolicyEngine.cpp: Priority arbitration between sources that want a power plan.
+
+#include "PolicyEngine.h"
+
+void PolicyEngine::Clear()
+{
+    m_active = 0;
+    m_expiring = 0;
+    m_winner = -1;
+    m_rescans = 0;
+}
+
+bool PolicyEngine::Beats(int a, int b) const
+{
+    if (m_claims[a].priority != m_claims[b].priority)
+        return m_claims[a].priority > m_claims[b].priority;
+    return a < b;
+}
+
+void PolicyEngine::Rescan()
+{
+    ++m_rescans;
+    m_winner = -1;
+    for (uint32_t bits = m_active; bits; bits &= bits - 1)
+    {
+        int s = 0;
+        while (!((bits >> s) & 1u)) ++s;
+        if (m_winner < 0 || Beats(s, m_winner))
+            m_winner = s;
+    }
+}
+
+bool PolicyEngine::Submit(int source, const PlanId& plan, int priority, uint64_t nowMs, uint64_t lifetimeMs)
+{
+    if (source < 0 || source >= kMaxSources)
+        return false;
+    const PlanId before = Effective();
+    const uint32_t bit = 1u << source;
+    const bool weakened = Has(source) && priority < m_claims[source].priority;
+
+    Claim& c = m_claims[source];
+    c.plan = plan;
+    c.priority = priority;
+    c.expiresMs = lifetimeMs ? nowMs + lifetimeMs : kNever;
+    m_active |= bit;
+    if (lifetimeMs) m_expiring |= bit; else m_expiring &= ~bit;
+
+    if (m_winner < 0 || (m_winner != source && Beats(source, m_winner)))
+        m_winner = source;
+    else if (m_winner == source && weakened)
+        Rescan(); // Someone else may outrank the winner now
+    return Effective() != before;
+}
+
+bool PolicyEngine::Withdraw(int source)
+{
+    if (source < 0 || source >= kMaxSources || !Has(source))
+        return false;
+    const PlanId before = Effective();
+    m_active &= ~(1u << source);
+    m_expiring &= ~(1u << source);
+    if (m_winner == source)
+        Rescan();
+    return Effective() != before;
+}
+
+bool PolicyEngine::Expire(uint64_t nowMs)
+{
+    const PlanId before = Effective();
+    bool winnerGone = false;
+    for (uint32_t bits = m_expiring; bits; bits &= bits - 1)
+    {
+        int s = 0;
+        while (!((bits >> s) & 1u)) ++s;
+        if (m_claims[s].expiresMs <= nowMs)
+        {
+            m_active &= ~(1u << s);
+            m_expiring &= ~(1u << s);
+            winnerGone |= s == m_winner;
+        }
+    }
+    if (winnerGone)
+        Rescan();
+    return Effective() != before;
+}
+
+int PolicyEngine::ClaimCount() const
+{
+    int n = 0;
+    for (uint32_t bits = m_active; bits; bits &= bits - 1) ++n;
+    return n;
+}
+
+uint64_t PolicyEngine::NextExpiryMs() const
+{
+    uint64_t next = kNever;
+    for (int s = 0; s < kMaxSources; ++s)
+    {
+        if (((m_expiring >> s) & 1u) && m_claims[s].expiresMs < next)
+            next = m_claims[s].expiresMs;
+    }
+    return next;
+}
@@ -0,0 +1,59 @@
+// PolicyEngine.h: Priority arbitration between sources that want a power plan.
+
+#pragma once
+
+#include "PlanId.h"
+
+#include <stdint.h>
+
+// Each source (menu choice, AFK, app rules, ...) holds at most one claim: a
+// plan, a priority and an optional lifetime. The effective plan is the claim
+// with the highest priority; ties go to the lower source index, so the result
+// depends only on the current claims and never on the order they arrived in.
+//
+// The winner is cached. A submission only has to be compared against it, and
+// the active set is rescanned only when the winner itself leaves or weakens.
+class PolicyEngine
+{
+public:
+    static const int kMaxSources = 16;
+    static const uint64_t kNever = UINT64_MAX;
+
+    PolicyEngine() { Clear(); }
+
+    void Clear();
+    // lifetimeMs 0 = until withdrawn. Returns true when Effective() changed.
+    bool Submit(int source, const PlanId& plan, int priority, uint64_t nowMs, uint64_t lifetimeMs);
+    bool Withdraw(int source);
+    // Drops claims whose lifetime has run out; true when Effective() changed
+    bool Expire(uint64_t nowMs);
+
+    bool Has(int source) const { return (m_active >> source) & 1u; }
+    // The plan a source claims, null when it holds no claim
+    PlanId Claimed(int source) const { return Has(source) ? m_claims[source].plan : PlanId{}; }
+    // Null when no source holds a claim
+    PlanId Effective() const { return m_winner < 0 ? PlanId{} : m_claims[m_winner].plan; }
+    int Winner() const { return m_winner; } // -1 if none
+    int ClaimCount() const;
+    // Earliest expiry among claims with a lifetime, or kNever
+    uint64_t NextExpiryMs() const;
+    // Full rescans of the active set, for diagnostics
+    uint32_t Rescans() const { return m_rescans; }
+
+private:
+    struct Claim
+    {
+        PlanId plan;
+        int priority;
+        uint64_t expiresMs;
+    };
+
+    bool Beats(int a, int b) const;
+    void Rescan();
+
+    Claim m_claims[kMaxSources];
+    uint32_t m_active;   // Bit per source holding a claim
+    uint32_t m_expiring; // Subset of m_active with a lifetime
+    int m_winner;
+    uint32_t m_rescans;
+};
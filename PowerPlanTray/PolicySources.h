@@ -0,0 +1,44 @@
+// PolicySources.h: The sources that claim a power plan, and what each one asks for.
+
+#pragma once
+
+#include "PlanId.h"
+
+#include <stdint.h>
+
+// Every source that wants a plan holds one claim in the policy engine
+enum PolicySource
+{
+    SOURCE_AFK,          // Away from keyboard
+    SOURCE_MANUAL_HOLD,  // Menu choice held against automation for ManualHoldMinutes
+    SOURCE_APP_RULE,     // Foreground application rule
+    SOURCE_PROCESS,      // Process-presence trigger
+    SOURCE_LOAD,         // CPU-load boost
+    SOURCE_POWER_SOURCE, // AC/DC, battery, energy saver mapping
+    SOURCE_SCHEDULE,     // Weekday / time-of-day schedule
+    SOURCE_MANUAL,       // Last plan chosen by the user; what everything falls back to
+    SOURCE_COUNT
+};
+
+// Higher wins. AFK outranks everything: nobody is there to notice the others.
+const int kSourcePriority[SOURCE_COUNT] = { 70, 60, 50, 40, 30, 20, 10, 0 };
+
+// Power state to plan; a null member leaves that state unmapped
+struct PowerSourceMap
+{
+    PlanId onAc{};
+    PlanId onDc{};
+    PlanId lowBattery{};
+    PlanId energySaver{};
+    uint32_t lowBatteryPercent = 20;
+
+    // Energy saver first, then a low battery, then plain AC or DC; null for none
+    PlanId Want(bool onBattery, uint32_t batteryPercent, bool saverOn) const
+    {
+        if (saverOn && !energySaver.IsNull())
+            return energySaver;
+        if (onBattery && batteryPercent <= lowBatteryPercent && !lowBattery.IsNull())
+            return lowBattery;
+        return onBattery ? onDc : onAc;
+    }
+};
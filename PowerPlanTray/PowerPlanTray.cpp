@@ -5,56 +5,182 @@
 
 #include <shellapi.h>
 #include <strsafe.h>
-#include <vector>
 #include <string>
+#include <time.h>
+#include <vector>
 
 #include <powrprof.h>
 #pragma comment(lib, "PowrProf.lib")
+#include <psapi.h>
+#pragma comment(lib, "Psapi.lib")
+// Only touched when an AFK stage is due; delay-loaded (see the project file)
+#include <pdh.h>
+#pragma comment(lib, "Pdh.lib")
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <iphlpapi.h>
+#pragma comment(lib, "Iphlpapi.lib")
+
+#include "AllocGuard.h"
+#include "AppRules.h"
+#include "CliCommand.h"
+#include "IpcServer.h"
+#include "ProcessSetDiff.h"
+#include "LatencyHistogram.h"
+#include "PlanCache.h"
+#include "PlanEngine.h"
+#include "PlanSchedule.h"
+#include "StatusBlock.h"
 
 #define WM_TRAYICON (WM_APP + 1)
+#define WM_APP_STARTUP (WM_APP + 2) // wParam = next StartupStage
+#define WM_APP_IPC (WM_APP + 3)     // An IPC client queued a switch
 #define TRAY_ID 1
 #define ID_BASE_PLAN 10000
 #define IDM_STARTUP 40001
 #define IDM_REFRESH 40002
+#define IDM_DIAGNOSTICS 40003
 // AFK feature command IDs
 #define IDM_AFK_OFF           40100
-#define IDM_AFK_INTERVAL_BASE 40200 // 6 entries: 5,10,15,30,45,60
-#define IDM_AFK_TARGET_BASE   40300 // dynamic per plan list
+#define IDM_AFK_ADD_BASE      40110 // + index into kAfkIntervals
+#define IDM_AFK_STAGE_BASE    41000 // + stage * IDM_AFK_STAGE_STRIDE + item below
+#define IDM_AFK_STAGE_STRIDE  100
+#define AFK_STAGE_REMOVE      10    // Items 0..9 pick a timeout, 20.. a plan
+#define AFK_STAGE_PLAN        20
 // Timer events
 #define TIMER_EVENT_POLL_ACTIVE 1
 #define TIMER_EVENT_AFK_CHECK 2
+#define TIMER_EVENT_IDLE_TRIM 3
+#define TIMER_EVENT_PROCESS_SCAN 4
+#define TIMER_EVENT_LOAD_SAMPLE 5
+#define TIMER_EVENT_SCHEDULE 6
+#define TIMER_EVENT_POLICY_EXPIRY 7
+#define TIMER_EVENT_GOVERNOR 8
+#define TIMER_EVENT_PLAN_CACHE 9
+
+// Deferred startup work, run one stage per posted message after the icon is shown
+enum StartupStage
+{
+    STARTUP_ACTIVE_PLAN,   // Tooltip from live plan list, last known scheme
+    STARTUP_NOTIFICATIONS, // Power setting notification and poll timer
+    STARTUP_AFK,           // AFK settings and checker timer
+    STARTUP_APP_RULES,     // Foreground application rules and hook
+    STARTUP_PROCESS_WATCH, // Process-presence triggers and scan timer
+    STARTUP_LOAD_WATCH,    // CPU-load boost settings and sampling timer
+    STARTUP_POWER_SOURCE,  // AC/DC, battery and energy saver subscriptions
+    STARTUP_SCHEDULE,      // Weekday / time-of-day schedule and its timer
+    STARTUP_IPC,           // Local IPC endpoint and its I/O thread
+    STARTUP_STATUS_BLOCK,  // Shared-memory status record for polling readers
+    STARTUP_DONE
+};
 
 HINSTANCE g_hInst = nullptr;
 HWND g_hWnd = nullptr;
 UINT g_uTaskbarCreated = 0;
 HPOWERNOTIFY g_hPowerNotify = nullptr;
-GUID g_lastActiveGuid{};
 HICON g_hTrayIcon = nullptr;
 HANDLE g_hInstanceMutex = nullptr;
-// AFK feature globals
-int g_afkTimeoutMinutes = 0; // 0 = Off
-GUID g_afkTargetGuid{};      // Target plan when AFK
-GUID g_afkPrevGuid{};        // Plan before AFK switch
-bool g_afkApplied = false;   // Whether AFK plan is currently applied
-
-struct PlanItem {
-    GUID guid;
-    std::wstring name;
+// Plan, AFK, CPU-load, power-source, rule, trigger and schedule state lives in
+// the engine; this window is its host and turns messages into engine events
+class TrayEngineHost : public PlanEngine::Host
+{
+public:
+    bool ReadActivePlan(PlanId& out) override;
+    void ApplyPlan(const PlanId& plan) override;
+    void ArmTimer(PlanEngine::Timer timer, uint64_t delayMs) override;
+    void CollectActivity(ActivitySample& out) override;
+    bool SetInputSink(bool on) override;
+    void LocalTime(uint32_t& weekday, uint32_t& minute, uint32_t& msIntoMinute) override;
+    void ReturnLearned(const ReturnPredictor& model) override;
+};
+TrayEngineHost g_engineHost;
+PlanEngine g_engine(g_engineHost);
+// AFK activity vetoes: disk counter opened the first time a stage is due
+PDH_HQUERY g_hDiskQuery = nullptr;
+PDH_HCOUNTER g_hDiskCounter = nullptr;
+static const int kAfkIntervals[8] = { 1, 5, 10, 15, 20, 30, 45, 60 }; // Minutes offered in the menu
+static const UINT kAfkIntervalStrings[8] = {
+    IDS_MENU_AFK_1MIN,
+    IDS_MENU_AFK_5MIN,
+    IDS_MENU_AFK_10MIN,
+    IDS_MENU_AFK_15MIN,
+    IDS_MENU_AFK_20MIN,
+    IDS_MENU_AFK_30MIN,
+    IDS_MENU_AFK_45MIN,
+    IDS_MENU_AFK_60MIN
 };
+// Foreground application rules
+HWINEVENTHOOK g_hForegroundHook = nullptr;
+DWORD g_ruleLastPid = 0;     // Foreground process last evaluated
+// Process-presence triggers: the scan's previous snapshot
+ProcessSetDiff g_processDiff;
+// Power-source triggers (all event-driven through WM_POWERBROADCAST)
+HPOWERNOTIFY g_hPowerSourceNotify[3] = {};
+// Latency tracking for user-visible paths (microseconds)
+enum LatencyPath
+{
+    LAT_MENU_OPEN,       // Right-click to menu shown
+    LAT_PLAN_CLICK,      // Menu click to the plan applied and shown
+    LAT_EXTERNAL_CHANGE, // External plan change to tooltip updated
+    LAT_AFK_APPLY,       // Idle threshold crossed to AFK plan applied
+    LAT_AFK_RESTORE,     // First input after AFK to the previous plan restored
+    LAT_MENU_AFTER_TRIM, // Right-click to menu shown, first open after a trim
+    LAT_PROCESS_SCAN,    // One incremental process-presence scan
+    LAT_COUNT
+};
+LatencyHistogram g_latency[LAT_COUNT];
+ULONGLONG g_menuOpenStartUs = 0; // Set on right-click, consumed on WM_INITMENUPOPUP
+// Startup timing (microseconds since wWinMain entry)
+ULONGLONG g_startUs = 0;
+ULONGLONG g_timeToIconUs = 0;
+ULONGLONG g_timeToReadyUs = 0;
+ULONGLONG g_timeToTooltipUs = 0; // Until the tooltip first names a plan
+// Idle footprint mode: trim the working set once quiet after menu use
+DWORD g_idleTrimSeconds = 60; // 0 = Off
+bool g_trimmed = false;       // Trimmed since the last menu open
+UINT g_trimCount = 0;
+SIZE_T g_trimRssBefore = 0;
+SIZE_T g_trimRssAfter = 0;
+// Tooltip currently shown
+wchar_t g_trayTip[sizeof(NOTIFYICONDATA::szTip) / sizeof(wchar_t)] = {};
+// Plan list rendered by the tooltip and menu; seeded from the on-disk cache
+PlanList g_plans;
+static_assert(kPlanNameMax == sizeof(NOTIFYICONDATA::szTip) / sizeof(wchar_t), "plan names are sized to the tooltip");
+GUID g_cachedActiveGuid{};   // Active plan as last written to the cache
+GUID g_cachedPreviousGuid{}; // The one active before it, for --toggle
+bool g_planCacheHit = false; // Whether startup rendered from the cache
+bool g_planCacheDirty = false; // A cache write is waiting on TIMER_EVENT_PLAN_CACHE
+static const UINT kPlanCacheWriteDelayMs = 3000;
+// Local IPC endpoint; its I/O thread only ever sees published snapshots
+IpcServer g_ipc;
+LONGLONG g_lastSwitchUnixMs = 0; // Wall clock of the last plan change seen, 0 if none
+// Status record in shared memory, for readers polling faster than IPC allows
+StatusWriter g_status;
+DWORD g_statusIdleSeconds = 0;      // Idle time as last sampled for it
+LONGLONG g_statusIdleSampledMs = 0; // and when
 
 static const wchar_t* kClassName = L"PowerPlanTrayHiddenWindow";
+static const wchar_t* kCliClassName = L"PowerPlanTrayCli";
+static const wchar_t* kAppRegPath = L"Software\\PowerPlanTray";
 
 ATOM RegisterTrayWindowClass(HINSTANCE hInstance);
 BOOL CreateHiddenWindow(HINSTANCE hInstance);
+void RunStartupStage(HWND hWnd, StartupStage stage);
 LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 
-std::vector<PlanItem> EnumeratePlans();
+void EnumeratePlans(PlanList& out);
 bool GetActivePlanGuid(GUID& outGuid);
 bool SetActivePlan(const GUID& guid);
 void ShowTrayMenu(HWND hWnd);
 void AddOrUpdateTrayIcon(HWND hWnd);
 void RemoveTrayIcon(HWND hWnd);
 void UpdateTrayTooltip(HWND hWnd);
+void LoadPlanCacheForStartup();
+void SavePlanCache();
+void FlushPlanCache();
+void NoteActivePlan(const GUID& active);
+bool ValidatePlans();
+const PlanItem* FindPlan(const GUID& guid);
 void EnableDpiAwareness();
 bool IsStartupEnabled();
 bool SetStartupEnabled(bool enable);
@@ -62,12 +188,70 @@ bool SetStartupEnabled(bool enable);
 void AfkLoadSettings();
 void AfkSaveSettings();
 void AfkCheckTick(HWND hWnd);
+bool AfkSinkSet(HWND hWnd, bool on);
+void AfkUserReturned(HWND hWnd);
+void AfkPredictLoadSettings();
+void AfkEdited(HWND hWnd);
+void AfkVetoLoadSettings();
+void AfkVetoStop();
+void CollectActivity(ActivitySample& out);
 DWORD GetIdleSeconds();
+ULONGLONG GetIdleMilliseconds();
+// App rule helpers
+void AppRulesLoad();
+void AppRulesStart(HWND hWnd);
+void AppRulesStop();
+void AppRulesOnForeground(HWND hwndForeground);
+// Process trigger helpers
+void ProcessTriggersStart(HWND hWnd);
+void ProcessTriggersScan();
+// CPU-load helpers
+void LoadWatchStart(HWND hWnd);
+void LoadWatchSample(HWND hWnd);
+// Power-source helpers
+void PowerSourceStart(HWND hWnd);
+void PowerSourceStop();
+bool PowerSourceOnSetting(const POWERBROADCAST_SETTING* setting);
+// Plan arbitration
+void GovernorLoadSettings();
+// Schedule helpers
+void ScheduleStart(HWND hWnd);
+void ScheduleEvaluate(HWND hWnd);
+LONGLONG UnixTimeMs();
+// Idle footprint
+void ScheduleIdleTrim(HWND hWnd);
+void TrimIdleFootprint(HWND hWnd);
+SIZE_T GetWorkingSetBytes();
+// Settings helpers
+DWORD ReadAppDword(const wchar_t* name, DWORD def);
+bool ReadAppGuid(const wchar_t* name, GUID& out);
+// Command line
+bool CliParseCommandLine(CliRequest& out);
+int CliMain(HINSTANCE hInstance, const CliRequest& request);
+CliStatus CliRun(HWND hWnd, const CliRequest& request, wchar_t* reply, size_t cch);
+void CliWrite(DWORD stdHandle, const wchar_t* text);
+// IPC helpers
+void IpcWake(void* context);
+void IpcPublishPlans();
+void IpcTakeSwitches();
+// Published state
+void PublishState();
+void StatusSampleIdle();
+// Diagnostics
+ULONGLONG NowMicros();
+void ShowDiagnostics(HWND hWnd);
+// Non-allocating variant for steady-state paths; buf is always terminated
+static int LoadResString(UINT id, wchar_t* buf, int cch)
+{
+    int n = LoadStringW(g_hInst, id, buf, cch);
+    if (n <= 0) { buf[0] = L'\0'; return 0; }
+    return n;
+}
+
 static std::wstring LoadResString(UINT id)
 {
     wchar_t buf[256] = {};
-    int n = LoadStringW(g_hInst, id, buf, ARRAYSIZE(buf));
-    if (n <= 0) return L"";
+    int n = LoadResString(id, buf, ARRAYSIZE(buf));
     return std::wstring(buf, n);
 }
 
@@ -77,6 +261,24 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
                      _In_ int       /*nCmdShow*/)
 {
     g_hInst = hInstance;
+    g_startUs = NowMicros();
+
+    // A verb is answered by the running tray, or here if there is none; either
+    // way this launch exits without a tray of its own
+    CliRequest request;
+    if (!CliParseCommandLine(request))
+    {
+        CliWrite(STD_ERROR_HANDLE, CliUsage());
+        return CLI_USAGE;
+    }
+    if (request.verb == CLI_HELP)
+    {
+        CliWrite(STD_OUTPUT_HANDLE, CliUsage());
+        return CLI_OK;
+    }
+    if (request.verb != CLI_NONE)
+        return CliMain(hInstance, request);
+
     EnableDpiAwareness();
     g_uTaskbarCreated = RegisterWindowMessage(L"TaskbarCreated");
 
@@ -132,29 +334,92 @@ BOOL CreateHiddenWindow(HINSTANCE hInstance)
     if (!g_hWnd)
         return FALSE;
 
-    // Do not show any window; use only tray icon
+    // Do not show any window; use only tray icon.
+    // Show it right away with the last known tooltip; no PowrProf work yet.
+    LoadPlanCacheForStartup();
     AddOrUpdateTrayIcon(g_hWnd);
-    UpdateTrayTooltip(g_hWnd);
-
-    // Initialize last known scheme
-    GetActivePlanGuid(g_lastActiveGuid);
+    g_timeToIconUs = NowMicros() - g_startUs;
+    if (g_planCacheHit) g_timeToTooltipUs = g_timeToIconUs;
 
-    // Subscribe to power setting change for personality changes
-    g_hPowerNotify = RegisterPowerSettingNotification(g_hWnd, &GUID_POWERSCHEME_PERSONALITY, DEVICE_NOTIFY_WINDOW_HANDLE);
-
-    // Fallback: poll for active plan changes (covers custom plans with same personality)
-    SetTimer(g_hWnd, TIMER_EVENT_POLL_ACTIVE, 2000, nullptr);
+    // Everything else runs from the message loop so the icon is never held up
+    PostMessage(g_hWnd, WM_APP_STARTUP, STARTUP_ACTIVE_PLAN, 0);
+    return TRUE;
+}
 
-    // Load AFK settings and start AFK timer
-    AfkLoadSettings();
-    // If no target set yet, default to current active plan to avoid surprise switches
-    if (IsEqualGUID(g_afkTargetGuid, GUID{}))
+void RunStartupStage(HWND hWnd, StartupStage stage)
+{
+    switch (stage)
     {
-        GUID cur{}; if (GetActivePlanGuid(cur)) g_afkTargetGuid = cur;
+    case STARTUP_ACTIVE_PLAN:
+    {
+        // Check the cached plan list against the live backend, patching differences
+        ValidatePlans();
+        UpdateTrayTooltip(hWnd);
+        if (!g_timeToTooltipUs) g_timeToTooltipUs = NowMicros() - g_startUs;
+        // Initialize last known scheme; it is the plan automation returns to
+        GUID active = g_cachedActiveGuid;
+        GetActivePlanGuid(active);
+        g_engine.SetManualHoldMinutes(ReadAppDword(L"ManualHoldMinutes", 0));
+        GovernorLoadSettings();
+        g_engine.Start(ToPlanId(active), GetTickCount64());
+        break;
+    }
+    case STARTUP_NOTIFICATIONS:
+        // Subscribe to power setting change for personality changes
+        g_hPowerNotify = RegisterPowerSettingNotification(hWnd, &GUID_POWERSCHEME_PERSONALITY, DEVICE_NOTIFY_WINDOW_HANDLE);
+        // Fallback: poll for active plan changes (covers custom plans with same personality)
+        SetTimer(hWnd, TIMER_EVENT_POLL_ACTIVE, 2000, nullptr);
+        break;
+    case STARTUP_AFK:
+        // Load the AFK stages and arm the timer for the first one
+        AfkLoadSettings();
+        AfkVetoLoadSettings();
+        AfkPredictLoadSettings();
+        AfkCheckTick(hWnd);
+        g_idleTrimSeconds = ReadAppDword(L"IdleTrimSeconds", g_idleTrimSeconds);
+        break;
+    case STARTUP_APP_RULES:
+        AppRulesLoad();
+        AppRulesStart(hWnd);
+        break;
+    case STARTUP_PROCESS_WATCH:
+        ProcessTriggersStart(hWnd);
+        break;
+    case STARTUP_LOAD_WATCH:
+        LoadWatchStart(hWnd);
+        break;
+    case STARTUP_POWER_SOURCE:
+        PowerSourceStart(hWnd);
+        break;
+    case STARTUP_SCHEDULE:
+        ScheduleStart(hWnd);
+        break;
+    case STARTUP_IPC:
+        // Last, so the first state a client sees already has AFK and rules applied
+        if (g_ipc.Start(IpcWake, hWnd))
+        {
+            IpcPublishPlans();
+            PublishState();
+        }
+        break;
+    case STARTUP_STATUS_BLOCK:
+        if (g_status.Open())
+            StatusSampleIdle();
+        break;
+    default:
+        return;
     }
-    SetTimer(g_hWnd, TIMER_EVENT_AFK_CHECK, 1000, nullptr); // AFK checker, 1s cadence
 
-    return TRUE;
+    if (stage + 1 < STARTUP_DONE)
+    {
+        PostMessage(hWnd, WM_APP_STARTUP, stage + 1, 0);
+    }
+    else
+    {
+        g_timeToReadyUs = NowMicros() - g_startUs;
+        // Startup touched plenty of pages that steady state never needs again
+        ScheduleIdleTrim(hWnd);
+    }
 }
 
 static UINT GetWindowDpi(HWND hWnd)
@@ -201,8 +466,10 @@ void AddOrUpdateTrayIcon(HWND hWnd)
     if (g_hTrayIcon) { DestroyIcon(g_hTrayIcon); g_hTrayIcon = nullptr; }
     g_hTrayIcon = CreateTrayIconForDpi(hWnd);
     nid.hIcon = g_hTrayIcon ? g_hTrayIcon : LoadIcon(g_hInst, MAKEINTRESOURCE(IDI_SMALL));
-    auto tip = LoadResString(IDS_TRAY_TOOLTIP_DEFAULT);
-    StringCchCopy(nid.szTip, ARRAYSIZE(nid.szTip), tip.c_str());
+    if (g_trayTip[0])
+        StringCchCopy(nid.szTip, ARRAYSIZE(nid.szTip), g_trayTip);
+    else
+        LoadResString(IDS_TRAY_TOOLTIP_DEFAULT, nid.szTip, ARRAYSIZE(nid.szTip));
     Shell_NotifyIcon(NIM_ADD, &nid);
 
     // Opt into modern behavior and DPI handling for tray icons
@@ -222,29 +489,134 @@ void RemoveTrayIcon(HWND hWnd)
 
 void UpdateTrayTooltip(HWND hWnd)
 {
+    NOTIFYICONDATA nid = {};
+    nid.cbSize = sizeof(nid);
+    nid.hWnd = hWnd;
+    nid.uID = TRAY_ID;
+    nid.uFlags = NIF_TIP;
+
     GUID active;
-    std::wstring tip = LoadResString(IDS_TRAY_TOOLTIP_DEFAULT);
+    const PlanItem* plan = nullptr;
     if (GetActivePlanGuid(active))
     {
-        auto items = EnumeratePlans();
-        for (const auto& it : items)
+        // Only go back to the backend when the active plan is not in the list
+        plan = FindPlan(active);
+        if (!plan && ValidatePlans())
+            plan = FindPlan(active);
+        NoteActivePlan(active);
+    }
+    if (plan)
+        StringCchCopy(nid.szTip, ARRAYSIZE(nid.szTip), plan->name);
+    else
+        LoadResString(IDS_TRAY_TOOLTIP_DEFAULT, nid.szTip, ARRAYSIZE(nid.szTip));
+    PublishState();
+
+    // The shell keeps the tip across NIM_ADD re-registrations via g_trayTip
+    if (wcscmp(g_trayTip, nid.szTip) == 0)
+        return;
+    Shell_NotifyIcon(NIM_MODIFY, &nid);
+    StringCchCopy(g_trayTip, ARRAYSIZE(g_trayTip), nid.szTip);
+}
+
+// ===== Plan cache =====
+void LoadPlanCacheForStartup()
+{
+    static PlanCacheData data;
+    // Names of built-in plans are localized; a cache from another UI language is stale
+    if (!PlanCacheLoad(data) || data.lang != GetUserDefaultUILanguage())
+        return;
+    g_plans = data.plans;
+    g_cachedActiveGuid = data.active;
+    g_cachedPreviousGuid = data.previous;
+    if (const PlanItem* plan = FindPlan(data.active))
+    {
+        StringCchCopy(g_trayTip, ARRAYSIZE(g_trayTip), plan->name);
+        g_planCacheHit = true;
+    }
+}
+
+// The tray coalesces writes: a burst of switches, or startup's validate and
+// first tooltip, cost one write a few seconds later instead of a temp file and
+// rename on the UI thread each. A one-shot command line writes straight away.
+void SavePlanCache()
+{
+    if (g_hWnd)
+    {
+        if (!g_planCacheDirty)
+            SetTimer(g_hWnd, TIMER_EVENT_PLAN_CACHE, kPlanCacheWriteDelayMs, nullptr);
+        g_planCacheDirty = true;
+        return;
+    }
+    g_planCacheDirty = true;
+    FlushPlanCache();
+}
+
+void FlushPlanCache()
+{
+    if (!g_planCacheDirty)
+        return;
+    g_planCacheDirty = false;
+    if (g_hWnd)
+        KillTimer(g_hWnd, TIMER_EVENT_PLAN_CACHE);
+    static PlanCacheData data;
+    data.lang = GetUserDefaultUILanguage();
+    data.active = g_cachedActiveGuid;
+    data.previous = g_cachedPreviousGuid;
+    data.plans = g_plans;
+    PlanCacheSave(data);
+}
+
+// Record a change of active plan, and the one it replaced, in the cache
+void NoteActivePlan(const GUID& active)
+{
+    if (IsEqualGUID(active, g_cachedActiveGuid))
+        return;
+    if (!IsEqualGUID(g_cachedActiveGuid, GUID{}))
+        g_cachedPreviousGuid = g_cachedActiveGuid;
+    g_cachedActiveGuid = active;
+    g_lastSwitchUnixMs = UnixTimeMs();
+    SavePlanCache();
+}
+
+// Refresh g_plans from the backend, touching only entries that differ.
+// Returns true if anything changed (and a cache write was queued).
+bool ValidatePlans()
+{
+    static PlanList live;
+    EnumeratePlans(live);
+    bool changed = live.count != g_plans.count;
+    g_plans.count = live.count;
+    for (size_t i = 0; i < live.count; ++i)
+    {
+        PlanItem& cur = g_plans.items[i];
+        if (!IsEqualGUID(cur.guid, live.items[i].guid) || wcscmp(cur.name, live.items[i].name) != 0)
         {
-            if (IsEqualGUID(it.guid, active)) { tip = it.name; break; }
+            cur = live.items[i];
+            changed = true;
         }
     }
+    if (changed)
+    {
+        SavePlanCache();
+        IpcPublishPlans();
+    }
+    return changed;
+}
 
-    NOTIFYICONDATA nid = {};
-    nid.cbSize = sizeof(nid);
-    nid.hWnd = hWnd;
-    nid.uID = TRAY_ID;
-    nid.uFlags = NIF_TIP;
-    StringCchCopy(nid.szTip, ARRAYSIZE(nid.szTip), tip.c_str());
-    Shell_NotifyIcon(NIM_MODIFY, &nid);
+const PlanItem* FindPlan(const GUID& guid)
+{
+    for (const auto& p : g_plans)
+    {
+        if (IsEqualGUID(p.guid, guid)) return &p;
+    }
+    return nullptr;
 }
 
 void ShowTrayMenu(HWND hWnd)
 {
-    auto plans = EnumeratePlans();
+    // Menu items index into g_plans; WM_COMMAND resolves against the same list
+    ValidatePlans();
+    const auto& plans = g_plans;
     GUID active{};
     GetActivePlanGuid(active);
 
@@ -256,58 +628,92 @@ void ShowTrayMenu(HWND hWnd)
         UINT flags = MF_STRING | MF_ENABLED;
         if (IsEqualGUID(p.guid, active))
             flags |= MF_CHECKED;
-        AppendMenu(hMenu, flags, id++, p.name.c_str());
+        AppendMenu(hMenu, flags, id++, p.name);
     }
     // Separator after plans
     AppendMenu(hMenu, MF_SEPARATOR, 0, nullptr);
 
-    // AFK submenu
+    // AFK submenu: Off, one entry per stage, then Add Stage
     HMENU hAfk = CreatePopupMenu();
     auto sAfk = LoadResString(IDS_MENU_AFK);
     auto sAfkOff = LoadResString(IDS_MENU_AFK_OFF);
     auto sAfkTimeout = LoadResString(IDS_MENU_AFK_TIMEOUT);
     auto sAfkTarget = LoadResString(IDS_MENU_AFK_TARGET);
+    auto sAfkAdd = LoadResString(IDS_MENU_AFK_ADD_STAGE);
+    auto sAfkRemove = LoadResString(IDS_MENU_AFK_REMOVE_STAGE);
+    auto sAfkStageFmt = LoadResString(IDS_MENU_AFK_STAGE_FMT);
+    std::wstring intervalNames[ARRAYSIZE(kAfkIntervals)];
+    for (size_t k = 0; k < ARRAYSIZE(kAfkIntervals); ++k)
+        intervalNames[k] = LoadResString(kAfkIntervalStrings[k]);
 
-    // Timeout options
-    HMENU hAfkTimeout = CreatePopupMenu();
-    // "Off" inside the timeout submenu
-    AppendMenu(hAfkTimeout, MF_STRING | (g_afkTimeoutMinutes == 0 ? MF_CHECKED : 0), IDM_AFK_OFF, sAfkOff.c_str());
-    const int intervals[7] = { 1, 5, 10, 15, 30, 45, 60 };
-    const UINT intervalStrings[7] = {
-        IDS_MENU_AFK_1MIN,
-        IDS_MENU_AFK_5MIN,
-        IDS_MENU_AFK_10MIN,
-        IDS_MENU_AFK_15MIN,
-        IDS_MENU_AFK_30MIN,
-        IDS_MENU_AFK_45MIN,
-        IDS_MENU_AFK_60MIN
-    };
-    for (int i = 0; i < 7; ++i)
+    const AfkLadder& ladder = g_engine.Ladder();
+    AppendMenu(hAfk, MF_STRING | (ladder.Count() == 0 ? MF_CHECKED : 0), IDM_AFK_OFF, sAfkOff.c_str());
+    if (ladder.Count())
+        AppendMenu(hAfk, MF_SEPARATOR, 0, nullptr);
+    for (size_t i = 0; i < ladder.Count(); ++i)
     {
-        auto s = LoadResString(intervalStrings[i]);
-        UINT flags = MF_STRING;
-        if (g_afkTimeoutMinutes == intervals[i]) flags |= MF_CHECKED;
-        AppendMenu(hAfkTimeout, flags, IDM_AFK_INTERVAL_BASE + i, s.c_str());
-    }
-    AppendMenu(hAfk, MF_POPUP, (UINT_PTR)hAfkTimeout, sAfkTimeout.c_str());
+        const AfkStage& stage = ladder.At(i);
+        const UINT base = IDM_AFK_STAGE_BASE + (UINT)i * IDM_AFK_STAGE_STRIDE;
+        const GUID stagePlan = ToGuid(stage.plan);
+        HMENU hStage = CreatePopupMenu();
 
-    // Target plan submenu
-    HMENU hAfkTarget = CreatePopupMenu();
-    UINT tid = IDM_AFK_TARGET_BASE;
-    for (const auto& p : plans)
+        // Timeout options
+        HMENU hTimeout = CreatePopupMenu();
+        const wchar_t* timeoutName = L"?";
+        for (size_t k = 0; k < ARRAYSIZE(kAfkIntervals); ++k)
+        {
+            // Another stage's threshold is not free to move to
+            const uint32_t ms = (uint32_t)kAfkIntervals[k] * 60000U;
+            const bool current = stage.thresholdMs == ms;
+            bool used = false;
+            for (size_t j = 0; j < ladder.Count(); ++j) used |= j != i && ladder.At(j).thresholdMs == ms;
+            if (current) timeoutName = intervalNames[k].c_str();
+            AppendMenu(hTimeout, MF_STRING | (current ? MF_CHECKED : 0) | (used ? MF_GRAYED : 0), base + (UINT)k,
+                intervalNames[k].c_str());
+        }
+        AppendMenu(hStage, MF_POPUP, (UINT_PTR)hTimeout, sAfkTimeout.c_str());
+
+        // Target plan submenu
+        HMENU hTarget = CreatePopupMenu();
+        UINT tid = base + AFK_STAGE_PLAN;
+        for (const auto& p : plans)
+        {
+            UINT flags = MF_STRING | MF_ENABLED;
+            if (IsEqualGUID(p.guid, stagePlan))
+                flags |= MF_CHECKED;
+            AppendMenu(hTarget, flags, tid++, p.name);
+        }
+        AppendMenu(hStage, MF_POPUP, (UINT_PTR)hTarget, sAfkTarget.c_str());
+        AppendMenu(hStage, MF_STRING, base + AFK_STAGE_REMOVE, sAfkRemove.c_str());
+
+        // "After 5 min: Balanced"
+        const PlanItem* plan = FindPlan(stagePlan);
+        wchar_t label[256];
+        StringCchPrintfW(label, ARRAYSIZE(label), sAfkStageFmt.empty() ? L"%s: %s" : sAfkStageFmt.c_str(),
+            timeoutName, plan ? plan->name : L"?");
+        AppendMenu(hAfk, MF_POPUP, (UINT_PTR)hStage, label);
+    }
+    if (ladder.Count() < AfkLadder::kMaxStages)
     {
-        UINT flags = MF_STRING | MF_ENABLED;
-        if (IsEqualGUID(p.guid, g_afkTargetGuid))
-            flags |= MF_CHECKED;
-        AppendMenu(hAfkTarget, flags, tid++, p.name.c_str());
+        HMENU hAdd = CreatePopupMenu();
+        for (size_t k = 0; k < ARRAYSIZE(kAfkIntervals); ++k)
+        {
+            // A threshold already in the ladder is edited through its own stage
+            const uint32_t ms = (uint32_t)kAfkIntervals[k] * 60000U;
+            bool used = false;
+            for (size_t i = 0; i < ladder.Count(); ++i) used |= ladder.At(i).thresholdMs == ms;
+            AppendMenu(hAdd, MF_STRING | (used ? MF_GRAYED : 0), IDM_AFK_ADD_BASE + (UINT)k, intervalNames[k].c_str());
+        }
+        AppendMenu(hAfk, MF_POPUP, (UINT_PTR)hAdd, sAfkAdd.c_str());
     }
-    AppendMenu(hAfk, MF_POPUP, (UINT_PTR)hAfkTarget, sAfkTarget.c_str());
 
     AppendMenu(hMenu, MF_POPUP, (UINT_PTR)hAfk, sAfk.c_str());
 
     // 2) Other options follow
     auto sRefresh = LoadResString(IDS_MENU_REFRESH);
     AppendMenu(hMenu, MF_STRING, IDM_REFRESH, sRefresh.c_str());
+    auto sDiagnostics = LoadResString(IDS_MENU_DIAGNOSTICS);
+    AppendMenu(hMenu, MF_STRING, IDM_DIAGNOSTICS, sDiagnostics.c_str());
     bool startup = IsStartupEnabled();
     auto sStartup = LoadResString(IDS_MENU_STARTUP);
     AppendMenu(hMenu, MF_STRING | (startup ? MF_CHECKED : 0), IDM_STARTUP, sStartup.c_str());
@@ -323,11 +729,11 @@ void ShowTrayMenu(HWND hWnd)
     DestroyMenu(hMenu);
 }
 
-std::vector<PlanItem> EnumeratePlans()
+void EnumeratePlans(PlanList& out)
 {
-    std::vector<PlanItem> result;
+    out.count = 0;
     DWORD index = 0;
-    for (;; ++index)
+    for (; out.count < kMaxPlans; ++index)
     {
         GUID guid{};
         DWORD size = sizeof(GUID);
@@ -335,18 +741,17 @@ std::vector<PlanItem> EnumeratePlans()
         if (status != ERROR_SUCCESS)
             break;
 
-        DWORD nameSize = 0;
-        if (PowerReadFriendlyName(nullptr, &guid, nullptr, nullptr, nullptr, &nameSize) != ERROR_SUCCESS)
+        // Read into a roomy stack buffer, then truncate to the fixed slot
+        wchar_t name[512];
+        DWORD nameSize = sizeof(name);
+        if (PowerReadFriendlyName(nullptr, &guid, nullptr, nullptr, reinterpret_cast<UCHAR*>(name), &nameSize) != ERROR_SUCCESS)
             continue;
-        std::wstring name; name.resize(nameSize / sizeof(wchar_t));
-        if (PowerReadFriendlyName(nullptr, &guid, nullptr, nullptr, reinterpret_cast<UCHAR*>(&name[0]), &nameSize) != ERROR_SUCCESS)
-            continue;
-        // Ensure null-termination trimming
-        if (!name.empty() && name.back() == L'\0') name.pop_back();
+        name[ARRAYSIZE(name) - 1] = L'\0';
 
-        result.push_back({ guid, name });
+        PlanItem& item = out.items[out.count++];
+        item.guid = guid;
+        StringCchCopy(item.name, ARRAYSIZE(item.name), name);
     }
-    return result;
 }
 
 bool GetActivePlanGuid(GUID& outGuid)
@@ -379,9 +784,16 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
     {
     case WM_CREATE:
         return 0;
+    case WM_APP_STARTUP:
+        RunStartupStage(hWnd, (StartupStage)wParam);
+        return 0;
+    case WM_APP_IPC:
+        IpcTakeSwitches();
+        return 0;
     case WM_COMMAND:
     {
         const UINT cmd = LOWORD(wParam);
+        const ULONGLONG startUs = NowMicros();
         if (cmd == IDM_EXIT)
         {
             DestroyWindow(hWnd);
@@ -389,9 +801,15 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
         }
         if (cmd == IDM_REFRESH)
         {
+            NoAllocScope noAlloc(g_timeToReadyUs != 0, "tooltip refresh");
             UpdateTrayTooltip(hWnd);
             return 0;
         }
+        if (cmd == IDM_DIAGNOSTICS)
+        {
+            ShowDiagnostics(hWnd);
+            return 0;
+        }
         if (cmd == IDM_STARTUP)
         {
             bool now = IsStartupEnabled();
@@ -402,51 +820,59 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
         if (cmd == IDM_AFK_OFF)
         {
             // Disable AFK switching; if currently applied, revert now
-            g_afkTimeoutMinutes = 0;
-            if (g_afkApplied)
-            {
-                GUID cur{}; GetActivePlanGuid(cur);
-                if (!IsEqualGUID(cur, g_afkPrevGuid) && !IsEqualGUID(g_afkPrevGuid, GUID{}))
-                {
-                    SetActivePlan(g_afkPrevGuid);
-                    g_lastActiveGuid = g_afkPrevGuid;
-                }
-                g_afkApplied = false;
-                UpdateTrayTooltip(hWnd);
-            }
-            AfkSaveSettings();
+            g_engine.Ladder().Clear();
+            AfkEdited(hWnd);
             return 0;
         }
-        if (cmd >= IDM_AFK_INTERVAL_BASE && cmd < IDM_AFK_INTERVAL_BASE + 100)
+        if (cmd >= IDM_AFK_ADD_BASE && cmd < IDM_AFK_ADD_BASE + ARRAYSIZE(kAfkIntervals))
         {
-            const int intervals[7] = { 1, 5, 10, 15, 30, 45, 60 };
-            int idx = (int)cmd - IDM_AFK_INTERVAL_BASE;
-            if (idx >= 0 && idx < 7)
-            {
-                g_afkTimeoutMinutes = intervals[idx];
-                AfkSaveSettings();
-            }
+            // A new stage goes to the deepest plan so far; until changed, the active one
+            AfkLadder& ladder = g_engine.Ladder();
+            const size_t n = ladder.Count();
+            const PlanId plan = n ? ladder.At(n - 1).plan : g_engine.Active();
+            if (!plan.IsNull() && ladder.Set((uint32_t)kAfkIntervals[cmd - IDM_AFK_ADD_BASE] * 60000U, plan))
+                AfkEdited(hWnd);
             return 0;
         }
-        if (cmd >= IDM_AFK_TARGET_BASE && cmd < IDM_AFK_TARGET_BASE + 10000)
+        if (cmd >= IDM_AFK_STAGE_BASE && cmd < IDM_AFK_STAGE_BASE + AfkLadder::kMaxStages * IDM_AFK_STAGE_STRIDE)
         {
-            UINT index = cmd - IDM_AFK_TARGET_BASE;
-            auto plans = EnumeratePlans();
-            if (index < plans.size())
+            const size_t i = (cmd - IDM_AFK_STAGE_BASE) / IDM_AFK_STAGE_STRIDE;
+            const UINT item = (cmd - IDM_AFK_STAGE_BASE) % IDM_AFK_STAGE_STRIDE;
+            AfkLadder& ladder = g_engine.Ladder();
+            if (i >= ladder.Count())
+                return 0;
+            const AfkStage stage = ladder.At(i);
+            if (item < ARRAYSIZE(kAfkIntervals))
             {
-                g_afkTargetGuid = plans[index].guid;
-                AfkSaveSettings();
+                // Set would re-target the stage that holds the threshold, losing this one
+                const uint32_t ms = (uint32_t)kAfkIntervals[item] * 60000U;
+                for (size_t j = 0; j < ladder.Count(); ++j)
+                {
+                    if (j != i && ladder.At(j).thresholdMs == ms)
+                        return 0;
+                }
+                ladder.Remove(i);
+                ladder.Set(ms, stage.plan);
+            }
+            else if (item == AFK_STAGE_REMOVE)
+            {
+                ladder.Remove(i);
             }
+            else if (item >= AFK_STAGE_PLAN && item - AFK_STAGE_PLAN < g_plans.size())
+            {
+                ladder.Set(stage.thresholdMs, ToPlanId(g_plans[item - AFK_STAGE_PLAN].guid));
+            }
+            AfkEdited(hWnd);
             return 0;
         }
         if (cmd >= ID_BASE_PLAN && cmd < ID_BASE_PLAN + 10000)
         {
             UINT index = cmd - ID_BASE_PLAN;
-            auto plans = EnumeratePlans();
-            if (index < plans.size())
+            if (index < g_plans.size())
             {
-                SetActivePlan(plans[index].guid);
-                UpdateTrayTooltip(hWnd);
+                // A click takes effect at once, whoever else holds a claim
+                g_engine.PlanPicked(ToPlanId(g_plans[index].guid), GetTickCount64());
+                g_latency[LAT_PLAN_CLICK].Record(NowMicros() - startUs);
             }
             return 0;
         }
@@ -455,49 +881,159 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
     case WM_TRAYICON:
         if (LOWORD(lParam) == WM_RBUTTONUP || LOWORD(lParam) == WM_CONTEXTMENU)
         {
+            KillTimer(hWnd, TIMER_EVENT_IDLE_TRIM);
+            g_menuOpenStartUs = NowMicros();
             ShowTrayMenu(hWnd);
+            g_menuOpenStartUs = 0;
+            ScheduleIdleTrim(hWnd);
             return 0;
         }
         break;
+    case WM_INITMENUPOPUP:
+        // First popup initialized inside TrackPopupMenu: the menu is about to show
+        if (g_menuOpenStartUs)
+        {
+            const ULONGLONG elapsed = NowMicros() - g_menuOpenStartUs;
+            g_latency[g_trimmed ? LAT_MENU_AFTER_TRIM : LAT_MENU_OPEN].Record(elapsed);
+            g_trimmed = false;
+            g_menuOpenStartUs = 0;
+        }
+        break;
     case WM_POWERBROADCAST:
         if (wParam == PBT_POWERSETTINGCHANGE)
         {
+            if (PowerSourceOnSetting(reinterpret_cast<const POWERBROADCAST_SETTING*>(lParam)))
+                return TRUE;
             // Power scheme likely changed; refresh tooltip
+            NoAllocScope noAlloc(g_timeToReadyUs != 0, "power broadcast");
+            const ULONGLONG startUs = NowMicros();
             UpdateTrayTooltip(hWnd);
+            g_latency[LAT_EXTERNAL_CHANGE].Record(NowMicros() - startUs);
+            return TRUE;
+        }
+        if (wParam == PBT_APMRESUMEAUTOMATIC)
+        {
+            // The schedule timer counts uptime, which stood still while asleep
+            ScheduleEvaluate(hWnd);
             return TRUE;
         }
         break;
+    case WM_COPYDATA:
+    {
+        // A verb from a second launch. The answer goes back to its window
+        // before this returns; the result tells it the tray handled it.
+        const COPYDATASTRUCT* data = reinterpret_cast<const COPYDATASTRUCT*>(lParam);
+        CliRequest request;
+        if (!CliDecode((uint32_t)data->dwData, data->lpData, data->cbData, request))
+            break;
+        static wchar_t reply[kCliReplyMax];
+        const CliStatus status = CliRun(hWnd, request, reply, ARRAYSIZE(reply));
+        COPYDATASTRUCT answer = { kCliReplyTag, (DWORD)((wcslen(reply) + 1) * sizeof(wchar_t)), reply };
+        SendMessageTimeoutW(reinterpret_cast<HWND>(wParam), WM_COPYDATA, reinterpret_cast<WPARAM>(hWnd),
+            reinterpret_cast<LPARAM>(&answer), SMTO_ABORTIFHUNG, kCliTimeoutMs, nullptr);
+        return kCliHandled | status;
+    }
+    case WM_TIMECHANGE:
+        // Clock or time zone changed; the CRT caches the zone until told otherwise
+        _tzset();
+        ScheduleEvaluate(hWnd);
+        return 0;
     case WM_DPICHANGED:
         // Recreate or refresh tray icon to ensure crisp rendering
         RemoveTrayIcon(hWnd);
         AddOrUpdateTrayIcon(hWnd);
         UpdateTrayTooltip(hWnd);
         return 0;
+    case WM_INPUT:
+        // Only ever registered while an AFK stage is applied; later events
+        // still queued behind the first find the sink already gone
+        if (g_engine.InputSink())
+            AfkUserReturned(hWnd);
+        break; // DefWindowProc frees the raw input
     case WM_TIMER:
         if (wParam == TIMER_EVENT_POLL_ACTIVE)
         {
+            NoAllocScope noAlloc(g_timeToReadyUs != 0, "poll tick");
+            const ULONGLONG startUs = NowMicros();
             GUID now{};
-            if (GetActivePlanGuid(now) && !IsEqualGUID(now, g_lastActiveGuid))
+            if (GetActivePlanGuid(now) && g_engine.PlanChanged(ToPlanId(now), GetTickCount64()))
             {
-                g_lastActiveGuid = now;
                 UpdateTrayTooltip(hWnd);
+                g_latency[LAT_EXTERNAL_CHANGE].Record(NowMicros() - startUs);
             }
+            StatusSampleIdle();
             return 0;
         }
         else if (wParam == TIMER_EVENT_AFK_CHECK)
         {
+            NoAllocScope noAlloc(g_timeToReadyUs != 0, "AFK tick");
             AfkCheckTick(hWnd);
             return 0;
         }
+        else if (wParam == TIMER_EVENT_PROCESS_SCAN)
+        {
+            ProcessTriggersScan();
+            return 0;
+        }
+        else if (wParam == TIMER_EVENT_LOAD_SAMPLE)
+        {
+            LoadWatchSample(hWnd);
+            return 0;
+        }
+        else if (wParam == TIMER_EVENT_SCHEDULE)
+        {
+            ScheduleEvaluate(hWnd);
+            return 0;
+        }
+        else if (wParam == TIMER_EVENT_POLICY_EXPIRY)
+        {
+            g_engine.ClaimsExpire(GetTickCount64());
+            return 0;
+        }
+        else if (wParam == TIMER_EVENT_GOVERNOR)
+        {
+            g_engine.GovernorDue(GetTickCount64());
+            return 0;
+        }
+        else if (wParam == TIMER_EVENT_PLAN_CACHE)
+        {
+            FlushPlanCache();
+            return 0;
+        }
+        else if (wParam == TIMER_EVENT_IDLE_TRIM)
+        {
+            KillTimer(hWnd, TIMER_EVENT_IDLE_TRIM);
+            TrimIdleFootprint(hWnd);
+            return 0;
+        }
         break;
+    case WM_ENDSESSION:
+        // Logoff ends the process without WM_DESTROY
+        if (wParam)
+            FlushPlanCache();
+        return 0;
     case WM_DESTROY:
         if (g_hPowerNotify)
         {
             UnregisterPowerSettingNotification(g_hPowerNotify);
             g_hPowerNotify = nullptr;
         }
-        KillTimer(hWnd, 1);
-        KillTimer(hWnd, 2);
+        AppRulesStop();
+        PowerSourceStop();
+        AfkVetoStop();
+        g_ipc.Stop();
+        g_status.Close();
+        if (g_engine.InputSink())
+            AfkSinkSet(hWnd, false);
+        KillTimer(hWnd, TIMER_EVENT_POLL_ACTIVE);
+        KillTimer(hWnd, TIMER_EVENT_AFK_CHECK);
+        KillTimer(hWnd, TIMER_EVENT_IDLE_TRIM);
+        KillTimer(hWnd, TIMER_EVENT_PROCESS_SCAN);
+        KillTimer(hWnd, TIMER_EVENT_LOAD_SAMPLE);
+        KillTimer(hWnd, TIMER_EVENT_SCHEDULE);
+        KillTimer(hWnd, TIMER_EVENT_POLICY_EXPIRY);
+        KillTimer(hWnd, TIMER_EVENT_GOVERNOR);
+        FlushPlanCache();
         RemoveTrayIcon(hWnd);
         if (g_hInstanceMutex)
         {
@@ -593,85 +1129,1066 @@ void EnableDpiAwareness()
     }
 }
 
-// ===== AFK helpers =====
-static const wchar_t* kAfkRegPath = L"Software\\PowerPlanTray";
+// ===== Settings helpers =====
+DWORD ReadAppDword(const wchar_t* name, DWORD def)
+{
+    DWORD dw = 0; DWORD size = sizeof(dw);
+    if (RegGetValueW(HKEY_CURRENT_USER, kAppRegPath, name, RRF_RT_REG_DWORD, nullptr, &dw, &size) == ERROR_SUCCESS)
+        return dw;
+    return def;
+}
 
-void AfkLoadSettings()
+bool ReadAppGuid(const wchar_t* name, GUID& out)
+{
+    GUID g{}; DWORD size = sizeof(g);
+    if (RegGetValueW(HKEY_CURRENT_USER, kAppRegPath, name, RRF_RT_REG_BINARY, nullptr, &g, &size) != ERROR_SUCCESS || size != sizeof(GUID))
+        return false;
+    out = g;
+    return true;
+}
+
+// ===== CPU load boost =====
+static ULONGLONG FileTimeToUll(const FILETIME& ft)
+{
+    return ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+void LoadWatchStart(HWND hWnd)
+{
+    GUID boost{};
+    if (!ReadAppGuid(L"LoadBoostPlan", boost) || IsEqualGUID(boost, GUID{}))
+        return; // Off unless a boost plan is configured
+
+    LoadSwitcher::Config config;
+    config.highPercent = (double)ReadAppDword(L"LoadHighPercent", 70);
+    config.lowPercent = (double)ReadAppDword(L"LoadLowPercent", 40);
+    config.minDwellMs = ReadAppDword(L"LoadDwellSeconds", 60) * 1000U;
+    g_engine.SetLoadBoost(ToPlanId(boost), config);
+    LoadWatchSample(hWnd);
+}
+
+void LoadWatchSample(HWND hWnd)
+{
+    // GetSystemTimes is a single cheap call; kernel time already includes idle
+    FILETIME idle{}, kernel{}, user{};
+    if (!GetSystemTimes(&idle, &kernel, &user))
+    {
+        SetTimer(hWnd, TIMER_EVENT_LOAD_SAMPLE, g_engine.Load().NextIntervalMs(), nullptr); // Try again later
+        return;
+    }
+    // The engine re-arms the timer for the next sample
+    g_engine.LoadSample(GetTickCount64(), FileTimeToUll(idle), FileTimeToUll(kernel) + FileTimeToUll(user));
+}
+
+// ===== Power source =====
+// Mappings: PlanOnAC, PlanOnDC, PlanLowBattery (+ LowBatteryPercent), PlanEnergySaver.
+// Windows sends the current value of each setting right after registration,
+// so there is no initial query and no battery polling.
+void PowerSourceStart(HWND hWnd)
+{
+    PowerSourceMap c;
+    GUID plan{};
+    if (ReadAppGuid(L"PlanOnAC", plan)) c.onAc = ToPlanId(plan);
+    if (ReadAppGuid(L"PlanOnDC", plan)) c.onDc = ToPlanId(plan);
+    if (ReadAppGuid(L"PlanLowBattery", plan)) c.lowBattery = ToPlanId(plan);
+    if (ReadAppGuid(L"PlanEnergySaver", plan)) c.energySaver = ToPlanId(plan);
+    c.lowBatteryPercent = ReadAppDword(L"LowBatteryPercent", c.lowBatteryPercent);
+    g_engine.SetPowerSourceMap(c);
+
+    if (!c.onAc.IsNull() || !c.onDc.IsNull() || !c.lowBattery.IsNull())
+        g_hPowerSourceNotify[0] = RegisterPowerSettingNotification(hWnd, &GUID_ACDC_POWER_SOURCE, DEVICE_NOTIFY_WINDOW_HANDLE);
+    if (!c.lowBattery.IsNull())
+        g_hPowerSourceNotify[1] = RegisterPowerSettingNotification(hWnd, &GUID_BATTERY_PERCENTAGE_REMAINING, DEVICE_NOTIFY_WINDOW_HANDLE);
+    if (!c.energySaver.IsNull())
+        g_hPowerSourceNotify[2] = RegisterPowerSettingNotification(hWnd, &GUID_ENERGY_SAVER_STATUS, DEVICE_NOTIFY_WINDOW_HANDLE);
+}
+
+void PowerSourceStop()
+{
+    for (auto& h : g_hPowerSourceNotify)
+    {
+        if (h) { UnregisterPowerSettingNotification(h); h = nullptr; }
+    }
+}
+
+// Returns true if the setting was one of ours (and has been handled)
+bool PowerSourceOnSetting(const POWERBROADCAST_SETTING* setting)
+{
+    if (!setting || setting->DataLength < sizeof(DWORD))
+        return false;
+    DWORD value = 0;
+    memcpy(&value, setting->Data, sizeof(value));
+
+    const ULONGLONG now = GetTickCount64();
+    if (IsEqualGUID(setting->PowerSetting, GUID_ACDC_POWER_SOURCE))
+        g_engine.PowerSource(value != 0, now); // 0 = AC, 1 = DC (battery), 2 = short-term (UPS)
+    else if (IsEqualGUID(setting->PowerSetting, GUID_BATTERY_PERCENTAGE_REMAINING))
+        g_engine.BatteryPercent(value, now);
+    else if (IsEqualGUID(setting->PowerSetting, GUID_ENERGY_SAVER_STATUS))
+        g_engine.EnergySaver(value != 0, now);
+    else
+        return false;
+    return true;
+}
+
+// ===== Plan arbitration =====
+void GovernorLoadSettings()
+{
+    SwitchGovernor::Config config;
+    config.minDwellMs = ReadAppDword(L"SwitchDwellSeconds", config.minDwellMs / 1000) * 1000U;
+    config.burst = ReadAppDword(L"SwitchBurst", config.burst);
+    config.refillMs = ReadAppDword(L"SwitchRefillSeconds", config.refillMs / 1000) * 1000U;
+    if (config.burst == 0) config.burst = 1; // An empty bucket would block every switch
+    g_engine.SetGovernorConfig(config);
+}
+
+// ===== Engine host =====
+bool TrayEngineHost::ReadActivePlan(PlanId& out)
+{
+    GUID guid{};
+    if (!GetActivePlanGuid(guid))
+        return false;
+    out = ToPlanId(guid);
+    return true;
+}
+
+void TrayEngineHost::ApplyPlan(const PlanId& plan)
+{
+    SetActivePlan(ToGuid(plan));
+    UpdateTrayTooltip(g_hWnd);
+}
+
+void TrayEngineHost::ArmTimer(PlanEngine::Timer timer, uint64_t delayMs)
+{
+    static const UINT kTimerIds[PlanEngine::TIMER_COUNT] = {
+        TIMER_EVENT_AFK_CHECK, TIMER_EVENT_LOAD_SAMPLE, TIMER_EVENT_GOVERNOR, TIMER_EVENT_POLICY_EXPIRY,
+        TIMER_EVENT_SCHEDULE
+    };
+    if (delayMs == PlanEngine::kNever)
+    {
+        KillTimer(g_hWnd, kTimerIds[timer]);
+        return;
+    }
+    // Re-arming the same timer ID replaces the previous period
+    SetTimer(g_hWnd, kTimerIds[timer], delayMs < USER_TIMER_MAXIMUM ? (UINT)delayMs : USER_TIMER_MAXIMUM, nullptr);
+}
+
+void TrayEngineHost::CollectActivity(ActivitySample& out)
+{
+    ::CollectActivity(out);
+}
+
+bool TrayEngineHost::SetInputSink(bool on)
+{
+    return AfkSinkSet(g_hWnd, on);
+}
+
+void TrayEngineHost::LocalTime(uint32_t& weekday, uint32_t& minute, uint32_t& msIntoMinute)
+{
+    SYSTEMTIME st;
+    GetLocalTime(&st);
+    weekday = st.wDayOfWeek;
+    minute = st.wHour * 60U + st.wMinute;
+    msIntoMinute = st.wSecond * 1000U + st.wMilliseconds;
+}
+
+// The model is small; keeping it current means nothing is lost on a crash
+void TrayEngineHost::ReturnLearned(const ReturnPredictor& model)
 {
     HKEY hKey;
-    if (RegOpenKeyExW(HKEY_CURRENT_USER, kAfkRegPath, 0, KEY_QUERY_VALUE, &hKey) == ERROR_SUCCESS)
+    if (RegCreateKeyExW(HKEY_CURRENT_USER, kAppRegPath, 0, nullptr, 0, KEY_SET_VALUE, nullptr, &hKey, nullptr) == ERROR_SUCCESS)
     {
-        DWORD dw = 0; DWORD size = sizeof(dw);
-        if (RegGetValueW(hKey, nullptr, L"AfkTimeoutMinutes", RRF_RT_REG_DWORD, nullptr, &dw, &size) == ERROR_SUCCESS)
+        RegSetValueExW(hKey, L"AfkReturnModel", 0, REG_BINARY, reinterpret_cast<const BYTE*>(model.Data()), ReturnPredictor::kDataSize);
+        RegCloseKey(hKey);
+    }
+}
+
+// ===== Schedule =====
+// Rules live under HKCU\Software\PowerPlanTray\Schedule as
+// "Mon-Fri 08:00-18:30" = REG_BINARY plan GUID, first match wins; outside every
+// window ScheduleDefaultPlan applies, if set.
+static const wchar_t* kScheduleRegPath = L"Software\\PowerPlanTray\\Schedule";
+
+// Wall-clock milliseconds since 1970-01-01 UTC, the schedule's time base
+LONGLONG UnixTimeMs()
+{
+    FILETIME ft{}; GetSystemTimeAsFileTime(&ft);
+    return (LONGLONG)((FileTimeToUll(ft) - 116444736000000000ULL) / 10000ULL);
+}
+
+void ScheduleStart(HWND hWnd)
+{
+    PlanSchedule& schedule = g_engine.Schedule();
+    schedule.Clear();
+    GUID def{};
+    if (ReadAppGuid(L"ScheduleDefaultPlan", def))
+        schedule.SetDefault(ToPlanId(def));
+
+    HKEY hKey;
+    if (RegOpenKeyExW(HKEY_CURRENT_USER, kScheduleRegPath, 0, KEY_QUERY_VALUE, &hKey) == ERROR_SUCCESS)
+    {
+        for (DWORD i = 0;; ++i)
         {
-            g_afkTimeoutMinutes = (int)dw;
+            wchar_t name[64]; DWORD nameLen = ARRAYSIZE(name);
+            GUID g{}; DWORD type = 0; DWORD size = sizeof(g);
+            LSTATUS rc = RegEnumValueW(hKey, i, name, &nameLen, nullptr, &type, reinterpret_cast<BYTE*>(&g), &size);
+            if (rc == ERROR_NO_MORE_ITEMS)
+                break;
+            ScheduleRule rule{};
+            if (rc != ERROR_SUCCESS || type != REG_BINARY || size != sizeof(GUID) || !PlanSchedule::Parse(name, rule))
+                continue;
+            rule.plan = ToPlanId(g);
+            schedule.Add(rule);
         }
-        GUID g{}; size = sizeof(g);
-        if (RegGetValueW(hKey, nullptr, L"AfkTargetPlan", RRF_RT_REG_BINARY, nullptr, &g, &size) == ERROR_SUCCESS && size == sizeof(GUID))
+        RegCloseKey(hKey);
+    }
+    ScheduleEvaluate(hWnd);
+}
+
+// The schedule's timer, and the handler for clock changes and resume, which
+// the timer cannot see
+void ScheduleEvaluate(HWND /*hWnd*/)
+{
+    if (g_engine.Schedule().Empty())
+        return;
+    g_engine.ScheduleDue(GetTickCount64(), UnixTimeMs());
+}
+
+// ===== Idle footprint =====
+// (Re)arm the quiet-period timer; any menu use pushes the trim further out
+void ScheduleIdleTrim(HWND hWnd)
+{
+    if (g_idleTrimSeconds == 0)
+        return;
+    SetTimer(hWnd, TIMER_EVENT_IDLE_TRIM, g_idleTrimSeconds * 1000U, nullptr);
+}
+
+SIZE_T GetWorkingSetBytes()
+{
+    PROCESS_MEMORY_COUNTERS pmc{}; pmc.cb = sizeof(pmc);
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return 0;
+    return pmc.WorkingSetSize;
+}
+
+void TrimIdleFootprint(HWND /*hWnd*/)
+{
+    g_trimRssBefore = GetWorkingSetBytes();
+
+    // The shell keeps its own copy of the icon; ours is recreated on the next NIM_ADD
+    if (g_hTrayIcon) { DestroyIcon(g_hTrayIcon); g_hTrayIcon = nullptr; }
+    // PDH's query and buffers; the next veto sample reopens them, and as the
+    // raw value is a running total a baseline taken before still holds
+    AfkVetoStop();
+    HeapCompact(GetProcessHeap(), 0);
+    // (SIZE_T)-1 for both limits empties the working set; pages fault back in on demand
+    SetProcessWorkingSetSizeEx(GetCurrentProcess(), (SIZE_T)-1, (SIZE_T)-1, 0);
+
+    g_trimRssAfter = GetWorkingSetBytes();
+    g_trimmed = true;
+    ++g_trimCount;
+}
+
+// ===== App rules =====
+// Rules live under HKCU\Software\PowerPlanTray\AppRules as
+// "<image>.exe" = REG_BINARY plan GUID.
+static const wchar_t* kAppRulesRegPath = L"Software\\PowerPlanTray\\AppRules";
+
+// Reads "<image>.exe" = REG_BINARY GUID values from a key into a rule table
+static void LoadRuleTable(const wchar_t* subkey, AppRuleTable& table)
+{
+    table.Clear();
+    HKEY hKey;
+    if (RegOpenKeyExW(HKEY_CURRENT_USER, subkey, 0, KEY_QUERY_VALUE, &hKey) != ERROR_SUCCESS)
+        return;
+    for (DWORD i = 0;; ++i)
+    {
+        wchar_t name[64]; DWORD nameLen = ARRAYSIZE(name);
+        GUID g{}; DWORD type = 0; DWORD size = sizeof(g);
+        LSTATUS rc = RegEnumValueW(hKey, i, name, &nameLen, nullptr, &type, reinterpret_cast<BYTE*>(&g), &size);
+        if (rc == ERROR_NO_MORE_ITEMS)
+            break;
+        if (rc != ERROR_SUCCESS || type != REG_BINARY || size != sizeof(GUID))
+            continue;
+        table.Add(name, ToPlanId(g));
+    }
+    RegCloseKey(hKey);
+}
+
+void AppRulesLoad()
+{
+    LoadRuleTable(kAppRulesRegPath, g_engine.AppRules());
+}
+
+static void CALLBACK ForegroundEventProc(HWINEVENTHOOK, DWORD, HWND hwnd, LONG, LONG, DWORD, DWORD)
+{
+    AppRulesOnForeground(hwnd);
+}
+
+void AppRulesStart(HWND /*hWnd*/)
+{
+    // No rules, no hook: zero cost for users who do not use the feature
+    if (g_engine.AppRules().Count() == 0 || g_hForegroundHook)
+        return;
+    // Out-of-context events are delivered on this thread through the message loop
+    g_hForegroundHook = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, nullptr,
+        ForegroundEventProc, 0, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+    AppRulesOnForeground(GetForegroundWindow());
+}
+
+void AppRulesStop()
+{
+    if (g_hForegroundHook)
+    {
+        UnhookWinEvent(g_hForegroundHook);
+        g_hForegroundHook = nullptr;
+    }
+}
+
+void AppRulesOnForeground(HWND hwndForeground)
+{
+    DWORD pid = 0;
+    if (!hwndForeground || !GetWindowThreadProcessId(hwndForeground, &pid) || pid == 0)
+        return;
+    // Focus moving between windows of one process resolves to the same rule
+    if (pid == g_ruleLastPid)
+        return;
+    g_ruleLastPid = pid;
+
+    wchar_t path[MAX_PATH];
+    bool known = false;
+    HANDLE hProc = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+    if (hProc)
+    {
+        DWORD cch = ARRAYSIZE(path);
+        known = QueryFullProcessImageNameW(hProc, 0, path, &cch) != FALSE;
+        CloseHandle(hProc);
+    }
+    g_engine.ForegroundChanged(known ? path : nullptr, GetTickCount64());
+}
+
+// ===== Process triggers =====
+// Same layout as AppRules: "<image>.exe" = REG_BINARY plan GUID, active while
+// any process with that image is running, foreground or not.
+static const wchar_t* kProcessTriggersRegPath = L"Software\\PowerPlanTray\\ProcessTriggers";
+
+// The head of one SystemProcessInformation record, as far as the scan reads
+// it. winternl.h hides the creation time among reserved fields; the layout
+// has not changed since Windows XP. EnumProcesses is built on the same query
+// and throws the rest away.
+struct ProcessInfoRecord
+{
+    ULONG nextEntryOffset;   // 0 on the last record
+    ULONG numberOfThreads;
+    LONGLONG workingSetPrivateSize;
+    ULONG hardFaultCount;
+    ULONG numberOfThreadsHighWatermark;
+    ULONGLONG cycleTime;
+    LONGLONG createTime;
+    LONGLONG userTime;
+    LONGLONG kernelTime;
+    USHORT imageNameLength;  // Bytes, not terminated
+    USHORT imageNameMaximumLength;
+    wchar_t* imageName;      // File name only; null for the idle process
+    LONG basePriority;
+    HANDLE uniqueProcessId;
+};
+typedef LONG (WINAPI *NtQuerySystemInformationFn)(int infoClass, PVOID buffer, ULONG bytes, ULONG* needed);
+static const int kSystemProcessInformation = 5;
+static const LONG kStatusInfoLengthMismatch = (LONG)0xC0000004;
+static NtQuerySystemInformationFn g_ntQuerySystemInformation = nullptr;
+
+void ProcessTriggersStart(HWND hWnd)
+{
+    AppRuleTable& triggers = g_engine.ProcessTriggers();
+    LoadRuleTable(kProcessTriggersRegPath, triggers);
+    if (triggers.Count() == 0)
+        return;
+    HMODULE hNtdll = GetModuleHandleW(L"ntdll.dll");
+    if (hNtdll)
+        g_ntQuerySystemInformation = reinterpret_cast<NtQuerySystemInformationFn>(
+            GetProcAddress(hNtdll, "NtQuerySystemInformation"));
+    if (!g_ntQuerySystemInformation)
+        return;
+    ProcessTriggersScan();
+    SetTimer(hWnd, TIMER_EVENT_PROCESS_SCAN, 5000, nullptr);
+}
+
+// A new process: its image name came with the snapshot, so matching it takes
+// no handle
+static void OnProcessAdded(const ProcessKey& key, const ProcessInfoRecord& record)
+{
+    if (!record.imageName || !record.imageNameLength)
+        return;
+    wchar_t image[MAX_PATH];
+    const size_t cch = (std::min)((size_t)record.imageNameLength / sizeof(wchar_t), ARRAYSIZE(image) - 1);
+    memcpy(image, record.imageName, cch * sizeof(wchar_t));
+    image[cch] = L'\0';
+    g_engine.ProcessStarted(key.pid, key.createTime, image);
+}
+
+void ProcessTriggersScan()
+{
+    const ULONGLONG startUs = NowMicros();
+    static std::vector<BYTE> buffer(256 * 1024);
+    ULONG needed = 0;
+    LONG status;
+    while ((status = g_ntQuerySystemInformation(kSystemProcessInformation, buffer.data(), (ULONG)buffer.size(),
+        &needed)) == kStatusInfoLengthMismatch)
+    {
+        // Leave headroom: processes start between the two calls
+        buffer.resize((std::max)((size_t)needed + 64 * 1024, buffer.size() * 2));
+    }
+    if (status < 0)
+        return;
+
+    // Keys into the snapshot; both vectors keep their capacity across scans
+    static std::vector<ProcessKey> keys;
+    static std::vector<const ProcessInfoRecord*> records;
+    keys.clear();
+    records.clear();
+    for (size_t offset = 0;;)
+    {
+        const ProcessInfoRecord* record = reinterpret_cast<const ProcessInfoRecord*>(buffer.data() + offset);
+        keys.push_back({ (uint32_t)(ULONG_PTR)record->uniqueProcessId, (uint32_t)records.size(),
+            (uint64_t)record->createTime });
+        records.push_back(record);
+        if (!record->nextEntryOffset)
+            break;
+        offset += record->nextEntryOffset;
+    }
+
+    g_processDiff.Update(keys.data(), keys.size(),
+        [](const ProcessKey& key) { OnProcessAdded(key, *records[key.tag]); },
+        [](const ProcessKey& key) { g_engine.ProcessExited(key.pid, key.createTime); });
+    g_engine.ProcessesScanned(GetTickCount64());
+    g_latency[LAT_PROCESS_SCAN].Record(NowMicros() - startUs);
+}
+
+// ===== AFK helpers =====
+// "AfkStages" = REG_BINARY array of { DWORD threshold seconds, GUID plan }
+struct AfkStageRecord
+{
+    DWORD thresholdSeconds;
+    GUID plan;
+};
+static_assert(sizeof(AfkStageRecord) == 20, "registry layout");
+
+void AfkLoadSettings()
+{
+    AfkLadder& ladder = g_engine.Ladder();
+    ladder.Clear();
+    // Sized first: a value written with more stages than the ladder holds
+    // would fail a fixed-size read with ERROR_MORE_DATA and look like no
+    // value at all. The first stages that fit are kept.
+    DWORD size = 0;
+    if (RegGetValueW(HKEY_CURRENT_USER, kAppRegPath, L"AfkStages", RRF_RT_REG_BINARY, nullptr, nullptr, &size) == ERROR_SUCCESS)
+    {
+        std::vector<AfkStageRecord> records(size / sizeof(AfkStageRecord) + 1);
+        size = (DWORD)(records.size() * sizeof(AfkStageRecord));
+        if (RegGetValueW(HKEY_CURRENT_USER, kAppRegPath, L"AfkStages", RRF_RT_REG_BINARY, nullptr, records.data(), &size) == ERROR_SUCCESS)
         {
-            g_afkTargetGuid = g;
+            for (DWORD i = 0; i < size / sizeof(AfkStageRecord); ++i)
+            {
+                if (!IsEqualGUID(records[i].plan, GUID{}))
+                    ladder.Set(records[i].thresholdSeconds * 1000U, ToPlanId(records[i].plan));
+            }
         }
-        RegCloseKey(hKey);
+        return;
+    }
+
+    // Settings from before stages existed: one timeout, one target
+    GUID target{};
+    const DWORD minutes = ReadAppDword(L"AfkTimeoutMinutes", 0);
+    if (minutes && ReadAppGuid(L"AfkTargetPlan", target) && !IsEqualGUID(target, GUID{}))
+    {
+        ladder.Set(minutes * 60000U, ToPlanId(target));
+        AfkSaveSettings();
     }
 }
 
 void AfkSaveSettings()
 {
     HKEY hKey;
-    if (RegCreateKeyExW(HKEY_CURRENT_USER, kAfkRegPath, 0, nullptr, 0, KEY_SET_VALUE, nullptr, &hKey, nullptr) == ERROR_SUCCESS)
+    if (RegCreateKeyExW(HKEY_CURRENT_USER, kAppRegPath, 0, nullptr, 0, KEY_SET_VALUE, nullptr, &hKey, nullptr) == ERROR_SUCCESS)
     {
-        DWORD dw = (DWORD)g_afkTimeoutMinutes;
-        RegSetValueExW(hKey, L"AfkTimeoutMinutes", 0, REG_DWORD, reinterpret_cast<const BYTE*>(&dw), sizeof(dw));
-        RegSetValueExW(hKey, L"AfkTargetPlan", 0, REG_BINARY, reinterpret_cast<const BYTE*>(&g_afkTargetGuid), sizeof(GUID));
+        const AfkLadder& ladder = g_engine.Ladder();
+        AfkStageRecord records[AfkLadder::kMaxStages] = {};
+        const DWORD count = (DWORD)ladder.Count();
+        for (DWORD i = 0; i < count; ++i)
+            records[i] = { ladder.At(i).thresholdMs / 1000U, ToGuid(ladder.At(i).plan) };
+        RegSetValueExW(hKey, L"AfkStages", 0, REG_BINARY, reinterpret_cast<const BYTE*>(records), count * sizeof(AfkStageRecord));
+        // The stage list supersedes the single-stage values
+        RegDeleteValueW(hKey, L"AfkTimeoutMinutes");
+        RegDeleteValueW(hKey, L"AfkTargetPlan");
         RegCloseKey(hKey);
     }
 }
 
+// After a menu edit: persist, then re-evaluate against the edited ladder
+void AfkEdited(HWND hWnd)
+{
+    AfkSaveSettings();
+    AfkCheckTick(hWnd);
+}
+
 DWORD GetIdleSeconds()
+{
+    return (DWORD)(GetIdleMilliseconds() / 1000ULL);
+}
+
+ULONGLONG GetIdleMilliseconds()
 {
     LASTINPUTINFO li{}; li.cbSize = sizeof(li);
     if (!GetLastInputInfo(&li)) return 0;
-    ULONGLONG now = GetTickCount64();
-    ULONGLONG then = (ULONGLONG)li.dwTime;
-    if (now < then) return 0; // extremely unlikely with GetTickCount64
-    ULONGLONG diff = now - then;
-    return (DWORD)(diff / 1000ULL);
+    // dwTime is a 32-bit tick: compare it with the low half of the clock
+    return IdleMsFromTicks((uint32_t)GetTickCount64(), li.dwTime);
+}
+
+// One step of the engine's AFK machine against the idle time
+void AfkCheckTick(HWND /*hWnd*/)
+{
+    const ULONGLONG startUs = NowMicros();
+    const ULONGLONG idleMs = g_engine.Ladder().Count() ? GetIdleMilliseconds() : 0;
+    const AfkMachine::Output out = g_engine.AfkTick(GetTickCount64(), idleMs);
+    if (out.action == AfkMachine::ACTION_APPLY && out.fresh)
+    {
+        // Lag since the stage threshold was crossed plus the time spent switching
+        const AfkStage& s = g_engine.Ladder().At((size_t)g_engine.Afk().Stage());
+        g_latency[LAT_AFK_APPLY].Record((idleMs - s.thresholdMs) * 1000ULL + (NowMicros() - startUs));
+    }
+    // A stage can change without the plan changing
+    PublishState();
 }
 
-void AfkCheckTick(HWND hWnd)
+// Keyboard and mouse in the background, so the user's return is seen on the
+// first event instead of the next tick. The engine asks for it while a stage
+// is applied and not a moment longer: while the user is active it costs nothing.
+bool AfkSinkSet(HWND hWnd, bool on)
 {
-    if (g_afkTimeoutMinutes <= 0)
-        return; // feature disabled
+    RAWINPUTDEVICE rid[2] = {
+        { 0x01, 0x02, on ? RIDEV_INPUTSINK : (DWORD)RIDEV_REMOVE, on ? hWnd : nullptr }, // Generic desktop: mouse
+        { 0x01, 0x06, on ? RIDEV_INPUTSINK : (DWORD)RIDEV_REMOVE, on ? hWnd : nullptr }, // Generic desktop: keyboard
+    };
+    return RegisterRawInputDevices(rid, ARRAYSIZE(rid), sizeof(RAWINPUTDEVICE)) != FALSE;
+}
 
-    DWORD idle = GetIdleSeconds();
-    const DWORD threshold = (DWORD)g_afkTimeoutMinutes * 60U;
+void AfkUserReturned(HWND /*hWnd*/)
+{
+    const ULONGLONG startUs = NowMicros();
+    // The event waited in the queue for this long before reaching us
+    const DWORD queuedMs = GetTickCount() - (DWORD)GetMessageTime();
+    const PlanId before = g_engine.Active();
+    const AfkMachine::Output out = g_engine.UserInput(GetTickCount64());
+    // Only a restore that put a plan in force counts
+    if (out.action == AfkMachine::ACTION_RESTORE && g_engine.Active() != before)
+        g_latency[LAT_AFK_RESTORE].Record(queuedMs * 1000ULL + (NowMicros() - startUs));
+    PublishState();
+}
 
-    if (idle >= threshold)
+// ===== AFK return prediction =====
+// AfkPredictMarginMinutes: restore this long before a predicted return (0 = off);
+// AfkPredictConfidence: least chance, in percent, of a return in the predicted
+// window. The learned model is kept in "AfkReturnModel".
+void AfkPredictLoadSettings()
+{
+    const DWORD margin = ReadAppDword(L"AfkPredictMarginMinutes", 0);
+    ReturnPredictor::Config config;
+    config.confidencePercent = ReadAppDword(L"AfkPredictConfidence", config.confidencePercent);
+    g_engine.SetPrediction(margin, config);
+    if (!margin)
+        return;
+    BYTE data[ReturnPredictor::kDataSize];
+    DWORD size = sizeof(data);
+    if (RegGetValueW(HKEY_CURRENT_USER, kAppRegPath, L"AfkReturnModel", RRF_RT_REG_BINARY, nullptr, data, &size) == ERROR_SUCCESS)
+        g_engine.Predictor().Load(data, size);
+}
+
+// ===== AFK activity vetoes =====
+// AfkVetoCpuPercent, AfkVetoDiskKBps, AfkVetoNetKBps (0 = ignore) and
+// AfkVetoPowerRequests (display- or system-required requests, 1 = honour)
+void AfkVetoLoadSettings()
+{
+    ActivityVeto::Config config;
+    config.cpuPercent = (double)ReadAppDword(L"AfkVetoCpuPercent", (DWORD)config.cpuPercent);
+    config.diskBytesPerSec = (uint64_t)ReadAppDword(L"AfkVetoDiskKBps", (DWORD)(config.diskBytesPerSec / 1024)) * 1024;
+    config.netBytesPerSec = (uint64_t)ReadAppDword(L"AfkVetoNetKBps", (DWORD)(config.netBytesPerSec / 1024)) * 1024;
+    config.powerRequests = ReadAppDword(L"AfkVetoPowerRequests", config.powerRequests ? 1 : 0) != 0;
+    g_engine.SetVetoConfig(config);
+}
+
+void AfkVetoStop()
+{
+    if (g_hDiskQuery)
     {
-        if (!g_afkApplied)
+        PdhCloseQuery(g_hDiskQuery);
+        g_hDiskQuery = nullptr;
+        g_hDiskCounter = nullptr;
+    }
+}
+
+// Running totals only; ActivityVeto turns consecutive samples into rates
+void CollectActivity(ActivitySample& out)
+{
+    out = ActivitySample{};
+    out.timeMs = GetTickCount64();
+    FILETIME idle{}, kernel{}, user{};
+    if (GetSystemTimes(&idle, &kernel, &user))
+    {
+        out.cpuIdle = FileTimeToUll(idle);
+        out.cpuTotal = FileTimeToUll(kernel) + FileTimeToUll(user);
+    }
+
+    const ActivityVeto::Config& config = g_engine.Veto().GetConfig();
+    if (config.diskBytesPerSec)
+    {
+        // The raw value of a per-second counter is its running total
+        if (!g_hDiskQuery && PdhOpenQueryW(nullptr, 0, &g_hDiskQuery) == ERROR_SUCCESS)
+            PdhAddEnglishCounterW(g_hDiskQuery, L"\\PhysicalDisk(_Total)\\Disk Bytes/sec", 0, &g_hDiskCounter);
+        PDH_RAW_COUNTER raw{};
+        if (g_hDiskCounter && PdhCollectQueryData(g_hDiskQuery) == ERROR_SUCCESS &&
+            PdhGetRawCounterValue(g_hDiskCounter, nullptr, &raw) == ERROR_SUCCESS)
+            out.diskBytes = (uint64_t)raw.FirstValue;
+    }
+    if (config.netBytesPerSec)
+    {
+        MIB_IF_TABLE2* table = nullptr;
+        if (GetIfTable2(&table) == NO_ERROR)
         {
-            GUID cur{}; if (GetActivePlanGuid(cur)) g_afkPrevGuid = cur; else g_afkPrevGuid = GUID{};
-            if (!IsEqualGUID(cur, g_afkTargetGuid) && !IsEqualGUID(g_afkTargetGuid, GUID{}))
+            // Physical adapters only; filter and virtual interfaces repeat their traffic
+            for (ULONG i = 0; i < table->NumEntries; ++i)
             {
-                SetActivePlan(g_afkTargetGuid);
-                g_lastActiveGuid = g_afkTargetGuid;
-                UpdateTrayTooltip(hWnd);
+                const MIB_IF_ROW2& row = table->Table[i];
+                if (row.InterfaceAndOperStatusFlags.HardwareInterface)
+                    out.netBytes += row.InOctets + row.OutOctets;
             }
-            g_afkApplied = true;
+            FreeMibTable(table);
         }
     }
+    if (config.powerRequests)
+    {
+        ULONG state = 0;
+        if (CallNtPowerInformation(SystemExecutionState, nullptr, 0, &state, sizeof(state)) == 0)
+            out.powerRequest = (state & (ES_SYSTEM_REQUIRED | ES_DISPLAY_REQUIRED)) != 0;
+    }
+}
+
+// ===== IPC =====
+// Runs on the server's I/O thread: only posts, the switch itself is made here
+void IpcWake(void* context)
+{
+    PostMessage((HWND)context, WM_APP_IPC, 0, 0);
+}
+
+void IpcPublishPlans()
+{
+    if (!g_ipc.Running())
+        return;
+    static IpcPlan plans[kIpcMaxPlans];
+    static_assert(kIpcMaxPlans == kMaxPlans && kIpcNameMax == kPlanNameMax, "IPC plan list mirrors g_plans");
+    for (size_t i = 0; i < g_plans.count; ++i)
+    {
+        plans[i].id = ToPlanId(g_plans.items[i].guid);
+        StringCchCopyW(plans[i].name, ARRAYSIZE(plans[i].name), g_plans.items[i].name);
+    }
+    g_ipc.PublishPlans(plans, g_plans.count);
+}
+
+// A client's SET goes through the engine, as a menu pick does
+void IpcTakeSwitches()
+{
+    PlanId plan;
+    while (g_ipc.TakeSwitch(plan))
+        g_engine.PlanPicked(plan, GetTickCount64());
+}
+
+// ===== Published state =====
+// Cheap enough for every tooltip refresh and AFK tick: a copy under the IPC
+// server's lock and a few stores to the status block, each skipped unless
+// something changed
+void PublishState()
+{
+    if (!g_ipc.Running() && !g_status.IsOpen())
+        return;
+    IpcState state;
+    state.active = ToPlanId(g_cachedActiveGuid);
+    if (const PlanItem* plan = FindPlan(g_cachedActiveGuid))
+        StringCchCopyW(state.name, ARRAYSIZE(state.name), plan->name);
+    const AfkMachine& afk = g_engine.Afk();
+    state.afkStage = (int8_t)afk.Stage();
+    if (afk.Stage() >= 0 && !afk.PreRestored())
+        state.flags |= IPC_AFK_APPLIED;
+    if (g_engine.Ladder().Count())
+        state.flags |= IPC_AFK_ENABLED;
+    state.lastSwitchUnixMs = (uint64_t)g_lastSwitchUnixMs;
+    g_ipc.PublishState(state);
+
+    static StatusSnapshot status;
+    status.active = state.active;
+    StringCchCopyW(status.name, ARRAYSIZE(status.name), state.name);
+    status.afkApplied = (state.flags & IPC_AFK_APPLIED) != 0;
+    status.afkStage = state.afkStage;
+    status.lastSwitchUnixMs = state.lastSwitchUnixMs;
+    status.idleSeconds = g_statusIdleSeconds;
+    status.idleSampledUnixMs = (uint64_t)g_statusIdleSampledMs;
+    g_status.Publish(status);
+}
+
+// Readers cannot ask for the idle time, so the poll tick samples it for them
+void StatusSampleIdle()
+{
+    if (!g_status.IsOpen())
+        return;
+    g_statusIdleSeconds = GetIdleSeconds();
+    g_statusIdleSampledMs = UnixTimeMs();
+    PublishState();
+}
+
+// ===== Command line =====
+bool CliParseCommandLine(CliRequest& out)
+{
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (!argv)
+        return CliParse(0, nullptr, out); // Start the tray as before
+    const bool ok = CliParse(argc, argv, out);
+    LocalFree(argv);
+    return ok;
+}
+
+// A GUI-subsystem exe has no console of its own: write to the handle the
+// caller redirected, else to the console it was started from
+void CliWrite(DWORD stdHandle, const wchar_t* text)
+{
+    HANDLE out = GetStdHandle(stdHandle);
+    bool owned = false;
+    if (!out || out == INVALID_HANDLE_VALUE)
+    {
+        if (!AttachConsole(ATTACH_PARENT_PROCESS) && GetLastError() != ERROR_ACCESS_DENIED)
+            return;
+        out = CreateFileW(L"CONOUT$", GENERIC_WRITE, FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+        if (out == INVALID_HANDLE_VALUE)
+            return;
+        owned = true;
+    }
+    const DWORD len = (DWORD)wcslen(text);
+    DWORD written = 0, mode = 0;
+    if (GetConsoleMode(out, &mode))
+    {
+        WriteConsoleW(out, text, len, &written, nullptr);
+    }
     else
     {
-        if (g_afkApplied)
+        // Redirected to a file or pipe: UTF-8, as scripts expect
+        static char utf8[kCliReplyMax * 3];
+        const int n = WideCharToMultiByte(CP_UTF8, 0, text, (int)len, utf8, (int)sizeof(utf8), nullptr, nullptr);
+        if (n > 0)
+            WriteFile(out, utf8, (DWORD)n, &written, nullptr);
+    }
+    if (owned)
+        CloseHandle(out);
+}
+
+// Plan named on the command line: a GUID, else a name in any case. A miss
+// re-reads the list once in case the plan is new.
+static const PlanItem* CliFindPlan(const wchar_t* text)
+{
+    PlanId id;
+    const bool byGuid = ParsePlanId(text, id);
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (const PlanItem& plan : g_plans)
         {
-            GUID cur{}; GetActivePlanGuid(cur);
-            if (!IsEqualGUID(cur, g_afkPrevGuid) && !IsEqualGUID(g_afkPrevGuid, GUID{}))
-            {
-                SetActivePlan(g_afkPrevGuid);
-                g_lastActiveGuid = g_afkPrevGuid;
-                UpdateTrayTooltip(hWnd);
-            }
-            g_afkApplied = false;
+            if (byGuid ? ToPlanId(plan.guid) == id : _wcsicmp(plan.name, text) == 0)
+                return &plan;
         }
+        if (pass == 0 && !ValidatePlans())
+            break;
     }
+    return nullptr;
+}
+
+// One "<mark>Name {guid}" line
+static void CliAppendPlan(wchar_t* reply, size_t cch, const GUID& guid, const wchar_t* mark)
+{
+    wchar_t id[40];
+    FormatPlanId(ToPlanId(guid), id, ARRAYSIZE(id));
+    const PlanItem* plan = FindPlan(guid);
+    const size_t len = wcslen(reply);
+    StringCchPrintfW(reply + len, cch - len, L"%s%s%s%s\n", mark, plan ? plan->name : L"", plan ? L" " : L"", id);
+}
+
+// In the tray a switch goes through the engine, as a menu pick does;
+// without one it is made directly and remembered for --toggle. False if
+// the system refused it.
+static bool CliSwitch(HWND hWnd, const GUID& plan)
+{
+    if (hWnd)
+    {
+        g_engine.PlanPicked(ToPlanId(plan), GetTickCount64());
+        return true;
+    }
+    if (!SetActivePlan(plan))
+        return false;
+    NoteActivePlan(plan);
+    return true;
+}
+
+// Runs a verb against this process's state: the tray's when hWnd is its
+// window, else a fresh read of the cache, registry and live plan list
+CliStatus CliRun(HWND hWnd, const CliRequest& request, wchar_t* reply, size_t cch)
+{
+    reply[0] = L'\0';
+    if (request.verb == CLI_LIST || !g_plans.count)
+        ValidatePlans();
+    const PlanItem* plan = nullptr;
+    if (request.plan[0] && !(plan = CliFindPlan(request.plan)))
+    {
+        StringCchPrintfW(reply, cch, L"No plan named \"%s\".\n", request.plan);
+        return CLI_FAILED;
+    }
+    GUID active{};
+    const bool known = GetActivePlanGuid(active);
+
+    switch (request.verb)
+    {
+    case CLI_TOGGLE:
+        plan = FindPlan(g_cachedPreviousGuid);
+        if (!plan || (known && IsEqualGUID(plan->guid, active)))
+        {
+            StringCchCopyW(reply, cch, L"No earlier plan to go back to.\n");
+            return CLI_FAILED;
+        }
+        // Fall through
+    case CLI_SET:
+        if (!CliSwitch(hWnd, plan->guid))
+        {
+            StringCchPrintfW(reply, cch, L"Could not switch to \"%s\".\n", plan->name);
+            return CLI_FAILED;
+        }
+        CliAppendPlan(reply, cch, plan->guid, L"");
+        return CLI_OK;
+    case CLI_GET:
+        if (!known)
+            break;
+        CliAppendPlan(reply, cch, active, L"");
+        return CLI_OK;
+    case CLI_LIST:
+        for (const PlanItem& item : g_plans)
+            CliAppendPlan(reply, cch, item.guid, known && IsEqualGUID(item.guid, active) ? L"* " : L"  ");
+        return CLI_OK;
+    case CLI_AFK:
+    {
+        // One stage replaces the ladder; without a plan it keeps the deepest one's
+        if (!hWnd)
+            AfkLoadSettings();
+        AfkLadder& ladder = g_engine.Ladder();
+        const PlanId target = plan ? ToPlanId(plan->guid) : ladder.Count() ? ladder.At(ladder.Count() - 1).plan : PlanId{};
+        if (request.minutes && target.IsNull())
+        {
+            StringCchCopyW(reply, cch, L"No AFK plan yet: give one after the minutes.\n");
+            return CLI_FAILED;
+        }
+        ladder.Clear();
+        if (request.minutes)
+            ladder.Set(request.minutes * 60000U, target);
+        if (hWnd)
+            AfkEdited(hWnd);
+        else
+            AfkSaveSettings();
+        if (!request.minutes)
+        {
+            StringCchCopyW(reply, cch, L"AFK off\n");
+            return CLI_OK;
+        }
+        wchar_t mark[32];
+        StringCchPrintfW(mark, ARRAYSIZE(mark), L"AFK after %u min: ", request.minutes);
+        CliAppendPlan(reply, cch, ToGuid(target), mark);
+        return CLI_OK;
+    }
+    default:
+        break;
+    }
+    StringCchCopyW(reply, cch, L"The active plan could not be read.\n");
+    return CLI_FAILED;
+}
+
+// The running tray answers by WM_COPYDATA to this window while the request
+// is still being sent
+static wchar_t g_cliReply[kCliReplyMax];
+static bool g_cliAnswered = false;
+
+static LRESULT CALLBACK CliReplyProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    if (message != WM_COPYDATA)
+        return DefWindowProc(hWnd, message, wParam, lParam);
+    const COPYDATASTRUCT* data = reinterpret_cast<const COPYDATASTRUCT*>(lParam);
+    const size_t cch = data->cbData / sizeof(wchar_t);
+    if (data->dwData == kCliReplyTag && data->lpData && cch && cch <= ARRAYSIZE(g_cliReply))
+    {
+        memcpy(g_cliReply, data->lpData, cch * sizeof(wchar_t));
+        g_cliReply[cch - 1] = L'\0';
+        g_cliAnswered = true;
+    }
+    return TRUE;
+}
+
+// False only if the tray is too old to know the verbs. Anything else it may
+// have acted on, so not hearing back is a failure, not a cue to run the verb
+// here against a cache the tray has yet to write.
+static bool CliForward(HINSTANCE hInstance, HWND tray, const CliRequest& request, CliStatus& status)
+{
+    status = CLI_FAILED;
+    StringCchCopyW(g_cliReply, ARRAYSIZE(g_cliReply), L"The running tray did not answer.\n");
+    WNDCLASSEXW wcex = {};
+    wcex.cbSize = sizeof(wcex);
+    wcex.lpfnWndProc = CliReplyProc;
+    wcex.hInstance = hInstance;
+    wcex.lpszClassName = kCliClassName;
+    if (!RegisterClassExW(&wcex))
+        return true;
+    HWND hReply = CreateWindowExW(0, kCliClassName, nullptr, 0, 0, 0, 0, 0, HWND_MESSAGE, nullptr, hInstance, nullptr);
+    if (!hReply)
+        return true;
+    COPYDATASTRUCT data = { kCliRequestTag, (DWORD)sizeof(request), const_cast<CliRequest*>(&request) };
+    DWORD_PTR result = 0;
+    // Not SMTO_BLOCK: the reply arrives as a sent message while this waits
+    const bool sent = SendMessageTimeoutW(tray, WM_COPYDATA, reinterpret_cast<WPARAM>(hReply),
+        reinterpret_cast<LPARAM>(&data), SMTO_ABORTIFHUNG, kCliTimeoutMs, &result) != 0;
+    DestroyWindow(hReply);
+    if (sent && !(result & kCliHandled))
+        return false;
+    if (sent && g_cliAnswered)
+        status = (CliStatus)(result & 0xFF);
+    return true;
+}
+
+int CliMain(HINSTANCE hInstance, const CliRequest& request)
+{
+    CliStatus status = CLI_FAILED;
+    HWND tray = FindWindowW(kClassName, nullptr);
+    if (!tray || !CliForward(hInstance, tray, request, status))
+    {
+        // No tray to ask: start from what it last saw, then catch up with
+        // any change made while it was not running
+        LoadPlanCacheForStartup();
+        ValidatePlans();
+        GUID active{};
+        if (GetActivePlanGuid(active))
+            NoteActivePlan(active);
+        status = CliRun(nullptr, request, g_cliReply, ARRAYSIZE(g_cliReply));
+    }
+    CliWrite(status == CLI_OK ? STD_OUTPUT_HANDLE : STD_ERROR_HANDLE, g_cliReply);
+    return status;
+}
+
+// ===== Diagnostics =====
+ULONGLONG NowMicros()
+{
+    static LARGE_INTEGER freq{};
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    LARGE_INTEGER now; QueryPerformanceCounter(&now);
+    // Split to avoid overflowing the multiplication on long uptimes
+    const ULONGLONG secs = (ULONGLONG)now.QuadPart / (ULONGLONG)freq.QuadPart;
+    const ULONGLONG rem = (ULONGLONG)now.QuadPart % (ULONGLONG)freq.QuadPart;
+    return secs * 1000000ULL + rem * 1000000ULL / (ULONGLONG)freq.QuadPart;
+}
+
+static void AppendLatencyLine(wchar_t* buf, size_t cch, const wchar_t* label, const LatencyHistogram& h)
+{
+    wchar_t line[256];
+    StringCchPrintfW(line, ARRAYSIZE(line), L"%s: n=%llu p50=%.2f ms p90=%.2f ms p99=%.2f ms max=%.2f ms\r\n",
+        label, h.Count(), h.Percentile(50) / 1000.0, h.Percentile(90) / 1000.0,
+        h.Percentile(99) / 1000.0, h.Max() / 1000.0);
+    StringCchCatW(buf, cch, line);
+}
+
+void ShowDiagnostics(HWND hWnd)
+{
+    static const wchar_t* kLabels[LAT_COUNT] = {
+        L"Menu open",
+        L"Plan click",
+        L"External change",
+        L"AFK apply",
+        L"AFK restore",
+        L"Menu open after trim",
+        L"Process scan"
+    };
+    wchar_t text[2048] = {};
+    for (int i = 0; i < LAT_COUNT; ++i)
+        AppendLatencyLine(text, ARRAYSIZE(text), kLabels[i], g_latency[i]);
+
+    wchar_t line[192];
+    StringCchPrintfW(line, ARRAYSIZE(line), L"Startup: icon=%.2f ms tooltip=%.2f ms ready=%.2f ms (plan cache %s)\r\n",
+        g_timeToIconUs / 1000.0, g_timeToTooltipUs / 1000.0, g_timeToReadyUs / 1000.0,
+        g_planCacheHit ? L"hit" : L"miss");
+    StringCchCatW(text, ARRAYSIZE(text), line);
+    StringCchPrintfW(line, ARRAYSIZE(line), L"Idle trim: count=%u last RSS %.1f KB -> %.1f KB, now %.1f KB\r\n",
+        g_trimCount, g_trimRssBefore / 1024.0, g_trimRssAfter / 1024.0, GetWorkingSetBytes() / 1024.0);
+    StringCchCatW(text, ARRAYSIZE(text), line);
+    if (g_engine.ProcessTriggers().Count())
+    {
+        StringCchPrintfW(line, ARRAYSIZE(line), L"Process triggers: watching %zu, %u matches dropped (table full)\r\n",
+            g_engine.WatchedProcesses(), g_engine.WatchedDropped());
+        StringCchCatW(text, ARRAYSIZE(text), line);
+    }
+    if (!g_engine.LoadBoostPlan().IsNull())
+    {
+        StringCchPrintfW(line, ARRAYSIZE(line), L"CPU load: %.1f%% (smoothed), boosted=%s\r\n",
+            g_engine.Load().SmoothedPercent(), g_engine.Load().Boosted() ? L"yes" : L"no");
+        StringCchCatW(text, ARRAYSIZE(text), line);
+    }
+    static const wchar_t* kSources[SOURCE_COUNT] = {
+        L"AFK", L"manual hold", L"app rule", L"process", L"CPU load", L"power source", L"schedule", L"manual"
+    };
+    const PolicyEngine& policy = g_engine.Policy();
+    const int winner = policy.Winner();
+    StringCchPrintfW(line, ARRAYSIZE(line), L"Policy: effective from %s, %d claims, %u rescans\r\n",
+        winner < 0 ? L"none" : kSources[winner], policy.ClaimCount(), policy.Rescans());
+    StringCchCatW(text, ARRAYSIZE(text), line);
+    const SwitchGovernor::Counters& gov = g_engine.Governor().GetCounters();
+    StringCchPrintfW(line, ARRAYSIZE(line), L"Switch governor: applied=%u suppressed=%u superseded=%u bypassed=%u%s\r\n",
+        gov.applied, gov.suppressed, gov.superseded, gov.bypassed, g_engine.Governor().HasPending() ? L" (one parked)" : L"");
+    StringCchCatW(text, ARRAYSIZE(text), line);
+    const ActivityVeto& veto = g_engine.Veto();
+    const AfkMachine& afk = g_engine.Afk();
+    if (veto.Enabled())
+    {
+        const uint32_t r = veto.Reasons();
+        StringCchPrintfW(line, ARRAYSIZE(line), L"AFK vetoes: held %u times%s, last cpu=%.0f%% disk=%.0f KB/s net=%.0f KB/s%s%s%s%s\r\n",
+            afk.GetCounters().vetoHolds, afk.VetoHeld() ? L" (holding)" : L"", veto.CpuPercent(),
+            veto.DiskBytesPerSec() / 1024.0, veto.NetBytesPerSec() / 1024.0,
+            (r & ActivityVeto::VETO_CPU) ? L" [cpu]" : L"", (r & ActivityVeto::VETO_DISK) ? L" [disk]" : L"",
+            (r & ActivityVeto::VETO_NETWORK) ? L" [net]" : L"", (r & ActivityVeto::VETO_POWER_REQUEST) ? L" [request]" : L"");
+        StringCchCatW(text, ARRAYSIZE(text), line);
+    }
+    if (g_engine.PredictMarginMinutes())
+    {
+        const AfkMachine::Counters& counters = afk.GetCounters();
+        StringCchPrintfW(line, ARRAYSIZE(line), L"AFK prediction: %u hits, %u misses, %.1f min restored early%s\r\n",
+            counters.predictHits, counters.predictMisses, counters.earlyMs / 60000.0, afk.PreRestored() ? L" (now)" : L"");
+        StringCchCatW(text, ARRAYSIZE(text), line);
+    }
+    if (g_engine.ScheduleDueWallMs())
+    {
+        StringCchPrintfW(line, ARRAYSIZE(line), L"Schedule: next transition in %.1f min\r\n",
+            (g_engine.ScheduleDueWallMs() - UnixTimeMs()) / 60000.0);
+        StringCchCatW(text, ARRAYSIZE(text), line);
+    }
+    if (g_ipc.Running())
+    {
+        const IpcServer::Stats ipc = g_ipc.GetStats();
+        StringCchPrintfW(line, ARRAYSIZE(line), L"IPC: %u clients (peak %u), %llu requests, %llu events, %u dropped\r\n",
+            ipc.clients, ipc.peakClients, ipc.requests, ipc.events, (UINT)ipc.dropped);
+        StringCchCatW(text, ARRAYSIZE(text), line);
+    }
+    if (g_status.IsOpen())
+    {
+        StringCchPrintfW(line, ARRAYSIZE(line), L"Status block: %llu writes\r\n", g_status.Writes());
+        StringCchCatW(text, ARRAYSIZE(text), line);
+    }
+
+    OutputDebugStringW(text);
+    auto title = LoadResString(IDS_MENU_DIAGNOSTICS);
+    MessageBoxW(hWnd, text, title.empty() ? L"PowerPlanTray" : title.c_str(), MB_OK | MB_ICONINFORMATION);
 }
@@ -1,3 +1,41 @@
 #pragma once
 
 #include "resource.h"
+#include "PlanId.h"
+
+#include <stddef.h>
+
+// Plan names are sized to NOTIFYICONDATA::szTip so the tooltip never truncates
+// further; fixed capacity keeps the steady-state paths free of heap allocation.
+const size_t kPlanNameMax = 128;
+const size_t kMaxPlans = 64;
+
+struct PlanItem {
+    GUID guid;
+    wchar_t name[kPlanNameMax];
+};
+
+struct PlanList {
+    PlanItem items[kMaxPlans];
+    size_t count = 0;
+
+    size_t size() const { return count; }
+    const PlanItem& operator[](size_t i) const { return items[i]; }
+    const PlanItem* begin() const { return items; }
+    const PlanItem* end() const { return items + count; }
+};
+
+// Conversions between the Win32 GUID and the portable PlanId used by policy code
+static_assert(sizeof(PlanId) == sizeof(GUID), "PlanId mirrors GUID");
+
+inline PlanId ToPlanId(const GUID& guid)
+{
+    PlanId id; memcpy(id.bytes, &guid, sizeof(guid));
+    return id;
+}
+
+inline GUID ToGuid(const PlanId& id)
+{
+    GUID guid; memcpy(&guid, id.bytes, sizeof(guid));
+    return guid;
+}
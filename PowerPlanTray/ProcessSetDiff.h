@@ -0,0 +1,66 @@
+// ProcessSetDiff.h: Incremental diffing of process snapshots.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+// One process in a snapshot. A PID alone does not name a process: Windows
+// reuses them, and a PID that exits and comes back between two scans would
+// look unchanged. Its creation time tells the two owners apart.
+struct ProcessKey
+{
+    uint32_t pid;
+    uint32_t tag;        // The caller's own, e.g. an index into its snapshot; not compared
+    uint64_t createTime;
+};
+
+// Keeps the previous snapshot sorted and reports only the processes that
+// appeared or disappeared since then, so callers resolve names and rules for
+// new processes alone instead of rescanning every process on every tick. A
+// reused PID is reported as its old owner removed and the new one added.
+class ProcessSetDiff
+{
+public:
+    // keys is sorted in place. onAdded(key) / onRemoved(key) are invoked in
+    // ascending (PID, creation time) order; onAdded gets the key with the tag
+    // given here, onRemoved the one remembered from the last Update. Storage
+    // grows only when the process count does.
+    template <class Added, class Removed>
+    void Update(ProcessKey* keys, size_t count, Added onAdded, Removed onRemoved)
+    {
+        std::sort(keys, keys + count, Less);
+        count = (size_t)(std::unique(keys, keys + count, Same) - keys);
+
+        size_t i = 0, j = 0;
+        const size_t prevCount = m_prev.size();
+        while (i < prevCount || j < count)
+        {
+            if (j == count || (i < prevCount && Less(m_prev[i], keys[j])))
+                onRemoved(m_prev[i++]);
+            else if (i == prevCount || Less(keys[j], m_prev[i]))
+                onAdded(keys[j++]);
+            else
+                ++i, ++j;
+        }
+        m_prev.assign(keys, keys + count);
+    }
+
+    void Reset() { m_prev.clear(); }
+    size_t Count() const { return m_prev.size(); }
+
+private:
+    static bool Less(const ProcessKey& a, const ProcessKey& b)
+    {
+        return a.pid != b.pid ? a.pid < b.pid : a.createTime < b.createTime;
+    }
+    static bool Same(const ProcessKey& a, const ProcessKey& b)
+    {
+        return a.pid == b.pid && a.createTime == b.createTime;
+    }
+
+    std::vector<ProcessKey> m_prev;
+};
@@ -35,6 +35,11 @@
 #define IDS_MENU_AFK_45MIN              2014
 #define IDS_MENU_AFK_60MIN              2015
 #define IDS_MENU_AFK_1MIN               2016
+#define IDS_MENU_DIAGNOSTICS            2017
+#define IDS_MENU_AFK_ADD_STAGE          2018
+#define IDS_MENU_AFK_REMOVE_STAGE       2019
+#define IDS_MENU_AFK_STAGE_FMT          2020
+#define IDS_MENU_AFK_20MIN              2021
 // Next default values for new objects
 //
 #ifdef APSTUDIO_INVOKED
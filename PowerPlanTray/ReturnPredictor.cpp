@@ -0,0 +1,78 @@
+// ReturnPredictor.cpp: Learns what time of day the user comes back to the machine, per weekday.
+
+#include "ReturnPredictor.h"
+
+#include <string.h>
+
+void ReturnPredictor::Clear()
+{
+    memset(m_bins, 0, sizeof(m_bins));
+    memset(m_total, 0, sizeof(m_total));
+}
+
+void ReturnPredictor::Observe(uint32_t weekday, uint32_t minuteOfDay)
+{
+    if (weekday >= 7 || minuteOfDay >= 24 * 60)
+        return;
+    uint16_t* day = m_bins[weekday];
+    ++day[minuteOfDay / kBinMinutes];
+    if (++m_total[weekday] < kDecayAt)
+        return;
+    m_total[weekday] = 0;
+    for (uint32_t b = 0; b < kBinsPerDay; ++b)
+    {
+        day[b] = (uint16_t)(day[b] / 2);
+        m_total[weekday] += day[b];
+    }
+}
+
+uint32_t ReturnPredictor::ConfidenceAt(uint32_t weekday, uint32_t minuteOfDay) const
+{
+    if (weekday >= 7 || minuteOfDay >= 24 * 60)
+        return 0;
+    const uint16_t* day = m_bins[weekday];
+    const uint32_t first = minuteOfDay / kBinMinutes;
+    uint32_t window = 0, ahead = 0;
+    for (uint32_t b = first; b < kBinsPerDay; ++b)
+    {
+        if (b < first + kWindowBins) window += day[b];
+        ahead += day[b];
+    }
+    return ahead ? window * 100 / ahead : 0;
+}
+
+uint32_t ReturnPredictor::MinutesToLikelyReturn(uint32_t weekday, uint32_t minuteOfDay) const
+{
+    if (weekday >= 7 || minuteOfDay >= 24 * 60 || m_total[weekday] < m_config.minReturns)
+        return kNone;
+    const uint16_t* day = m_bins[weekday];
+    const uint32_t first = minuteOfDay / kBinMinutes;
+
+    // Walk backwards from midnight so the mass still ahead is a running sum
+    uint32_t ahead = 0, found = kNone;
+    for (uint32_t b = kBinsPerDay; b-- > first;)
+    {
+        ahead += day[b];
+        uint32_t window = 0;
+        for (uint32_t w = b; w < b + kWindowBins && w < kBinsPerDay; ++w) window += day[w];
+        if (window && window * 100 >= m_config.confidencePercent * ahead)
+            found = b;
+    }
+    if (found == kNone)
+        return kNone;
+    const uint32_t start = found * kBinMinutes;
+    return start > minuteOfDay ? start - minuteOfDay : 0;
+}
+
+bool ReturnPredictor::Load(const void* data, uint32_t size)
+{
+    if (size != kDataSize)
+        return false;
+    memcpy(m_bins, data, kDataSize);
+    for (uint32_t d = 0; d < 7; ++d)
+    {
+        m_total[d] = 0;
+        for (uint32_t b = 0; b < kBinsPerDay; ++b) m_total[d] += m_bins[d][b];
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+// ReturnPredictor.h: Learns what time of day the user comes back to the machine, per weekday.
+
+#pragma once
+
+#include <stdint.h>
+
+// One fixed histogram of return times per weekday, in kBinMinutes bins. While
+// the user is away, the chance of a return in the next window is the mass of
+// that window over the mass of everything still ahead today, i.e. among the
+// returns that happened no earlier than now. Memory is fixed at 4 KB and an
+// observation is one increment; a weekday is halved once it holds kDecayAt
+// returns, so old habits fade (amortised O(1): 288 bins about every
+// kDecayAt / 2 returns, since a halved day keeps up to half its total).
+class ReturnPredictor
+{
+public:
+    static const uint32_t kBinMinutes = 5;
+    static const uint32_t kBinsPerDay = 24 * 60 / kBinMinutes;
+    static const uint32_t kWindowBins = 2;   // A predicted return lands in this many bins
+    static const uint32_t kDecayAt = 64;
+    static const uint32_t kNone = UINT32_MAX;
+
+    struct Config
+    {
+        uint32_t confidencePercent = 70; // Least chance of a return within the window
+        uint32_t minReturns = 8;         // Returns seen on a weekday before it predicts
+    };
+
+    ReturnPredictor() { Clear(); }
+
+    void Clear();
+    // The user came back on weekday (0 = Sunday) at minuteOfDay
+    void Observe(uint32_t weekday, uint32_t minuteOfDay);
+    // Minutes from minuteOfDay to the start of the first window today that
+    // meets the confidence, 0 if the current one does, kNone if none does
+    uint32_t MinutesToLikelyReturn(uint32_t weekday, uint32_t minuteOfDay) const;
+    // Chance in percent of a return within the window starting at minuteOfDay
+    uint32_t ConfidenceAt(uint32_t weekday, uint32_t minuteOfDay) const;
+    uint32_t Returns(uint32_t weekday) const { return weekday < 7 ? m_total[weekday] : 0; }
+
+    const Config& GetConfig() const { return m_config; }
+    void SetConfig(const Config& config) { m_config = config; }
+
+    // Raw bins for persistence; Load rejects anything but exactly this size
+    const void* Data() const { return m_bins; }
+    static const uint32_t kDataSize = 7 * kBinsPerDay * sizeof(uint16_t);
+    bool Load(const void* data, uint32_t size);
+
+private:
+    Config m_config;
+    uint16_t m_bins[7][kBinsPerDay];
+    uint32_t m_total[7];
+};
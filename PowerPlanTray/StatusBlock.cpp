@@ -0,0 +1,299 @@
+// StatusBlock.cpp: Shared-memory status record the tray keeps current, read without syscalls.
+
+#include "StatusBlock.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const size_t kWords = kStatusBytes / 4;
+static const size_t kMagicWord = 0;
+static const size_t kVersionWord = 1;
+static const size_t kSequenceWord = 2;
+static const size_t kGenerationWord = 3; // First word under the seqlock
+static const size_t kNameOffset = 56;
+// A write is a few dozen stores; this many attempts only fail if the writer
+// stopped halfway, which is the reader's cue to give up rather than spin
+static const int kReadAttempts = 10000;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "lock-free words are what make the block safe to share");
+static_assert(kNameOffset + 2 * kStatusNameMax <= kStatusBytes, "the name fits the block");
+
+bool StatusBlockName(char* out, size_t bytes)
+{
+#ifdef _WIN32
+    // The Local\ namespace is per session already
+    const int n = snprintf(out, bytes, "Local\\PowerPlanTray.Status");
+#else
+    const int n = snprintf(out, bytes, "/PowerPlanTray-%u.status", (unsigned)getuid());
+#endif
+    return n > 0 && (size_t)n < bytes;
+}
+
+// ===== Encoding =====
+// The record as the words that go under the seqlock; wchar_t is UTF-16 on
+// Windows and UTF-32 elsewhere, the block is UTF-16 on both
+static void Encode(const StatusSnapshot& s, uint32_t* words)
+{
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(words);
+    memset(bytes, 0, kStatusBytes);
+    memcpy(bytes + 12, &s.generation, 4);
+    memcpy(bytes + 16, s.active.bytes, 16);
+    memcpy(bytes + 32, &s.lastSwitchUnixMs, 8);
+    memcpy(bytes + 40, &s.idleSampledUnixMs, 8);
+    memcpy(bytes + 48, &s.idleSeconds, 4);
+    bytes[52] = s.afkApplied ? 1 : 0;
+    bytes[53] = (uint8_t)s.afkStage;
+    uint16_t units[kStatusNameMax] = {};
+    size_t n = 0;
+    for (const wchar_t* c = s.name; *c && n + 1 < kStatusNameMax; ++c)
+    {
+        const uint32_t cp = (uint32_t)*c;
+        if (cp > 0xFFFF && cp <= 0x10FFFF)
+        {
+            if (n + 2 >= kStatusNameMax)
+                break;
+            units[n++] = (uint16_t)(0xD800 + ((cp - 0x10000) >> 10));
+            units[n++] = (uint16_t)(0xDC00 + ((cp - 0x10000) & 0x3FF));
+        }
+        else
+        {
+            units[n++] = (uint16_t)cp;
+        }
+    }
+    memcpy(bytes + kNameOffset, units, sizeof(units));
+}
+
+static void Decode(const uint32_t* words, StatusSnapshot& out)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(words);
+    memcpy(&out.generation, bytes + 12, 4);
+    memcpy(out.active.bytes, bytes + 16, 16);
+    memcpy(&out.lastSwitchUnixMs, bytes + 32, 8);
+    memcpy(&out.idleSampledUnixMs, bytes + 40, 8);
+    memcpy(&out.idleSeconds, bytes + 48, 4);
+    out.afkApplied = bytes[52] != 0;
+    out.afkStage = (int8_t)bytes[53];
+    uint16_t units[kStatusNameMax];
+    memcpy(units, bytes + kNameOffset, sizeof(units));
+    size_t n = 0;
+    for (size_t i = 0; i < kStatusNameMax && units[i] && n + 1 < kStatusNameMax; ++i)
+    {
+        uint32_t cp = units[i];
+        // Pairs become one wchar_t where it is 32 bits wide
+        if (sizeof(wchar_t) == 4 && cp >= 0xD800 && cp < 0xDC00 && i + 1 < kStatusNameMax &&
+            units[i + 1] >= 0xDC00 && units[i + 1] < 0xE000)
+        {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (units[++i] - 0xDC00u);
+        }
+        out.name[n++] = (wchar_t)cp;
+    }
+    out.name[n] = L'\0';
+}
+
+// ===== Mapping =====
+static StatusShared* MapBlock(const char* name, bool writable, void** mapping)
+{
+    char defaultName[64];
+    if (!name)
+    {
+        if (!StatusBlockName(defaultName, sizeof(defaultName)))
+            return nullptr;
+        name = defaultName;
+    }
+#ifdef _WIN32
+    HANDLE h = writable
+        ? CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD)kStatusBytes, name)
+        : OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if (!h)
+        return nullptr;
+    void* view = MapViewOfFile(h, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, kStatusBytes);
+    if (!view)
+    {
+        CloseHandle(h);
+        return nullptr;
+    }
+    *mapping = h;
+    return static_cast<StatusShared*>(view);
+#else
+    (void)mapping;
+    const int fd = shm_open(name, writable ? O_CREAT | O_RDWR | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    const bool sized = writable ? ftruncate(fd, kStatusBytes) == 0 : fstat(fd, &st) == 0 && (size_t)st.st_size >= kStatusBytes;
+    void* view = sized ? mmap(nullptr, kStatusBytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    // The mapping keeps the section alive; the descriptor is not needed
+    close(fd);
+    return view == MAP_FAILED ? nullptr : static_cast<StatusShared*>(view);
+#endif
+}
+
+static void UnmapBlock(const StatusShared* block, void* mapping)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(block);
+    CloseHandle(mapping);
+#else
+    (void)mapping;
+    munmap(const_cast<StatusShared*>(block), kStatusBytes);
+#endif
+}
+
+// ===== Writer =====
+bool StatusWriter::Open(const char* name)
+{
+    if (m_block)
+        return true;
+    void* mapping = nullptr;
+    StatusShared* block = MapBlock(name, true, &mapping);
+    if (!block)
+        return false;
+#ifdef _WIN32
+    m_mapping = mapping;
+#else
+    if (name) snprintf(m_name, sizeof(m_name), "%s", name);
+    else StatusBlockName(m_name, sizeof(m_name));
+#endif
+    // A block left by a writer that crashed mid-write is picked up where it
+    // stopped, so readers still mapping it see the generation carry on
+    const uint32_t sequence = block->words[kSequenceWord].load(std::memory_order_relaxed);
+    block->words[kSequenceWord].store(sequence + (sequence & 1), std::memory_order_relaxed);
+    m_last = StatusSnapshot{};
+    m_last.generation = block->words[kGenerationWord].load(std::memory_order_relaxed);
+    m_written = false;
+    block->words[kVersionWord].store(kStatusVersion | ((uint32_t)kStatusBytes << 16), std::memory_order_relaxed);
+    block->words[kMagicWord].store(kStatusMagic, std::memory_order_release);
+    m_block = block;
+    return true;
+}
+
+void StatusWriter::Close()
+{
+    if (!m_block)
+        return;
+    m_block->words[kMagicWord].store(0, std::memory_order_release);
+#ifdef _WIN32
+    UnmapBlock(m_block, m_mapping);
+    m_mapping = nullptr;
+#else
+    UnmapBlock(m_block, nullptr);
+    shm_unlink(m_name);
+#endif
+    m_block = nullptr;
+}
+
+static bool SameRecord(const StatusSnapshot& a, const StatusSnapshot& b, bool& idleOnly)
+{
+    const bool idleSame = a.idleSeconds == b.idleSeconds && a.idleSampledUnixMs == b.idleSampledUnixMs;
+    const bool restSame = a.active == b.active && a.lastSwitchUnixMs == b.lastSwitchUnixMs &&
+        a.afkApplied == b.afkApplied && a.afkStage == b.afkStage && wcscmp(a.name, b.name) == 0;
+    idleOnly = restSame;
+    return idleSame && restSame;
+}
+
+void StatusWriter::Publish(const StatusSnapshot& status)
+{
+    if (!m_block)
+        return;
+    bool idleOnly = false;
+    if (m_written && SameRecord(m_last, status, idleOnly))
+        return;
+    const uint32_t generation = m_last.generation + (m_written && idleOnly ? 0 : 1);
+    m_last = status;
+    m_last.generation = generation;
+    m_written = true;
+    uint32_t words[kWords];
+    Encode(m_last, words);
+
+    // Odd first, with the fence keeping every field store after it; the
+    // release on the closing even value keeps them all before it
+    std::atomic<uint32_t>& sequence = m_block->words[kSequenceWord];
+    const uint32_t before = sequence.load(std::memory_order_relaxed);
+    sequence.store(before + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = kGenerationWord; i < kWords; ++i)
+        m_block->words[i].store(words[i], std::memory_order_relaxed);
+    sequence.store(before + 2, std::memory_order_release);
+    ++m_writes;
+}
+
+// ===== Reader =====
+bool StatusReader::Open(const char* name)
+{
+    if (m_block)
+        return true;
+    void* mapping = nullptr;
+    const StatusShared* block = MapBlock(name, false, &mapping);
+    if (!block)
+        return false;
+    if (block->words[kMagicWord].load(std::memory_order_acquire) != kStatusMagic ||
+        (block->words[kVersionWord].load(std::memory_order_relaxed) & 0xFFFF) != kStatusVersion)
+    {
+        UnmapBlock(block, mapping);
+        return false;
+    }
+    m_block = block;
+#ifdef _WIN32
+    m_mapping = mapping;
+#endif
+    return true;
+}
+
+void StatusReader::Close()
+{
+    if (!m_block)
+        return;
+#ifdef _WIN32
+    UnmapBlock(m_block, m_mapping);
+    m_mapping = nullptr;
+#else
+    UnmapBlock(m_block, nullptr);
+#endif
+    m_block = nullptr;
+}
+
+StatusReader::Result StatusReader::Read(StatusSnapshot& out, uint32_t* retries) const
+{
+    if (retries)
+        *retries = 0;
+    if (!m_block || m_block->words[kMagicWord].load(std::memory_order_acquire) != kStatusMagic)
+        return READ_CLOSED;
+    const std::atomic<uint32_t>& sequence = m_block->words[kSequenceWord];
+    uint32_t words[kWords];
+    for (int attempt = 0; attempt < kReadAttempts; ++attempt)
+    {
+        const uint32_t before = sequence.load(std::memory_order_acquire);
+        if (before == 0)
+            return READ_EMPTY;
+        if (!(before & 1))
+        {
+            for (size_t i = kGenerationWord; i < kWords; ++i)
+                words[i] = m_block->words[i].load(std::memory_order_relaxed);
+            // Keeps the copy above ahead of the second look at the sequence
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before)
+            {
+                Decode(words, out);
+                return READ_OK;
+            }
+        }
+        if (retries)
+            ++*retries;
+    }
+    return READ_BUSY;
+}
+
+uint32_t StatusReader::Generation() const
+{
+    return m_block ? m_block->words[kGenerationWord].load(std::memory_order_acquire) : 0;
+}
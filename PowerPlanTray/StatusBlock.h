@@ -0,0 +1,128 @@
+// StatusBlock.h: Shared-memory status record the tray keeps current, read without syscalls.
+
+#pragma once
+
+#include "PlanId.h"
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// The tray maps a small section ("Local\PowerPlanTray.Status", so one per
+// session, on Windows; /dev/shm/PowerPlanTray-<uid>.status elsewhere) and
+// rewrites it under a seqlock on every change. A reader maps it read-only once;
+// after that a snapshot is a few dozen loads, with no syscall and no lock the
+// tray could be made to wait on.
+//
+// Layout, native byte order (little-endian on every target), 320 bytes:
+//    0  uint32 magic       kStatusMagic; 0 once the tray has closed it
+//    4  uint16 version     kStatusVersion
+//    6  uint16 size        of the block
+//    8  uint32 sequence    odd while the tray is writing; 0 before the first write
+//   12  uint32 generation  bumped by each change of anything but the idle time
+//   16  16 bytes           active plan GUID, as PlanId
+//   32  uint64             last plan switch seen, Unix ms (0 if none)
+//   40  uint64             when the idle time was sampled, Unix ms
+//   48  uint32             idle seconds, as sampled (every 2 s at most)
+//   52  uint8              AFK stage's plan applied (0/1)
+//   53  int8               AFK stage (-1 = none)
+//   54  uint16             reserved
+//   56  128 x uint16       plan name, UTF-16, terminated
+// To read: load the sequence (acquire); if odd, retry; copy the fields; fence
+// (acquire); if the sequence is unchanged the copy is whole, else retry.
+
+const uint32_t kStatusMagic = 0x54535050; // "PPST"
+const uint16_t kStatusVersion = 1;
+const size_t kStatusBytes = 320;
+const size_t kStatusNameMax = 128; // UTF-16 units with the terminator, as kPlanNameMax
+
+struct StatusSnapshot
+{
+    uint32_t generation = 0;
+    PlanId active{};
+    uint64_t lastSwitchUnixMs = 0;
+    uint64_t idleSampledUnixMs = 0;
+    uint32_t idleSeconds = 0;
+    bool afkApplied = false;
+    int8_t afkStage = -1;
+    wchar_t name[kStatusNameMax] = {};
+};
+
+// Mapped as whole words so both sides touch it only through atomics
+struct StatusShared
+{
+    std::atomic<uint32_t> words[kStatusBytes / 4];
+};
+static_assert(sizeof(StatusShared) == kStatusBytes, "the mapped block is exactly the documented layout");
+
+// Name of the section: "Local\PowerPlanTray.Status" on Windows,
+// "/PowerPlanTray-<uid>.status" for shm_open elsewhere
+bool StatusBlockName(char* out, size_t bytes);
+
+// The tray's side. Publish is a handful of stores and does nothing when the
+// record would not change, so readers' cached copies stay valid.
+class StatusWriter
+{
+public:
+    StatusWriter() {}
+    ~StatusWriter() { Close(); }
+
+    // StatusBlockName's section unless one is given
+    bool Open(const char* name = nullptr);
+    // Marks the block closed for readers still mapping it, then unmaps
+    void Close();
+    bool IsOpen() const { return m_block != nullptr; }
+
+    // The generation is the writer's own, as in IpcServer
+    void Publish(const StatusSnapshot& status);
+    uint64_t Writes() const { return m_writes; }
+
+private:
+    StatusWriter(const StatusWriter&) = delete;
+    StatusWriter& operator=(const StatusWriter&) = delete;
+
+    StatusShared* m_block = nullptr;
+#ifdef _WIN32
+    void* m_mapping = nullptr;
+#else
+    char m_name[64] = {};
+#endif
+    StatusSnapshot m_last;
+    bool m_written = false;
+    uint64_t m_writes = 0;
+};
+
+// The reader library: map once, then Read as often as wanted
+class StatusReader
+{
+public:
+    StatusReader() {}
+    ~StatusReader() { Close(); }
+
+    // False if no tray has the block open (yet)
+    bool Open(const char* name = nullptr);
+    void Close();
+    bool IsOpen() const { return m_block != nullptr; }
+
+    enum Result
+    {
+        READ_OK,
+        READ_EMPTY,  // Mapped, nothing published yet
+        READ_BUSY,   // Still mid-write after every retry: the writer stalled or died there
+        READ_CLOSED, // The tray closed the block: Close and Open again
+    };
+    // A consistent snapshot, retried while the tray is writing; retries (if
+    // given) gets the number of attempts that found a write in progress
+    Result Read(StatusSnapshot& out, uint32_t* retries = nullptr) const;
+    // One load, for readers that only want to know whether anything changed
+    uint32_t Generation() const;
+
+private:
+    StatusReader(const StatusReader&) = delete;
+    StatusReader& operator=(const StatusReader&) = delete;
+
+    const StatusShared* m_block = nullptr;
+#ifdef _WIN32
+    void* m_mapping = nullptr;
+#endif
+};
@@ -0,0 +1,101 @@
+// SwitchGovernor.cpp: Rate limiting and minimum dwell for automatic plan switches.
+
+#include "SwitchGovernor.h"
+
+void SwitchGovernor::Refill(uint64_t nowMs)
+{
+    if (!m_primed)
+    {
+        m_primed = true;
+        m_tokens = m_config.burst;
+        m_lastRefillMs = nowMs;
+        return;
+    }
+    if (nowMs <= m_lastRefillMs || m_config.refillMs == 0)
+        return;
+    const uint64_t periods = (nowMs - m_lastRefillMs) / m_config.refillMs;
+    if (m_tokens + periods >= m_config.burst)
+    {
+        m_tokens = m_config.burst;
+        m_lastRefillMs = nowMs; // A full bucket does not bank time
+    }
+    else
+    {
+        m_tokens += (uint32_t)periods;
+        m_lastRefillMs += periods * m_config.refillMs;
+    }
+}
+
+bool SwitchGovernor::Allowed(uint64_t nowMs)
+{
+    Refill(nowMs);
+    if (m_switched && nowMs - m_lastSwitchMs < m_config.minDwellMs)
+        return false;
+    return m_tokens > 0 || m_config.refillMs == 0;
+}
+
+void SwitchGovernor::Commit(const PlanId& plan, uint64_t nowMs)
+{
+    if (m_tokens > 0) --m_tokens;
+    m_current = plan;
+    m_switched = true;
+    m_lastSwitchMs = nowMs;
+    m_hasPending = false;
+    ++m_counters.applied;
+}
+
+bool SwitchGovernor::Offer(const PlanId& target, uint64_t nowMs)
+{
+    if (target == m_current)
+    {
+        // Back where we are: whatever was parked is no longer wanted
+        if (m_hasPending) { m_hasPending = false; ++m_counters.superseded; }
+        return false;
+    }
+    if (m_hasPending)
+    {
+        if (target == m_pending)
+            return false;
+        ++m_counters.superseded;
+    }
+    if (Allowed(nowMs))
+    {
+        Commit(target, nowMs);
+        return true;
+    }
+    m_pending = target;
+    m_hasPending = true;
+    ++m_counters.suppressed;
+    return false;
+}
+
+bool SwitchGovernor::TakeDue(uint64_t nowMs, PlanId& out)
+{
+    if (!m_hasPending || !Allowed(nowMs))
+        return false;
+    out = m_pending;
+    Commit(m_pending, nowMs);
+    return true;
+}
+
+void SwitchGovernor::NoteBypass(const PlanId& plan, uint64_t nowMs)
+{
+    if (m_hasPending) { m_hasPending = false; ++m_counters.superseded; }
+    m_current = plan;
+    m_switched = true;
+    m_lastSwitchMs = nowMs;
+    ++m_counters.bypassed;
+}
+
+uint64_t SwitchGovernor::NextDueMs() const
+{
+    if (!m_hasPending)
+        return kNever;
+    uint64_t due = m_switched ? m_lastSwitchMs + m_config.minDwellMs : 0;
+    if (m_tokens == 0 && m_config.refillMs != 0)
+    {
+        const uint64_t token = m_lastRefillMs + m_config.refillMs;
+        if (token > due) due = token;
+    }
+    return due;
+}
@@ -0,0 +1,67 @@
+// SwitchGovernor.h: Rate limiting and minimum dwell for automatic plan switches.
+
+#pragma once
+
+#include "PlanId.h"
+
+#include <stdint.h>
+
+// Sits between the policy engine and PowerSetActiveScheme. An automatic switch
+// goes through only if the current plan has been in force for minDwellMs and
+// a token is left in the bucket (burst tokens, one more every refillMs).
+// Otherwise the target is parked; a newer target replaces it, and a target
+// equal to the current plan cancels it, so intermediate plans never get applied.
+class SwitchGovernor
+{
+public:
+    struct Config
+    {
+        uint32_t minDwellMs = 10000; // Least time between automatic switches
+        uint32_t burst = 3;          // Bucket capacity
+        uint32_t refillMs = 20000;   // One token per period
+    };
+    struct Counters
+    {
+        uint32_t applied = 0;    // Automatic switches let through
+        uint32_t suppressed = 0; // Requests parked by dwell or rate limit
+        uint32_t superseded = 0; // Parked targets dropped before being applied
+        uint32_t bypassed = 0;   // Switches made outside the governor (menu, external)
+    };
+
+    static const uint64_t kNever = UINT64_MAX;
+
+    SwitchGovernor() {}
+    explicit SwitchGovernor(const Config& config) : m_config(config) {}
+
+    // Plan known to be active, without starting a dwell (startup, resync)
+    void SetCurrent(const PlanId& plan) { m_current = plan; }
+    // True: switch to target now. False: nothing to do, or parked until NextDueMs().
+    bool Offer(const PlanId& target, uint64_t nowMs);
+    // Releases the parked target once allowed; true with out set if so
+    bool TakeDue(uint64_t nowMs, PlanId& out);
+    // A switch nobody may hold back; it drops the parked target and starts a dwell
+    void NoteBypass(const PlanId& plan, uint64_t nowMs);
+
+    bool HasPending() const { return m_hasPending; }
+    // When the parked target becomes allowed, or kNever without one
+    uint64_t NextDueMs() const;
+    const Counters& GetCounters() const { return m_counters; }
+    const Config& GetConfig() const { return m_config; }
+    void SetConfig(const Config& config) { m_config = config; }
+
+private:
+    void Refill(uint64_t nowMs);
+    bool Allowed(uint64_t nowMs);
+    void Commit(const PlanId& plan, uint64_t nowMs);
+
+    Config m_config;
+    Counters m_counters;
+    PlanId m_current{};
+    PlanId m_pending{};
+    bool m_hasPending = false;
+    bool m_switched = false; // Any switch yet; the first one has no dwell to wait out
+    uint64_t m_lastSwitchMs = 0;
+    bool m_primed = false;   // Bucket initialised
+    uint32_t m_tokens = 0;
+    uint64_t m_lastRefillMs = 0;
+};